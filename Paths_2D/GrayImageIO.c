@@ -0,0 +1,778 @@
+/*
+ * File:		GrayImageIO.c
+ *
+ * Purpose:	Reading and writing grayscale images in PGM, uncompressed TIFF and raw
+ *		formats without ImageMagick, straight to and from 8- or 16-bit pixels
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "GrayImageIO.h"
+
+/* TIFF tags and field types read or written here */
+#define TIFF_IMAGE_WIDTH 256
+#define TIFF_IMAGE_LENGTH 257
+#define TIFF_BITS_PER_SAMPLE 258
+#define TIFF_COMPRESSION 259
+#define TIFF_PHOTOMETRIC 262
+#define TIFF_STRIP_OFFSETS 273
+#define TIFF_SAMPLES_PER_PIXEL 277
+#define TIFF_ROWS_PER_STRIP 278
+#define TIFF_STRIP_BYTE_COUNTS 279
+#define TIFF_X_RESOLUTION 282
+#define TIFF_Y_RESOLUTION 283
+#define TIFF_RESOLUTION_UNIT 296
+#define TIFF_TILE_WIDTH 322
+
+#define TIFF_SHORT 3
+#define TIFF_LONG 4
+#define TIFF_RATIONAL 5
+
+/* Most IFD entries read, more than any grayscale image needs */
+#define TIFF_MAX_ENTRIES 256
+
+/* Bytes before the pixels in the TIFF files written here: header, directory, resolution */
+#define TIFF_HEADER_SIZE 174
+
+/* Header of the PGM files written here, given nx, ny and maxval */
+#define PGM_HEADER "P5\n%d %d\n%d\n"
+
+GRAY_IMAGE * GRAY_IMAGE_constructor(
+	int nx, int ny,
+	int depth
+)
+{
+	GRAY_IMAGE * this_struct = (GRAY_IMAGE *)malloc(sizeof(GRAY_IMAGE));
+
+	this_struct->nx = nx;
+	this_struct->ny = ny;
+	this_struct->depth = depth;
+	this_struct->buf = malloc((size_t)nx * ny * depth);
+
+	return this_struct;
+}
+
+void GRAY_IMAGE_destructor(
+	GRAY_IMAGE * this_struct
+)
+{
+	free(this_struct->buf);
+	free((void *)this_struct);
+}
+
+/* - host_is_big_endian:
+ * Byte order of the machine
+ */
+static int host_is_big_endian(void)
+{
+	unsigned short one = 1;
+
+	return *(unsigned char *)&one == 0;
+}
+
+/* - swap_bytes:
+ * Swap the bytes of num_pixels 16-bit pixels in place
+ */
+static void swap_bytes(
+	unsigned short * pixels,
+	size_t num_pixels
+)
+{
+	size_t i;
+
+	for (i = 0; i < num_pixels; ++i) {
+		pixels[i] = (unsigned short)((pixels[i] >> 8) | (pixels[i] << 8));
+	}
+}
+
+/* - has_extension:
+ * Does the file name end in the given extension, ignoring case?
+ */
+static int has_extension(
+	const char * filename,
+	const char * extension
+)
+{
+	size_t length = strlen(filename), extension_length = strlen(extension);
+	size_t i;
+
+	if (length < extension_length) return 0;
+	for (i = 0; i < extension_length; ++i) {
+		if (tolower((unsigned char)filename[length - extension_length + i]) != extension[i]) return 0;
+	}
+	return 1;
+}
+
+GRAY_FORMAT gray_image_format(
+	const char * filename
+)
+{
+	if (has_extension(filename, ".pgm") || has_extension(filename, ".pnm")) return GRAY_FORMAT_PGM;
+	if (has_extension(filename, ".tif") || has_extension(filename, ".tiff")) return GRAY_FORMAT_TIFF;
+	if (has_extension(filename, ".raw") || has_extension(filename, ".gray")) return GRAY_FORMAT_RAW;
+	return GRAY_FORMAT_UNKNOWN;
+}
+
+
+/*************************************** PGM *********************************************/
+/* - pgm_read_value:
+ * Read a decimal header field or plain pixel, skipping whitespace and # comments.
+ * Returns -1 at a malformed value or the end of the file.
+ */
+static long pgm_read_value(
+	FILE * file
+)
+{
+	int c;
+	long value;
+
+	for (;;) {
+		c = getc(file);
+		if (c == '#') {
+			while (c != '\n' && c != EOF) c = getc(file);
+		} else if (!isspace(c)) {
+			break;
+		}
+	}
+	if (c == EOF || !isdigit(c)) return -1;
+
+	for (value = 0; c != EOF && isdigit(c); c = getc(file)) {
+		value = 10 * value + (c - '0');
+		if (value > 0x7fffffffL) return -1;
+	}
+	/* The single whitespace character ending the header is consumed here too */
+	if (c != EOF && !isspace(c)) ungetc(c, file);
+
+	return value;
+}
+
+/* - pgm_read_header:
+ * Read the dimensions and maxval of a PGM image after its two-byte magic number,
+ * leaving the file at the first pixel.  Returns 0, or -1 on a malformed header.
+ */
+static int pgm_read_header(
+	FILE * file,
+	const char * filename,
+	long * nx, long * ny,
+	long * maxval
+)
+{
+	*nx = pgm_read_value(file);
+	*ny = pgm_read_value(file);
+	*maxval = pgm_read_value(file);
+	if (*nx <= 0 || *ny <= 0 || *maxval <= 0 || *maxval > 65535 || *nx * *ny / *ny != *nx || *nx * *ny > 0x7fffffffL) {
+		fprintf(stderr, "read_gray_image: %s: bad PGM header\n", filename);
+		return -1;
+	}
+	return 0;
+}
+
+/* - read_pgm:
+ * Read a PGM image after its two-byte magic number.  16-bit binary pixels are stored
+ * most significant byte first.
+ */
+static GRAY_IMAGE * read_pgm(
+	FILE * file,
+	const char * filename,
+	int plain										/* P2 rather than P5 */
+)
+{
+	long nx, ny, maxval, value;
+	size_t i, num_pixels;
+	GRAY_IMAGE * image;
+
+	if (pgm_read_header(file, filename, &nx, &ny, &maxval) != 0) return NULL;
+
+	image = GRAY_IMAGE_constructor((int)nx, (int)ny, maxval <= 255 ? 1 : 2);
+	num_pixels = (size_t)nx * ny;
+
+	if (plain) {
+		for (i = 0; i < num_pixels; ++i) {
+			if ((value = pgm_read_value(file)) < 0 || value > maxval) break;
+			if (image->depth == 1) ((unsigned char *)image->buf)[i] = (unsigned char)value;
+			else ((unsigned short *)image->buf)[i] = (unsigned short)value;
+		}
+	} else {
+		i = fread(image->buf, image->depth, num_pixels, file);
+		if (image->depth == 2 && !host_is_big_endian()) {
+			swap_bytes((unsigned short *)image->buf, num_pixels);
+		}
+	}
+
+	if (i < num_pixels) {
+		fprintf(stderr, "read_gray_image: %s: PGM data ends early\n", filename);
+		GRAY_IMAGE_destructor(image);
+		return NULL;
+	}
+	return image;
+}
+
+/* - write_pgm:
+ * Write a binary PGM, with the full range of its depth as maxval
+ */
+static int write_pgm(
+	const GRAY_IMAGE * image,
+	FILE * file
+)
+{
+	size_t num_pixels = (size_t)image->nx * image->ny;
+	unsigned short * swapped;
+	size_t written;
+
+	fprintf(file, PGM_HEADER, image->nx, image->ny, image->depth == 1 ? 255 : 65535);
+
+	if (image->depth == 1 || host_is_big_endian()) {
+		written = fwrite(image->buf, image->depth, num_pixels, file);
+	} else {
+		swapped = (unsigned short *)malloc(num_pixels * sizeof(unsigned short));
+		memcpy(swapped, image->buf, num_pixels * sizeof(unsigned short));
+		swap_bytes(swapped, num_pixels);
+		written = fwrite(swapped, sizeof(unsigned short), num_pixels, file);
+		free((void *)swapped);
+	}
+
+	return written == num_pixels ? 0 : -1;
+}
+
+
+/*************************************** TIFF ********************************************/
+/* - tiff_get:
+ * An unsigned integer of size bytes, in the file's byte order
+ */
+static unsigned long tiff_get(
+	const unsigned char * p,
+	int size,
+	int big_endian
+)
+{
+	unsigned long value = 0;
+	int i;
+
+	for (i = 0; i < size; ++i) {
+		value |= (unsigned long)p[big_endian ? i : size - 1 - i] << (8 * (size - 1 - i));
+	}
+	return value;
+}
+
+/* - tiff_put:
+ * Store an unsigned integer of size bytes in the machine's byte order
+ */
+static void tiff_put(
+	unsigned char * p,
+	int size,
+	unsigned long value
+)
+{
+	int big_endian = host_is_big_endian();
+	int i;
+
+	for (i = 0; i < size; ++i) {
+		p[big_endian ? size - 1 - i : i] = (unsigned char)(value >> (8 * i));
+	}
+}
+
+/* - tiff_values:
+ * Read the first count SHORT or LONG values of an IFD entry into values, from the entry
+ * itself if all its values fit there or else from the offset it holds.  Returns 0, or
+ * -1 on error.
+ */
+static int tiff_values(
+	FILE * file,
+	const unsigned char * entry,
+	int big_endian,
+	unsigned long * values,
+	unsigned long count
+)
+{
+	int type = (int)tiff_get(entry + 2, 2, big_endian);
+	int size = (type == TIFF_SHORT) ? 2 : 4;
+	unsigned long i;
+	unsigned char * data;
+	int status = 0;
+
+	if (type != TIFF_SHORT && type != TIFF_LONG) return -1;
+	if (count > tiff_get(entry + 4, 4, big_endian)) return -1;
+
+	if (tiff_get(entry + 4, 4, big_endian) * size <= 4) {
+		for (i = 0; i < count; ++i) {
+			values[i] = tiff_get(entry + 8 + size * i, size, big_endian);
+		}
+		return 0;
+	}
+
+	data = (unsigned char *)malloc(count * size);
+	if (fseek(file, (long)tiff_get(entry + 8, 4, big_endian), SEEK_SET) != 0 ||
+		fread(data, size, count, file) != count) {
+		status = -1;
+	} else {
+		for (i = 0; i < count; ++i) {
+			values[i] = tiff_get(data + size * i, size, big_endian);
+		}
+	}
+	free((void *)data);
+
+	return status;
+}
+
+/* - read_tiff:
+ * Read the first image of a TIFF file, if it is an uncompressed single-channel image
+ * of 8 or 16 bits in strips.  WhiteIsZero images are inverted to BlackIsZero.
+ */
+static GRAY_IMAGE * read_tiff(
+	FILE * file,
+	const char * filename
+)
+{
+	unsigned char header[8], count_bytes[2];
+	unsigned char * entries;
+	unsigned long nx = 0, ny = 0, bits = 1, compression = 1, photometric = 1, samples = 1;
+	unsigned long rows_per_strip = 0xffffffffUL, num_strips = 0, value, strip, rows;
+	unsigned long * strip_offsets;
+	const unsigned char * offsets_entry = NULL;
+	int big_endian, num_entries, e, tag, tiled = 0;
+	size_t i, row_bytes, num_pixels;
+	GRAY_IMAGE * image = NULL;
+
+	if (fseek(file, 0, SEEK_SET) != 0 || fread(header, 1, 8, file) != 8) return NULL;
+	big_endian = (header[0] == 'M');
+	if (tiff_get(header + 2, 2, big_endian) != 42) return NULL;
+
+	/* The first image file directory */
+	if (fseek(file, (long)tiff_get(header + 4, 4, big_endian), SEEK_SET) != 0 ||
+		fread(count_bytes, 1, 2, file) != 2) {
+		fprintf(stderr, "read_gray_image: %s: bad TIFF directory\n", filename);
+		return NULL;
+	}
+	num_entries = (int)tiff_get(count_bytes, 2, big_endian);
+	if (num_entries > TIFF_MAX_ENTRIES) return NULL;
+	entries = (unsigned char *)malloc(12 * num_entries + 1);
+	if (fread(entries, 12, num_entries, file) != (size_t)num_entries) {
+		fprintf(stderr, "read_gray_image: %s: bad TIFF directory\n", filename);
+		free((void *)entries);
+		return NULL;
+	}
+
+	for (e = 0; e < num_entries; ++e) {
+		const unsigned char * entry = entries + 12 * e;
+		unsigned long count = tiff_get(entry + 4, 4, big_endian);
+
+		tag = (int)tiff_get(entry, 2, big_endian);
+		if (tag == TIFF_STRIP_OFFSETS) {
+			offsets_entry = entry;
+			num_strips = count;
+			continue;
+		}
+		if (tag == TIFF_TILE_WIDTH) tiled = 1;
+		if (tag != TIFF_IMAGE_WIDTH && tag != TIFF_IMAGE_LENGTH && tag != TIFF_BITS_PER_SAMPLE &&
+			tag != TIFF_COMPRESSION && tag != TIFF_PHOTOMETRIC && tag != TIFF_SAMPLES_PER_PIXEL &&
+			tag != TIFF_ROWS_PER_STRIP) continue;
+
+		/* Of these, only BitsPerSample may have more than one value, one per sample */
+		if (count < 1 || tiff_values(file, entry, big_endian, &value, 1) != 0) {
+			tiled = 1;
+			continue;
+		}
+		switch (tag) {
+			case TIFF_IMAGE_WIDTH: nx = value; break;
+			case TIFF_IMAGE_LENGTH: ny = value; break;
+			case TIFF_BITS_PER_SAMPLE: bits = value; break;
+			case TIFF_COMPRESSION: compression = value; break;
+			case TIFF_PHOTOMETRIC: photometric = value; break;
+			case TIFF_SAMPLES_PER_PIXEL: samples = value; break;
+			case TIFF_ROWS_PER_STRIP: rows_per_strip = value; break;
+		}
+	}
+
+	/* Anything else is left to ImageMagick */
+	if (tiled || offsets_entry == NULL || compression != 1 || samples != 1 || (bits != 8 && bits != 16) ||
+		photometric > 1 || nx == 0 || ny == 0 || nx > 0x7fffffffUL / ny || rows_per_strip == 0) {
+		free((void *)entries);
+		return NULL;
+	}
+	if (rows_per_strip > ny) rows_per_strip = ny;
+	if (num_strips != (ny + rows_per_strip - 1) / rows_per_strip) {
+		fprintf(stderr, "read_gray_image: %s: bad TIFF strips\n", filename);
+		free((void *)entries);
+		return NULL;
+	}
+
+	strip_offsets = (unsigned long *)malloc(num_strips * sizeof(unsigned long));
+	if (tiff_values(file, offsets_entry, big_endian, strip_offsets, num_strips) == 0) {
+		image = GRAY_IMAGE_constructor((int)nx, (int)ny, (int)bits / 8);
+		row_bytes = (size_t)nx * image->depth;
+
+		/* Each strip holds rows_per_strip rows, the last maybe fewer */
+		for (strip = 0; strip < num_strips; ++strip) {
+			rows = (strip + 1 < num_strips) ? rows_per_strip : ny - strip * rows_per_strip;
+			if (fseek(file, (long)strip_offsets[strip], SEEK_SET) != 0 ||
+				fread((unsigned char *)image->buf + row_bytes * rows_per_strip * strip, row_bytes, rows, file) != rows) {
+				GRAY_IMAGE_destructor(image);
+				image = NULL;
+				break;
+			}
+		}
+	}
+	if (image == NULL) {
+		fprintf(stderr, "read_gray_image: %s: TIFF data ends early\n", filename);
+	} else {
+		num_pixels = (size_t)nx * ny;
+		if (image->depth == 2 && big_endian != host_is_big_endian()) {
+			swap_bytes((unsigned short *)image->buf, num_pixels);
+		}
+		if (photometric == 0) {
+			for (i = 0; i < num_pixels; ++i) {
+				if (image->depth == 1) ((unsigned char *)image->buf)[i] = (unsigned char)~((unsigned char *)image->buf)[i];
+				else ((unsigned short *)image->buf)[i] = (unsigned short)~((unsigned short *)image->buf)[i];
+			}
+		}
+	}
+
+	free((void *)strip_offsets);
+	free((void *)entries);
+
+	return image;
+}
+
+/* - tiff_entry:
+ * Fill in an IFD entry holding a single value, or the offset of its values
+ */
+static void tiff_entry(
+	unsigned char * entry,
+	int tag,
+	int type,
+	unsigned long value
+)
+{
+	tiff_put(entry, 2, tag);
+	tiff_put(entry + 2, 2, type);
+	tiff_put(entry + 4, 4, 1);
+	memset(entry + 8, 0, 4);
+	tiff_put(entry + 8, type == TIFF_SHORT ? 2 : 4, value);
+}
+
+/* - tiff_header:
+ * Fill in the TIFF_HEADER_SIZE bytes before the pixels of a baseline grayscale TIFF in
+ * the machine's byte order: header, a directory of twelve entries and the resolution.
+ * The pixels follow as a single strip.
+ */
+static void tiff_header(
+	unsigned char * header,
+	int nx, int ny,
+	int depth
+)
+{
+	enum { NUM_ENTRIES = 12, DIRECTORY = 8, RESOLUTION = DIRECTORY + 2 + 12 * NUM_ENTRIES + 4 };
+	unsigned char * entry = header + DIRECTORY + 2;
+
+	memset(header, 0, TIFF_HEADER_SIZE);
+	header[0] = header[1] = host_is_big_endian() ? 'M' : 'I';
+	tiff_put(header + 2, 2, 42);
+	tiff_put(header + 4, 4, DIRECTORY);
+	tiff_put(header + DIRECTORY, 2, NUM_ENTRIES);
+
+	/* Entries in increasing tag order, then a zero offset to end the directories */
+	tiff_entry(entry, TIFF_IMAGE_WIDTH, TIFF_LONG, nx); entry += 12;
+	tiff_entry(entry, TIFF_IMAGE_LENGTH, TIFF_LONG, ny); entry += 12;
+	tiff_entry(entry, TIFF_BITS_PER_SAMPLE, TIFF_SHORT, 8 * depth); entry += 12;
+	tiff_entry(entry, TIFF_COMPRESSION, TIFF_SHORT, 1); entry += 12;
+	tiff_entry(entry, TIFF_PHOTOMETRIC, TIFF_SHORT, 1); entry += 12;
+	tiff_entry(entry, TIFF_STRIP_OFFSETS, TIFF_LONG, TIFF_HEADER_SIZE); entry += 12;
+	tiff_entry(entry, TIFF_SAMPLES_PER_PIXEL, TIFF_SHORT, 1); entry += 12;
+	tiff_entry(entry, TIFF_ROWS_PER_STRIP, TIFF_LONG, ny); entry += 12;
+	tiff_entry(entry, TIFF_STRIP_BYTE_COUNTS, TIFF_LONG, (unsigned long)((size_t)nx * ny * depth)); entry += 12;
+	tiff_entry(entry, TIFF_X_RESOLUTION, TIFF_RATIONAL, RESOLUTION); entry += 12;
+	tiff_entry(entry, TIFF_Y_RESOLUTION, TIFF_RATIONAL, RESOLUTION + 8); entry += 12;
+	tiff_entry(entry, TIFF_RESOLUTION_UNIT, TIFF_SHORT, 1);
+
+	/* 1/1 pixels per unit, the unit being none */
+	tiff_put(header + RESOLUTION, 4, 1);
+	tiff_put(header + RESOLUTION + 4, 4, 1);
+	tiff_put(header + RESOLUTION + 8, 4, 1);
+	tiff_put(header + RESOLUTION + 12, 4, 1);
+}
+
+/* - write_tiff:
+ * Write a baseline grayscale TIFF
+ */
+static int write_tiff(
+	const GRAY_IMAGE * image,
+	FILE * file
+)
+{
+	unsigned char header[TIFF_HEADER_SIZE];
+	size_t num_pixels = (size_t)image->nx * image->ny;
+
+	tiff_header(header, image->nx, image->ny, image->depth);
+
+	if (fwrite(header, 1, TIFF_HEADER_SIZE, file) != TIFF_HEADER_SIZE) return -1;
+	return fwrite(image->buf, image->depth, num_pixels, file) == num_pixels ? 0 : -1;
+}
+
+
+/********************************** READING AND WRITING **********************************/
+GRAY_IMAGE * read_gray_image(
+	const char * filename
+)
+{
+	FILE * file;
+	unsigned char magic[4];
+	GRAY_IMAGE * image = NULL;
+
+	if ((file = fopen(filename, "rb")) == NULL) return NULL;
+
+	if (fread(magic, 1, 4, file) == 4) {
+		if (magic[0] == 'P' && (magic[1] == '5' || magic[1] == '2')) {
+			fseek(file, 2, SEEK_SET);
+			image = read_pgm(file, filename, magic[1] == '2');
+		} else if ((magic[0] == 'I' && magic[1] == 'I' && magic[2] == 42 && magic[3] == 0) ||
+			(magic[0] == 'M' && magic[1] == 'M' && magic[2] == 0 && magic[3] == 42)) {
+			image = read_tiff(file, filename);
+		}
+	}
+
+	fclose(file);
+	return image;
+}
+
+GRAY_IMAGE * read_raw_image(
+	const char * filename,
+	int nx, int ny,
+	int depth
+)
+{
+	FILE * file;
+	GRAY_IMAGE * image;
+	size_t num_pixels = (size_t)nx * ny;
+
+	if (nx <= 0 || ny <= 0 || (depth != 1 && depth != 2)) return NULL;
+	if ((file = fopen(filename, "rb")) == NULL) return NULL;
+
+	image = GRAY_IMAGE_constructor(nx, ny, depth);
+	if (fread(image->buf, depth, num_pixels, file) != num_pixels) {
+		fprintf(stderr, "read_raw_image: %s: shorter than %d x %d x %d bytes\n", filename, nx, ny, depth);
+		GRAY_IMAGE_destructor(image);
+		image = NULL;
+	}
+
+	fclose(file);
+	return image;
+}
+
+int write_gray_image(
+	const GRAY_IMAGE * image,
+	const char * filename
+)
+{
+	GRAY_FORMAT format = gray_image_format(filename);
+	FILE * file;
+	int status;
+	size_t num_pixels = (size_t)image->nx * image->ny;
+
+	if (format == GRAY_FORMAT_UNKNOWN) return -1;
+	if ((file = fopen(filename, "wb")) == NULL) return -1;
+
+	switch (format) {
+		case GRAY_FORMAT_PGM:
+			status = write_pgm(image, file);
+			break;
+		case GRAY_FORMAT_TIFF:
+			status = write_tiff(image, file);
+			break;
+		default:
+			status = fwrite(image->buf, image->depth, num_pixels, file) == num_pixels ? 0 : -1;
+			break;
+	}
+
+	if (fclose(file) != 0) status = -1;
+	return status;
+}
+
+
+/************************************ MEMORY MAPPING *************************************/
+/* - map_pixels:
+ * Map an open file from its start up to the end of the nx * ny pixels at offset,
+ * read-only and private, or writable and shared.
+ */
+static GRAY_MAPPED_IMAGE * map_pixels(
+	int fd,
+	const char * filename,
+	size_t offset,									/* Of the first pixel in the file */
+	int nx, int ny,
+	int depth,
+	int writable
+)
+{
+	GRAY_MAPPED_IMAGE * this_struct;
+	size_t map_size = offset + (size_t)nx * ny * depth;
+	struct stat file_status;
+	void * map;
+
+	/* Pixels must be aligned to be used in place */
+	if (offset % depth != 0) return NULL;
+
+	if (fstat(fd, &file_status) != 0 || (size_t)file_status.st_size < map_size) {
+		fprintf(stderr, "map_gray_image: %s: shorter than %d x %d x %d bytes of pixels\n", filename, nx, ny, depth);
+		return NULL;
+	}
+	map = mmap(NULL, map_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) return NULL;
+
+	this_struct = (GRAY_MAPPED_IMAGE *)malloc(sizeof(GRAY_MAPPED_IMAGE));
+	this_struct->image.nx = nx;
+	this_struct->image.ny = ny;
+	this_struct->image.depth = depth;
+	this_struct->image.buf = (unsigned char *)map + offset;
+	this_struct->map = map;
+	this_struct->map_size = map_size;
+
+	return this_struct;
+}
+
+GRAY_MAPPED_IMAGE * map_gray_image(
+	const char * filename
+)
+{
+	FILE * file;
+	char magic[2];
+	long nx, ny, maxval;
+	int depth;
+	GRAY_MAPPED_IMAGE * this_struct = NULL;
+
+	if ((file = fopen(filename, "rb")) == NULL) return NULL;
+
+	if (fread(magic, 1, 2, file) == 2 && magic[0] == 'P' && magic[1] == '5' &&
+		pgm_read_header(file, filename, &nx, &ny, &maxval) == 0) {
+		depth = maxval <= 255 ? 1 : 2;
+		/* 16-bit PGM pixels are most significant byte first */
+		if (depth == 1 || host_is_big_endian()) {
+			this_struct = map_pixels(fileno(file), filename, (size_t)ftell(file), (int)nx, (int)ny, depth, 0);
+		}
+	}
+
+	/* The mapping outlives the file descriptor */
+	fclose(file);
+	return this_struct;
+}
+
+GRAY_MAPPED_IMAGE * map_raw_image(
+	const char * filename,
+	int nx, int ny,
+	int depth
+)
+{
+	int fd;
+	GRAY_MAPPED_IMAGE * this_struct;
+
+	if (nx <= 0 || ny <= 0 || (depth != 1 && depth != 2)) return NULL;
+	if ((fd = open(filename, O_RDONLY)) < 0) return NULL;
+
+	this_struct = map_pixels(fd, filename, 0, nx, ny, depth, 0);
+
+	close(fd);
+	return this_struct;
+}
+
+GRAY_MAPPED_IMAGE * create_mapped_gray_image(
+	const char * filename,
+	int nx, int ny,
+	int depth
+)
+{
+	GRAY_FORMAT format = gray_image_format(filename);
+	unsigned char header[TIFF_HEADER_SIZE + 1];
+	size_t header_size = 0;
+	int fd;
+	GRAY_MAPPED_IMAGE * this_struct = NULL;
+
+	if (nx <= 0 || ny <= 0 || (depth != 1 && depth != 2)) return NULL;
+
+	switch (format) {
+		case GRAY_FORMAT_PGM:
+			if (depth == 2 && !host_is_big_endian()) return NULL;
+			header_size = (size_t)sprintf((char *)header, PGM_HEADER, nx, ny, depth == 1 ? 255 : 65535);
+			break;
+		case GRAY_FORMAT_TIFF:
+			tiff_header(header, nx, ny, depth);
+			header_size = TIFF_HEADER_SIZE;
+			break;
+		case GRAY_FORMAT_RAW:
+			break;
+		default:
+			return NULL;
+	}
+	if (header_size % depth != 0) return NULL;
+
+	if ((fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0666)) < 0) return NULL;
+
+	/* The pixels are left as a hole for the mapping to fill */
+	if (write(fd, header, header_size) == (ssize_t)header_size &&
+		ftruncate(fd, (off_t)(header_size + (size_t)nx * ny * depth)) == 0) {
+		this_struct = map_pixels(fd, filename, header_size, nx, ny, depth, 1);
+	}
+
+	close(fd);
+	return this_struct;
+}
+
+int same_gray_image_file(
+	const char * filename1,
+	const char * filename2
+)
+{
+	struct stat status1, status2;
+
+	if (stat(filename1, &status1) != 0 || stat(filename2, &status2) != 0) return 0;
+	return status1.st_dev == status2.st_dev && status1.st_ino == status2.st_ino;
+}
+
+int GRAY_MAPPED_IMAGE_destructor(
+	GRAY_MAPPED_IMAGE * this_struct
+)
+{
+	int status = munmap(this_struct->map, this_struct->map_size);
+
+	free((void *)this_struct);
+	return status;
+}
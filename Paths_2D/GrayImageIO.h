@@ -0,0 +1,183 @@
+/*
+ * File:		GrayImageIO.h
+ *
+ * Purpose:	Reading and writing grayscale images in PGM, uncompressed TIFF and raw
+ *		formats without ImageMagick, straight to and from 8- or 16-bit pixels
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+#ifndef GRAYIMAGEIO_H
+#define GRAYIMAGEIO_H
+
+/******************************** GRAY_IMAGE ******************************************/
+/*
+ * A grayscale image of unsigned char (depth 1) or unsigned short (depth 2) pixels, in
+ * rows of nx pixels, ready to pass to pathopen() as it is.
+ *
+ */
+typedef struct {
+	int nx, ny;						/* Image dimensions */
+	int depth;						/* Bytes per pixel, 1 or 2 */
+	void * buf;						/* nx * ny pixels */
+} GRAY_IMAGE;
+
+/* Formats handled without ImageMagick */
+typedef enum {
+	GRAY_FORMAT_UNKNOWN = 0,
+	GRAY_FORMAT_PGM,				/* PGM, binary (P5) or plain (P2), 8 or 16 bits */
+	GRAY_FORMAT_TIFF,				/* Uncompressed single-channel TIFF, 8 or 16 bits, in strips */
+	GRAY_FORMAT_RAW					/* Headerless pixels, in the machine's byte order */
+} GRAY_FORMAT;
+
+/* - GRAY_IMAGE_constructor:
+ * Construct an image of the given dimensions and depth, its pixels uninitialised
+ */
+GRAY_IMAGE * GRAY_IMAGE_constructor(
+	int nx, int ny,
+	int depth
+);
+
+/* - GRAY_IMAGE_destructor:
+ * Deallocate internal memory and object memory
+ */
+void GRAY_IMAGE_destructor(
+	GRAY_IMAGE * this_struct
+);
+
+/* - gray_image_format:
+ * The format a file name's extension stands for: .pgm or .pnm, .tif or .tiff, .raw or
+ * .gray, in any case.
+ */
+GRAY_FORMAT gray_image_format(
+	const char * filename
+);
+
+/* - read_gray_image:
+ * Read a PGM or TIFF image, recognised by its contents.  Returns NULL if the file is in
+ * neither format, or in a variant not handled here (compressed, colour or tiled TIFF,
+ * say), so that the caller may fall back to ImageMagick; malformed files are also
+ * reported on stderr.
+ */
+GRAY_IMAGE * read_gray_image(
+	const char * filename
+);
+
+/* - read_raw_image:
+ * Read a headerless image of the given dimensions and depth.  Returns NULL if the file
+ * is too short.
+ */
+GRAY_IMAGE * read_raw_image(
+	const char * filename,
+	int nx, int ny,
+	int depth
+);
+
+/* - write_gray_image:
+ * Write an image in the format given by the file name's extension: binary PGM, TIFF in
+ * the machine's byte order, or raw.  Returns 0 on success, -1 if the extension is not
+ * one of these or the file cannot be written.
+ */
+int write_gray_image(
+	const GRAY_IMAGE * image,
+	const char * filename
+);
+
+/******************************** GRAY_MAPPED_IMAGE ***********************************/
+/*
+ * A GRAY_IMAGE whose pixels are those of a file mapped into memory, so that pathopen()
+ * reads its input from, or writes its output to, the page cache without copies.  Only
+ * layouts whose pixels need no conversion can be mapped: raw files and binary PGM of 8
+ * bits (or of 16 bits on big-endian machines), and for output TIFF too.
+ *
+ */
+typedef struct {
+	GRAY_IMAGE image;				/* image.buf points into the mapping */
+	void * map;						/* The mapping, from the start of the file */
+	size_t map_size;				/* Its length in bytes */
+} GRAY_MAPPED_IMAGE;
+
+/* - map_gray_image:
+ * Map a binary PGM image read-only.  Returns NULL if the file is not a PGM whose pixels
+ * can be used as they are, so that the caller may read it with read_gray_image().
+ */
+GRAY_MAPPED_IMAGE * map_gray_image(
+	const char * filename
+);
+
+/* - map_raw_image:
+ * Map a headerless image of the given dimensions and depth read-only.  Returns NULL if
+ * the file is too short or cannot be mapped.
+ */
+GRAY_MAPPED_IMAGE * map_raw_image(
+	const char * filename,
+	int nx, int ny,
+	int depth
+);
+
+/* - create_mapped_gray_image:
+ * Create a file of the format given by the extension, its header written and its pixels
+ * left to fill in through a shared writable mapping.  Returns NULL if the format cannot
+ * be mapped at this depth (16-bit PGM on little-endian machines, say) or the file cannot
+ * be created, so that the caller may use write_gray_image() instead.  An existing file
+ * is truncated first, so the output must not be a file whose mapping is still the
+ * input: see same_gray_image_file().
+ */
+GRAY_MAPPED_IMAGE * create_mapped_gray_image(
+	const char * filename,
+	int nx, int ny,
+	int depth
+);
+
+/* - same_gray_image_file:
+ * Whether two names are of one existing file, by device and inode, however they are
+ * spelt.  A filter writing over its own mapped input must write a copy of the output
+ * with write_gray_image() after filtering, rather than map the output.
+ */
+int same_gray_image_file(
+	const char * filename1,
+	const char * filename2
+);
+
+/* - GRAY_MAPPED_IMAGE_destructor:
+ * Unmap the file, leaving any pixels written to it in the page cache for the kernel to
+ * write back, and free the object.  Returns 0, or -1 if unmapping failed.
+ */
+int GRAY_MAPPED_IMAGE_destructor(
+	GRAY_MAPPED_IMAGE * this_struct
+);
+
+#endif // GRAYIMAGEIO_H
@@ -55,6 +55,27 @@ knowledge of the CeCILL-B license and that you accept its terms.
 #include "pde_toolbox_bimage.h"
 #include "ImageMagickIO.h"
 
+/* Set while a caller holds ImageMagick initialised across many reads and writes */
+static int imagemagick_held = 0;
+
+/* begin_imagemagick:
+   Initialise ImageMagick once, until end_imagemagick()
+*/
+void begin_imagemagick(const char * currentpath)
+{
+    MagickCoreGenesis(currentpath, MagickFalse);
+    imagemagick_held = 1;
+}
+
+/* end_imagemagick:
+   Finalise ImageMagick after begin_imagemagick()
+*/
+void end_imagemagick(void)
+{
+    imagemagick_held = 0;
+    MagickCoreTerminus();
+}
+
 /* read_grayscale_image:
    Read a grayscale image from the specified file
    Construct and return a BIMAGE object
@@ -73,7 +94,8 @@ BIMAGE *read_grayscale_image(const char *currentpath, const char * filename)
 
     /* Initialise ImageMagick.  This just tells it what directory (*argv) we're running from */
     //InitializeMagick((char *)NULL);
-    MagickCoreGenesis(currentpath, MagickFalse);
+    if (!imagemagick_held)
+        MagickCoreGenesis(currentpath, MagickFalse);
 
     /* Initialise the ExceptionInfo - ImageMagick's way of implementing exceptions in C */
     GetExceptionInfo(&exception);
@@ -89,8 +111,13 @@ BIMAGE *read_grayscale_image(const char *currentpath, const char * filename)
     /* Deal with exceptions (ie. drop out) */
     if (exception.severity != UndefinedException)
         CatchException(&exception);
-    if (image == (Image *) NULL)
-        exit(1);
+    if (image == (Image *) NULL) {
+        image_info = DestroyImageInfo(image_info);
+        DestroyExceptionInfo(&exception);
+        if (!imagemagick_held)
+            MagickCoreTerminus();
+        return (BIMAGE *)NULL;
+    }
 
     /*** Construct a BIMAGE ***/
     /* Setup the dimensions */
@@ -124,8 +151,9 @@ BIMAGE *read_grayscale_image(const char *currentpath, const char * filename)
     /* Finalise the ExceptionInfo */
     DestroyExceptionInfo(&exception);
     
-    /* Finalise ImageMagick */
-    MagickCoreTerminus();
+    /* Finalise ImageMagick, unless a caller holds it */
+    if (!imagemagick_held)
+        MagickCoreTerminus();
     
     //normalise_contrast(bimage);
 
@@ -150,7 +178,8 @@ void write_grayscale_image(
     int i, num_pixels, maxval=0;
 
     /* Initialise ImageMagick.  This just tells it what directory (*argv) we're running from */
-    MagickCoreGenesis((char *)NULL, MagickFalse);
+    if (!imagemagick_held)
+        MagickCoreGenesis((char *)NULL, MagickFalse);
 
     /* Initialise the ExceptionInfo - ImageMagick's way of implementing exceptions in C */
     GetExceptionInfo(&exception);
@@ -212,8 +241,9 @@ void write_grayscale_image(
     /* Finalise the ExceptionInfo */
     DestroyExceptionInfo(&exception);
     
-    /* Finalise ImageMagick */
-    MagickCoreTerminus();
+    /* Finalise ImageMagick, unless a caller holds it */
+    if (!imagemagick_held)
+        MagickCoreTerminus();
     
     return;
 }
@@ -237,7 +267,8 @@ void write_colour_image(
     int i, num_pixels;
 
     /* Initialise ImageMagick.  This just tells it what directory (*argv) we're running from */
-    MagickCoreGenesis((char *)NULL, MagickFalse);
+    if (!imagemagick_held)
+        MagickCoreGenesis((char *)NULL, MagickFalse);
 
     /* Initialise the ExceptionInfo - ImageMagick's way of implementing exceptions in C */
     GetExceptionInfo(&exception);
@@ -286,8 +317,9 @@ void write_colour_image(
     /* Finalise the ExceptionInfo */
     DestroyExceptionInfo(&exception);
     
-    /* Finalise ImageMagick */
-    MagickCoreTerminus();
+    /* Finalise ImageMagick, unless a caller holds it */
+    if (!imagemagick_held)
+        MagickCoreTerminus();
     
     return;
 }
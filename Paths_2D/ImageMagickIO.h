@@ -61,7 +61,14 @@ knowledge of the CeCILL-B license and that you accept its terms.
 // #define MAX_PIXEL_VALUE 65535
 
 /*** Function prototypes ***/
-/* Read a grayscale image and construct a BIMAGE object */
+/* Initialise ImageMagick once for the reads and writes that follow, rather than
+   in each of them, until end_imagemagick() */
+void begin_imagemagick(
+	const char * currentpath
+);
+void end_imagemagick(void);
+
+/* Read a grayscale image and construct a BIMAGE object, or return NULL if it cannot be read */
 BIMAGE * read_grayscale_image(
     const char *currentpath,
 	const char * filename
@@ -0,0 +1,408 @@
+/*
+ *		File:		batch_pathopen.cxx
+ *
+ *		Purpose:	Path openings of many images in one process: ImageMagick is initialised
+ *					once, each worker thread keeps a context per image size, and files are
+ *					filtered concurrently with per-file and overall throughput reported
+ *
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+	#include "pde_toolbox_bimage.h"
+	#include "pde_toolbox_defs.h"
+	#include "ImageMagickIO.h"
+	#include "GrayImageIO.h"
+}
+
+#include "pathopenclose.h"
+
+using namespace std;
+using namespace std::chrono;
+
+/* ImageMagick is the fallback for formats GrayImageIO does not handle; calls into it are
+	serialised */
+static mutex imagemagick_lock;
+
+/* Per-file lines are printed whole */
+static mutex report_lock;
+
+/* Batch_File:
+	One image to filter, and how it went.
+*/
+struct Batch_File {
+	string input;
+	string output;
+	int nx, ny;
+	bool ok;
+	double open_time;								/* Reading or mapping input, creating output (s) */
+	double filter_time;								/* pathopen() (s) */
+	double write_time;								/* Writing or unmapping output (s) */
+};
+
+static double seconds_since(steady_clock::time_point start)
+{
+	return duration<double>(steady_clock::now() - start).count();
+}
+
+/* write_with_imagemagick:
+	Write 8- or 16-bit pixels in a format only ImageMagick handles.
+*/
+static void write_with_imagemagick(const GRAY_IMAGE * image, const char * filename)
+{
+	BVECT * dim = BVECT_constructor(2);
+	dim->buf[0] = image->nx;
+	dim->buf[1] = image->ny;
+	BIMAGE * bimage = BIMAGE_constructor(dim);
+	int i;
+
+	for (i = 0; i < image->nx * image->ny; ++i) {
+		bimage->buf[i] = (image->depth == 1) ?
+			((unsigned char *)image->buf)[i] : ((unsigned short *)image->buf)[i];
+	}
+	{
+		lock_guard<mutex> lock(imagemagick_lock);
+		write_grayscale_image(bimage, filename);
+	}
+
+	BIMAGE_destructor(bimage);
+	BVECT_destructor(dim);
+}
+
+/* filter_file:
+	Path-open one file with a context for its size from the worker's cache, the same way as
+	test_pathopen: mapped or read natively where GrayImageIO can, through ImageMagick
+	otherwise.
+*/
+static void filter_file(Path_Open_Context_Cache & contexts, int L, int K, Batch_File & file, const char * currentpath)
+{
+	steady_clock::time_point start = steady_clock::now();
+	GRAY_MAPPED_IMAGE * input_map = map_gray_image(file.input.c_str());
+	GRAY_IMAGE * input_gray = (input_map != NULL) ? &input_map->image : read_gray_image(file.input.c_str());
+	GRAY_MAPPED_IMAGE * output_map = NULL;
+	GRAY_IMAGE * output_gray = NULL;
+	BIMAGE * input_bimage = NULL, * output_bimage = NULL;
+
+	file.ok = false;
+	if (input_gray != NULL) {
+		file.nx = input_gray->nx;
+		file.ny = input_gray->ny;
+		/* check_outputs() has ruled out writing over any input, mapped or not */
+		output_map = create_mapped_gray_image(file.output.c_str(), file.nx, file.ny, input_gray->depth);
+		output_gray = (output_map != NULL) ?
+			&output_map->image : GRAY_IMAGE_constructor(file.nx, file.ny, input_gray->depth);
+	} else {
+		{
+			lock_guard<mutex> lock(imagemagick_lock);
+			input_bimage = read_grayscale_image(currentpath, file.input.c_str());
+		}
+		if (input_bimage == NULL) {
+			file.nx = file.ny = 0;
+			return;
+		}
+		file.nx = input_bimage->dim->buf[0];
+		file.ny = input_bimage->dim->buf[1];
+		output_bimage = BIMAGE_constructor(input_bimage->dim);
+	}
+	file.open_time = seconds_since(start);
+
+	start = steady_clock::now();
+	Path_Open_Context & context = contexts.context(file.nx, file.ny, L, K);
+	if (input_gray == NULL) {
+		pathopen(context, input_bimage->buf, output_bimage->buf);
+	} else if (input_gray->depth == 1) {
+		pathopen(context, (unsigned char *)input_gray->buf, (unsigned char *)output_gray->buf);
+	} else {
+		pathopen(context, (unsigned short *)input_gray->buf, (unsigned short *)output_gray->buf);
+	}
+	file.filter_time = seconds_since(start);
+
+	start = steady_clock::now();
+	file.ok = true;
+	if (output_map != NULL) {
+		file.ok = (GRAY_MAPPED_IMAGE_destructor(output_map) == 0);
+	} else if (output_gray != NULL) {
+		if (gray_image_format(file.output.c_str()) != GRAY_FORMAT_UNKNOWN) {
+			file.ok = (write_gray_image(output_gray, file.output.c_str()) == 0);
+		} else {
+			write_with_imagemagick(output_gray, file.output.c_str());
+		}
+		GRAY_IMAGE_destructor(output_gray);
+	} else {
+		lock_guard<mutex> lock(imagemagick_lock);
+		write_grayscale_image(output_bimage, file.output.c_str());
+	}
+	file.write_time = seconds_since(start);
+
+	if (input_map != NULL) {
+		GRAY_MAPPED_IMAGE_destructor(input_map);
+	} else if (input_gray != NULL) {
+		GRAY_IMAGE_destructor(input_gray);
+	} else {
+		BIMAGE_destructor(input_bimage);
+		BIMAGE_destructor(output_bimage);
+	}
+}
+
+/* list_inputs:
+	Append the files named by one argument: @file for a list with one name per line
+	(blank lines and lines starting with # skipped), otherwise a glob pattern.
+	Returns 0, or -1 if the list cannot be read or the pattern matches nothing.
+*/
+static int list_inputs(const char * spec, vector<string> & inputs)
+{
+	if (spec[0] == '@') {
+		FILE * list = fopen(spec + 1, "r");
+		char line[4096];
+
+		if (list == NULL) {
+			fprintf(stderr, "Could not open list %s\n", spec + 1);
+			return -1;
+		}
+		while (fgets(line, sizeof(line), list) != NULL) {
+			line[strcspn(line, "\r\n")] = '\0';
+			if (line[0] != '\0' && line[0] != '#') {
+				inputs.push_back(line);
+			}
+		}
+		fclose(list);
+	} else {
+		glob_t matches;
+		size_t m;
+
+		if (glob(spec, 0, NULL, &matches) != 0) {
+			fprintf(stderr, "No files match %s\n", spec);
+			return -1;
+		}
+		for (m = 0; m < matches.gl_pathc; ++m) {
+			inputs.push_back(matches.gl_pathv[m]);
+		}
+		globfree(&matches);
+	}
+
+	return 0;
+}
+
+/* output_name:
+	The output pattern with its %s replaced by the input's base name without extension.
+*/
+static string output_name(const string & pattern, const string & input)
+{
+	size_t slash = input.find_last_of('/');
+	string base = input.substr(slash == string::npos ? 0 : slash + 1);
+	size_t dot = base.find_last_of('.');
+	string output = pattern;
+	size_t hole = output.find("%s");
+
+	if (dot != string::npos && dot > 0) {
+		base.erase(dot);
+	}
+	if (hole != string::npos) {
+		output.replace(hole, 2, base);
+	}
+
+	return output;
+}
+
+/* check_outputs:
+	Refuse a batch in which two inputs would be written to one output, as a/x.tif and
+	b/x.pgm would to out/%s.pgm, or an output would overwrite an input: workers would
+	truncate and map one file at once, or an input as it was read.  Names are compared
+	as given, and existing files by device and inode.  Returns 0, or -1 after saying
+	which files clash.
+*/
+static int check_outputs(const vector<Batch_File> & files)
+{
+	map<string, size_t> outputs;
+	map<pair<dev_t, ino_t>, size_t> output_files;
+	set<string> inputs;
+	set<pair<dev_t, ino_t> > input_files;
+	struct stat status;
+	size_t f;
+
+	for (f = 0; f < files.size(); ++f) {
+		inputs.insert(files[f].input);
+		if (stat(files[f].input.c_str(), &status) == 0) {
+			input_files.insert(make_pair(status.st_dev, status.st_ino));
+		}
+	}
+
+	for (f = 0; f < files.size(); ++f) {
+		const string & output = files[f].output;
+		bool exists = (stat(output.c_str(), &status) == 0);
+		pair<dev_t, ino_t> file = make_pair(status.st_dev, status.st_ino);
+
+		if (inputs.count(output) != 0 || (exists && input_files.count(file) != 0)) {
+			fprintf(stderr, "The output of %s, %s, is an input\n", files[f].input.c_str(), output.c_str());
+			return -1;
+		}
+		if (outputs.count(output) != 0 || (exists && output_files.count(file) != 0)) {
+			size_t other = outputs.count(output) != 0 ? outputs[output] : output_files[file];
+			fprintf(stderr, "%s and %s would both be written to %s\n",
+				files[other].input.c_str(), files[f].input.c_str(), output.c_str());
+			return -1;
+		}
+		outputs[output] = f;
+		if (exists) output_files[file] = f;
+	}
+
+	return 0;
+}
+
+int usage(const char *name)
+{
+	fprintf(stderr, "Usage : %s [-j num_workers] [-t threads_per_image] L K <output pattern> <inputs>...\n", name);
+	fprintf(stderr, "Where : L is the length of the path\n");
+	fprintf(stderr, "        K is the number of admissible missing pixels\n");
+	fprintf(stderr, "        <output pattern> names each output, %%s standing for the input's name\n");
+	fprintf(stderr, "                         without directory or extension, e.g. out/%%s_open.pgm\n");
+	fprintf(stderr, "                         no two inputs may share an output, nor may an output be an input\n");
+	fprintf(stderr, "        <inputs> are glob patterns such as 'images/*.tif' or @list, a file of names\n");
+	fprintf(stderr, "        num_workers is the number of files filtered at once (default: all cores)\n");
+	fprintf(stderr, "        threads_per_image is the number of threads per file (default: 1)\n");
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int num_workers = 0, threads_per_image = 1, L, K, a = 1, w;
+	vector<string> inputs;
+	vector<Batch_File> files;
+	vector<thread> workers;
+	atomic<size_t> next_file(0);
+	size_t f, num_failed = 0;
+	double num_pixels = 0, filter_time = 0;
+
+	/* Options, then the positional arguments */
+	while (a + 1 < argc && argv[a][0] == '-') {
+		if (strcmp(argv[a], "-j") == 0) num_workers = atoi(argv[a + 1]);
+		else if (strcmp(argv[a], "-t") == 0) threads_per_image = atoi(argv[a + 1]);
+		else break;
+		a += 2;
+	}
+	if (argc - a < 4) {
+		usage(argv[0]);
+		return 1;
+	}
+	L = atoi(argv[a]);
+	K = atoi(argv[a + 1]);
+	string pattern = argv[a + 2];
+	for (a += 3; a < argc; ++a) {
+		if (list_inputs(argv[a], inputs) != 0) return 1;
+	}
+	if (pattern.find("%s") == string::npos && inputs.size() > 1) {
+		fprintf(stderr, "The output pattern needs a %%s for %d inputs\n", (int)inputs.size());
+		return 1;
+	}
+
+	files.resize(inputs.size());
+	for (f = 0; f < inputs.size(); ++f) {
+		files[f].input = inputs[f];
+		files[f].output = output_name(pattern, inputs[f]);
+	}
+	if (check_outputs(files) != 0) return 1;
+
+	if (num_workers <= 0) {
+		num_workers = (int)thread::hardware_concurrency();
+	}
+	num_workers = MAX(1, MIN(num_workers, (int)files.size()));
+
+	begin_imagemagick(argv[0]);
+	steady_clock::time_point start = steady_clock::now();
+
+	/* Each worker takes the next file until none are left */
+	for (w = 0; w < num_workers; ++w) {
+		workers.push_back(thread([&]() {
+			Path_Open_Context_Cache contexts(4, threads_per_image);
+			size_t mine;
+
+			while ((mine = next_file++) < files.size()) {
+				Batch_File & file = files[mine];
+
+				filter_file(contexts, L, K, file, argv[0]);
+
+				lock_guard<mutex> lock(report_lock);
+				if (file.ok) {
+					printf("%s -> %s: %d x %d, open %.1f ms, filter %.1f ms, write %.1f ms, %.2f Mpixel/s\n",
+						file.input.c_str(), file.output.c_str(), file.nx, file.ny,
+						1e3 * file.open_time, 1e3 * file.filter_time, 1e3 * file.write_time,
+						1e-6 * file.nx * file.ny / (file.open_time + file.filter_time + file.write_time));
+				} else {
+					printf("%s -> %s: FAILED\n", file.input.c_str(), file.output.c_str());
+				}
+				fflush(stdout);
+			}
+		}));
+	}
+	for (w = 0; w < num_workers; ++w) {
+		workers[w].join();
+	}
+
+	double elapsed_time = seconds_since(start);
+	end_imagemagick();
+
+	for (f = 0; f < files.size(); ++f) {
+		if (files[f].ok) {
+			num_pixels += (double)files[f].nx * files[f].ny;
+			filter_time += files[f].filter_time;
+		} else {
+			++num_failed;
+		}
+	}
+	printf("%d files (%d failed) by %d workers in %.3f s: %.1f files/s, %.2f Mpixel/s, %.1f ms filtering per file\n",
+		(int)files.size(), (int)num_failed, num_workers, elapsed_time,
+		(files.size() - num_failed) / elapsed_time, 1e-6 * num_pixels / elapsed_time,
+		1e3 * filter_time / MAX(1, (int)(files.size() - num_failed)));
+
+	return num_failed != 0;
+}
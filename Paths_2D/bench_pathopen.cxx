@@ -0,0 +1,588 @@
+/*
+ *		File:		bench_pathopen.cxx
+ *
+ *		Purpose:	Time path openings on reproducible synthetic images over a
+ *					sweep of sizes, lengths and gaps, reporting CSV or JSON
+ *
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <chrono>
+#include <vector>
+#include "pathopenclose.h"
+
+using namespace std;
+using namespace std::chrono;
+
+#define BENCH_NUM_IMAGES 4
+
+static const char * bench_image_names[BENCH_NUM_IMAGES] = { "noise", "segments", "fibres", "gel" };
+
+/* Bench_Random:
+	A 64-bit linear congruential generator, so that an image is the same for a given
+	seed on every platform, whatever rand() does.
+*/
+struct Bench_Random {
+	unsigned long long state;
+};
+
+static void bench_seed(Bench_Random & random, unsigned long long seed)
+{
+	random.state = seed * 0x9E3779B97F4A7C15ULL + 1;
+}
+
+/* 32 random bits, the high ones of the state */
+static unsigned int bench_bits(Bench_Random & random)
+{
+	random.state = random.state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (unsigned int)(random.state >> 32);
+}
+
+/* Uniform in [0, 1) */
+static double bench_uniform(Bench_Random & random)
+{
+	return bench_bits(random) * (1.0 / 4294967296.0);
+}
+
+/* Uniform integer in [0, n) */
+static int bench_below(Bench_Random & random, int n)
+{
+	return (int)(bench_uniform(random) * n);
+}
+
+/* Brighten one pixel, if it lies in the image */
+static void bench_plot(unsigned char * image, int nx, int ny, double x, double y, int value)
+{
+	int ix = (int)floor(x + 0.5);
+	int iy = (int)floor(y + 0.5);
+
+	if (ix >= 0 && ix < nx && iy >= 0 && iy < ny) {
+		image[ix + nx * iy] = MAX(image[ix + nx * iy], value);
+	}
+}
+
+/* Dim background noise of the given range */
+static void bench_background(Bench_Random & random, unsigned char * image, int nx, int ny, int base, int range)
+{
+	size_t i, num_pixels = (size_t)nx * ny;
+
+	for (i = 0; i < num_pixels; ++i) {
+		image[i] = (unsigned char)(base + bench_below(random, range));
+	}
+}
+
+/* - make_noise:
+	Uniform white noise over 0..255: no structure, every threshold level in use.
+*/
+static void make_noise(Bench_Random & random, unsigned char * image, int nx, int ny)
+{
+	bench_background(random, image, nx, ny, 0, 256);
+}
+
+/* - make_segments:
+	Straight bright segments at every angle over dim noise, one per thousand pixels,
+	up to a quarter of the smaller side long.
+*/
+static void make_segments(Bench_Random & random, unsigned char * image, int nx, int ny)
+{
+	int i, t, length, value;
+	int num_segments = (int)MAX(1, (long long)nx * ny / 1000);
+	int max_length = MAX(8, MIN(nx, ny) / 4);
+	double x, y, angle;
+
+	bench_background(random, image, nx, ny, 20, 40);
+	for (i = 0; i < num_segments; ++i) {
+		x = bench_uniform(random) * nx;
+		y = bench_uniform(random) * ny;
+		angle = bench_uniform(random) * M_PI;
+		length = 8 + bench_below(random, max_length - 7);
+		value = 128 + bench_below(random, 128);
+		for (t = 0; t < length; ++t) {
+			bench_plot(image, nx, ny, x + t * cos(angle), y + t * sin(angle), value);
+		}
+	}
+}
+
+/* - make_fibres:
+	Curvilinear fibres over dim noise: walks whose heading drifts a little at each
+	step, with one pixel in twenty dropped so that gaps matter.
+*/
+static void make_fibres(Bench_Random & random, unsigned char * image, int nx, int ny)
+{
+	int i, t, length, value;
+	int num_fibres = (int)MAX(1, (long long)nx * ny / 4000);
+	int max_length = MAX(50, MIN(nx, ny) / 2);
+	double x, y, angle;
+
+	bench_background(random, image, nx, ny, 0, 60);
+	for (i = 0; i < num_fibres; ++i) {
+		x = bench_uniform(random) * nx;
+		y = bench_uniform(random) * ny;
+		angle = bench_uniform(random) * 2 * M_PI;
+		length = 50 + bench_below(random, max_length - 49);
+		value = 140 + bench_below(random, 100);
+		for (t = 0; t < length; ++t) {
+			if (bench_below(random, 20) != 0) bench_plot(image, nx, ny, x, y, value);
+			angle += (bench_uniform(random) - 0.5) * 0.3;
+			x += cos(angle);
+			y += sin(angle);
+		}
+	}
+}
+
+/* - make_gel:
+	An electrophoresis gel like images/DNAGI.tif: vertical lanes of horizontal bands,
+	each smeared downwards and bowed at the lane edges, on a shaded noisy background.
+	A profile per lane makes it linear in the image size.
+*/
+static void make_gel(Bench_Random & random, unsigned char * image, int nx, int ny)
+{
+	int x, y, b, lane, num_bands, band_y;
+	int pitch = MAX(16, nx / 12);
+	int lane_width = (pitch * 7) / 10;
+	int num_lanes = MAX(1, nx / pitch);
+	double amplitude, sigma, smear, bow, value;
+	vector<double> profile(ny);
+
+	for (y = 0; y < ny; ++y) {
+		for (x = 0; x < nx; ++x) {
+			image[x + nx * y] = (unsigned char)(30 + (20 * y) / ny + bench_below(random, 24));
+		}
+	}
+
+	for (lane = 0; lane < num_lanes; ++lane) {
+		int x0 = lane * pitch + (pitch - lane_width) / 2;
+
+		/* The lane's brightness down its length */
+		for (y = 0; y < ny; ++y) profile[y] = 0.0;
+		num_bands = 6 + bench_below(random, 10);
+		for (b = 0; b < num_bands; ++b) {
+			band_y = bench_below(random, ny);
+			amplitude = 60 + bench_below(random, 140);
+			sigma = 1 + bench_uniform(random) * ny / 200.0;
+			smear = MAX(1.0, ny / 20.0);
+			for (y = MAX(0, band_y - (int)(4 * sigma)); y < ny; ++y) {
+				double d = y - band_y;
+				double smeared = (d > 0) ? 0.15 * exp(-d / smear) : 0.0;
+
+				if (d > 4 * sigma && smeared < 0.005) break;
+				profile[y] += amplitude * (exp(-d * d / (2 * sigma * sigma)) + smeared);
+			}
+		}
+
+		/* Across the lane: bands bow up to two pixels at the edges, which are soft */
+		for (x = x0; x < x0 + lane_width && x < nx; ++x) {
+			double across = (2.0 * (x - x0) + 1) / lane_width - 1;
+			double weight = (x == x0 || x == x0 + lane_width - 1) ? 0.5 : 1.0;
+
+			bow = 2 * across * across;
+			for (y = 0; y < ny; ++y) {
+				int source_y = y + (int)bow;
+
+				if (source_y >= ny) break;
+				value = image[x + nx * y] + weight * profile[source_y];
+				image[x + nx * y] = (unsigned char)MIN(255.0, value);
+			}
+		}
+	}
+}
+
+/* - make_image:
+	The named synthetic image, the same for the same seed and size.
+*/
+static void make_image(int image_type, unsigned long long seed, unsigned char * image, int nx, int ny)
+{
+	Bench_Random random;
+
+	bench_seed(random, seed * 1000003ULL + (unsigned long long)image_type * 7919ULL + (unsigned long long)nx * 31ULL + ny);
+	switch (image_type) {
+		case 0: make_noise(random, image, nx, ny); break;
+		case 1: make_segments(random, image, nx, ny); break;
+		case 2: make_fibres(random, image, nx, ny); break;
+		default: make_gel(random, image, nx, ny); break;
+	}
+}
+
+/* - reset_peak_rss:
+	Restart the resident set high-water mark, where Linux allows it.
+*/
+static bool reset_peak_rss(void)
+{
+	FILE * file = fopen("/proc/self/clear_refs", "w");
+	bool ok;
+
+	if (file == NULL) return false;
+	ok = fputs("5", file) >= 0;
+	if (fclose(file) != 0) ok = false;
+	return ok;
+}
+
+/* - peak_rss_kb:
+	The resident set high-water mark in kilobytes, from /proc (which reset_peak_rss()
+	restarts), else getrusage() (which it does not).
+*/
+static long peak_rss_kb(void)
+{
+	char line[256];
+	long kb = -1;
+	FILE * file = fopen("/proc/self/status", "r");
+	struct rusage usage;
+
+	if (file != NULL) {
+		while (fgets(line, sizeof(line), file) != NULL) {
+			if (sscanf(line, "VmHWM: %ld", &kb) == 1) break;
+		}
+		fclose(file);
+	}
+	if (kb < 0 && getrusage(RUSAGE_SELF, &usage) == 0) {
+		kb = usage.ru_maxrss;
+	}
+	return kb;
+}
+
+/* Bench_Options:
+	The sweep, from the command line.
+*/
+struct Bench_Options {
+	vector<int> images;								/* Indices into bench_image_names */
+	vector<int> sizes;								/* Square image sides */
+	vector<int> lengths;
+	vector<int> gaps;								/* Values of K */
+	int depth;										/* Bytes per pixel, 1 or 2 */
+	int num_threads;
+	int num_reps;
+	size_t memory_budget;							/* Beyond it, the tiled engine */
+	unsigned long long seed;
+	bool json;
+};
+
+/* Bench_Result:
+	The best of the repetitions of one case.  For the tiled engine the sort and pass
+	times are summed over tiles, halos included.
+*/
+struct Bench_Result {
+	const char * engine;
+	double total_time;
+	double sort_time;
+	double pass_times[4];
+	long peak_rss;
+};
+
+/* - bench_case:
+	Time the opening of one image at one length, the best of num_reps.
+*/
+template <class PIX_TYPE>
+static int bench_case(
+	const Bench_Options & options,
+	Path_Open_Context * context,					/* Whole-image working memory, or NULL for the tiled engine */
+	PIX_TYPE * input_image,
+	PIX_TYPE * output_image,
+	int nx, int ny, int L, int K,
+	Bench_Result & result
+)
+{
+	int r, p, t;
+
+	result.engine = context ? "context" : "tiled";
+	result.total_time = 1e30;
+	for (r = 0; r < options.num_reps; ++r) {
+		double sort_time, total_time, pass_times[4];
+		steady_clock::time_point start = steady_clock::now();
+
+		if (context != NULL) {
+			context->L = L;
+			pathopen_presort(*context, input_image);
+			sort_time = duration<double>(steady_clock::now() - start).count();
+			pathopen_presorted(*context, input_image, output_image);
+			total_time = duration<double>(steady_clock::now() - start).count();
+			for (p = 0; p < 4; ++p) pass_times[p] = context->pass_times[p];
+		} else {
+			Path_Open_Engine_Stats stats;
+
+			if (pathopen_tiled(input_image, nx, ny, L, K, output_image, options.memory_budget,
+					options.num_threads, &stats) != 0) {
+				return -1;
+			}
+			total_time = duration<double>(steady_clock::now() - start).count();
+			sort_time = 0.0;
+			for (p = 0; p < 4; ++p) pass_times[p] = 0.0;
+			for (t = 0; t < stats.num_tiles; ++t) {
+				sort_time += stats.tiles[t].sort_time;
+				for (p = 0; p < 4; ++p) pass_times[p] += stats.tiles[t].pass_times[p];
+			}
+		}
+
+		if (total_time < result.total_time) {
+			result.total_time = total_time;
+			result.sort_time = sort_time;
+			for (p = 0; p < 4; ++p) result.pass_times[p] = pass_times[p];
+		}
+	}
+	result.peak_rss = peak_rss_kb();
+
+	return 0;
+}
+
+/* - print_result:
+	One line of CSV, or one object of the JSON array.
+*/
+static void print_result(const Bench_Options & options, bool first, int image_type, int nx, int ny, int L, int K,
+	const Bench_Result & result)
+{
+	double mpixels_per_s = (double)nx * ny / result.total_time / 1e6;
+
+	if (options.json) {
+		printf("%s\n  {\"image\": \"%s\", \"depth\": %d, \"nx\": %d, \"ny\": %d, \"L\": %d, \"K\": %d, "
+			"\"threads\": %d, \"engine\": \"%s\", \"repeats\": %d, \"total_s\": %.6f, \"sort_s\": %.6f, "
+			"\"passes_s\": %.6f, \"mpixels_per_s\": %.3f, \"vert_s\": %.6f, \"diag_s\": %.6f, "
+			"\"horiz_s\": %.6f, \"antidiag_s\": %.6f, \"peak_rss_kb\": %ld}",
+			first ? "" : ",", bench_image_names[image_type], 8 * options.depth, nx, ny, L, K,
+			options.num_threads, result.engine, options.num_reps, result.total_time, result.sort_time,
+			result.total_time - result.sort_time, mpixels_per_s, result.pass_times[0], result.pass_times[1],
+			result.pass_times[2], result.pass_times[3], result.peak_rss);
+	} else {
+		printf("%s,%d,%d,%d,%d,%d,%d,%s,%d,%.6f,%.6f,%.6f,%.3f,%.6f,%.6f,%.6f,%.6f,%ld\n",
+			bench_image_names[image_type], 8 * options.depth, nx, ny, L, K,
+			options.num_threads, result.engine, options.num_reps, result.total_time, result.sort_time,
+			result.total_time - result.sort_time, mpixels_per_s, result.pass_times[0], result.pass_times[1],
+			result.pass_times[2], result.pass_times[3], result.peak_rss);
+	}
+	fflush(stdout);
+}
+
+/* - bench_sweep:
+	Every image, size, K and L of the options, with pixels of PIX_TYPE.  A context
+	serves all the lengths of an image size and K; the image is made once per size.
+*/
+template <class PIX_TYPE>
+static int bench_sweep(const Bench_Options & options)
+{
+	size_t i, s, k, l, num_pixels;
+	int image_type, nx, ny, L, K;
+	int scale = (sizeof(PIX_TYPE) == 1) ? 1 : 257;
+	bool first = true;
+	bool rss_reset = true;
+	unsigned char * pixels;
+	PIX_TYPE * input_image, * output_image;
+	Bench_Result result;
+
+	if (options.json) printf("[");
+	else printf("image,depth,nx,ny,L,K,threads,engine,repeats,total_s,sort_s,passes_s,mpixels_per_s,"
+		"vert_s,diag_s,horiz_s,antidiag_s,peak_rss_kb\n");
+
+	for (s = 0; s < options.sizes.size(); ++s) {
+		nx = ny = options.sizes[s];
+		num_pixels = (size_t)nx * ny;
+		pixels = (unsigned char *)malloc(num_pixels);
+		input_image = (PIX_TYPE *)malloc(num_pixels * sizeof(PIX_TYPE));
+		output_image = (PIX_TYPE *)malloc(num_pixels * sizeof(PIX_TYPE));
+		if (pixels == NULL || input_image == NULL || output_image == NULL) {
+			fprintf(stderr, "Not enough memory for %d x %d images\n", nx, ny);
+			free(pixels); free(input_image); free(output_image);
+			return 1;
+		}
+
+		for (i = 0; i < options.images.size(); ++i) {
+			image_type = options.images[i];
+			make_image(image_type, options.seed, pixels, nx, ny);
+			for (size_t j = 0; j < num_pixels; ++j) input_image[j] = (PIX_TYPE)(pixels[j] * scale);
+
+			for (k = 0; k < options.gaps.size(); ++k) {
+				Path_Open_Context * context = NULL;
+				int max_L = 1;
+
+				K = options.gaps[k];
+				for (l = 0; l < options.lengths.size(); ++l) max_L = MAX(max_L, options.lengths[l]);
+
+				/* The whole image at once if its working memory fits, else in tiles */
+				if (pathopen_memory_size(nx, ny, max_L, K, sizeof(PIX_TYPE), options.num_threads) +
+						2 * num_pixels * sizeof(PIX_TYPE) <= options.memory_budget) {
+					context = new Path_Open_Context(nx, ny, max_L, K, options.num_threads);
+				}
+
+				for (l = 0; l < options.lengths.size(); ++l) {
+					L = options.lengths[l];
+					if (!reset_peak_rss()) rss_reset = false;
+					if (bench_case(options, context, input_image, output_image, nx, ny, L, K, result) != 0) {
+						fprintf(stderr, "%s %d x %d, L = %d, K = %d: the tiled engine failed\n",
+							bench_image_names[image_type], nx, ny, L, K);
+						continue;
+					}
+					print_result(options, first, image_type, nx, ny, L, K, result);
+					first = false;
+				}
+				delete context;
+			}
+		}
+
+		free(pixels);
+		free(input_image);
+		free(output_image);
+	}
+
+	if (options.json) printf("\n]\n");
+	if (!rss_reset) fprintf(stderr, "Peak RSS could not be reset: each figure is the peak of the run so far\n");
+
+	return 0;
+}
+
+/* - parse_list:
+	A comma-separated list of integers of at least min_value.
+*/
+static int parse_list(const char * text, int min_value, vector<int> & list)
+{
+	char * end;
+
+	list.clear();
+	for (;;) {
+		long value = strtol(text, &end, 10);
+
+		if (end == text || value < min_value || value > 1000000) return -1;
+		list.push_back((int)value);
+		if (*end == '\0') return 0;
+		if (*end != ',') return -1;
+		text = end + 1;
+	}
+}
+
+/* - parse_images:
+	A comma-separated list of image names, or "all".
+*/
+static int parse_images(const char * text, vector<int> & images)
+{
+	int i;
+	size_t length;
+
+	images.clear();
+	if (strcmp(text, "all") == 0) {
+		for (i = 0; i < BENCH_NUM_IMAGES; ++i) images.push_back(i);
+		return 0;
+	}
+	for (;;) {
+		length = strcspn(text, ",");
+		for (i = 0; i < BENCH_NUM_IMAGES; ++i) {
+			if (strlen(bench_image_names[i]) == length && strncmp(text, bench_image_names[i], length) == 0) break;
+		}
+		if (i == BENCH_NUM_IMAGES) return -1;
+		images.push_back(i);
+		if (text[length] == '\0') return 0;
+		text += length + 1;
+	}
+}
+
+int usage(const char *name)
+{
+	fprintf(stderr, "Usage : %s [-i images] [-s sizes] [-L lengths] [-K gaps] [-d depth] [-t threads]\n", name);
+	fprintf(stderr, "        [-r repeats] [-b budget_MB] [-seed n] [-json]\n");
+	fprintf(stderr, "Where : images are some of noise,segments,fibres,gel, or all (default: all)\n");
+	fprintf(stderr, "        sizes are square image sides, 256 to 16384 (default: 256,512,1024)\n");
+	fprintf(stderr, "        lengths are path lengths L (default: 20,100)\n");
+	fprintf(stderr, "        gaps are numbers K of admissible missing pixels (default: 0,1,2)\n");
+	fprintf(stderr, "        depth is 8 or 16 bits per pixel (default: 8)\n");
+	fprintf(stderr, "        threads is the number of threads per opening (default: 1)\n");
+	fprintf(stderr, "        repeats is the number of runs of each case, the best reported (default: 3)\n");
+	fprintf(stderr, "        budget_MB is the memory beyond which images are opened in tiles\n");
+	fprintf(stderr, "                  (default: half the physical memory)\n");
+	fprintf(stderr, "        seed changes every image (default: 1)\n");
+	fprintf(stderr, "Prints CSV, or a JSON array with -json, a record per case.\n");
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int a, depth = 8;
+	long num_pages = sysconf(_SC_PHYS_PAGES);
+	long page_size = sysconf(_SC_PAGESIZE);
+	Bench_Options options;
+
+	parse_images("all", options.images);
+	parse_list("256,512,1024", 1, options.sizes);
+	parse_list("20,100", 1, options.lengths);
+	parse_list("0,1,2", 0, options.gaps);
+	options.num_threads = 1;
+	options.num_reps = 3;
+	options.memory_budget = (num_pages > 0 && page_size > 0) ? (size_t)num_pages * page_size / 2 : ((size_t)1 << 30);
+	options.seed = 1;
+	options.json = false;
+
+	for (a = 1; a < argc; ++a) {
+		bool has_value = a + 1 < argc;
+		int status = 0;
+
+		if (strcmp(argv[a], "-json") == 0) {
+			options.json = true;
+			continue;
+		}
+		if (!has_value) status = -1;
+		else if (strcmp(argv[a], "-i") == 0) status = parse_images(argv[++a], options.images);
+		else if (strcmp(argv[a], "-s") == 0) status = parse_list(argv[++a], 1, options.sizes);
+		else if (strcmp(argv[a], "-L") == 0) status = parse_list(argv[++a], 1, options.lengths);
+		else if (strcmp(argv[a], "-K") == 0) status = parse_list(argv[++a], 0, options.gaps);
+		else if (strcmp(argv[a], "-d") == 0) depth = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-t") == 0) options.num_threads = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-r") == 0) options.num_reps = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-b") == 0) options.memory_budget = (size_t)atol(argv[++a]) << 20;
+		else if (strcmp(argv[a], "-seed") == 0) options.seed = strtoull(argv[++a], NULL, 10);
+		else status = -1;
+
+		if (status != 0) {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	for (size_t s = 0; s < options.sizes.size(); ++s) {
+		if (options.sizes[s] > 16384) {
+			fprintf(stderr, "Sizes are limited to 16384\n");
+			return 1;
+		}
+	}
+	if ((depth != 8 && depth != 16) || options.num_threads <= 0 || options.num_reps <= 0) {
+		usage(argv[0]);
+		return 1;
+	}
+	options.depth = depth / 8;
+
+	if (options.depth == 1) return bench_sweep<unsigned char>(options);
+	return bench_sweep<unsigned short>(options);
+}
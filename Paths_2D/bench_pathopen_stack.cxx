@@ -0,0 +1,131 @@
+/*
+ *		File:		bench_pathopen_stack.cxx
+ *
+ *		Purpose:	Time pathopen_stack() over a list of lengths against one
+ *					pathopen() call per length, on a synthetic image
+ *
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "pathopenclose.h"
+
+/* Seconds of CPU time since start */
+static double elapsed(clock_t start)
+{
+	return ((double)clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char ** argv)
+{
+	int nx, ny, K, num_reps, num_pixels, num_lengths;
+	int i, j, r, x, y;
+	int lengths[PATHOPEN_MAX_LENGTHS];
+	PATHOPEN_PIX_TYPE * input_image, * output_stack, * reference_stack;
+	clock_t start;
+	double reference_time, time;
+
+	nx = (argc > 1) ? atoi(argv[1]) : 1000;
+	ny = (argc > 2) ? atoi(argv[2]) : 800;
+	K = (argc > 3) ? atoi(argv[3]) : 2;
+	num_reps = (argc > 4) ? atoi(argv[4]) : 3;
+	num_lengths = 0;
+	for (i = 5; i < argc && num_lengths < PATHOPEN_MAX_LENGTHS; ++i) {
+		lengths[num_lengths++] = atoi(argv[i]);
+	}
+	if (num_lengths == 0) {
+		lengths[0] = 20; lengths[1] = 40; lengths[2] = 70; lengths[3] = 120;
+		num_lengths = 4;
+	}
+	if (nx <= 0 || ny <= 0 || K < 0 || num_reps <= 0) {
+		fprintf(stderr, "Usage : %s [nx ny K num_reps [L ...]]\n", argv[0]);
+		return 1;
+	}
+	num_pixels = nx * ny;
+
+	input_image = (PATHOPEN_PIX_TYPE *)malloc(num_pixels * sizeof(PATHOPEN_PIX_TYPE));
+	output_stack = (PATHOPEN_PIX_TYPE *)malloc((size_t)num_pixels * num_lengths * sizeof(PATHOPEN_PIX_TYPE));
+	reference_stack = (PATHOPEN_PIX_TYPE *)malloc((size_t)num_pixels * num_lengths * sizeof(PATHOPEN_PIX_TYPE));
+
+	/* Smooth oriented ridges under noise, so that paths of many lengths survive */
+	srand(1);
+	for (y = 0; y < ny; ++y) {
+		for (x = 0; x < nx; ++x) {
+			double ridges = sin(0.05 * x + 0.02 * y) + sin(0.013 * x - 0.07 * y);
+			input_image[x + nx * y] = (PATHOPEN_PIX_TYPE)(128 + 50 * ridges + rand() % 56 - 28);
+		}
+	}
+
+	printf("%d x %d, K = %d, %d lengths, best of %d\n", nx, ny, K, num_lengths, num_reps);
+
+	reference_time = time = 1e30;
+	for (r = 0; r < num_reps; ++r) {
+		start = clock();
+		for (j = 0; j < num_lengths; ++j) {
+			pathopen(input_image, nx, ny, lengths[j], K, reference_stack + (size_t)num_pixels * j);
+		}
+		reference_time = MIN(reference_time, elapsed(start));
+
+		start = clock();
+		if (pathopen_stack(input_image, nx, ny, lengths, num_lengths, K, output_stack) != 0) {
+			fprintf(stderr, "Lengths must be increasing, from 1\n");
+			return 1;
+		}
+		time = MIN(time, elapsed(start));
+	}
+	printf("pathopen_stack: %.4f s, %d pathopen calls: %.4f s (%.2fx)\n",
+		time, num_lengths, reference_time, reference_time / time);
+
+	/* The outputs agree at every length */
+	for (j = 0; j < num_lengths; ++j) {
+		if (memcmp(output_stack + (size_t)num_pixels * j, reference_stack + (size_t)num_pixels * j,
+				num_pixels * sizeof(PATHOPEN_PIX_TYPE))) {
+			printf("L = %d: MISMATCH\n", lengths[j]);
+		}
+	}
+
+	free((void *)input_image);
+	free((void *)output_stack);
+	free((void *)reference_stack);
+
+	return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ *		File:		bench_transpose.c
+ *
+ *		Purpose:	Time the tiled transpose and flip of path_support.c against
+ *					the original pixel-by-pixel versions
+ *
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "path_support.h"
+
+/* - reference_transpose_image:
+	The original transpose_image(), one pixel at a time, out of place only
+*/
+static void reference_transpose_image(
+	void * input_image,
+	int nx, int ny,
+	int num_bytes_per_element,
+	void * output_image
+)
+{
+	int i, num_pixels;
+
+	num_pixels = nx * ny;
+	for (i = 0; i < num_pixels; ++i) {
+		int x, y, new_index;
+
+		/* Compute destination address */
+		x = i % nx;
+		y = i / nx;
+		new_index = y + ny * x;
+
+		memcpy(
+			(unsigned char *)output_image + new_index * num_bytes_per_element,
+			(unsigned char *)input_image + i * num_bytes_per_element,
+			num_bytes_per_element
+		);
+	}
+}
+
+/* - reference_transpose_indices:
+	The original transpose_indices()
+*/
+static void reference_transpose_indices(
+	int * input_indices,
+	int nx, int ny,
+	int * output_indices
+)
+{
+	int i, num_pixels;
+
+	num_pixels = nx * ny;
+	for (i = 0; i < num_pixels; ++i) {
+		int x, y, old_index;
+
+		old_index = input_indices[i];
+		x = old_index % nx;
+		y = old_index / nx;
+		output_indices[i] = y + ny * x;
+	}
+}
+
+/* Seconds of CPU time since start */
+static double elapsed(clock_t start)
+{
+	return ((double)clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char ** argv)
+{
+	int nx, ny, num_reps, num_pixels;
+	int i, r, size_index;
+	int sizes[3] = {1, 2, 4};
+	unsigned char * input_image, * output_image, * reference_image;
+	int * indices, * output_indices, * reference_indices;
+	clock_t start;
+	double reference_time, time;
+
+	nx = (argc > 1) ? atoi(argv[1]) : 4000;
+	ny = (argc > 2) ? atoi(argv[2]) : 3000;
+	num_reps = (argc > 3) ? atoi(argv[3]) : 5;
+	if (nx <= 0 || ny <= 0 || num_reps <= 0) {
+		fprintf(stderr, "Usage : %s [nx ny num_reps]\n", argv[0]);
+		return 1;
+	}
+	num_pixels = nx * ny;
+
+	input_image = (unsigned char *)malloc((size_t)num_pixels * 4);
+	output_image = (unsigned char *)malloc((size_t)num_pixels * 4);
+	reference_image = (unsigned char *)malloc((size_t)num_pixels * 4);
+	indices = (int *)malloc(num_pixels * sizeof(int));
+	output_indices = (int *)malloc(num_pixels * sizeof(int));
+	reference_indices = (int *)malloc(num_pixels * sizeof(int));
+
+	srand(1);
+	for (i = 0; i < num_pixels * 4; ++i) {
+		input_image[i] = (unsigned char)rand();
+	}
+	image_sort(input_image, num_pixels, indices);
+
+	printf("%d x %d, best of %d\n", nx, ny, num_reps);
+
+	/* Transposes of each element size */
+	for (size_index = 0; size_index < 3; ++size_index) {
+		int size = sizes[size_index];
+
+		reference_time = time = 1e30;
+		for (r = 0; r < num_reps; ++r) {
+			start = clock();
+			reference_transpose_image(input_image, nx, ny, size, reference_image);
+			reference_time = MIN(reference_time, elapsed(start));
+
+			start = clock();
+			transpose_image(input_image, nx, ny, size, output_image);
+			time = MIN(time, elapsed(start));
+		}
+		printf("transpose_image, %d byte pixels: %.4f s, was %.4f s%s\n", size, time, reference_time,
+			memcmp(output_image, reference_image, (size_t)num_pixels * size) ? "  MISMATCH" : "");
+	}
+
+	/* Transposed indices */
+	reference_time = time = 1e30;
+	for (r = 0; r < num_reps; ++r) {
+		start = clock();
+		reference_transpose_indices(indices, nx, ny, reference_indices);
+		reference_time = MIN(reference_time, elapsed(start));
+
+		start = clock();
+		transpose_indices(indices, nx, ny, output_indices);
+		time = MIN(time, elapsed(start));
+	}
+	printf("transpose_indices: %.4f s, was %.4f s%s\n", time, reference_time,
+		memcmp(output_indices, reference_indices, num_pixels * sizeof(int)) ? "  MISMATCH" : "");
+
+	/* In-place flip: flipping twice restores the input */
+	memcpy(reference_image, input_image, num_pixels);
+	time = 1e30;
+	for (r = 0; r < num_reps; ++r) {
+		start = clock();
+		flip_image(reference_image, nx, ny, 1, reference_image);
+		time = MIN(time, elapsed(start));
+	}
+	if (num_reps % 2) flip_image(reference_image, nx, ny, 1, reference_image);
+	printf("flip_image in place: %.4f s%s\n", time,
+		memcmp(reference_image, input_image, num_pixels) ? "  MISMATCH" : "");
+
+	free((void *)input_image);
+	free((void *)output_image);
+	free((void *)reference_image);
+	free((void *)indices);
+	free((void *)output_indices);
+	free((void *)reference_indices);
+
+	return 0;
+}
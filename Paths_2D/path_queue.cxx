@@ -46,6 +46,9 @@ knowledge of the CeCILL-B license and that you accept its terms.
 
 #include "path_queue.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include <iostream>
 using namespace std;
 
@@ -55,23 +58,97 @@ Path_Queue::Path_Queue(
 	int row_max_length
 )
 {
-	int i;
-
 	this->num_gaps = num_gaps;
 	this->num_rows = num_rows;
 	this->row_max_length = row_max_length;
 
-	/* Set up the size of the path queue */
-	q.resize(num_gaps);
-	for (i = 0; i < num_gaps; ++i) {
-		q[i].resize(num_rows);
-	}
-	// Individual rows are a vector list implementation; nothing to do
+	/* Set up the size of the path queue: one fixed-capacity array per (gap, row) */
+	capacity = num_rows * row_max_length;
+	length_capacity = num_rows;
+	q = (PIXEL_INDEX_TYPE *)malloc((size_t)num_gaps * capacity * sizeof(PIXEL_INDEX_TYPE));
+	in_queue = (char *)malloc((size_t)num_gaps * capacity * sizeof(char));
+	length = (int *)malloc((size_t)num_gaps * length_capacity * sizeof(int));
+	num_pending = (int *)malloc((size_t)num_gaps * length_capacity * sizeof(int));
+	merge_buffer = (PIXEL_INDEX_TYPE *)malloc(row_max_length * sizeof(PIXEL_INDEX_TYPE));
+	cursor = 0;
+	num_merges = 0;
+	num_merged = 0;
+
+	/* All queues initially empty.  The flags are cleared as entries are visited, so stay clear. */
+	memset(in_queue, 0, (size_t)num_gaps * capacity * sizeof(char));
+	memset(length, 0, (size_t)num_gaps * length_capacity * sizeof(int));
+	memset(num_pending, 0, (size_t)num_gaps * length_capacity * sizeof(int));
 }
 
 Path_Queue::~Path_Queue()
 {
-	// Nothing to do
+	free((void *)q);
+	free((void *)in_queue);
+	free((void *)length);
+	free((void *)num_pending);
+	free((void *)merge_buffer);
+}
+
+/* reshape:
+	Change the row geometry of an empty queue, reallocating only if it no longer fits.
+*/
+void Path_Queue::reshape(
+	int num_rows,
+	int row_max_length
+)
+{
+	if (num_rows * row_max_length > capacity) {
+		capacity = num_rows * row_max_length;
+		free((void *)q);
+		free((void *)in_queue);
+		q = (PIXEL_INDEX_TYPE *)malloc((size_t)num_gaps * capacity * sizeof(PIXEL_INDEX_TYPE));
+		in_queue = (char *)malloc((size_t)num_gaps * capacity * sizeof(char));
+		memset(in_queue, 0, (size_t)num_gaps * capacity * sizeof(char));
+	}
+	if (num_rows > length_capacity) {
+		length_capacity = num_rows;
+		free((void *)length);
+		free((void *)num_pending);
+		length = (int *)malloc((size_t)num_gaps * length_capacity * sizeof(int));
+		num_pending = (int *)malloc((size_t)num_gaps * length_capacity * sizeof(int));
+	}
+	if (row_max_length > this->row_max_length) {
+		free((void *)merge_buffer);
+		merge_buffer = (PIXEL_INDEX_TYPE *)malloc(row_max_length * sizeof(PIXEL_INDEX_TYPE));
+	}
+
+	this->num_rows = num_rows;
+	this->row_max_length = row_max_length;
+
+	/* Queue is empty */
+	memset(length, 0, (size_t)num_gaps * num_rows * sizeof(int));
+	memset(num_pending, 0, num_gaps * num_rows * sizeof(int));
+}
+
+/* commit:
+	Merge the entries inserted after the end of queue (k, r) into it.
+	They are usually ascending already, and are sorted first if not.
+*/
+void Path_Queue::commit(
+	int k,								// Gap number
+	int r								// Row number
+)
+{
+	int i;
+	int & num_pending = this->num_pending[r + num_rows * k];
+	if (num_pending == 0) return;
+
+	PIXEL_INDEX_TYPE * pending = row(k, r) + row_length(k, r);
+	memcpy(merge_buffer, pending, num_pending * sizeof(PIXEL_INDEX_TYPE));
+	for (i = 1; i < num_pending; ++i) {
+		if (merge_buffer[i] < merge_buffer[i - 1]) {
+			sort(merge_buffer, merge_buffer + num_pending);
+			break;
+		}
+	}
+
+	merge_row(merge_buffer, num_pending, k, r);
+	num_pending = 0;
 }
 
 /* merge_row:
@@ -79,61 +156,89 @@ Path_Queue::~Path_Queue()
 	Maintains ascending order.
 */
 void Path_Queue::merge_row(
-	vector<PIXEL_INDEX_TYPE> row,		// Assumed non-empty for efficiency
+	const PIXEL_INDEX_TYPE * row,		// Sorted ascending
+	int row_size,						// Assumed non-empty for efficiency
 	int k,								// Gap number
 	int r								// Row number
 )
 {
-	vector<PIXEL_INDEX_TYPE> & old_row = this->q[k][r];
+	PIXEL_INDEX_TYPE * old_row = this->row(k, r);
+	int & old_row_size = this->row_length(k, r);
+
+#ifdef PATHOPEN_STATS
+	++num_merges;
+	num_merged += row_size;
+#endif
 
 	/*  Shortcut */
-	if (old_row.size() == 0) {
-		old_row = row;
+	if (old_row_size == 0) {
+		memcpy(old_row, row, row_size * sizeof(PIXEL_INDEX_TYPE));
+		old_row_size = row_size;
 		return;
 	}
 
-	vector<PIXEL_INDEX_TYPE> new_row;		// Initially empty
-
-	/* DEBUGGING */
-	/*
-	this->print_state();
-	int j;
-	for (j = 0; j < row.size(); ++j) {
-		cout << row[j] << ", ";
+	/* Without duplicates the merged row always fits.  Otherwise count them first, so that
+		the merge below never writes past the end of this row. */
+	int num_duplicates = 0;
+	if (old_row_size + row_size > row_max_length) {
+		int old_row_index, row_index;
+		for (old_row_index = 0, row_index = 0; old_row_index < old_row_size && row_index < row_size; ) {
+			if (old_row[old_row_index] < row[row_index]) {
+				++old_row_index;
+			} else if (row[row_index] < old_row[old_row_index]) {
+				++row_index;
+			} else {
+				++num_duplicates;
+				++old_row_index;
+				++row_index;
+			}
+		}
 	}
-	cout << endl;
-	*/
-	/*************/
 
-	/* Merge row and old_row into new_row
-		- consumes them in competition
-		- uses sentinels to detect end of row
+	/* Merge row into old_row, in place
+		- consumes both rows from the back in competition, filling old_row from its end
+		- equal entries are written once; any uncounted duplicates leave a hole, closed afterwards
 	*/
-	int old_row_index;
-	int row_index;
-	int old_row_size = old_row.size();
-	int row_size = row.size();
-	// Append sentinels
-	row.push_back(PIXEL_INDEX_TYPE_MAX);
-	old_row.push_back(PIXEL_INDEX_TYPE_MAX);
-	for (
-		old_row_index = 0, row_index = 0; 
-		old_row_index < old_row_size || row_index < row_size;		// Halt when both rows are consumed
-
-	) {
-		if (old_row[old_row_index] < row[row_index]) {
-			new_row.push_back(old_row[old_row_index]);
-			++old_row_index;
+	int old_row_index = old_row_size - 1;
+	int row_index = row_size - 1;
+	int new_row_index = old_row_size + row_size - num_duplicates - 1;
+
+	while (row_index >= 0) {
+		if (old_row_index >= 0 && old_row[old_row_index] >= row[row_index]) {
+			if (old_row[old_row_index] == row[row_index]) {
+				// Duplicate: drop the incoming copy
+				--row_index;
+			}
+			old_row[new_row_index--] = old_row[old_row_index--];
 		} else {
-			new_row.push_back(row[row_index]);
-			++row_index;
+			old_row[new_row_index--] = row[row_index--];
 		}
 	}
-	// Remove the sentinel from 'row'
-	row.pop_back();
 
-	// Replace the old row by the new row
-	old_row = new_row;
+	/* Any remaining old entries are already in place, unless uncounted duplicates left a hole */
+	int num_holes = new_row_index - old_row_index;
+	if (num_holes > 0) {
+		memmove(
+			old_row + old_row_index + 1,
+			old_row + new_row_index + 1,
+			(old_row_size + row_size - num_duplicates - 1 - new_row_index) * sizeof(PIXEL_INDEX_TYPE)
+		);
+	}
+	old_row_size += row_size - num_duplicates - num_holes;
+}
+
+/* memory_size:
+	Bytes allocated by a queue of the given geometry
+*/
+size_t Path_Queue::memory_size(
+	int num_gaps,
+	int num_rows,
+	int row_max_length
+)
+{
+	return (size_t)num_gaps * num_rows * row_max_length * (sizeof(PIXEL_INDEX_TYPE) + sizeof(char))
+		+ (size_t)num_gaps * num_rows * 2 * sizeof(int)
+		+ (size_t)row_max_length * sizeof(PIXEL_INDEX_TYPE);
 }
 
 /* print_state:
@@ -145,8 +250,8 @@ void Path_Queue::print_state() {
 	cout << "print_state:" << endl;
 	for (k = 0; k < num_gaps; ++k) {
 		for (r = 0; r < num_rows; ++r) {
-			vector<PIXEL_INDEX_TYPE> & row = q[k][r];
-			int length = row.size();
+			PIXEL_INDEX_TYPE * row = this->row(k, r);
+			int length = this->row_length(k, r);
 			if (length > 0) {
 				cout << "(" << k << ", " << r << "): ";
 				for (i = 0; i < length; ++i) {
@@ -158,3 +263,100 @@ void Path_Queue::print_state() {
 		}
 	}
 }
+
+
+Path_Queue_Bitset::Path_Queue_Bitset(
+	int num_gaps,
+	int num_rows,
+	int row_max_length
+)
+{
+	this->num_gaps = num_gaps;
+	this->num_rows = num_rows;
+	this->row_max_length = row_max_length;
+
+	/* One bit per column, rounded up to whole words per (gap, row) */
+	row_words = (row_max_length + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS;
+	capacity = num_rows * row_words;
+	length_capacity = num_rows;
+	bits = (BITSET_WORD_TYPE *)malloc((size_t)num_gaps * capacity * sizeof(BITSET_WORD_TYPE));
+	length = (int *)malloc((size_t)num_gaps * length_capacity * sizeof(int));
+	num_merges = 0;
+	num_merged = 0;
+
+	/* All queues initially empty.  Bits are cleared as they are visited, so stay clear. */
+	memset(bits, 0, (size_t)num_gaps * capacity * sizeof(BITSET_WORD_TYPE));
+	memset(length, 0, (size_t)num_gaps * length_capacity * sizeof(int));
+}
+
+Path_Queue_Bitset::~Path_Queue_Bitset()
+{
+	free((void *)bits);
+	free((void *)length);
+}
+
+/* reshape:
+	Change the row geometry of an empty queue, reallocating only if it no longer fits.
+*/
+void Path_Queue_Bitset::reshape(
+	int num_rows,
+	int row_max_length
+)
+{
+	int row_words = (row_max_length + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS;
+
+	if (num_rows * row_words > capacity) {
+		capacity = num_rows * row_words;
+		free((void *)bits);
+		bits = (BITSET_WORD_TYPE *)malloc((size_t)num_gaps * capacity * sizeof(BITSET_WORD_TYPE));
+		memset(bits, 0, (size_t)num_gaps * capacity * sizeof(BITSET_WORD_TYPE));
+	}
+	if (num_rows > length_capacity) {
+		length_capacity = num_rows;
+		free((void *)length);
+		length = (int *)malloc((size_t)num_gaps * length_capacity * sizeof(int));
+	}
+
+	this->num_rows = num_rows;
+	this->row_max_length = row_max_length;
+	this->row_words = row_words;
+
+	/* Queue is empty */
+	memset(length, 0, (size_t)num_gaps * num_rows * sizeof(int));
+}
+
+/* memory_size:
+	Bytes allocated by a queue of the given geometry
+*/
+size_t Path_Queue_Bitset::memory_size(
+	int num_gaps,
+	int num_rows,
+	int row_max_length
+)
+{
+	int row_words = (row_max_length + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS;
+
+	return (size_t)num_gaps * num_rows * row_words * sizeof(BITSET_WORD_TYPE)
+		+ (size_t)num_gaps * num_rows * sizeof(int);
+}
+
+/* print_state:
+	Debugging function - dumps the internal state
+*/
+void Path_Queue_Bitset::print_state() {
+	int k, r, x;
+
+	cout << "print_state:" << endl;
+	for (k = 0; k < num_gaps; ++k) {
+		for (r = 0; r < num_rows; ++r) {
+			if (!empty(k, r)) {
+				cout << "(" << k << ", " << r << "): ";
+				for (x = first(k, r); x >= 0; x = next(k, r, x + 1)) {
+					cout << x;
+					if (next(k, r, x + 1) >= 0) cout << ", ";
+				}
+				cout << endl;
+			}
+		}
+	}
+}
@@ -43,12 +43,16 @@ The fact that you are presently reading this means that you have had
 knowledge of the CeCILL-B license and that you accept its terms.
 
 */
-
- 
-
 /*		Notes:
- *			- Does not account for duplicates (handle outside)
- *			- Expects and maintains ascending order
+ *			- Two implementations of the same interface: sorted arrays (Path_Queue) and
+ *			  bitsets (Path_Queue_Bitset).  pathopen.h selects one for the kernels.
+ *			- Both hold the queue membership flags, so insertion never creates duplicates
+ *			- Rows are visited in ascending (first/next) or descending (last/prev) order
+ *			- Path_Queue: each (gap, row) queue is a fixed-capacity array of row_max_length
+ *			  entries inside one contiguous buffer, so merging never touches the heap.
+ *			  Insertions are appended past the end of the row and merged in by commit().
+ *			- Path_Queue_Bitset: one bit per (gap, row, column), so the bitset is both the
+ *			  queue and its flags, is always sorted, and commit() has nothing to do.
  */
 
 #ifndef PATH_QUEUE_H
@@ -67,6 +71,11 @@ typedef unsigned char PIXEL_TYPE;
 static const int PIXEL_TYPE_MIN = 0;
 static const int PIXEL_TYPE_MAX = 255;
 
+// The word type of the bitset queues
+typedef unsigned long long BITSET_WORD_TYPE;
+static const int BITSET_WORD_BITS = 64;
+static const int BITSET_WORD_SHIFT = 6;				// log2(BITSET_WORD_BITS)
+
 class Path_Queue {
 public:
 	/* Data */
@@ -74,7 +83,16 @@ public:
 	int num_gaps;
 	int num_rows;
 	int row_max_length;
-	vector< vector< vector< PIXEL_INDEX_TYPE > > > q;
+	int capacity;							// Allocated entries per gap
+	int length_capacity;					// Allocated lengths per gap
+	PIXEL_INDEX_TYPE * q;					// Queue (k, r) starts at q + row_max_length * (r + num_rows * k)
+	int * length;							// Length of queue (k, r) is length[r + num_rows * k]
+	int * num_pending;						// Entries inserted after the end of queue (k, r), not yet merged
+	char * in_queue;						// Flag of column x in queue (k, r) is in_queue[x + row_max_length * (r + num_rows * k)]
+	PIXEL_INDEX_TYPE * merge_buffer;		// Pending entries being merged, row_max_length entries
+	int cursor;								// Position of the row iteration (first/next, last/prev)
+	long long num_merges;					// merge_row() calls, counted if PATHOPEN_STATS is defined
+	long long num_merged;					// Entries they merged in
 
 	/* Methods */
 	Path_Queue(
@@ -85,22 +103,294 @@ public:
 
 	~Path_Queue();
 
-	/* merge_row:
-		Merge the given list of indices with the queue for the specified row.
-		NOTE: This is the only means of insertion; 
-			this is to emphasise that insertion of single elements is slow!
+	/* reshape:
+		Change the row geometry, reallocating only if it outgrows the current buffers.
+		The queue must be empty.
+	*/
+	void reshape(
+		int num_rows,
+		int row_max_length
+	);
+
+	/* memory_size:
+		Bytes allocated by a queue of this geometry, for budgeting before constructing one
+	*/
+	static size_t memory_size(
+		int num_gaps,
+		int num_rows,
+		int row_max_length
+	);
+
+	/* row, row_length:
+		Direct access to the queue for gap number k and row r
+	*/
+	inline PIXEL_INDEX_TYPE * row(int k, int r) {
+		return q + row_max_length * (r + num_rows * k);
+	}
+	inline int & row_length(int k, int r) {
+		return length[r + num_rows * k];
+	}
+
+	/* empty, contains:
+		Is queue (k, r) empty?  Is column x in it, or pending for it?
+	*/
+	inline bool empty(int k, int r) {
+		return length[r + num_rows * k] == 0;
+	}
+	inline bool contains(int k, int r, int x) {
+		return in_queue[x + row_max_length * (r + num_rows * k)] != 0;
+	}
+
+	/* insert, commit:
+		Queue column x in row r for gap number k, unless it is already queued.
+		Insertions into a row may come in any order, and become visible once it is committed.
+	*/
+	inline void insert(int k, int r, int x) {
+		char & flag = in_queue[x + row_max_length * (r + num_rows * k)];
+		if (!flag) {
+			flag = 1;
+			row(k, r)[length[r + num_rows * k] + num_pending[r + num_rows * k]++] = x;
+		}
+	}
+	void commit(
+		int k,
+		int r
+	);
+
+	/* mark, remove:
+		Set or clear the flag of column x only.  mark() is for a column that the caller
+		will visit straight away, while walking along the row being visited.
+		Only queued or marked columns may be removed.
+	*/
+	inline void mark(int k, int r, int x) {
+		in_queue[x + row_max_length * (r + num_rows * k)] = 1;
+	}
+	inline void remove(int k, int r, int x) {
+		in_queue[x + row_max_length * (r + num_rows * k)] = 0;
+	}
 
+	/* first, next, last, prev:
+		Visit queue (k, r) in ascending or descending order: the first queued column >= x,
+		or the last queued column <= x, or -1 if there is none.  One row at a time.
+	*/
+	inline int first(int k, int r) {
+		cursor = 0;
+		return length[r + num_rows * k] > 0 ? row(k, r)[0] : -1;
+	}
+	inline int next(int k, int r, int x) {
+		PIXEL_INDEX_TYPE * row = this->row(k, r);
+		int length = this->length[r + num_rows * k];
+		while (cursor < length && row[cursor] < x) ++cursor;
+		return cursor < length ? row[cursor] : -1;
+	}
+	inline int last(int k, int r) {
+		cursor = length[r + num_rows * k] - 1;
+		return cursor >= 0 ? row(k, r)[cursor] : -1;
+	}
+	inline int prev(int k, int r, int x) {
+		PIXEL_INDEX_TYPE * row = this->row(k, r);
+		while (cursor >= 0 && row[cursor] > x) --cursor;
+		return cursor >= 0 ? row[cursor] : -1;
+	}
+
+	/* clear_row:
+		Empty queue (k, r) once all its entries have been visited and removed
+	*/
+	inline void clear_row(int k, int r) {
+		length[r + num_rows * k] = 0;
+	}
+
+	/* merge_row:
+		Merge the given sorted list of indices with the queue for the specified row, in place.
+		Does not set the in_queue flags: for use by commit(), or on its own without them.
 	*/
 	void merge_row(
-		vector<PIXEL_INDEX_TYPE> row,
+		const PIXEL_INDEX_TYPE * row,
+		int row_size,
 		int k,
 		int r
 	);
 
+	inline void merge_row(
+		const vector<PIXEL_INDEX_TYPE> & row,
+		int k,
+		int r
+	) {
+		if (row.size() > 0) merge_row(&row[0], (int)row.size(), k, r);
+	}
+
+	/* print_state:
+		Debugging function - dumps the internal state
+	*/
+	void print_state();
+
+private:
+	/* Not copyable: owns its buffers */
+	Path_Queue(const Path_Queue &);
+	Path_Queue & operator=(const Path_Queue &);
+};
+
+/* lowest_bit, highest_bit:
+	Position of the lowest or highest set bit of a non-zero word
+*/
+static inline int lowest_bit(BITSET_WORD_TYPE word) {
+#ifdef __GNUC__
+	return __builtin_ctzll(word);
+#else
+	int b = 0;
+	while (!(word & 1)) {
+		word >>= 1;
+		++b;
+	}
+	return b;
+#endif
+}
+
+static inline int highest_bit(BITSET_WORD_TYPE word) {
+#ifdef __GNUC__
+	return BITSET_WORD_BITS - 1 - __builtin_clzll(word);
+#else
+	int b = BITSET_WORD_BITS - 1;
+	while (!(word >> b)) --b;
+	return b;
+#endif
+}
+
+class Path_Queue_Bitset {
+public:
+	/* Data */
+	int num_gaps;
+	int num_rows;
+	int row_max_length;
+	int row_words;							// Words per row
+	int capacity;							// Allocated words per gap
+	int length_capacity;					// Allocated lengths per gap
+	BITSET_WORD_TYPE * bits;				// Queue (k, r) starts at bits + row_words * (r + num_rows * k)
+	int * length;							// Number of columns in queue (k, r) is length[r + num_rows * k]
+	long long num_merges;					// Always zero, as nothing is merged: as for Path_Queue
+	long long num_merged;
+
+	/* Methods */
+	Path_Queue_Bitset(
+		int num_gaps,
+		int num_rows,
+		int row_max_length
+	);
+
+	~Path_Queue_Bitset();
+
+	/* reshape:
+		Change the row geometry, reallocating only if it outgrows the current buffers.
+		The queue must be empty.
+	*/
+	void reshape(
+		int num_rows,
+		int row_max_length
+	);
+
+	/* memory_size:
+		Bytes allocated by a queue of this geometry, for budgeting before constructing one
+	*/
+	static size_t memory_size(
+		int num_gaps,
+		int num_rows,
+		int row_max_length
+	);
+
+	/* row, row_length:
+		Direct access to the queue for gap number k and row r
+	*/
+	inline BITSET_WORD_TYPE * row(int k, int r) {
+		return bits + row_words * (r + num_rows * k);
+	}
+	inline int & row_length(int k, int r) {
+		return length[r + num_rows * k];
+	}
+
+	/* empty, contains:
+		As for Path_Queue
+	*/
+	inline bool empty(int k, int r) {
+		return length[r + num_rows * k] == 0;
+	}
+	inline bool contains(int k, int r, int x) {
+		return (row(k, r)[x >> BITSET_WORD_SHIFT] >> (x & (BITSET_WORD_BITS - 1))) & 1;
+	}
+
+	/* insert, commit, mark, remove:
+		As for Path_Queue.  Insertion sets the bit, in any order, so commit() is a no-op.
+	*/
+	inline void insert(int k, int r, int x) {
+		BITSET_WORD_TYPE & word = row(k, r)[x >> BITSET_WORD_SHIFT];
+		BITSET_WORD_TYPE bit = (BITSET_WORD_TYPE)1 << (x & (BITSET_WORD_BITS - 1));
+		if (!(word & bit)) {
+			word |= bit;
+			++length[r + num_rows * k];
+		}
+	}
+	inline void commit(int k, int r) {
+	}
+	inline void mark(int k, int r, int x) {
+		insert(k, r, x);
+	}
+	inline void remove(int k, int r, int x) {
+		row(k, r)[x >> BITSET_WORD_SHIFT] &= ~((BITSET_WORD_TYPE)1 << (x & (BITSET_WORD_BITS - 1)));
+		--length[r + num_rows * k];
+	}
+
+	/* first, next, last, prev:
+		As for Path_Queue, scanning words for the next set bit
+	*/
+	inline int first(int k, int r) {
+		return next(k, r, 0);
+	}
+	inline int next(int k, int r, int x) {
+		if (x >= row_max_length) return -1;
+		BITSET_WORD_TYPE * row = this->row(k, r);
+		int w = x >> BITSET_WORD_SHIFT;
+		BITSET_WORD_TYPE word = row[w] & (~(BITSET_WORD_TYPE)0 << (x & (BITSET_WORD_BITS - 1)));
+		while (!word) {
+			if (++w >= row_words) return -1;
+			word = row[w];
+		}
+		return w * BITSET_WORD_BITS + lowest_bit(word);
+	}
+	inline int last(int k, int r) {
+		return prev(k, r, row_max_length - 1);
+	}
+	inline int prev(int k, int r, int x) {
+		if (x < 0) return -1;
+		BITSET_WORD_TYPE * row = this->row(k, r);
+		int w = x >> BITSET_WORD_SHIFT;
+		BITSET_WORD_TYPE word = row[w] & (~(BITSET_WORD_TYPE)0 >> (BITSET_WORD_BITS - 1 - (x & (BITSET_WORD_BITS - 1))));
+		while (!word) {
+			if (--w < 0) return -1;
+			word = row[w];
+		}
+		return w * BITSET_WORD_BITS + highest_bit(word);
+	}
+
+	/* clear_row:
+		Empty queue (k, r).  Visiting removes every bit, so usually there is nothing to clear.
+	*/
+	inline void clear_row(int k, int r) {
+		if (length[r + num_rows * k] != 0) {
+			int w;
+			BITSET_WORD_TYPE * row = this->row(k, r);
+			for (w = 0; w < row_words; ++w) row[w] = 0;
+			length[r + num_rows * k] = 0;
+		}
+	}
+
 	/* print_state:
 		Debugging function - dumps the internal state
 	*/
 	void print_state();
+
+private:
+	/* Not copyable: owns its buffers */
+	Path_Queue_Bitset(const Path_Queue_Bitset &);
+	Path_Queue_Bitset & operator=(const Path_Queue_Bitset &);
 };
 
 #endif
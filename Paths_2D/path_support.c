@@ -127,28 +127,15 @@ void add_point(
 
 	/* Check if we need to allocate more memory */
 	if (this_struct->length == this_struct->allocated_length) {
-		PATH_GRANULOMETRY * new_struct;
-
-		/* Construct a new structure with the same length but twice the allocated memory */
-		new_struct = PATH_GRANULOMETRY_constructor(this_struct->length);
-
-		/* Copy the data across from old to new */
-		memcpy(new_struct->path_length, this_struct->path_length, this_struct->length * sizeof(int));
-		memcpy(new_struct->threshold, this_struct->threshold, this_struct->length * sizeof(GPOT_PIX_TYPE));
-		this_struct->length = new_struct->length;
-		this_struct->allocated_length = new_struct->allocated_length;
-
-		/* Now swap internal arrays, gutting the new_struct object, and delete the old structure */
-		{
-			void * swap = this_struct->buf;
-			this_struct->buf = new_struct->buf;
-			free((void *)swap);
-		}
-		this_struct->path_length = new_struct->path_length;
-		this_struct->threshold = new_struct->threshold;
-		
-		/* Clean up by deleting the skeleton of the new structure */
-		free((void *)new_struct);
+		int allocated_length = this_struct->allocated_length * 2;
+
+		/* Grow the pool in place where possible, then slide the thresholds up behind the
+		 * enlarged path_length array */
+		this_struct->buf = (unsigned char *)realloc((void *)this_struct->buf, allocated_length * (sizeof(int) + sizeof(GPOT_PIX_TYPE)));
+		this_struct->path_length = (int *)this_struct->buf;
+		this_struct->threshold = (GPOT_PIX_TYPE *)(this_struct->buf + allocated_length * sizeof(int));
+		memmove(this_struct->threshold, this_struct->buf + this_struct->allocated_length * sizeof(int), this_struct->length * sizeof(GPOT_PIX_TYPE));
+		this_struct->allocated_length = allocated_length;
 	}
 }
 
@@ -160,23 +147,22 @@ GPOT_PIX_TYPE path_length_to_threshold(
 	PATH_GRANULOMETRY * this_struct			/* The 'this' pointer */
 )
 {
-	int i;
-	GPOT_PIX_TYPE value;
-
-	if (this_struct->length == 0) {
-		return (GPOT_PIX_TYPE)0;
+	int low, high, middle;
+
+	/* Granulometric curves are stored in order of increasing threshold, decreasing path length:
+	 * bisect for the first point shorter than path_length, the answer being the one before */
+	low = 0;
+	high = this_struct->length;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (this_struct->path_length[middle] < path_length) high = middle;
+		else low = middle + 1;
 	}
 
-	/* Granulometric curves are stored in order of increasing threshold, decreasing path length */
-	value = 0;
-	for (i = 0; i < this_struct->length; ++i) {
-		/* Once we find the correct segment of the granulometric curve, halt */
-		if (this_struct->path_length[i] < path_length) break;
-
-		value = this_struct->threshold[i];
+	if (low == 0) {
+		return (GPOT_PIX_TYPE)0;
 	}
-
-	return value;
+	return this_struct->threshold[low - 1];
 }
 
 /* - threshold_to_path_length:
@@ -187,23 +173,23 @@ int threshold_to_path_length(
 	PATH_GRANULOMETRY * this_struct			/* The 'this' pointer */
 )
 {
-	int i;
-	int path_length;
+	int low, high, middle;
 
 	if (this_struct->length == 0) {
 		return (int)0;
 	}
 
-	/* Granulometric curves are stored in order of increasing threshold */
-	path_length = 0;
-	for (i = 0; i < this_struct->length; ++i) {
-		path_length = this_struct->path_length[i];
-
-		/* Once we find the correct segment of the granulometric curve, halt */
-		if (this_struct->threshold[i] > threshold) break;
+	/* Granulometric curves are stored in order of increasing threshold: bisect for the first
+	 * point above threshold, or failing that take the last point */
+	low = 0;
+	high = this_struct->length - 1;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (this_struct->threshold[middle] > threshold) high = middle;
+		else low = middle + 1;
 	}
 
-	return path_length;
+	return this_struct->path_length[low];
 }
 
 /* - PATH_GRANULOMETRY_print:
@@ -229,16 +215,32 @@ PATH_GRANULOMETRY * merge(
 	PATH_GRANULOMETRY * input_struct_a,			/* Structure to merge, "A" */
 	PATH_GRANULOMETRY * input_struct_b			/* Structure to merge, "B" */
 )
+{
+	PATH_GRANULOMETRY * this_struct;
+
+	/* Allocate structure which will be returned.  Initially empty */
+	this_struct = PATH_GRANULOMETRY_constructor(0);
+
+	merge_into(input_struct_a, input_struct_b, this_struct);
+
+	return this_struct;
+}
+
+/* - merge_into:
+ * Merge two granulometric curves into a third, empty one, so that a caller merging many
+ * curves may recycle the output structure.
+ */
+void merge_into(
+	PATH_GRANULOMETRY * input_struct_a,			/* Structure to merge, "A" */
+	PATH_GRANULOMETRY * input_struct_b,			/* Structure to merge, "B" */
+	PATH_GRANULOMETRY * this_struct				/* The empty output */
+)
 {
 	int i;
 	int index_a, index_b, index_output;
 	int cur_path_length;
 	int num_points;
 	int cur_threshold;		/* This is slightly naughty (GPOT_PIX_TYPE could be float), but gets around more serious problems */
-	PATH_GRANULOMETRY * this_struct;
-
-	/* Allocate structure which will be returned.  Initially empty */
-	this_struct = PATH_GRANULOMETRY_constructor(0);
 
 	/* A conceptual algorithm to merge the two lists:
 	 * Put all points from both lists into the one list
@@ -288,10 +290,134 @@ PATH_GRANULOMETRY * merge(
 			}
 		}
 	}
+}
+
+/************************** PATH_GRANULOMETRY_IMAGE IMPLEMENTATIONS *****************************/
+/* - PATH_GRANULOMETRY_IMAGE_constructor:
+ * Construct storage for the given number of curves and points in total, or return NULL.
+ */
+PATH_GRANULOMETRY_IMAGE * PATH_GRANULOMETRY_IMAGE_constructor(
+	int num_pixels,
+	size_t num_points
+)
+{
+	PATH_GRANULOMETRY_IMAGE * this_struct;
+
+	/* Allocate memory for the structure itself */
+	this_struct = (PATH_GRANULOMETRY_IMAGE *)malloc(sizeof(PATH_GRANULOMETRY_IMAGE));
+	if (this_struct == NULL) return NULL;
+
+	this_struct->num_pixels = num_pixels;
+	this_struct->num_points = num_points;
+	this_struct->minimum = (GPOT_PIX_TYPE)0;
+
+	/* Keep all three arrays (offsets, path_length, threshold) inside single larger array */
+	this_struct->buf = (unsigned char *)malloc(((size_t)num_pixels + 1) * sizeof(size_t) + num_points * (sizeof(int) + sizeof(GPOT_PIX_TYPE)));
+	if (this_struct->buf == NULL) {
+		free((void *)this_struct);
+		return NULL;
+	}
+	this_struct->offsets = (size_t *)this_struct->buf;
+	this_struct->path_length = (int *)(this_struct->offsets + num_pixels + 1);
+	this_struct->threshold = (GPOT_PIX_TYPE *)(this_struct->path_length + num_points);
+
+	return this_struct;
+}
+
+/* - PATH_GRANULOMETRY_IMAGE_destructor:
+ * Deallocate internal memory and object memory
+ */
+void PATH_GRANULOMETRY_IMAGE_destructor(
+	PATH_GRANULOMETRY_IMAGE * this_struct
+)
+{
+	free((void *)this_struct->buf);
+	free((void *)this_struct);
+}
+
+/* - PATH_GRANULOMETRY_IMAGE_pack:
+ * Pack separately allocated curves, one per pixel, into a new PATH_GRANULOMETRY_IMAGE
+ */
+PATH_GRANULOMETRY_IMAGE * PATH_GRANULOMETRY_IMAGE_pack(
+	PATH_GRANULOMETRY * * curves,			/* The curve of each pixel */
+	int num_pixels
+)
+{
+	int i;
+	size_t num_points;
+	PATH_GRANULOMETRY_IMAGE * this_struct;
+
+	num_points = 0;
+	for (i = 0; i < num_pixels; ++i) {
+		num_points += curves[i]->length;
+	}
+
+	this_struct = PATH_GRANULOMETRY_IMAGE_constructor(num_pixels, num_points);
+	if (this_struct == NULL) return NULL;
+	this_struct->offsets[0] = 0;
+	for (i = 0; i < num_pixels; ++i) {
+		size_t offset = this_struct->offsets[i];
+
+		memcpy(this_struct->path_length + offset, curves[i]->path_length, curves[i]->length * sizeof(int));
+		memcpy(this_struct->threshold + offset, curves[i]->threshold, curves[i]->length * sizeof(GPOT_PIX_TYPE));
+		this_struct->offsets[i + 1] = offset + curves[i]->length;
+	}
 
 	return this_struct;
 }
 
+/* - PATH_GRANULOMETRY_IMAGE_curve:
+ * Make a PATH_GRANULOMETRY view of the curve of one pixel, pointing into the pool.  The view
+ * may be read, printed and queried, but not grown, merged from or destructed.
+ */
+void PATH_GRANULOMETRY_IMAGE_curve(
+	int pixel_index,						/* The pixel */
+	PATH_GRANULOMETRY_IMAGE * this_struct,	/* The 'this' pointer */
+	PATH_GRANULOMETRY * curve				/* The view to fill */
+)
+{
+	size_t offset = this_struct->offsets[pixel_index];
+
+	curve->length = (int)(this_struct->offsets[pixel_index + 1] - offset);
+	curve->allocated_length = curve->length;
+	curve->buf = NULL;
+	curve->path_length = this_struct->path_length + offset;
+	curve->threshold = this_struct->threshold + offset;
+}
+
+/* - pixel_path_length_to_threshold:
+ * Given a specified path length, determine the corresponding threshold in the granulometric curve
+ * of one pixel.  With no point that long, this is the image minimum, not 0
+ */
+GPOT_PIX_TYPE pixel_path_length_to_threshold(
+	int pixel_index,						/* The pixel */
+	int path_length,						/* The desired path length */
+	PATH_GRANULOMETRY_IMAGE * this_struct	/* The 'this' pointer */
+)
+{
+	PATH_GRANULOMETRY curve;
+
+	PATH_GRANULOMETRY_IMAGE_curve(pixel_index, this_struct, &curve);
+
+	return MAX(path_length_to_threshold(path_length, &curve), this_struct->minimum);
+}
+
+/* - pixel_threshold_to_path_length:
+ * Given a specified grayscale threshold, determine the corresponding path length in the
+ * granulometric curve of one pixel
+ */
+int pixel_threshold_to_path_length(
+	int pixel_index,						/* The pixel */
+	GPOT_PIX_TYPE threshold,				/* The desired grayscale threshold */
+	PATH_GRANULOMETRY_IMAGE * this_struct	/* The 'this' pointer */
+)
+{
+	PATH_GRANULOMETRY curve;
+
+	PATH_GRANULOMETRY_IMAGE_curve(pixel_index, this_struct, &curve);
+
+	return threshold_to_path_length(threshold, &curve);
+}
 
 /****************************** UTILITY FUNCTION IMPLEMENTATIONS ***********************************/
 /* Compare two pointers to image pixels (sorts ascending) */
@@ -377,6 +503,70 @@ void image_sort(
 }
 
 
+/* Side of the square tiles transposed at a time: two tiles of 32 * 32 pixels fit in L1 */
+#define TRANSPOSE_TILE 32
+
+/* Transpose rows [y_begin, y_end) tile by tile, for an element type TYPE */
+#define TRANSPOSE_TILES(TYPE) \
+	for (y0 = y_begin; y0 < y_end; y0 += TRANSPOSE_TILE) { \
+		int y1 = MIN(y0 + TRANSPOSE_TILE, y_end); \
+		for (x0 = 0; x0 < nx; x0 += TRANSPOSE_TILE) { \
+			int x1 = MIN(x0 + TRANSPOSE_TILE, nx); \
+			for (x = x0; x < x1; ++x) { \
+				const TYPE * in = (const TYPE *)input_image + x; \
+				TYPE * out = (TYPE *)output_image + (size_t)ny * x; \
+				for (y = y0; y < y1; ++y) { \
+					out[y] = in[(size_t)nx * y]; \
+				} \
+			} \
+		} \
+	}
+
+/* - transpose_image_rows:
+	Transpose input rows [y_begin, y_end) into output columns [y_begin, y_end).  Out of
+	place only.  Disjoint row ranges may be transposed concurrently.
+*/
+void transpose_image_rows(
+	void * input_image,
+	int nx, int ny,
+	int num_bytes_per_element,
+	void * output_image,
+	int y_begin, int y_end
+)
+{
+	int x, y, x0, y0;
+
+	switch(num_bytes_per_element) {
+		case 1:
+			TRANSPOSE_TILES(unsigned char)
+			break;
+		case 2:
+			TRANSPOSE_TILES(unsigned short)
+			break;
+		case 4:
+			TRANSPOSE_TILES(unsigned int)
+			break;
+		default:
+			for (y0 = y_begin; y0 < y_end; y0 += TRANSPOSE_TILE) {
+				int y1 = MIN(y0 + TRANSPOSE_TILE, y_end);
+				for (x0 = 0; x0 < nx; x0 += TRANSPOSE_TILE) {
+					int x1 = MIN(x0 + TRANSPOSE_TILE, nx);
+					for (x = x0; x < x1; ++x) {
+						for (y = y0; y < y1; ++y) {
+							memcpy(
+								(unsigned char *)output_image + ((size_t)ny * x + y) * num_bytes_per_element,
+								(unsigned char *)input_image + ((size_t)nx * y + x) * num_bytes_per_element,
+								num_bytes_per_element
+							);
+						}
+					}
+				}
+			}
+			break;
+	}
+}
+
+
 /*
 	Transpose an image, possibly 'in place'
 */
@@ -389,7 +579,7 @@ void transpose_image(
 {
 	char in_place;
 	void * temporary_image;
-	int i, num_pixels;
+	int num_pixels;
 
 	num_pixels = nx * ny;
 
@@ -403,79 +593,42 @@ void transpose_image(
 	}
 
 	/* Transpose from input image to temporary image */
-	/* Templates would be nifty here! */
-#ifdef GPOT_USE_MEMCPY
-	for (i = 0; i < num_pixels; ++i) {
-		int x, y, new_index;
+	transpose_image_rows(input_image, nx, ny, num_bytes_per_element, temporary_image, 0, ny);
 
-		/* Compute destination address */
-		x = i % nx;
-		y = i / nx;
-		new_index = y + ny * x;
-
-		memcpy(temporary_image + new_index * num_bytes_per_element, input_image + i * num_bytes_per_element, num_bytes_per_element);
+	/* Free memory */
+	if (in_place) {
+		memcpy(output_image, temporary_image, num_pixels * num_bytes_per_element);
+		free((void *)temporary_image);
 	}
-#else
-	switch(num_bytes_per_element) {
-		case 1:
-			for (i = 0; i < num_pixels; ++i) {
-				int x, y, new_index;
-
-				/* Compute destination address */
-				x = i % nx;
-				y = i / nx;
-				new_index = y + ny * x;
+}
 
-				((char *)temporary_image)[new_index] = ((char *)input_image)[i];
-			}
-			break;
-		case 2:
-			for (i = 0; i < num_pixels; ++i) {
-				int x, y, new_index;
 
-				/* Compute destination address */
-				x = i % nx;
-				y = i / nx;
-				new_index = y + ny * x;
+/* - transpose_indices_range:
+	Transform the pixel indices in [i_begin, i_end) of an array according to a
+	transposition.  Doesn't care about in-place/out-of-place.
+*/
+void transpose_indices_range(
+	int * input_indices,
+	int nx, int ny,
+	int * output_indices,
+	int i_begin, int i_end
+)
+{
+	int i;
 
-				((short int *)temporary_image)[new_index] = ((short int *)input_image)[i];
-			}
-			break;
-		case 4:
-			for (i = 0; i < num_pixels; ++i) {
-				int x, y, new_index;
+	/* Transform each index individually */
+	for (i = i_begin; i < i_end; ++i) {
+		int x, y, old_index;
 
-				/* Compute destination address */
-				x = i % nx;
-				y = i / nx;
-				new_index = y + ny * x;
+		/* Lookup old image index */
+		old_index = input_indices[i];
 
-				((long int *)temporary_image)[new_index] = ((long int *)input_image)[i];
-			}
-			break;
-		default:
-			for (i = 0; i < num_pixels; ++i) {
-				int x, y, new_index;
-
-				/* Compute destination address */
-				x = i % nx;
-				y = i / nx;
-				new_index = y + ny * x;
-
-				memcpy(
-					(unsigned char *)(temporary_image) + new_index * num_bytes_per_element, 
-					(unsigned char *)(input_image) + i * num_bytes_per_element, 
-					num_bytes_per_element
-				);
-			}
-			break;
-	}
-#endif
+		/* Compute destination address */
+		y = old_index / nx;
+		x = old_index - nx * y;
 
-	/* Free memory */
-	if (in_place) {
-		memcpy(output_image, temporary_image, num_pixels * num_bytes_per_element);
-		free((void *)temporary_image);
+		/* Store transposed image index */
+		output_indices[i] = y + ny * x;
 	}
 }
 
@@ -490,24 +643,31 @@ void transpose_indices(
 	int * output_indices
 )
 {
-	int i, num_pixels;
-
-	num_pixels = nx * ny;
-
-	/* Transform each index individually */
-	for (i = 0; i < num_pixels; ++i) {
-		int x, y, old_index, new_index;
+	transpose_indices_range(input_indices, nx, ny, output_indices, 0, nx * ny);
+}
 
-		/* Lookup old image index */
-		old_index = input_indices[i];
 
-		/* Compute destination address */
-		x = old_index % nx;
-		y = old_index / nx;
-		new_index = y + ny * x;
+/* - flip_image_rows:
+	Flip input rows [y_begin, y_end) into output rows [ny - y_end, ny - y_begin).
+	Out of place only.  Disjoint row ranges may be flipped concurrently.
+*/
+void flip_image_rows(
+	void * input_image,
+	int nx, int ny,
+	int num_bytes_per_element,
+	void * output_image,
+	int y_begin, int y_end
+)
+{
+	int y;
+	size_t row_bytes = (size_t)nx * num_bytes_per_element;
 
-		/* Store transposed image index */
-		output_indices[i] = new_index;
+	for (y = y_begin; y < y_end; ++y) {
+		memcpy(
+			(unsigned char *)output_image + (size_t)(ny - 1 - y) * row_bytes,
+			(unsigned char *)input_image + (size_t)y * row_bytes,
+			row_bytes
+		);
 	}
 }
 
@@ -522,37 +682,51 @@ void flip_image(
 	void * output_image
 )
 {
-	char in_place;
-	void * temporary_image;
-	int y, num_pixels;
+	int y;
+	size_t row_bytes = (size_t)nx * num_bytes_per_element;
+	unsigned char * swap_row;
 
-	num_pixels = nx * ny;
+	if (input_image != output_image) {
+		flip_image_rows(input_image, nx, ny, num_bytes_per_element, output_image, 0, ny);
+		return;
+	}
 
-	in_place = (input_image == output_image);
+	/* In place: swap mirrored pairs of rows through a single row of memory */
+	swap_row = (unsigned char *)malloc(row_bytes);
+	for (y = 0; y < ny / 2; ++y) {
+		unsigned char * row_a = (unsigned char *)input_image + (size_t)y * row_bytes;
+		unsigned char * row_b = (unsigned char *)input_image + (size_t)(ny - 1 - y) * row_bytes;
 
-	/* Allocate memory */
-	if (in_place) {
-		temporary_image = (void *)malloc(num_pixels * num_bytes_per_element);
-	} else {
-		temporary_image = output_image;
+		memcpy(swap_row, row_a, row_bytes);
+		memcpy(row_a, row_b, row_bytes);
+		memcpy(row_b, swap_row, row_bytes);
 	}
+	free((void *)swap_row);
+}
 
-	/* Flip the image */
-	for (y = 0; y < ny; ++y) {
-		int row_base_index = nx * y;
-		int new_row_base_index = nx * (ny - 1 - y);
 
-		memcpy(
-			(unsigned char *)temporary_image + new_row_base_index * num_bytes_per_element,
-			(unsigned char *)input_image + row_base_index * num_bytes_per_element,
-			nx * num_bytes_per_element
-		);
-	}
+/* - flip_indices_range:
+	Transform the pixel indices in [i_begin, i_end) of an array according to a
+	vertical flip.  Doesn't care about in-place/out-of-place.
+*/
+void flip_indices_range(
+	int * input_indices,
+	int nx, int ny,
+	int * output_indices,
+	int i_begin, int i_end
+)
+{
+	int i;
+	int last_row_index = nx * (ny - 1);
 
-	/* Free memory */
-	if (in_place) {
-		memcpy(output_image, temporary_image, num_pixels * num_bytes_per_element);
-		free((void *)temporary_image);
+	/* Transform each index individually: x + nx * (ny - 1 - y) */
+	for (i = i_begin; i < i_end; ++i) {
+		int y, old_index;
+
+		old_index = input_indices[i];
+		y = old_index / nx;
+
+		output_indices[i] = old_index + last_row_index - 2 * nx * y;
 	}
 }
 
@@ -567,25 +741,7 @@ void flip_indices(
 	int * output_indices
 )
 {
-	int i, num_pixels;
-
-	num_pixels = nx * ny;
-
-	/* Transform each index individually */
-	for (i = 0; i < num_pixels; ++i) {
-		int x, y, old_index, new_index;
-
-		/* Lookup old image index */
-		old_index = input_indices[i];
-
-		/* Compute destination address */
-		x = old_index % nx;
-		y = old_index / nx;
-		new_index = x + nx * (ny - 1 - y);
-
-		/* Store transposed image index */
-		output_indices[i] = new_index;
-	}
+	flip_indices_range(input_indices, nx, ny, output_indices, 0, nx * ny);
 }
 
 
@@ -57,6 +57,8 @@ knowledge of the CeCILL-B license and that you accept its terms.
 #ifndef PATH_SUPPORT_H
 #define PATH_SUPPORT_H
 
+#include <stddef.h>
+
 #ifndef MAX
 	#define MAX(x, y) ((x) > (y) ? (x) : (y))
 #endif
@@ -134,7 +136,8 @@ void add_point(
 );
 
 /* - path_length_to_threshold:
- * Given a specified path length, determine the corresponding threshold in the granulometric curve
+ * Given a specified path length, determine the corresponding threshold in the granulometric curve,
+ * by binary search
  */
 GPOT_PIX_TYPE path_length_to_threshold(
 	int path_length,						/* The desired path length */
@@ -142,7 +145,8 @@ GPOT_PIX_TYPE path_length_to_threshold(
 );
 
 /* - threshold_to_path_length:
- * Given a specified grayscale threshold, determine the corresponding path length in the granulometric curve
+ * Given a specified grayscale threshold, determine the corresponding path length in the granulometric curve,
+ * by binary search
  */
 int threshold_to_path_length(
 	GPOT_PIX_TYPE threshold,				/* The desired grayscale threshold */
@@ -164,6 +168,89 @@ PATH_GRANULOMETRY * merge(
 	PATH_GRANULOMETRY * input_struct_b			/* Structure to merge, "B" */
 );
 
+/* - merge_into:
+ * Merge two granulometric curves into a third, empty one, as merge() does.
+ */
+void merge_into(
+	PATH_GRANULOMETRY * input_struct_a,			/* Structure to merge, "A" */
+	PATH_GRANULOMETRY * input_struct_b,			/* Structure to merge, "B" */
+	PATH_GRANULOMETRY * this_struct				/* The empty output */
+);
+
+/**************************** PATH_GRANULOMETRY_IMAGE ************************************/
+/*
+ * The granulometric curves of every pixel of an image, packed end to end in one memory
+ * pool rather than allocated pixel by pixel: the curve of pixel i is the points
+ * offsets[i] to offsets[i + 1] - 1 of the path_length and threshold arrays.  A pixel
+ * whose curve has no point as long as a length takes the image minimum there, as in
+ * pathopen().
+ *
+ */
+typedef struct {
+	int num_pixels;					/* Number of curves */
+	size_t num_points;				/* Total length of the arrays */
+	GPOT_PIX_TYPE minimum;			/* The image minimum, 0 unless the caller sets it */
+
+	unsigned char * buf;			/* Combined memory pool for arrays */
+	size_t * offsets;				/* Base pointer for the num_pixels + 1 curve offsets */
+	int * path_length;				/* Base pointer for array of path lengths */
+	GPOT_PIX_TYPE * threshold;		/* Base pointer for array of associated thresholds */
+} PATH_GRANULOMETRY_IMAGE;
+
+/* - PATH_GRANULOMETRY_IMAGE_constructor:
+ * Construct storage for the given number of curves and points in total.  The caller fills
+ * in offsets and the points.  Returns NULL if out of memory.
+ */
+PATH_GRANULOMETRY_IMAGE * PATH_GRANULOMETRY_IMAGE_constructor(
+	int num_pixels,
+	size_t num_points
+);
+
+/* - PATH_GRANULOMETRY_IMAGE_destructor:
+ * Deallocate internal memory and object memory
+ */
+void PATH_GRANULOMETRY_IMAGE_destructor(
+	PATH_GRANULOMETRY_IMAGE * this_struct
+);
+
+/* - PATH_GRANULOMETRY_IMAGE_pack:
+ * Pack separately allocated curves, one per pixel, into a new PATH_GRANULOMETRY_IMAGE, or
+ * return NULL if out of memory
+ */
+PATH_GRANULOMETRY_IMAGE * PATH_GRANULOMETRY_IMAGE_pack(
+	PATH_GRANULOMETRY * * curves,			/* The curve of each pixel */
+	int num_pixels
+);
+
+/* - PATH_GRANULOMETRY_IMAGE_curve:
+ * Make a PATH_GRANULOMETRY view of the curve of one pixel, pointing into the pool.  The view
+ * may be read, printed and queried, but not grown, merged from or destructed.
+ */
+void PATH_GRANULOMETRY_IMAGE_curve(
+	int pixel_index,						/* The pixel */
+	PATH_GRANULOMETRY_IMAGE * this_struct,	/* The 'this' pointer */
+	PATH_GRANULOMETRY * curve				/* The view to fill */
+);
+
+/* - pixel_path_length_to_threshold:
+ * As path_length_to_threshold(), for the curve of one pixel, by binary search, but
+ * never below the image minimum
+ */
+GPOT_PIX_TYPE pixel_path_length_to_threshold(
+	int pixel_index,						/* The pixel */
+	int path_length,						/* The desired path length */
+	PATH_GRANULOMETRY_IMAGE * this_struct	/* The 'this' pointer */
+);
+
+/* - pixel_threshold_to_path_length:
+ * As threshold_to_path_length(), for the curve of one pixel, by binary search
+ */
+int pixel_threshold_to_path_length(
+	int pixel_index,						/* The pixel */
+	GPOT_PIX_TYPE threshold,				/* The desired grayscale threshold */
+	PATH_GRANULOMETRY_IMAGE * this_struct	/* The 'this' pointer */
+);
+
 
 /******************************** UTILITY FUNCTION PROTOTYPES **************************************/
 /* Sort an image by its pixel values (monotonic transform to 0, 1, ...) */
@@ -193,6 +280,15 @@ void transpose_image(
 	void * output_image
 );
 
+/* Transpose rows [y_begin, y_end) of an image, out of place, in cache-sized tiles */
+void transpose_image_rows(
+	void * input_image,
+	int nx, int ny,
+	int num_bytes_per_element,
+	void * output_image,
+	int y_begin, int y_end
+);
+
 /* Transform an array of pixel indices according to a transposition of the image */
 void transpose_indices(
 	int * input_indices,
@@ -200,7 +296,15 @@ void transpose_indices(
 	int * output_indices
 );
 
-/* Vertically flip an image, possibly 'in-place' (internally allocates extra memory) */
+/* As transpose_indices, for the array elements [i_begin, i_end) only */
+void transpose_indices_range(
+	int * input_indices,
+	int nx, int ny,
+	int * output_indices,
+	int i_begin, int i_end
+);
+
+/* Vertically flip an image, possibly 'in-place' (internally allocates a row) */
 void flip_image(
 	void * input_image,
 	int nx, int ny,
@@ -208,6 +312,15 @@ void flip_image(
 	void * output_image
 );
 
+/* Flip rows [y_begin, y_end) of an image, out of place */
+void flip_image_rows(
+	void * input_image,
+	int nx, int ny,
+	int num_bytes_per_element,
+	void * output_image,
+	int y_begin, int y_end
+);
+
 /* Transform an array of pixel indices according to a vertical flip of the image */
 void flip_indices(
 	int * input_indices,
@@ -215,4 +328,12 @@ void flip_indices(
 	int * output_indices
 );
 
+/* As flip_indices, for the array elements [i_begin, i_end) only */
+void flip_indices_range(
+	int * input_indices,
+	int nx, int ny,
+	int * output_indices,
+	int i_begin, int i_end
+);
+
 #endif // PATH_SUPPORT_H
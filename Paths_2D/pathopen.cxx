@@ -69,7 +69,13 @@ knowledge of the CeCILL-B license and that you accept its terms.
 #include "path_queue.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <mutex>
+#include <thread>
 using namespace std;
 
 /* A fix for a silly assumption I made.  I was thinking that the centre pixel can be
@@ -79,133 +85,2287 @@ skipped by an incomplete path. */
 /* - pathopen:
 	Perform a path opening on an image.  Main interface, calls all subfunctions.
 */
+template <class PIX_TYPE>
 int pathopen(
+	PIX_TYPE * input_image,							/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_image							/* Output image */
+)
+{
+	Path_Open_Context context(nx, ny, L, K, 1);
+
+	return pathopen(context, input_image, output_image);
+}
+
+/* - pathopen_threaded:
+	Perform a path opening on an image, running the four orientation passes concurrently.
+	The output is identical to pathopen().
+*/
+template <class PIX_TYPE>
+int pathopen_threaded(
+	PIX_TYPE * input_image,							/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_image,						/* Output image */
+	int num_threads									/* Number of worker threads, <= 0 for all cores */
+)
+{
+	Path_Open_Context context(nx, ny, L, K, num_threads);
+
+	return pathopen(context, input_image, output_image);
+}
+
+
+/* - run_tasks:
+	Run tasks 0 .. num_tasks - 1 on up to num_threads threads, the calling thread included.
+	Each thread repeatedly claims the next unclaimed task until none remain.  Tasks are
+	invoked as task(task_index, thread_index), with thread_index in [0, num_threads).
+*/
+template <class TASK>
+static void run_tasks(
+	int num_tasks,									/* Number of tasks */
+	int num_threads,								/* Maximum number of threads */
+	TASK task										/* Callable, see above */
+)
+{
+	int t;
+	atomic<int> next_task(0);
+	vector<thread> threads;
+
+	auto worker = [&](int thread_index) {
+		int task_index;
+		while ((task_index = next_task++) < num_tasks) {
+			task(task_index, thread_index);
+		}
+	};
+
+	for (t = 1; t < MIN(num_threads, num_tasks); ++t) {
+		threads.push_back(thread(worker, t));
+	}
+	worker(0);
+	for (t = 0; t < (int)threads.size(); ++t) {
+		threads[t].join();
+	}
+}
+
+/* - chain_length_size:
+	Bytes needed per chain length.  PATHOPEN_LENGTH_HEURISTIC bounds chain lengths by
+	L - 1, otherwise they may reach nx + ny.
+*/
+static size_t chain_length_size(
+	int L											/* The threshold line length */
+)
+{
+#ifdef PATHOPEN_LENGTH_HEURISTIC
+	if (L >= 1 && L - 1 <= UCHAR_MAX) return sizeof(unsigned char);
+	if (L >= 1 && L - 1 <= USHRT_MAX) return sizeof(unsigned short);
+#endif
+	return sizeof(int);
+}
+
+/* - planar_layout:
+	Whether to store the per-gap images planar rather than interleaved, see GAP_INDEX.
+	The sweeps visit one gap number at a time, so planar wins once there are enough gaps.
+*/
+static bool planar_layout(
+	int K											/* The maximum number of gaps in the path */
+)
+{
+	return K >= PATHOPEN_PLANAR_MIN_K;
+}
+
+/* Radix_Key:
+	Unsigned radix sort keys, ordered as the pixel values they stand for.  Floats map
+	their bit patterns so that unsigned order is numerical order, with -0 taken as +0
+	so that equal pixels share a key.
+*/
+template <class PIX_TYPE> struct Radix_Key;
+
+template <> struct Radix_Key<unsigned char> {
+	typedef unsigned char KEY_TYPE;
+	static KEY_TYPE key(unsigned char value) { return value; }
+};
+
+template <> struct Radix_Key<unsigned short> {
+	typedef unsigned short KEY_TYPE;
+	static KEY_TYPE key(unsigned short value) { return value; }
+};
+
+template <> struct Radix_Key<float> {
+	typedef unsigned int KEY_TYPE;
+	static KEY_TYPE key(float value) {
+		unsigned int bits;
+
+		if (value == 0.0f) value = 0.0f;
+		memcpy(&bits, &value, sizeof(bits));
+		return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+	}
+};
+
+/* - same_level:
+	Whether two pixels lie on one threshold level, as the sort saw them.  Comparing keys
+	rather than values, a NaN, equal to nothing, still makes a level of its own instead
+	of stalling the sweep.
+*/
+template <class PIX_TYPE>
+static inline bool same_level(PIX_TYPE a, PIX_TYPE b)
+{
+	return Radix_Key<PIX_TYPE>::key(a) == Radix_Key<PIX_TYPE>::key(b);
+}
+
+/* - add_pass_stats:
+	Add the statistics of one pass into a total.
+*/
+static void add_pass_stats(
+	Path_Open_Pass_Stats & total,					/* The total to add to */
+	const Path_Open_Pass_Stats & stats				/* The pass to add */
+)
+{
+	total.num_levels += stats.num_levels;
+	total.num_seeds += stats.num_seeds;
+	total.num_enqueued_down += stats.num_enqueued_down;
+	total.num_enqueued_up += stats.num_enqueued_up;
+	total.num_merges += stats.num_merges;
+	total.num_merged += stats.num_merged;
+	total.num_chain_updates += stats.num_chain_updates;
+	total.num_early_outs += stats.num_early_outs;
+	total.seed_time += stats.seed_time;
+	total.down_time += stats.down_time;
+	total.up_time += stats.up_time;
+}
+
+/* - image_sort:
+	Sort an image by its pixel values, as image_sort() in path_support.c does for
+	PATHOPEN_PIX_TYPE.  An LSD radix sort of 8-bit digits, one pass per digit on which
+	the pixels differ, each pass stable so that equal pixels stay in raster order as
+	the sweeps expect.  The pixels are cut into up to num_threads contiguous chunks,
+	each histogrammed and scattered by its own thread.  Keys wider than one digit need
+	image_sort_buffer_size() bytes of buffer.
+*/
+template <class PIX_TYPE>
+static void image_sort(
+	PIX_TYPE * input_image,
+	int num_pixels,
+	int * sorted_indices,
+	void * buffer,									/* Scratch, see image_sort_buffer_size() */
+	int num_threads									/* Maximum number of threads */
+)
+{
+	typedef typename Radix_Key<PIX_TYPE>::KEY_TYPE KEY_TYPE;
+	const int num_digits = sizeof(KEY_TYPE);
+	int num_chunks, num_passes, pass, d, b, t;
+	int passes[sizeof(KEY_TYPE)];
+	KEY_TYPE first_key;
+	int * histograms;								/* [(t * num_digits + d) * 256 + b] */
+	KEY_TYPE * keys[2];
+	int * indices[2];
+
+	if (num_pixels <= 0) return;
+
+	/* Chunks of fewer than 2^16 pixels are not worth a thread */
+	num_chunks = MAX(MIN(num_threads, num_pixels >> 16), 1);
+	histograms = (int *)calloc(num_chunks * num_digits * 256, sizeof(int));
+
+	/* Histogram every digit of each chunk */
+	run_tasks(num_chunks, num_threads, [&](int chunk, int) {
+		int i, d;
+		int i_begin = (int)(((long long)num_pixels * chunk) / num_chunks);
+		int i_end = (int)(((long long)num_pixels * (chunk + 1)) / num_chunks);
+		int * histogram = histograms + chunk * num_digits * 256;
+
+		for (i = i_begin; i < i_end; ++i) {
+			KEY_TYPE key = Radix_Key<PIX_TYPE>::key(input_image[i]);
+			for (d = 0; d < num_digits; ++d) {
+				++histogram[d * 256 + ((key >> (8 * d)) & 0xff)];
+			}
+		}
+	});
+
+	/* A digit on which all pixels agree needs no pass */
+	first_key = Radix_Key<PIX_TYPE>::key(input_image[0]);
+	num_passes = 0;
+	for (d = 0; d < num_digits; ++d) {
+		int total = 0;
+		for (t = 0; t < num_chunks; ++t) {
+			total += histograms[(t * num_digits + d) * 256 + ((first_key >> (8 * d)) & 0xff)];
+		}
+		if (total < num_pixels) passes[num_passes++] = d;
+	}
+
+	if (num_passes == 0) {
+		for (b = 0; b < num_pixels; ++b) {
+			sorted_indices[b] = b;
+		}
+		free((void *)histograms);
+		return;
+	}
+
+	/* Ping-pong between the buffer and sorted_indices, ending in sorted_indices */
+	indices[0] = (int *)buffer;
+	indices[1] = sorted_indices;
+	keys[0] = (KEY_TYPE *)(indices[0] + num_pixels);
+	keys[1] = keys[0] + num_pixels;
+
+	for (pass = 0; pass < num_passes; ++pass) {
+		int shift = 8 * passes[pass];
+		int dst = ((num_passes - 1 - pass) & 1) ? 0 : 1;
+		bool last_pass = (pass == num_passes - 1);
+		int * src_indices = indices[1 - dst];
+		KEY_TYPE * src_keys = keys[1 - dst];
+
+		/* Histogram the chunks as they now lie, unless still in raster order */
+		if (pass > 0) {
+			memset(histograms, 0, num_chunks * num_digits * 256 * sizeof(int));
+			run_tasks(num_chunks, num_threads, [&](int chunk, int) {
+				int i;
+				int i_begin = (int)(((long long)num_pixels * chunk) / num_chunks);
+				int i_end = (int)(((long long)num_pixels * (chunk + 1)) / num_chunks);
+				int * histogram = histograms + (chunk * num_digits + passes[pass]) * 256;
+
+				for (i = i_begin; i < i_end; ++i) {
+					++histogram[(src_keys[i] >> shift) & 0xff];
+				}
+			});
+		}
+
+		/* Turn the counts into each chunk's starting offset per bucket */
+		{
+			int offset = 0;
+			for (b = 0; b < 256; ++b) {
+				for (t = 0; t < num_chunks; ++t) {
+					int * count = histograms + (t * num_digits + passes[pass]) * 256 + b;
+					int n = *count;
+					*count = offset;
+					offset += n;
+				}
+			}
+		}
+
+		/* Scatter each chunk to its offsets */
+		run_tasks(num_chunks, num_threads, [&](int chunk, int) {
+			int i;
+			int i_begin = (int)(((long long)num_pixels * chunk) / num_chunks);
+			int i_end = (int)(((long long)num_pixels * (chunk + 1)) / num_chunks);
+			int * offset = histograms + (chunk * num_digits + passes[pass]) * 256;
+			int * dst_indices = indices[dst];
+			KEY_TYPE * dst_keys = keys[dst];
+
+			/* The first pass reads the image itself, the last needs no keys */
+			if (pass == 0 && last_pass) {
+				for (i = i_begin; i < i_end; ++i) {
+					dst_indices[offset[(Radix_Key<PIX_TYPE>::key(input_image[i]) >> shift) & 0xff]++] = i;
+				}
+			} else if (pass == 0) {
+				for (i = i_begin; i < i_end; ++i) {
+					KEY_TYPE key = Radix_Key<PIX_TYPE>::key(input_image[i]);
+					int position = offset[(key >> shift) & 0xff]++;
+					dst_indices[position] = i;
+					dst_keys[position] = key;
+				}
+			} else if (last_pass) {
+				for (i = i_begin; i < i_end; ++i) {
+					dst_indices[offset[(src_keys[i] >> shift) & 0xff]++] = src_indices[i];
+				}
+			} else {
+				for (i = i_begin; i < i_end; ++i) {
+					KEY_TYPE key = src_keys[i];
+					int position = offset[(key >> shift) & 0xff]++;
+					dst_indices[position] = src_indices[i];
+					dst_keys[position] = key;
+				}
+			}
+		});
+	}
+
+	free((void *)histograms);
+}
+
+/* - image_sort_buffer_size:
+	Bytes of scratch needed by image_sort() for the given pixel size.  Single-byte
+	pixels sort in one pass straight into the output and need none.
+*/
+static size_t image_sort_buffer_size(
+	int num_pixels,
+	size_t pixel_size								/* Bytes per pixel */
+)
+{
+	if (pixel_size <= 1) return 0;
+	return (size_t)num_pixels * (sizeof(int) + 2 * pixel_size);
+}
+
+/* - orientation_passes:
+	Run the four orientation passes of pathopen(context, ...) or pathclose(context, ...)
+	with the given pixel type, chain length type and layout.  The passes share only
+	read-only inputs, each writing its own output: an image, or with lengths a stack of
+	one image per length.  Given a pass number, only that pass runs, in the given
+	workspace on the calling thread.
+*/
+template <class PIX_TYPE, class CHAIN_TYPE, bool PLANAR>
+static void orientation_passes(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The input image */
+	bool closing,									/* Path closing rather than opening */
+	int L,											/* The threshold line length, the largest of lengths */
+	const int * lengths,							/* Increasing lengths of a multi-length pass, or NULL */
+	int num_lengths,								/* Number of lengths */
+	Path_Open_Transform_Log * * transform_logs,		/* Curves of each pass of a transform, or NULL */
+	PIX_TYPE * output_image,						/* Vertical output */
+	PIX_TYPE * diag_image,							/* ++diagonal output */
+	PIX_TYPE * horiz_image,							/* Horizontal output */
+	PIX_TYPE * flipped_antidiag_image,				/* +-diagonal output, flipped */
+	int pass,										/* The one pass to run, or -1 for all four */
+	Path_Open_Workspace * workspace					/* Working memory of that one pass */
+)
+{
+	int nx = context.nx;
+	int ny = context.ny;
+	int K = context.K;
+	PIX_TYPE * flipped_input_image = (PIX_TYPE *)context.flipped_input_image;
+
+	auto run_pass = [&](int pass, Path_Open_Workspace & workspace) {
+		switch (pass) {
+			case 0:
+				/* Vertical path opening or closing */
+				vert_pathopen<PIX_TYPE, CHAIN_TYPE, PLANAR, false>(workspace, input_image, context.sorted_indices, closing, nx, ny, L, lengths, num_lengths, transform_logs ? transform_logs[0] : NULL, K, output_image);
+				break;
+			case 1:
+				/* ++diagonal path opening or closing */
+				diag_pathopen<PIX_TYPE, CHAIN_TYPE, PLANAR>(workspace, input_image, context.sorted_indices, closing, nx, ny, L, lengths, num_lengths, transform_logs ? transform_logs[1] : NULL, K, diag_image);
+				break;
+			case 2:
+				/* Horizontal, the vertical pass of the image viewed transposed */
+				vert_pathopen<PIX_TYPE, CHAIN_TYPE, PLANAR, true>(workspace, input_image, context.sorted_indices, closing, ny, nx, L, lengths, num_lengths, transform_logs ? transform_logs[2] : NULL, K, horiz_image);
+				break;
+			case 3:
+				/* +-diagonal, left flipped: the reduction reads it upside down */
+				diag_pathopen<PIX_TYPE, CHAIN_TYPE, PLANAR>(workspace, flipped_input_image, context.flipped_sorted_indices, closing, nx, ny, L, lengths, num_lengths, transform_logs ? transform_logs[3] : NULL, K, flipped_antidiag_image);
+				break;
+		}
+	};
+
+	if (pass >= 0) {
+		run_pass(pass, *workspace);
+		return;
+	}
+	run_tasks(4, context.num_threads, [&](int pass, int thread_index) {
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		run_pass(pass, *context.workspaces[thread_index]);
+		context.pass_times[pass] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+#ifdef PATHOPEN_STATS
+		context.pass_stats[pass] = context.workspaces[thread_index]->stats;
+#endif
+	});
+}
+
+/* - run_orientation_passes:
+	orientation_passes() with chain lengths stored as narrowly as L allows, and the
+	per-gap images laid out as suits context.K.  All four passes run unless one is given.
+*/
+template <class PIX_TYPE>
+static void run_orientation_passes(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The input image */
+	bool closing,									/* Path closing rather than opening */
+	int L,											/* The threshold line length, the largest of lengths */
+	const int * lengths,							/* Increasing lengths of a multi-length pass, or NULL */
+	int num_lengths,								/* Number of lengths */
+	Path_Open_Transform_Log * * transform_logs,		/* Curves of each pass of a transform, or NULL */
+	PIX_TYPE * output_image,						/* Vertical output */
+	PIX_TYPE * diag_image,							/* ++diagonal output */
+	PIX_TYPE * horiz_image,							/* Horizontal output */
+	PIX_TYPE * flipped_antidiag_image,				/* +-diagonal output, flipped */
+	int pass = -1,									/* The one pass to run, or -1 for all four */
+	Path_Open_Workspace * workspace = NULL			/* Working memory of that one pass */
+)
+{
+	bool planar = planar_layout(context.K);
+
+	switch (chain_length_size(L)) {
+		case sizeof(unsigned char):
+			if (planar) orientation_passes<PIX_TYPE, unsigned char, true>(context, input_image, closing, L, lengths, num_lengths, transform_logs, output_image, diag_image, horiz_image, flipped_antidiag_image, pass, workspace);
+			else orientation_passes<PIX_TYPE, unsigned char, false>(context, input_image, closing, L, lengths, num_lengths, transform_logs, output_image, diag_image, horiz_image, flipped_antidiag_image, pass, workspace);
+			break;
+		case sizeof(unsigned short):
+			if (planar) orientation_passes<PIX_TYPE, unsigned short, true>(context, input_image, closing, L, lengths, num_lengths, transform_logs, output_image, diag_image, horiz_image, flipped_antidiag_image, pass, workspace);
+			else orientation_passes<PIX_TYPE, unsigned short, false>(context, input_image, closing, L, lengths, num_lengths, transform_logs, output_image, diag_image, horiz_image, flipped_antidiag_image, pass, workspace);
+			break;
+		default:
+			if (planar) orientation_passes<PIX_TYPE, int, true>(context, input_image, closing, L, lengths, num_lengths, transform_logs, output_image, diag_image, horiz_image, flipped_antidiag_image, pass, workspace);
+			else orientation_passes<PIX_TYPE, int, false>(context, input_image, closing, L, lengths, num_lengths, transform_logs, output_image, diag_image, horiz_image, flipped_antidiag_image, pass, workspace);
+			break;
+	}
+}
+
+/* - pathopen (context):
+	Perform a path opening using the working memory held by the context.
+*/
+template <class PIX_TYPE>
+int pathopen(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The input image */
+	PIX_TYPE * output_image							/* Output image */
+)
+{
+	pathopen_presort(context, input_image);
+
+	return pathopen_presorted(context, input_image, output_image);
+}
+
+/* - presort:
+	Sort the image pixels into context.sorted_indices, or copy in a permutation sorted
+	earlier, then build the flipped copies of the image and permutation, on up to
+	num_threads threads.
+*/
+template <class PIX_TYPE>
+static void presort(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The input image */
+	const int * sorted_indices,						/* Its sorted pixel indices, or NULL to sort */
+	int num_threads									/* Number of worker threads */
+)
+{
+	int nx = context.nx;
+	int ny = context.ny;
+	int num_pixels, num_bands;
+
+	num_pixels = nx * ny;
+
+	context.reserve_pixel_images(sizeof(PIX_TYPE));
+
+	/* Sort the image pixels, storing pixel indices */
+	if (sorted_indices == NULL) {
+		image_sort(input_image, num_pixels, context.sorted_indices, context.sort_buffer, num_threads);
+	} else if (sorted_indices != context.sorted_indices) {
+		memcpy(context.sorted_indices, sorted_indices, num_pixels * sizeof(int));
+	}
+
+	/* Create the flipped copies of the original image and permutation, each cut into
+		a band per thread: task 2 * band + copy makes that band of the given copy */
+	num_bands = num_threads;
+	run_tasks(2 * num_bands, num_threads, [&](int task_index, int) {
+		int band = task_index / 2;
+
+		if (task_index % 2 == 0) {
+			int y_begin = (int)(((long long)ny * band) / num_bands);
+			int y_end = (int)(((long long)ny * (band + 1)) / num_bands);
+			flip_image_rows((void *)input_image, nx, ny, sizeof(PIX_TYPE), context.flipped_input_image, y_begin, y_end);
+		} else {
+			int i_begin = (int)(((long long)num_pixels * band) / num_bands);
+			int i_end = (int)(((long long)num_pixels * (band + 1)) / num_bands);
+			flip_indices_range(context.sorted_indices, nx, ny, context.flipped_sorted_indices, i_begin, i_end);
+		}
+	});
+}
+
+/* - pathopen_presort:
+	Sort the image and build its flipped copies on the context's threads.
+*/
+template <class PIX_TYPE>
+void pathopen_presort(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The input image */
+	const int * sorted_indices						/* Its sorted pixel indices, or NULL to sort */
+)
+{
+	presort(context, input_image, sorted_indices, context.num_threads);
+}
+
+/* - reduce_orientations:
+	Reduce the outputs of the four orientation passes into output_image, which holds the
+	vertical pass's, in parallel bands of rows: by max for an opening, by min for a
+	closing.  The +-diagonal output is read upside down.
+*/
+template <class PIX_TYPE>
+static void reduce_orientations(
+	int nx, int ny,									/* Image dimensions */
+	bool closing,									/* Path closing rather than opening */
+	int num_lengths,								/* Number of images per orientation */
+	PIX_TYPE * output_image,						/* Vertical output, reduced in place */
+	PIX_TYPE * diag_image,							/* ++diagonal output */
+	PIX_TYPE * horiz_image,							/* Horizontal output */
+	PIX_TYPE * flipped_antidiag_image,				/* +-diagonal output, flipped */
+	int num_threads									/* Number of worker threads */
+)
+{
+	int num_pixels = nx * ny;
+	int num_bands = MIN(ny, 4 * num_threads);
+
+	run_tasks(num_bands, num_threads, [&](int band, int) {
+		int x, y, j;
+		int y_begin = (int)(((long long)ny * band) / num_bands);
+		int y_end = (int)(((long long)ny * (band + 1)) / num_bands);
+
+		for (j = 0; j < num_lengths; ++j) {
+			size_t offset = (size_t)num_pixels * j;
+
+			for (y = y_begin; y < y_end; ++y) {
+				PIX_TYPE * output_row = output_image + offset + nx * y;
+				PIX_TYPE * diag_row = diag_image + offset + nx * y;
+				PIX_TYPE * horiz_row = horiz_image + offset + nx * y;
+				PIX_TYPE * antidiag_row = flipped_antidiag_image + offset + nx * (ny - 1 - y);
+
+				if (closing) {
+					for (x = 0; x < nx; ++x) {
+						output_row[x] = MIN(output_row[x], diag_row[x]);
+						output_row[x] = MIN(output_row[x], horiz_row[x]);
+						output_row[x] = MIN(output_row[x], antidiag_row[x]);
+					}
+				} else {
+					for (x = 0; x < nx; ++x) {
+						output_row[x] = MAX(output_row[x], diag_row[x]);
+						output_row[x] = MAX(output_row[x], horiz_row[x]);
+						output_row[x] = MAX(output_row[x], antidiag_row[x]);
+					}
+				}
+			}
+		}
+	});
+}
+
+/* - presorted_passes:
+	The four orientation passes on the image last given to pathopen_presort(), each
+	writing its own output, which are then reduced into output_image.  With lengths, a
+	pass per orientation serves every length, reducing into one output image per length.
+*/
+template <class PIX_TYPE>
+static int presorted_passes(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The image given to pathopen_presort() */
+	bool closing,									/* Path closing rather than opening */
+	const int * lengths,							/* Increasing lengths, or NULL for context.L alone */
+	int num_lengths,								/* Number of lengths */
+	PIX_TYPE * output_image							/* Output image, or one per length */
+)
+{
+	int nx = context.nx;
+	int ny = context.ny;
+	int num_pixels = nx * ny;
+	int L, i;
+	PIX_TYPE * diag_image, * horiz_image, * flipped_antidiag_image;
+
+	if (lengths == NULL) {
+		L = context.L;
+		num_lengths = 1;
+		diag_image = (PIX_TYPE *)context.diag_image;
+		horiz_image = (PIX_TYPE *)context.horiz_image;
+		flipped_antidiag_image = (PIX_TYPE *)context.flipped_antidiag_image;
+	} else {
+		/* The chain lengths need only be exact up to the largest length */
+		if (num_lengths < 1 || num_lengths > PATHOPEN_MAX_LENGTHS || lengths[0] < 1) return -1;
+		for (i = 1; i < num_lengths; ++i) {
+			if (lengths[i] <= lengths[i - 1]) return -1;
+		}
+		L = lengths[num_lengths - 1];
+		context.reserve_stack_images(num_lengths);
+		diag_image = (PIX_TYPE *)context.stack_images;
+		horiz_image = diag_image + (size_t)num_pixels * num_lengths;
+		flipped_antidiag_image = horiz_image + (size_t)num_pixels * num_lengths;
+	}
+
+	run_orientation_passes(context, input_image, closing, L, lengths, num_lengths, (Path_Open_Transform_Log * *)NULL,
+		output_image, diag_image, horiz_image, flipped_antidiag_image);
+
+	/* Accumulate results into output */
+	reduce_orientations(nx, ny, closing, num_lengths, output_image, diag_image, horiz_image, flipped_antidiag_image,
+		context.num_threads);
+
+	return 0;
+}
+
+/* - pathopen_presorted:
+	The path opening proper, on the image last given to pathopen_presort().
+*/
+template <class PIX_TYPE>
+int pathopen_presorted(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The image given to pathopen_presort() */
+	PIX_TYPE * output_image							/* Output image */
+)
+{
+	return presorted_passes(context, input_image, false, (const int *)NULL, 0, output_image);
+}
+
+/* - pathclose_presorted:
+	The path closing proper, on the image last given to pathopen_presort().  The sweeps
+	visit the sorted pixels backwards, from the largest threshold down.
+*/
+template <class PIX_TYPE>
+int pathclose_presorted(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The image given to pathopen_presort() */
+	PIX_TYPE * output_image							/* Output image */
+)
+{
+	return presorted_passes(context, input_image, true, (const int *)NULL, 0, output_image);
+}
+
+/* - pathclose (context):
+	Perform a path closing using the working memory held by the context.
+*/
+template <class PIX_TYPE>
+int pathclose(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The input image */
+	PIX_TYPE * output_image							/* Output image */
+)
+{
+	pathopen_presort(context, input_image);
+
+	return pathclose_presorted(context, input_image, output_image);
+}
+
+/* - pathclose:
+	Perform a path closing on an image, the dual of pathopen().
+*/
+template <class PIX_TYPE>
+int pathclose(
+	PIX_TYPE * input_image,							/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_image							/* Output image */
+)
+{
+	Path_Open_Context context(nx, ny, L, K, 1);
+
+	return pathclose(context, input_image, output_image);
+}
+
+/* - pathclose_threaded:
+	Perform a path closing on an image, running the four orientation passes concurrently.
+	The output is identical to pathclose().
+*/
+template <class PIX_TYPE>
+int pathclose_threaded(
+	PIX_TYPE * input_image,							/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_image,						/* Output image */
+	int num_threads									/* Number of worker threads, <= 0 for all cores */
+)
+{
+	Path_Open_Context context(nx, ny, L, K, num_threads);
+
+	return pathclose(context, input_image, output_image);
+}
+
+
+/* - pathopen_stack_presorted:
+	Path openings at each of the given lengths, on the image last given to
+	pathopen_presort(), from a single pass per orientation.
+*/
+template <class PIX_TYPE>
+int pathopen_stack_presorted(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The image given to pathopen_presort() */
+	const int * lengths,							/* Increasing threshold line lengths */
+	int num_lengths,								/* Number of lengths */
+	PIX_TYPE * output_stack							/* One output image per length */
+)
+{
+	return presorted_passes(context, input_image, false, lengths, num_lengths, output_stack);
+}
+
+/* - pathclose_stack_presorted:
+	Path closings at each of the given lengths, on the image last given to
+	pathopen_presort(), from a single pass per orientation.
+*/
+template <class PIX_TYPE>
+int pathclose_stack_presorted(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The image given to pathopen_presort() */
+	const int * lengths,							/* Increasing threshold line lengths */
+	int num_lengths,								/* Number of lengths */
+	PIX_TYPE * output_stack							/* One output image per length */
+)
+{
+	return presorted_passes(context, input_image, true, lengths, num_lengths, output_stack);
+}
+
+/* - pathopen_stack (context):
+	Path openings at each of the given lengths, using the working memory held by the context.
+*/
+template <class PIX_TYPE>
+int pathopen_stack(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The input image */
+	const int * lengths,							/* Increasing threshold line lengths */
+	int num_lengths,								/* Number of lengths */
+	PIX_TYPE * output_stack							/* One output image per length */
+)
+{
+	pathopen_presort(context, input_image);
+
+	return pathopen_stack_presorted(context, input_image, lengths, num_lengths, output_stack);
+}
+
+/* - pathclose_stack (context):
+	Path closings at each of the given lengths, using the working memory held by the context.
+*/
+template <class PIX_TYPE>
+int pathclose_stack(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The input image */
+	const int * lengths,							/* Increasing threshold line lengths */
+	int num_lengths,								/* Number of lengths */
+	PIX_TYPE * output_stack							/* One output image per length */
+)
+{
+	pathopen_presort(context, input_image);
+
+	return pathclose_stack_presorted(context, input_image, lengths, num_lengths, output_stack);
+}
+
+/* - pathopen_stack:
+	Path openings of an image at each of the given lengths.
+*/
+template <class PIX_TYPE>
+int pathopen_stack(
+	PIX_TYPE * input_image,							/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	const int * lengths,							/* Increasing threshold line lengths */
+	int num_lengths,								/* Number of lengths */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_stack							/* One output image per length */
+)
+{
+	if (num_lengths < 1) return -1;
+
+	Path_Open_Context context(nx, ny, lengths[num_lengths - 1], K, 1);
+
+	return pathopen_stack(context, input_image, lengths, num_lengths, output_stack);
+}
+
+/* - pathclose_stack:
+	Path closings of an image at each of the given lengths.
+*/
+template <class PIX_TYPE>
+int pathclose_stack(
+	PIX_TYPE * input_image,							/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	const int * lengths,							/* Increasing threshold line lengths */
+	int num_lengths,								/* Number of lengths */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_stack							/* One output image per length */
+)
+{
+	if (num_lengths < 1) return -1;
+
+	Path_Open_Context context(nx, ny, lengths[num_lengths - 1], K, 1);
+
+	return pathclose_stack(context, input_image, lengths, num_lengths, output_stack);
+}
+
+
+/* - log_curve:
+	Copy the curve of a pixel out of a transform log, in increasing threshold, growing the
+	structure if need be.  As for any PATH_GRANULOMETRY, a blank point is left at the end.
+*/
+static void log_curve(
+	Path_Open_Transform_Log & log,					/* The curves of one orientation */
+	int pixel_index,								/* The pixel, indexed as in the log */
+	PATH_GRANULOMETRY * & curve						/* The curve to fill */
+)
+{
+	int i, point;
+
+	if (log.num_points[pixel_index] >= curve->allocated_length) {
+		PATH_GRANULOMETRY_destructor(curve);
+		curve = PATH_GRANULOMETRY_constructor(log.num_points[pixel_index]);
+	}
+	curve->length = log.num_points[pixel_index];
+
+	/* The log links each point to the one before */
+	for (i = curve->length - 1, point = log.last_point[pixel_index]; i >= 0; --i, point = log.points[point].previous) {
+		curve->path_length[i] = log.points[point].path_length;
+		curve->threshold[i] = log.points[point].threshold;
+	}
+}
+
+/* - pathopen_transform_presorted:
+	The path opening transform of the image last given to pathopen_presort(): at every pixel,
+	the granulometric curve giving its path opening for any length.  The four orientation
+	passes log their curves as they sweep, which are then merged pixel by pixel, once to
+	count the points and once to pack them.  Returns NULL if out of memory.
+*/
+PATH_GRANULOMETRY_IMAGE * pathopen_transform_presorted(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PATHOPEN_PIX_TYPE * input_image,				/* The image given to pathopen_presort() */
+	int max_length									/* Longest length to resolve, <= 0 for all */
+)
+{
+	int nx = context.nx;
+	int ny = context.ny;
+	int num_pixels = nx * ny;
+	int num_threads = context.num_threads;
+	int i, o, pack, num_bands;
+	bool failed;
+	size_t * offsets;
+	Path_Open_Transform_Log * transform_logs[4];
+	PATH_GRANULOMETRY * * scratch;
+	PATH_GRANULOMETRY_IMAGE * transform;
+
+	/* No path is longer than nx + ny - 1 */
+	if (max_length <= 0 || max_length > nx + ny) max_length = nx + ny;
+
+	/* Log the curves of each orientation, from chains exact up to max_length */
+	failed = false;
+	for (o = 0; o < 4; ++o) {
+		transform_logs[o] = new Path_Open_Transform_Log(num_pixels, max_length);
+		failed = failed || transform_logs[o]->failed;
+	}
+	if (!failed) {
+		run_orientation_passes(context, input_image, false, max_length, (const int *)NULL, 0, transform_logs,
+			(PATHOPEN_PIX_TYPE *)NULL, (PATHOPEN_PIX_TYPE *)NULL, (PATHOPEN_PIX_TYPE *)NULL, (PATHOPEN_PIX_TYPE *)NULL);
+		for (o = 0; o < 4; ++o) {
+			failed = failed || transform_logs[o]->failed;
+		}
+	}
+	if (failed) {
+		for (o = 0; o < 4; ++o) {
+			delete transform_logs[o];
+		}
+		return NULL;
+	}
+
+	/* Six curves per thread: one per orientation and two partial merges */
+	scratch = (PATH_GRANULOMETRY * *)malloc(6 * num_threads * sizeof(PATH_GRANULOMETRY *));
+	for (i = 0; i < 6 * num_threads; ++i) {
+		scratch[i] = PATH_GRANULOMETRY_constructor(0);
+	}
+	offsets = (size_t *)malloc((num_pixels + 1) * sizeof(size_t));
+	transform = NULL;
+
+	/* Merge the orientations' curves at each pixel, a band of rows per task: first to count
+		the points of each pixel, then again to pack them at their offsets */
+	num_bands = MIN(ny, 4 * num_threads);
+	for (pack = 0; pack < 2 && offsets != NULL; ++pack) {
+		run_tasks(num_bands, num_threads, [&](int band, int thread_index) {
+			PATH_GRANULOMETRY * * curves = scratch + 6 * thread_index;
+			int x, y, index;
+			int y_begin = (int)(((long long)ny * band) / num_bands);
+			int y_end = (int)(((long long)ny * (band + 1)) / num_bands);
+
+			for (y = y_begin; y < y_end; ++y) {
+				for (x = 0, index = nx * y; x < nx; ++x, ++index) {
+					/* The +-diagonal pass ran on the flipped image */
+					log_curve(*transform_logs[0], index, curves[0]);
+					log_curve(*transform_logs[1], index, curves[1]);
+					log_curve(*transform_logs[2], index, curves[2]);
+					log_curve(*transform_logs[3], x + nx * (ny - 1 - y), curves[3]);
+
+					curves[4]->length = 0;
+					merge_into(curves[0], curves[1], curves[4]);
+					curves[5]->length = 0;
+					merge_into(curves[4], curves[2], curves[5]);
+					curves[4]->length = 0;
+					merge_into(curves[5], curves[3], curves[4]);
+
+					if (!pack) {
+						offsets[index + 1] = curves[4]->length;
+					} else {
+						memcpy(transform->path_length + offsets[index], curves[4]->path_length, curves[4]->length * sizeof(int));
+						memcpy(transform->threshold + offsets[index], curves[4]->threshold, curves[4]->length * sizeof(GPOT_PIX_TYPE));
+					}
+				}
+			}
+		});
+
+		if (!pack) {
+			offsets[0] = 0;
+			for (i = 0; i < num_pixels; ++i) {
+				offsets[i + 1] += offsets[i];
+			}
+			transform = PATH_GRANULOMETRY_IMAGE_constructor(num_pixels, offsets[num_pixels]);
+			if (transform == NULL) break;
+			transform->minimum = input_image[context.sorted_indices[0]];
+			memcpy(transform->offsets, offsets, (num_pixels + 1) * sizeof(size_t));
+		}
+	}
+
+	/* Free memory */
+	for (i = 0; i < 6 * num_threads; ++i) {
+		PATH_GRANULOMETRY_destructor(scratch[i]);
+	}
+	free((void *)scratch);
+	free((void *)offsets);
+	for (o = 0; o < 4; ++o) {
+		delete transform_logs[o];
+	}
+
+	return transform;
+}
+
+/* - pathopen_transform (context):
+	The path opening transform, using the working memory held by the context.
+*/
+PATH_GRANULOMETRY_IMAGE * pathopen_transform(
+	Path_Open_Context & context,					/* Working memory and parameters */
 	PATHOPEN_PIX_TYPE * input_image,				/* The input image */
+	int max_length									/* Longest length to resolve, <= 0 for all */
+)
+{
+	pathopen_presort(context, input_image);
+
+	return pathopen_transform_presorted(context, input_image, max_length);
+}
+
+/* - pathopen_transform:
+	The path opening transform of an image.
+*/
+PATH_GRANULOMETRY_IMAGE * pathopen_transform(
+	PATHOPEN_PIX_TYPE * input_image,				/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int K,											/* The maximum number of gaps in the path */
+	int max_length,									/* Longest length to resolve, <= 0 for all */
+	int num_threads									/* Number of worker threads, <= 0 for all cores */
+)
+{
+	Path_Open_Context context(nx, ny, max_length > 0 ? max_length : nx + ny, K, num_threads);
+
+	return pathopen_transform(context, input_image, max_length);
+}
+
+
+/* - pathopen_transform_render:
+	Render the path opening at one length from a path opening transform, looking up each
+	pixel's curve in parallel chunks of the image.
+*/
+void pathopen_transform_render(
+	PATH_GRANULOMETRY_IMAGE * transform,			/* The transform */
+	int path_length,								/* The threshold line length */
+	PATHOPEN_PIX_TYPE * output_image,				/* Output image */
+	int num_threads									/* Number of worker threads, <= 0 for all cores */
+)
+{
+	int num_pixels = transform->num_pixels;
+	int num_chunks;
+
+	if (num_threads <= 0) {
+		num_threads = (int)thread::hardware_concurrency();
+	}
+	num_threads = MAX(num_threads, 1);
+
+	num_chunks = MIN(MAX(num_pixels, 1), 4 * num_threads);
+	run_tasks(num_chunks, num_threads, [&](int chunk, int) {
+		int i;
+		int i_begin = (int)(((long long)num_pixels * chunk) / num_chunks);
+		int i_end = (int)(((long long)num_pixels * (chunk + 1)) / num_chunks);
+
+		for (i = i_begin; i < i_end; ++i) {
+			output_image[i] = pixel_path_length_to_threshold(i, path_length, transform);
+		}
+	});
+}
+
+
+/* - pathopen_memory_size:
+	Bytes of working memory held by a Path_Open_Context for an nx * ny image, once its
+	pixel images hold pixel_size bytes per pixel: the sorted indices, pixel images and
+	sort scratch, and a workspace per thread with queues for either orientation.
+*/
+size_t pathopen_memory_size(
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	size_t pixel_size,								/* Bytes per pixel */
+	int num_threads									/* Number of worker threads, <= 0 for all cores */
+)
+{
+	size_t num_pixels = (size_t)nx * ny;
+	size_t nk = K + 1;
+	size_t context_size, queue_size, workspace_size;
+
+	if (num_threads <= 0) {
+		num_threads = (int)thread::hardware_concurrency();
+	}
+	num_threads = MIN(MAX(num_threads, 1), 4);
+	pixel_size = MAX(pixel_size, sizeof(PATHOPEN_PIX_TYPE));
+
+	context_size = num_pixels * (2 * sizeof(int) + 4 * pixel_size) + image_sort_buffer_size((int)num_pixels, pixel_size);
+	queue_size = MAX(Path_Open_Queue::memory_size(K + 1, ny, nx), Path_Open_Queue::memory_size(K + 1, nx, ny));
+	workspace_size = num_pixels * (2 + nk + 2 * nk * chain_length_size(L)) + 2 * queue_size;
+
+	return context_size + num_threads * workspace_size;
+}
+
+/* - tile_memory_size:
+	Bytes needed to path-open one tile: the context, and the tile's input and output.
+*/
+static size_t tile_memory_size(
+	int nx, int ny,									/* Tile dimensions, halo included */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	size_t pixel_size,								/* Bytes per pixel */
+	int num_threads									/* Number of worker threads */
+)
+{
+	return pathopen_memory_size(nx, ny, L, K, pixel_size, num_threads) + 2 * (size_t)nx * ny * pixel_size;
+}
+
+/* - largest_fitting:
+	The largest n in [0, n_max] for which fits(n) holds, given that it holds for every
+	n below one for which it holds.
+*/
+template <class FITS>
+static int largest_fitting(
+	int n_max,
+	FITS fits										/* Callable, fits(n) */
+)
+{
+	int lo = 0, hi = n_max, mid;
+
+	while (lo < hi) {
+		mid = hi - (hi - lo) / 2;
+		if (fits(mid)) lo = mid;
+		else hi = mid - 1;
+	}
+	return lo;
+}
+
+/* - plan_tiles:
+	Choose the interior size of the tiles of a tiled opening, the largest whose tiles fit
+	the budget once a halo is added all round.  Full-width strips and square tiles are
+	both tried, keeping whichever wastes the smaller fraction of each tile on its halo.
+	Returns false if not even a one-pixel interior fits.
+*/
+static bool plan_tiles(
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	size_t pixel_size,								/* Bytes per pixel */
+	int num_threads,								/* Number of worker threads */
+	size_t memory_budget,							/* Bytes of working memory */
+	int halo,										/* Overlap on each side of a tile */
+	int * tile_nx, int * tile_ny					/* Output: interior dimensions */
+)
+{
+	int strip_ny, square_n, square_ny;
+	double strip_use = 0.0, square_use = 0.0;
+
+	if (tile_memory_size(nx, ny, L, K, pixel_size, num_threads) <= memory_budget) {
+		*tile_nx = nx;
+		*tile_ny = ny;
+		return true;
+	}
+
+	strip_ny = largest_fitting(ny, [&](int n) {
+		return tile_memory_size(nx, n, L, K, pixel_size, num_threads) <= memory_budget;
+	}) - 2 * halo;
+	if (strip_ny > 0) {
+		strip_use = (double)strip_ny / (strip_ny + 2 * halo);
+	}
+
+	/* Squares at least as wide as the image are strips */
+	square_n = largest_fitting(nx - 1, [&](int n) {
+		return tile_memory_size(n, MIN(n, ny), L, K, pixel_size, num_threads) <= memory_budget;
+	}) - 2 * halo;
+	square_ny = MIN(square_n, ny);
+	if (square_n > 0) {
+		square_use = (double)square_n / (square_n + 2 * halo) * square_ny / MIN(square_ny + 2 * halo, ny);
+	}
+
+	if (strip_ny <= 0 && square_n <= 0) return false;
+	if (strip_use >= square_use) {
+		*tile_nx = nx;
+		*tile_ny = strip_ny;
+	} else {
+		*tile_nx = square_n;
+		*tile_ny = square_ny;
+	}
+	return true;
+}
+
+/* Engine_Task:
+	One orientation pass of one tile.
+*/
+struct Engine_Task {
+	int tile;
+	int pass;
+};
+
+/* Engine_Deque:
+	A thread's tasks.  Its owner takes them from the back, most recently read tile first,
+	while other threads steal from the front.
+*/
+struct Engine_Deque {
+	mutex lock;
+	deque<Engine_Task> tasks;
+};
+
+/* Engine_Tile:
+	A tile of a tiled opening, and its working memory while in progress.
+*/
+template <class PIX_TYPE>
+struct Engine_Tile {
+	int x0, y0, x1, y1;								/* Interior */
+	int region_x0, region_y0, region_nx, region_ny;	/* With the halo */
+	size_t memory;									/* Bytes of working memory */
+	Path_Open_Context * context;
+	PIX_TYPE * input_image;
+	PIX_TYPE * output_image;
+	atomic<int> passes_left;						/* Passes still to finish */
+	atomic<int> free_workspaces;					/* Bit w set if context workspace w is free */
+};
+
+/* - tiled_passes:
+	Path-open or -close an image tile by tile on num_threads threads.  Each tile is read
+	with a halo of L pixels on every side the image allows, sorted, and its four
+	orientation passes queued as separate tasks, so that one tile keeps up to four threads
+	busy.  A thread takes the passes it queued itself, steals from the other threads when
+	it has none left, and reads the next tile when there is nothing to steal, but only if
+	the working memory admitted so far leaves room for it.  Whichever thread finishes a
+	tile's last pass reduces the passes, writes the interior back and frees the tile.
+	Tile I/O is serialised.
+*/
+template <class PIX_TYPE>
+static int tiled_passes(
+	Path_Open_Tile_IO<PIX_TYPE> & io,				/* Input and output image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	bool closing,									/* Path closing rather than opening */
+	size_t memory_budget,							/* Bytes of working memory */
+	int num_threads,								/* Number of worker threads, <= 0 for all cores */
+	Path_Open_Engine_Stats * stats					/* Statistics, or NULL */
+)
+{
+	int halo = MAX(L, 0);
+	int tile_nx, tile_ny, num_tiles_x, num_tiles_y, num_tiles;
+	int num_workspaces, tiles_wanted, i, t;
+	int next_tile = 0, tiles_in_flight = 0, max_tiles_in_flight = 0;
+	unsigned int version = 0;
+	size_t memory_in_use = 0, peak_memory = 0;
+	atomic<bool> failed(false);
+	atomic<int> num_steals(0);
+	Engine_Tile<PIX_TYPE> * tiles;
+	Engine_Deque * deques;
+	Path_Open_Tile_Stats * tile_stats;
+	double * busy_times;
+	Path_Open_Pass_Stats * pass_stats;				/* [4 * thread + pass] */
+	mutex admission_lock, io_lock;
+	condition_variable admission_changed;
+	vector<thread> threads;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	auto now = [&]() {
+		return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	};
+
+	if (nx <= 0 || ny <= 0) return 0;
+	if (num_threads <= 0) {
+		num_threads = (int)thread::hardware_concurrency();
+	}
+	num_threads = MAX(num_threads, 1);
+
+	/* A tile's passes run on at most four threads at once, so enough tiles to go round
+		must fit the budget together, and one more to read while the others run */
+	num_workspaces = MIN(num_threads, 4);
+	tiles_wanted = (num_threads == 1) ? 1 : (num_threads + 3) / 4 + 1;
+	if (!plan_tiles(nx, ny, L, K, sizeof(PIX_TYPE), num_workspaces, memory_budget / tiles_wanted, halo, &tile_nx, &tile_ny) &&
+		!plan_tiles(nx, ny, L, K, sizeof(PIX_TYPE), num_workspaces, memory_budget, halo, &tile_nx, &tile_ny)) {
+		return -1;
+	}
+
+	num_tiles_x = (nx + tile_nx - 1) / tile_nx;
+	num_tiles_y = (ny + tile_ny - 1) / tile_ny;
+	num_tiles = num_tiles_x * num_tiles_y;
+
+	tiles = new Engine_Tile<PIX_TYPE> [num_tiles];
+	for (i = 0; i < num_tiles; ++i) {
+		Engine_Tile<PIX_TYPE> & tile = tiles[i];
+
+		tile.x0 = (i % num_tiles_x) * tile_nx;
+		tile.y0 = (i / num_tiles_x) * tile_ny;
+		tile.x1 = MIN(tile.x0 + tile_nx, nx);
+		tile.y1 = MIN(tile.y0 + tile_ny, ny);
+		tile.region_x0 = MAX(tile.x0 - halo, 0);
+		tile.region_y0 = MAX(tile.y0 - halo, 0);
+		tile.region_nx = MIN(tile.x1 + halo, nx) - tile.region_x0;
+		tile.region_ny = MIN(tile.y1 + halo, ny) - tile.region_y0;
+		tile.memory = tile_memory_size(tile.region_nx, tile.region_ny, L, K, sizeof(PIX_TYPE), num_workspaces);
+		tile.context = NULL;
+		tile.input_image = NULL;
+		tile.output_image = NULL;
+	}
+	deques = new Engine_Deque [num_threads];
+	tile_stats = (Path_Open_Tile_Stats *)calloc(num_tiles, sizeof(Path_Open_Tile_Stats));
+	busy_times = (double *)calloc(num_threads, sizeof(double));
+	pass_stats = (Path_Open_Pass_Stats *)calloc(4 * num_threads, sizeof(Path_Open_Pass_Stats));
+
+	/* Free a tile's working memory and return it to the budget.  After a failure no
+		more tiles are admitted. */
+	auto release_tile = [&](int i) {
+		Engine_Tile<PIX_TYPE> & tile = tiles[i];
+
+		delete tile.context;
+		free((void *)tile.input_image);
+		free((void *)tile.output_image);
+		tile.context = NULL;
+
+		lock_guard<mutex> guard(admission_lock);
+		memory_in_use -= tile.memory;
+		--tiles_in_flight;
+		if (failed) next_tile = num_tiles;
+		++version;
+		admission_changed.notify_all();
+	};
+
+	/* Read and sort tile i, queueing its passes on thread t */
+	auto admit_tile = [&](int i, int t) {
+		Engine_Tile<PIX_TYPE> & tile = tiles[i];
+		Path_Open_Tile_Stats & record = tile_stats[i];
+		size_t region_size = (size_t)tile.region_nx * tile.region_ny;
+		double t0 = now(), t1, t2;
+		int pass, status;
+
+		tile.context = new Path_Open_Context(tile.region_nx, tile.region_ny, L, K, num_workspaces);
+		tile.input_image = (PIX_TYPE *)malloc(region_size * sizeof(PIX_TYPE));
+		tile.output_image = (PIX_TYPE *)malloc(region_size * sizeof(PIX_TYPE));
+		{
+			lock_guard<mutex> guard(io_lock);
+			status = io.read_tile(tile.region_x0, tile.region_y0, tile.region_nx, tile.region_ny,
+				tile.input_image, tile.region_nx);
+		}
+		t1 = now();
+		if (status != 0) {
+			failed = true;
+			release_tile(i);
+			return;
+		}
+		presort(*tile.context, tile.input_image, (const int *)NULL, 1);
+		t2 = now();
+
+		record.x = tile.x0;
+		record.y = tile.y0;
+		record.w = tile.x1 - tile.x0;
+		record.h = tile.y1 - tile.y0;
+		record.region_nx = tile.region_nx;
+		record.region_ny = tile.region_ny;
+		record.admit_thread = t;
+		record.admit_time = t0;
+		record.read_time = t1 - t0;
+		record.sort_time = t2 - t1;
+		busy_times[t] += t2 - t0;
+
+		tile.passes_left = 4;
+		tile.free_workspaces = (1 << num_workspaces) - 1;
+		{
+			lock_guard<mutex> guard(deques[t].lock);
+			for (pass = 3; pass >= 0; --pass) {
+				Engine_Task task = {i, pass};
+				deques[t].tasks.push_back(task);
+			}
+		}
+		lock_guard<mutex> guard(admission_lock);
+		++version;
+		admission_changed.notify_all();
+	};
+
+	/* Reduce tile i's passes and write its interior */
+	auto finish_tile = [&](int i, int t) {
+		Engine_Tile<PIX_TYPE> & tile = tiles[i];
+		Path_Open_Context & context = *tile.context;
+		double t0 = now();
+		int status = 0;
+
+		reduce_orientations(tile.region_nx, tile.region_ny, closing, 1, tile.output_image, (PIX_TYPE *)context.diag_image,
+			(PIX_TYPE *)context.horiz_image, (PIX_TYPE *)context.flipped_antidiag_image, 1);
+		{
+			lock_guard<mutex> guard(io_lock);
+			if (!failed) {
+				status = io.write_tile(tile.x0, tile.y0, tile.x1 - tile.x0, tile.y1 - tile.y0,
+					tile.output_image + (tile.x0 - tile.region_x0) + (size_t)tile.region_nx * (tile.y0 - tile.region_y0),
+					tile.region_nx);
+			}
+		}
+		if (status != 0) failed = true;
+
+		tile_stats[i].write_time = now() - t0;
+		tile_stats[i].finish_time = now();
+		busy_times[t] += tile_stats[i].write_time;
+		release_tile(i);
+	};
+
+	/* Run one pass in a free workspace of its tile's context */
+	auto run_pass = [&](Engine_Task task, int t) {
+		Engine_Tile<PIX_TYPE> & tile = tiles[task.tile];
+		Path_Open_Context & context = *tile.context;
+		double t0 = now();
+		int free_workspaces, w;
+
+		/* No more passes of a tile run at once than it has workspaces */
+		free_workspaces = tile.free_workspaces;
+		do {
+			for (w = 0; !(free_workspaces & (1 << w)); ++w);
+		} while (!tile.free_workspaces.compare_exchange_weak(free_workspaces, free_workspaces & ~(1 << w)));
+
+		run_orientation_passes(context, tile.input_image, closing, L, (const int *)NULL, 0, (Path_Open_Transform_Log * *)NULL,
+			tile.output_image, (PIX_TYPE *)context.diag_image, (PIX_TYPE *)context.horiz_image,
+			(PIX_TYPE *)context.flipped_antidiag_image, task.pass, context.workspaces[w]);
+#ifdef PATHOPEN_STATS
+		add_pass_stats(pass_stats[4 * t + task.pass], context.workspaces[w]->stats);
+#endif
+
+		tile.free_workspaces |= 1 << w;
+		tile_stats[task.tile].pass_threads[task.pass] = t;
+		tile_stats[task.tile].pass_times[task.pass] = now() - t0;
+		busy_times[t] += tile_stats[task.tile].pass_times[task.pass];
+
+		if (--tile.passes_left == 0) {
+			finish_tile(task.tile, t);
+		}
+	};
+
+	/* Take a task from the back of thread t's deque, or steal one from the front of another's */
+	auto next_task = [&](int t, Engine_Task & task) {
+		int v;
+
+		for (v = 0; v < num_threads; ++v) {
+			Engine_Deque & victim = deques[(t + v) % num_threads];
+			lock_guard<mutex> guard(victim.lock);
+
+			if (!victim.tasks.empty()) {
+				if (v == 0) {
+					task = victim.tasks.back();
+					victim.tasks.pop_back();
+				} else {
+					task = victim.tasks.front();
+					victim.tasks.pop_front();
+					++num_steals;
+				}
+				return true;
+			}
+		}
+		return false;
+	};
+
+	auto worker = [&](int t) {
+		Engine_Task task;
+		unsigned int seen;
+		int i;
+
+		for (;;) {
+			{
+				lock_guard<mutex> guard(admission_lock);
+				seen = version;
+			}
+			if (next_task(t, task)) {
+				run_pass(task, t);
+				continue;
+			}
+
+			unique_lock<mutex> guard(admission_lock);
+			if (next_tile < num_tiles &&
+				(tiles_in_flight == 0 || memory_in_use + tiles[next_tile].memory <= memory_budget)) {
+				i = next_tile++;
+				memory_in_use += tiles[i].memory;
+				peak_memory = MAX(peak_memory, memory_in_use);
+				++tiles_in_flight;
+				max_tiles_in_flight = MAX(max_tiles_in_flight, tiles_in_flight);
+				guard.unlock();
+
+				admit_tile(i, t);
+				continue;
+			}
+			if (next_tile == num_tiles && tiles_in_flight == 0) break;
+
+			/* Wait for a tile to be queued or freed */
+			admission_changed.wait(guard, [&]() { return version != seen; });
+		}
+	};
+
+	for (t = 1; t < num_threads; ++t) {
+		threads.push_back(thread(worker, t));
+	}
+	worker(0);
+	for (t = 0; t < (int)threads.size(); ++t) {
+		threads[t].join();
+	}
+
+	if (stats != NULL) {
+		free((void *)stats->tiles);
+		stats->num_threads = num_threads;
+		stats->tile_nx = tile_nx;
+		stats->tile_ny = tile_ny;
+		stats->halo = halo;
+		stats->memory_budget = memory_budget;
+		stats->peak_memory = peak_memory;
+		stats->max_tiles_in_flight = max_tiles_in_flight;
+		stats->num_steals = num_steals;
+		stats->elapsed_time = now();
+		stats->busy_time = 0.0;
+		memset(stats->pass_stats, 0, sizeof(stats->pass_stats));
+		for (t = 0; t < num_threads; ++t) {
+			stats->busy_time += busy_times[t];
+			for (i = 0; i < 4; ++i) {
+				add_pass_stats(stats->pass_stats[i], pass_stats[4 * t + i]);
+			}
+		}
+		stats->num_tiles = num_tiles;
+		stats->tiles = tile_stats;
+	} else {
+		free((void *)tile_stats);
+	}
+
+	free((void *)busy_times);
+	free((void *)pass_stats);
+	delete [] deques;
+	delete [] tiles;
+
+	return failed ? -1 : 0;
+}
+
+/* Image_Tile_IO:
+	Tile I/O on input and output images held in memory.
+*/
+template <class PIX_TYPE>
+class Image_Tile_IO : public Path_Open_Tile_IO<PIX_TYPE> {
+public:
+	PIX_TYPE * input_image;
+	PIX_TYPE * output_image;
+	int nx;											/* Image width */
+
+	Image_Tile_IO(PIX_TYPE * input_image, PIX_TYPE * output_image, int nx) :
+		input_image(input_image), output_image(output_image), nx(nx) {}
+
+	int read_tile(int x, int y, int w, int h, PIX_TYPE * tile, int stride) {
+		int j;
+		for (j = 0; j < h; ++j) {
+			memcpy(tile + (size_t)stride * j, input_image + x + (size_t)nx * (y + j), w * sizeof(PIX_TYPE));
+		}
+		return 0;
+	}
+
+	int write_tile(int x, int y, int w, int h, const PIX_TYPE * tile, int stride) {
+		int j;
+		for (j = 0; j < h; ++j) {
+			memcpy(output_image + x + (size_t)nx * (y + j), tile + (size_t)stride * j, w * sizeof(PIX_TYPE));
+		}
+		return 0;
+	}
+};
+
+/* - pathopen_tiled:
+	Perform a path opening tile by tile, in parallel within a memory budget.
+*/
+template <class PIX_TYPE>
+int pathopen_tiled(
+	Path_Open_Tile_IO<PIX_TYPE> & io,				/* Input and output image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	size_t memory_budget,							/* Bytes of working memory */
+	int num_threads,								/* Number of worker threads, <= 0 for all cores */
+	Path_Open_Engine_Stats * stats					/* Statistics, or NULL */
+)
+{
+	return tiled_passes(io, nx, ny, L, K, false, memory_budget, num_threads, stats);
+}
+
+template <class PIX_TYPE>
+int pathopen_tiled(
+	PIX_TYPE * input_image,							/* The input image */
 	int nx, int ny,									/* Image dimensions */
 	int L,											/* The threshold line length */
 	int K,											/* The maximum number of gaps in the path */
-	PATHOPEN_PIX_TYPE * output_image				/* Output image */
+	PIX_TYPE * output_image,						/* Output image */
+	size_t memory_budget,							/* Bytes of working memory */
+	int num_threads,								/* Number of worker threads, <= 0 for all cores */
+	Path_Open_Engine_Stats * stats					/* Statistics, or NULL */
 )
 {
-	int i, num_pixels;
+	Image_Tile_IO<PIX_TYPE> io(input_image, output_image, nx);
+
+	return tiled_passes(io, nx, ny, L, K, false, memory_budget, num_threads, stats);
+}
 
-	PATHOPEN_PIX_TYPE * accumulator_image;
+/* - pathclose_tiled:
+	Perform a path closing tile by tile, in parallel within a memory budget.
+*/
+template <class PIX_TYPE>
+int pathclose_tiled(
+	Path_Open_Tile_IO<PIX_TYPE> & io,				/* Input and output image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	size_t memory_budget,							/* Bytes of working memory */
+	int num_threads,								/* Number of worker threads, <= 0 for all cores */
+	Path_Open_Engine_Stats * stats					/* Statistics, or NULL */
+)
+{
+	return tiled_passes(io, nx, ny, L, K, true, memory_budget, num_threads, stats);
+}
 
-	PATHOPEN_PIX_TYPE * transposed_input_image;
-	PATHOPEN_PIX_TYPE * flipped_input_image;
+template <class PIX_TYPE>
+int pathclose_tiled(
+	PIX_TYPE * input_image,							/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_image,						/* Output image */
+	size_t memory_budget,							/* Bytes of working memory */
+	int num_threads,								/* Number of worker threads, <= 0 for all cores */
+	Path_Open_Engine_Stats * stats					/* Statistics, or NULL */
+)
+{
+	Image_Tile_IO<PIX_TYPE> io(input_image, output_image, nx);
 
-	int * sorted_indices;
-	int * transposed_sorted_indices;
-	int * flipped_sorted_indices;
+	return tiled_passes(io, nx, ny, L, K, true, memory_budget, num_threads, stats);
+}
 
-	num_pixels = nx * ny;
 
-	/* Allocate memory */
-	accumulator_image = (PATHOPEN_PIX_TYPE *)malloc(num_pixels * sizeof(PATHOPEN_PIX_TYPE));
+/* Path_Open_Stream:
+	An empty stream, with a window of band_rows + 2 * L rows.
+*/
+template <class PIX_TYPE>
+Path_Open_Stream<PIX_TYPE>::Path_Open_Stream(
+	int nx,											/* Image width */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	bool closing,									/* Path closing rather than opening */
+	int band_rows,									/* Output rows per band, <= 0 for 2 * L */
+	int num_threads									/* Number of worker threads, <= 0 for all cores */
+)
+{
+	int window_capacity;
+
+	this->nx = nx;
+	this->L = L;
+	this->K = K;
+	this->closing = closing;
+	this->halo = MAX(L, 0);
+	this->band_rows = (band_rows > 0) ? band_rows : MAX(2 * L, 1);
+	this->num_threads = num_threads;
+
+	window_capacity = this->band_rows + 2 * halo;
+	window = (PIX_TYPE *)malloc((size_t)nx * window_capacity * sizeof(PIX_TYPE));
+	band_output = (PIX_TYPE *)malloc((size_t)nx * window_capacity * sizeof(PIX_TYPE));
+	window_y = 0;
+	window_rows = 0;
+	next_y = 0;
+	context = NULL;
+	memset(pass_stats, 0, sizeof(pass_stats));
+}
+
+template <class PIX_TYPE>
+Path_Open_Stream<PIX_TYPE>::~Path_Open_Stream()
+{
+	delete context;
+	free((void *)window);
+	free((void *)band_output);
+}
+
+/* push_row:
+	Append a row to the window, emitting a band once L rows below it have arrived.
+*/
+template <class PIX_TYPE>
+int Path_Open_Stream<PIX_TYPE>::push_row(
+	const PIX_TYPE * input_row,						/* nx pixels */
+	PIX_TYPE * output_rows							/* Finished rows, if any */
+)
+{
+	memcpy(window + (size_t)nx * window_rows, input_row, nx * sizeof(PIX_TYPE));
+	++window_rows;
+
+	if (window_y + window_rows < next_y + band_rows + halo) return 0;
+	return emit(next_y + band_rows, output_rows);
+}
+
+/* finish:
+	Emit everything left, the window's last rows being the bottom of the image.
+*/
+template <class PIX_TYPE>
+int Path_Open_Stream<PIX_TYPE>::finish(
+	PIX_TYPE * output_rows							/* The remaining rows */
+)
+{
+	int num_rows = 0;
+
+	if (window_y + window_rows > next_y) {
+		num_rows = emit(window_y + window_rows, output_rows);
+	}
+
+	window_y = 0;
+	window_rows = 0;
+	next_y = 0;
+
+	return num_rows;
+}
+
+/* emit:
+	Open the whole window, which starts L rows above next_y or at the top of the image,
+	copy out rows next_y to y_end - 1, and keep the last L rows of the window as the
+	halo above the next band.  The window is the same height for every band but the
+	first and the last, so the context is seldom rebuilt.
+*/
+template <class PIX_TYPE>
+int Path_Open_Stream<PIX_TYPE>::emit(
+	int y_end,										/* Row after the last to write */
+	PIX_TYPE * output_rows							/* Written rows */
+)
+{
+	int num_rows = y_end - next_y;
+	int new_window_y;
+
+	if (context == NULL || context->ny != window_rows) {
+		delete context;
+		context = new Path_Open_Context(nx, window_rows, L, K, num_threads);
+	}
+	if (closing) pathclose(*context, window, band_output);
+	else pathopen(*context, window, band_output);
+#ifdef PATHOPEN_STATS
+	add_pass_stats(pass_stats[0], context->pass_stats[0]);
+	add_pass_stats(pass_stats[1], context->pass_stats[1]);
+	add_pass_stats(pass_stats[2], context->pass_stats[2]);
+	add_pass_stats(pass_stats[3], context->pass_stats[3]);
+#endif
+
+	memcpy(output_rows, band_output + (size_t)nx * (next_y - window_y), (size_t)nx * num_rows * sizeof(PIX_TYPE));
+
+	new_window_y = MAX(y_end - halo, 0);
+	window_rows -= new_window_y - window_y;
+	memmove(window, window + (size_t)nx * (new_window_y - window_y), (size_t)nx * window_rows * sizeof(PIX_TYPE));
+	window_y = new_window_y;
+	next_y = y_end;
 
-	transposed_input_image = (PATHOPEN_PIX_TYPE *)malloc(num_pixels * sizeof(PATHOPEN_PIX_TYPE));
-	flipped_input_image = (PATHOPEN_PIX_TYPE *)malloc(num_pixels * sizeof(PATHOPEN_PIX_TYPE));
+	return num_rows;
+}
+
+
+/* Explicit instantiations for the supported pixel types, see pathopenclose.h */
+#define PATHOPEN_INSTANTIATE(PIX_TYPE) \
+	template int pathopen<PIX_TYPE>(PIX_TYPE *, int, int, int, int, PIX_TYPE *); \
+	template int pathopen_threaded<PIX_TYPE>(PIX_TYPE *, int, int, int, int, PIX_TYPE *, int); \
+	template int pathopen<PIX_TYPE>(Path_Open_Context &, PIX_TYPE *, PIX_TYPE *); \
+	template void pathopen_presort<PIX_TYPE>(Path_Open_Context &, PIX_TYPE *, const int *); \
+	template int pathopen_presorted<PIX_TYPE>(Path_Open_Context &, PIX_TYPE *, PIX_TYPE *); \
+	template int pathclose<PIX_TYPE>(PIX_TYPE *, int, int, int, int, PIX_TYPE *); \
+	template int pathclose_threaded<PIX_TYPE>(PIX_TYPE *, int, int, int, int, PIX_TYPE *, int); \
+	template int pathclose<PIX_TYPE>(Path_Open_Context &, PIX_TYPE *, PIX_TYPE *); \
+	template int pathclose_presorted<PIX_TYPE>(Path_Open_Context &, PIX_TYPE *, PIX_TYPE *); \
+	template int pathopen_stack<PIX_TYPE>(PIX_TYPE *, int, int, const int *, int, int, PIX_TYPE *); \
+	template int pathopen_stack<PIX_TYPE>(Path_Open_Context &, PIX_TYPE *, const int *, int, PIX_TYPE *); \
+	template int pathopen_stack_presorted<PIX_TYPE>(Path_Open_Context &, PIX_TYPE *, const int *, int, PIX_TYPE *); \
+	template int pathclose_stack<PIX_TYPE>(PIX_TYPE *, int, int, const int *, int, int, PIX_TYPE *); \
+	template int pathclose_stack<PIX_TYPE>(Path_Open_Context &, PIX_TYPE *, const int *, int, PIX_TYPE *); \
+	template int pathclose_stack_presorted<PIX_TYPE>(Path_Open_Context &, PIX_TYPE *, const int *, int, PIX_TYPE *); \
+	template int pathopen_tiled<PIX_TYPE>(Path_Open_Tile_IO<PIX_TYPE> &, int, int, int, int, size_t, int, Path_Open_Engine_Stats *); \
+	template int pathopen_tiled<PIX_TYPE>(PIX_TYPE *, int, int, int, int, PIX_TYPE *, size_t, int, Path_Open_Engine_Stats *); \
+	template int pathclose_tiled<PIX_TYPE>(Path_Open_Tile_IO<PIX_TYPE> &, int, int, int, int, size_t, int, Path_Open_Engine_Stats *); \
+	template int pathclose_tiled<PIX_TYPE>(PIX_TYPE *, int, int, int, int, PIX_TYPE *, size_t, int, Path_Open_Engine_Stats *); \
+	template class Path_Open_Stream<PIX_TYPE>;
+
+PATHOPEN_INSTANTIATE(unsigned char)
+PATHOPEN_INSTANTIATE(unsigned short)
+PATHOPEN_INSTANTIATE(float)
+
+
+/* Path_Open_Context:
+	Allocate all working memory for path openings of nx * ny images.
+*/
+Path_Open_Context::Path_Open_Context(
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	int num_threads									/* Number of worker threads, <= 0 for all cores */
+)
+{
+	int t, num_pixels;
+
+	if (num_threads <= 0) {
+		num_threads = (int)thread::hardware_concurrency();
+	}
+	/* There are only four orientation passes to share out */
+	num_threads = MIN(MAX(num_threads, 1), 4);
+
+	this->nx = nx;
+	this->ny = ny;
+	this->L = L;
+	this->K = K;
+	this->num_threads = num_threads;
 
+	num_pixels = nx * ny;
+
+	/* Allocate memory */
 	sorted_indices = (int *)malloc(num_pixels * sizeof(int));
-	transposed_sorted_indices = (int *)malloc(num_pixels * sizeof(int));
 	flipped_sorted_indices = (int *)malloc(num_pixels * sizeof(int));
+	flipped_input_image = NULL;
+
+	diag_image = NULL;
+	horiz_image = NULL;
+	flipped_antidiag_image = NULL;
+	sort_buffer = NULL;
+	pixel_size = 0;
+	reserve_pixel_images(sizeof(PATHOPEN_PIX_TYPE));
+
+	stack_images = NULL;
+	stack_images_size = 0;
+
+	for (t = 0; t < 4; ++t) {
+		pass_times[t] = 0.0;
+	}
+	memset(pass_stats, 0, sizeof(pass_stats));
+
+	workspaces = new Path_Open_Workspace * [num_threads];
+	for (t = 0; t < num_threads; ++t) {
+		workspaces[t] = new Path_Open_Workspace(nx, ny, K);
+		workspaces[t]->reserve_chain_images(chain_length_size(L));
+	}
+}
+
+Path_Open_Context::~Path_Open_Context()
+{
+	int t;
+
+	/* Free allocated memory */
+	for (t = 0; t < num_threads; ++t) {
+		delete workspaces[t];
+	}
+	delete [] workspaces;
+
+	free((void *)sorted_indices);
+	free((void *)flipped_sorted_indices);
+	free(flipped_input_image);
+
+	free(diag_image);
+	free(horiz_image);
+	free(flipped_antidiag_image);
+	free(sort_buffer);
+	free(stack_images);
+}
+
+/* reserve_pixel_images:
+	Grow the pixel images to hold pixels of the given size.
+*/
+void Path_Open_Context::reserve_pixel_images(
+	size_t pixel_size								/* Bytes per pixel */
+)
+{
+	int num_pixels = nx * ny;
+
+	if (pixel_size > this->pixel_size) {
+		free(flipped_input_image);
+		free(diag_image);
+		free(horiz_image);
+		free(flipped_antidiag_image);
+		free(sort_buffer);
+
+		flipped_input_image = malloc(num_pixels * pixel_size);
+		diag_image = malloc(num_pixels * pixel_size);
+		horiz_image = malloc(num_pixels * pixel_size);
+		flipped_antidiag_image = malloc(num_pixels * pixel_size);
+		sort_buffer = pixel_size > sizeof(unsigned char) ? malloc(image_sort_buffer_size(num_pixels, pixel_size)) : NULL;
+		this->pixel_size = pixel_size;
+	}
+}
+
+/* reserve_stack_images:
+	Grow the per-orientation stacks to hold num_lengths images of the current pixel size.
+*/
+void Path_Open_Context::reserve_stack_images(
+	int num_lengths									/* Images per orientation */
+)
+{
+	size_t size = 3 * (size_t)num_lengths * nx * ny * pixel_size;
+
+	if (size > stack_images_size) {
+		free(stack_images);
+		stack_images = malloc(size);
+		stack_images_size = size;
+	}
+}
+
+/* Path_Open_Context_Cache:
+	An empty cache.
+*/
+Path_Open_Context_Cache::Path_Open_Context_Cache(
+	int max_contexts,								/* Contexts kept */
+	int num_threads									/* Worker threads of each context */
+)
+{
+	this->max_contexts = MAX(max_contexts, 1);
+	this->num_threads = num_threads;
+	num_contexts = 0;
+	contexts = (Path_Open_Context * *)malloc(this->max_contexts * sizeof(Path_Open_Context *));
+}
+
+Path_Open_Context_Cache::~Path_Open_Context_Cache()
+{
+	int c;
+
+	for (c = 0; c < num_contexts; ++c) {
+		delete contexts[c];
+	}
+	free((void *)contexts);
+}
+
+/* context:
+	Find the context for this size and K, or make one in place of the least recently
+	used, and move it to the end.
+*/
+Path_Open_Context & Path_Open_Context_Cache::context(
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K											/* The maximum number of gaps in the path */
+)
+{
+	Path_Open_Context * found;
+	int c;
+
+	for (c = num_contexts - 1; c >= 0; --c) {
+		if (contexts[c]->nx == nx && contexts[c]->ny == ny && contexts[c]->K == K) break;
+	}
+	if (c >= 0) {
+		found = contexts[c];
+	} else if (num_contexts < max_contexts) {
+		found = new Path_Open_Context(nx, ny, L, K, num_threads);
+		c = num_contexts++;
+	} else {
+		delete contexts[0];
+		found = new Path_Open_Context(nx, ny, L, K, num_threads);
+		c = 0;
+	}
+	for (; c + 1 < num_contexts; ++c) {
+		contexts[c] = contexts[c + 1];
+	}
+	contexts[num_contexts - 1] = found;
+
+	found->L = L;
+	return *found;
+}
+
+
+/* Path_Open_Engine_Stats:
+	Empty statistics, filled in by a tiled opening.
+*/
+Path_Open_Engine_Stats::Path_Open_Engine_Stats()
+{
+	num_threads = 0;
+	tile_nx = tile_ny = 0;
+	halo = 0;
+	memory_budget = peak_memory = 0;
+	max_tiles_in_flight = 0;
+	num_steals = 0;
+	elapsed_time = busy_time = 0.0;
+	memset(pass_stats, 0, sizeof(pass_stats));
+	num_tiles = 0;
+	tiles = NULL;
+}
+
+Path_Open_Engine_Stats::~Path_Open_Engine_Stats()
+{
+	free((void *)tiles);
+}
+
+/* print:
+	Report the statistics, with a line per tile if asked.  Utilisation is the work done
+	over the threads' time available.
+*/
+void Path_Open_Engine_Stats::print(
+	bool per_tile									/* Also list every tile */
+) const
+{
+	int i;
+
+	printf("%d tiles of up to %d x %d, halo %d, on %d threads\n", num_tiles, tile_nx, tile_ny, halo, num_threads);
+	printf("peak memory %lu of %lu bytes, up to %d tiles in flight, %d passes stolen\n",
+		(unsigned long)peak_memory, (unsigned long)memory_budget, max_tiles_in_flight, num_steals);
+	printf("%.3f s elapsed, %.3f s busy, %.0f%% utilisation\n", elapsed_time, busy_time,
+		elapsed_time > 0.0 ? 100.0 * busy_time / (elapsed_time * num_threads) : 0.0);
+
+	if (per_tile) {
+		printf("tile x y w h region thread admitted finished read sort pass0 pass1 pass2 pass3 write stolen\n");
+		for (i = 0; i < num_tiles; ++i) {
+			const Path_Open_Tile_Stats & tile = tiles[i];
+			int pass, num_stolen = 0;
+
+			for (pass = 0; pass < 4; ++pass) {
+				if (tile.pass_threads[pass] != tile.admit_thread) ++num_stolen;
+			}
+			printf("%d %d %d %d %d %dx%d %d %.4f %.4f %.4f %.4f %.4f %.4f %.4f %.4f %.4f %d\n",
+				i, tile.x, tile.y, tile.w, tile.h, tile.region_nx, tile.region_ny, tile.admit_thread,
+				tile.admit_time, tile.finish_time, tile.read_time, tile.sort_time,
+				tile.pass_times[0], tile.pass_times[1], tile.pass_times[2], tile.pass_times[3],
+				tile.write_time, num_stolen);
+		}
+	}
+
+	if (pathopen_stats_enabled()) {
+		pathopen_print_stats(pass_stats);
+	}
+}
+
+
+/* - pathopen_stats_enabled:
+	Whether the kernels count into Path_Open_Pass_Stats.
+*/
+bool pathopen_stats_enabled()
+{
+#ifdef PATHOPEN_STATS
+	return true;
+#else
+	return false;
+#endif
+}
+
+/* - pathopen_print_stats:
+	Report the pass statistics of the context's last whole-image call, a line per
+	orientation and their total.  Entries are counted per gap number.
+*/
+void pathopen_print_stats(
+	const Path_Open_Context & context				/* Context of the call */
+)
+{
+	pathopen_print_stats(context.pass_stats);
+}
+
+/* - pathopen_print_stats:
+	Report the pass statistics of four orientations, a line each and their total.
+*/
+void pathopen_print_stats(
+	const Path_Open_Pass_Stats * pass_stats			/* Statistics of the four orientations */
+)
+{
+	static const char * names[4] = { "vertical", "++diagonal", "horizontal", "+-diagonal" };
+	Path_Open_Pass_Stats total;
+	int pass;
+
+	if (!pathopen_stats_enabled()) {
+		printf("no pass statistics: the library was compiled without PATHOPEN_STATS\n");
+		return;
+	}
+
+	memset(&total, 0, sizeof(total));
+	printf("pass levels seeds enqueued_down enqueued_up merges merged chain_updates early_outs seed_s down_s up_s\n");
+	for (pass = 0; pass <= 4; ++pass) {
+		const Path_Open_Pass_Stats & stats = (pass < 4) ? pass_stats[pass] : total;
+
+		printf("%s %lld %lld %lld %lld %lld %lld %lld %lld %.4f %.4f %.4f\n", (pass < 4) ? names[pass] : "total",
+			stats.num_levels, stats.num_seeds, stats.num_enqueued_down, stats.num_enqueued_up,
+			stats.num_merges, stats.num_merged, stats.num_chain_updates, stats.num_early_outs,
+			stats.seed_time, stats.down_time, stats.up_time);
+		if (pass < 4) {
+			add_pass_stats(total, stats);
+		}
+	}
+}
+
+
+/* Path_Open_Workspace:
+	Allocate the working memory of one orientation pass over an nx * ny or ny * nx image.
+*/
+Path_Open_Workspace::Path_Open_Workspace(
+	int nx, int ny,									/* Image dimensions */
+	int K											/* The maximum gap number */
+) :
+	path_queue_up(K + 1, ny, nx),
+	path_queue_down(K + 1, ny, nx)
+{
+	num_pixels = nx * ny;
+	nk = K + 1;
+
+	bin_input_image = (char *)malloc(num_pixels * sizeof(char));
+	chain_image_up = NULL;
+	chain_image_down = NULL;
+	chain_length_size = 0;
+	bin_output_image_array = (char *)malloc((size_t)num_pixels * nk * sizeof(char));
+	bin_output_image_count = (char *)malloc(num_pixels * sizeof(char));
+	memset(&stats, 0, sizeof(stats));
+}
+
+/* reserve_chain_images:
+	Grow the chain images to hold chain lengths of the given size.
+*/
+void Path_Open_Workspace::reserve_chain_images(
+	size_t chain_length_size						/* Bytes per chain length */
+)
+{
+	if (chain_length_size > this->chain_length_size) {
+		free(chain_image_up);
+		free(chain_image_down);
+		chain_image_up = malloc((size_t)num_pixels * nk * chain_length_size);
+		chain_image_down = malloc((size_t)num_pixels * nk * chain_length_size);
+		this->chain_length_size = chain_length_size;
+	}
+}
+
+Path_Open_Workspace::~Path_Open_Workspace()
+{
+	free((void *)bin_input_image);
+
+	free(chain_image_up);
+	free(chain_image_down);
+
+	free((void *)bin_output_image_array);
+	free((void *)bin_output_image_count);
+}
+
+
+/* Path_Open_Transform_Log:
+	Allocate the curves of one orientation pass, initially empty.  Every pixel gets a
+	point at least, so the pool starts with one per pixel.  Sets failed if out of memory.
+*/
+Path_Open_Transform_Log::Path_Open_Transform_Log(
+	int num_pixels,
+	int max_length									/* Longer paths are recorded as this long */
+)
+{
+	int i;
+
+	this->num_pixels = num_pixels;
+	this->max_length = max_length;
+
+	path_length = (int *)malloc(num_pixels * sizeof(int));
+	last_point = (int *)malloc(num_pixels * sizeof(int));
+	num_points = (int *)malloc(num_pixels * sizeof(int));
+
+	size = 0;
+	allocated_size = MAX(num_pixels, PATH_GRANULOMETRY_MIN_ALLOCATED_LENGTH);
+	points = (Path_Open_Transform_Point *)malloc(allocated_size * sizeof(Path_Open_Transform_Point));
+
+	failed = path_length == NULL || last_point == NULL || num_points == NULL || points == NULL;
+	if (failed) return;
+
+	for (i = 0; i < num_pixels; ++i) {
+		last_point[i] = -1;
+	}
+	memset(num_points, 0, num_pixels * sizeof(int));
+}
+
+Path_Open_Transform_Log::~Path_Open_Transform_Log()
+{
+	free((void *)path_length);
+	free((void *)last_point);
+	free((void *)num_points);
+	free((void *)points);
+}
+
+/* add_point:
+	Add a point to the curve of a pixel, eliding into its last point as add_point() does.
+	Points arrive in non-decreasing threshold and non-increasing path length.  If the pool
+	cannot grow, the point is dropped and failed set.
+*/
+inline void Path_Open_Transform_Log::add_point(
+	int pixel_index,
+	int path_length,								/* The path_length of the new point */
+	GPOT_PIX_TYPE threshold							/* The grayscale threshold of the new point */
+)
+{
+	int last = last_point[pixel_index];
+
+	if (path_length > max_length) path_length = max_length;
+
+	if (last >= 0) {
+		/* == length, > threshold -> update existing point */
+		if (path_length == points[last].path_length) {
+			if (threshold > points[last].threshold) {
+				points[last].threshold = threshold;
+			}
+			return;
+		}
+		/* == threshold -> skip */
+		if (threshold == points[last].threshold) {
+			return;
+		}
+	}
+
+	/* Grow the pool, whose points link to one another by int index */
+	if (size == allocated_size) {
+		size_t grown_size = MIN(2 * allocated_size, (size_t)INT_MAX);
+		Path_Open_Transform_Point * grown = NULL;
+
+		if (grown_size > allocated_size) {
+			grown = (Path_Open_Transform_Point *)realloc((void *)points, grown_size * sizeof(Path_Open_Transform_Point));
+		}
+		if (grown == NULL) {
+			failed = true;
+			return;
+		}
+		points = grown;
+		allocated_size = grown_size;
+	}
+
+	points[size].path_length = path_length;
+	points[size].previous = last;
+	points[size].threshold = threshold;
+	last_point[pixel_index] = (int)size;
+	++num_points[pixel_index];
+	++size;
+}
 
-	/* Sort the image pixels, storing pixel indices */
-	image_sort(input_image, num_pixels, sorted_indices);
 
-	/* Create a transposed copy of the original image */
-	transpose_image((void *)input_image, nx, ny, sizeof(PATHOPEN_PIX_TYPE), (void *)transposed_input_image);
-	transpose_indices(sorted_indices, nx, ny, transposed_sorted_indices);
+/* GAP_INDEX:
+	Position of gap number k at a pixel in the per-gap images (chain lengths and output
+	flags), interleaved as [k + nk * index] or planar as [index + num_pixels * k].
+	Expects PLANAR, nk and num_pixels in scope.
+*/
+#define GAP_INDEX(k, index) (PLANAR ? (index) + num_pixels * (k) : (k) + nk * (index))
 
-	/* Create a flipped copy of the original image */
-	flip_image((void *)input_image, nx, ny, sizeof(PATHOPEN_PIX_TYPE), (void *)flipped_input_image);
-	flip_indices(sorted_indices, nx, ny, flipped_sorted_indices);
+/* IMAGE_INDEX, IMAGE_X, IMAGE_Y:
+	Index into the input and output images of the kernel's pixel (x, y), and back.  The
+	kernel works on an nx * ny image, stored as such or, if TRANSPOSED, as its ny * nx
+	transpose.  Working images stay in the kernel's own layout, [x + nx * y].
+	Expects TRANSPOSED, nx and ny in scope.
+*/
+#define IMAGE_INDEX(x, y) (TRANSPOSED ? (y) + ny * (x) : (x) + nx * (y))
+#define IMAGE_X(image_index) (TRANSPOSED ? (image_index) / ny : (image_index) % nx)
+#define IMAGE_Y(image_index) (TRANSPOSED ? (image_index) % ny : (image_index) / nx)
+
+/* - stack_extinguish:
+	In a multi-length pass, the longest path through a pixel has dropped to path_length.
+	The lengths still alive there are the smallest alive_count of them: each that now
+	exceeds path_length records the threshold in its output image and dies.
+*/
+template <class PIX_TYPE>
+static inline void stack_extinguish(
+	const int * lengths,							/* The increasing lengths */
+	char & alive_count,								/* Number of lengths still alive at the pixel */
+	int path_length,								/* Longest path through the pixel */
+	PIX_TYPE threshold,								/* Current threshold */
+	PIX_TYPE * output_stack,						/* One output image per length */
+	int output_index,								/* Index of the pixel in an output image */
+	int num_pixels									/* Pixels per output image */
+)
+{
+	while (alive_count > 0 && lengths[alive_count - 1] > path_length) {
+		--alive_count;
+		output_stack[output_index + num_pixels * alive_count] = threshold;
+	}
+}
 
-	/* Vertical path opening */
-	vert_pathopen(input_image, sorted_indices, nx, ny, L, K, output_image);
+/* - stack_shorten:
+	In a multi-length pass, one path through a pixel still in the binary image has shortened
+	to pair_length.  Only if that falls short of the longest length alive there can any
+	die, so only then is the longest path over all gap numbers recomputed.
+*/
+template <class PIX_TYPE, class CHAIN_TYPE, bool PLANAR>
+static inline void stack_shorten(
+	const int * lengths,							/* The increasing lengths */
+	char & alive_count,								/* Number of lengths still alive at the pixel */
+	int pair_length,								/* The new length of the shortened path */
+	CHAIN_TYPE * chain_image_up,					/* Up/down chain lengths */
+	CHAIN_TYPE * chain_image_down,
+	int index,										/* Index of the pixel in the chain images */
+	int num_pixels, int nk,							/* Chain image dimensions */
+	PIX_TYPE threshold,								/* Current threshold */
+	PIX_TYPE * output_stack,						/* One output image per length */
+	int output_index								/* Index of the pixel in an output image */
+)
+{
+	int k, path_length;
+	int K = nk - 1;
 
-	/* ++diagonal path opening */
-	diag_pathopen(input_image, sorted_indices, nx, ny, L, K, accumulator_image);
+	if (alive_count == 0 || pair_length >= lengths[alive_count - 1]) return;
 
-	/* Accumulate results */
-	for (i = 0; i < num_pixels; ++i) {
-		output_image[i] = MAX(output_image[i], accumulator_image[i]);
+	path_length = pair_length;
+	for (k = 0; k < nk; ++k) {
+		path_length = MAX(path_length, chain_image_up[GAP_INDEX(k, index)] + chain_image_down[GAP_INDEX(K - k, index)] + 1);
 	}
+	stack_extinguish(lengths, alive_count, path_length, threshold, output_stack, output_index, num_pixels);
+}
 
-	/* Horizontal path opening */
-	vert_pathopen(transposed_input_image, transposed_sorted_indices, ny, nx, L, K, accumulator_image);
-	transpose_image((void *)accumulator_image, ny, nx, sizeof(PATHOPEN_PIX_TYPE), (void *)accumulator_image);
-	/* Accumulate into output */
-	for (i = 0; i < num_pixels; ++i) {
-		output_image[i] = MAX(output_image[i], accumulator_image[i]);
-	}
+/* - transform_shorten:
+	In a transform pass, one path through a pixel still in the binary image has shortened
+	to pair_length.  If the pixel's longest path is now shorter, the length it had up to
+	this threshold becomes a point of its curve.
+*/
+template <class PIX_TYPE, class CHAIN_TYPE, bool PLANAR>
+static inline void transform_shorten(
+	Path_Open_Transform_Log & log,					/* The pass's curves */
+	int pair_length,								/* The new length of the shortened path */
+	CHAIN_TYPE * chain_image_up,					/* Up/down chain lengths */
+	CHAIN_TYPE * chain_image_down,
+	int index,										/* Index of the pixel in the chain images */
+	int num_pixels, int nk,							/* Chain image dimensions */
+	PIX_TYPE threshold,								/* Current threshold */
+	int output_index								/* Index of the pixel in the output image */
+)
+{
+	int k, path_length;
+	int K = nk - 1;
 
-	/* +-diagonal path opening */
-	diag_pathopen(flipped_input_image, flipped_sorted_indices, nx, ny, L, K, accumulator_image);
-	flip_image((void *)accumulator_image, nx, ny, sizeof(PATHOPEN_PIX_TYPE), (void *)accumulator_image);
-	/* Accumulate into output */
-	for (i = 0; i < num_pixels; ++i) {
-		output_image[i] = MAX(output_image[i], accumulator_image[i]);
+	if (pair_length >= log.path_length[output_index]) return;
+
+	path_length = pair_length;
+	for (k = 0; k < nk; ++k) {
+		path_length = MAX(path_length, chain_image_up[GAP_INDEX(k, index)] + chain_image_down[GAP_INDEX(K - k, index)] + 1);
 	}
+	if (path_length < log.path_length[output_index]) {
+		log.add_point(output_index, log.path_length[output_index], (GPOT_PIX_TYPE)threshold);
+		log.path_length[output_index] = path_length;
+	}
+}
 
-	/* Free allocated memory */
-	free((void *)sorted_indices);
-	free((void *)transposed_sorted_indices);
-	free((void *)flipped_sorted_indices);
-	free((void *)accumulator_image);
-	free((void *)transposed_input_image);
-	free((void *)flipped_input_image);
 
-	return 0;
+#ifdef PATHOPEN_STATS
+/* - stats_lap:
+	Add the seconds since phase_start to a phase's time, and start the next phase now.
+*/
+static inline void stats_lap(double & phase_time, chrono::steady_clock::time_point & phase_start)
+{
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+	phase_time += chrono::duration<double>(now - phase_start).count();
+	phase_start = now;
 }
+#endif
 
 
-/* A path opening in the vertical direction.
-	Conjugate with transpose to perform horizontal path openings
+/* A path opening in the vertical direction, or with descending a path closing.
+	With TRANSPOSED, performs the horizontal path opening of an ny * nx image by viewing
+	it as its nx * ny transpose: see IMAGE_INDEX.
 */
+template <class PIX_TYPE, class CHAIN_TYPE, bool PLANAR, bool TRANSPOSED>
 static int vert_pathopen(
-	PATHOPEN_PIX_TYPE * input_image,					/* The input image */
+	Path_Open_Workspace & workspace,					/* Working memory */
+	PIX_TYPE * input_image,								/* The input image */
 	int * sorted_indices,								/* Monotonic transform to [0, 1, ...] of input image */
+	bool descending,									/* Sweep thresholds downwards, for a path closing */
 	int nx, int ny,										/* Image dimensions */
-	int L,												/* The threshold line length */
+	int L,												/* The threshold line length, the largest of lengths */
+	const int * lengths,								/* Increasing lengths of a multi-length pass, or NULL */
+	int num_lengths,									/* Number of lengths */
+	Path_Open_Transform_Log * transform_log,			/* Curves of a transform pass, or NULL */
 	int K,												/* The maximum gap number */
-	PATHOPEN_PIX_TYPE * output_image					/* Output image */
+	PIX_TYPE * output_image								/* Output image, or one per length */
 )
 {
-	int k, x, y, index, new_index, sort_index, num_pixels;
+	int k, x, y, index, image_index, new_index, sort_index, num_pixels;
 
 	/************************************** Allocation **********************************************/
+	/* All working memory is owned by the workspace */
 	num_pixels = nx * ny;
 	int nk = K + 1;
 
-	/* Construct queueing system */
-	Path_Queue path_queue_up(nk, ny, nx);
-	Path_Queue path_queue_down(nk, ny, nx);
+	/* Queueing system and in_queue flags, empty between passes */
+	Path_Open_Queue & path_queue_up = workspace.path_queue_up;
+	Path_Open_Queue & path_queue_down = workspace.path_queue_down;
+	path_queue_up.reshape(ny, nx);
+	path_queue_down.reshape(ny, nx);
 
 	/* Dynamic binary input image */
-	char * bin_input_image = (char *)malloc(num_pixels * sizeof(char));
-
-	/* in_queue flags */
-	char * in_queue_up = (char *)malloc(num_pixels * nk * sizeof(char));
-	char * in_queue_down = (char *)malloc(num_pixels * nk * sizeof(char));
+	char * bin_input_image = workspace.bin_input_image;
 
-	/* Chain length images [k + nk * pixel_index].  These don't include the current pixel. */
-	int * chain_image_up = (int *)malloc(num_pixels * nk * sizeof(int));
-	int * chain_image_down = (int *)malloc(num_pixels * nk * sizeof(int));
+	/* Chain length images [GAP_INDEX(k, pixel_index)].  These don't include the current pixel. */
+	workspace.reserve_chain_images(sizeof(CHAIN_TYPE));
+	CHAIN_TYPE * chain_image_up = (CHAIN_TYPE *)workspace.chain_image_up;
+	CHAIN_TYPE * chain_image_down = (CHAIN_TYPE *)workspace.chain_image_down;
 
 	// At each pixel, we store the vector of binary outputs indexed by gap number of upward chain
-	char * bin_output_image_array = (char *)malloc(num_pixels * nk * sizeof(char));
+	char * bin_output_image_array = workspace.bin_output_image_array;
 	// Also count the vector of binary outputs, to note when they are all extinguished (boolean PQ!)
-	char * bin_output_image_count = (char *)malloc(num_pixels * sizeof(char));
+	char * bin_output_image_count = workspace.bin_output_image_count;
 
 	/************************************** Initialisation **********************************************/
 	/* Dynamic binary threshold image is initially all 1's */
 	memset(bin_input_image, 1, num_pixels * sizeof(char));
 
-	/* Queue initially empty */
-	memset(in_queue_up, 0, num_pixels * nk * sizeof(char));
-	memset(in_queue_down, 0, num_pixels * nk * sizeof(char));
-
 	/* Initialise the chain lengths */
 	for (y = 0; y < ny; ++y) {
 		int up_length = y;
@@ -220,44 +2380,101 @@ static int vert_pathopen(
 		/* Memset */
 		for (x = 0, index = nx * y; x < nx; ++x, ++index) 
 			for (k = 0; k < nk; ++k)
-				chain_image_up[k + nk * index] = up_length;
+				chain_image_up[GAP_INDEX(k, index)] = up_length;
 		for (x = 0, index = nx * y; x < nx; ++x, ++index) 
 			for (k = 0; k < nk; ++k)
-				chain_image_down[k + nk * index] = down_length;
+				chain_image_down[GAP_INDEX(k, index)] = down_length;
 	}
 
-	/* Binary output vector at each pixel */
-	memset(bin_output_image_array, 1, num_pixels * nk * sizeof(char));
-	memset(bin_output_image_count, nk, num_pixels * sizeof(char));
+	if (transform_log != NULL) {
+		/* Transform pass: no output image, just the longest path through each pixel.
+			Nothing is alive for the output code */
+		memset(bin_output_image_count, 0, num_pixels * sizeof(char));
+
+		for (y = 0; y < ny; ++y) {
+			for (x = 0, index = nx * y; x < nx; ++x, ++index) {
+				transform_log->path_length[IMAGE_INDEX(x, y)] =
+					chain_image_up[GAP_INDEX(0, index)] + chain_image_down[GAP_INDEX(0, index)] + 1;
+			}
+		}
+	} else if (lengths == NULL) {
+		/* Binary output vector at each pixel */
+		memset(bin_output_image_array, 1, num_pixels * nk * sizeof(char));
+		memset(bin_output_image_count, nk, num_pixels * sizeof(char));
+
+		/* Set output image to default value (0 here) */
+		memset(output_image, 0, num_pixels * sizeof(PIX_TYPE));
 
-	/* Set output image to default value (0 here) */
-	memset(output_image, 0, num_pixels * sizeof(PATHOPEN_PIX_TYPE));
+		/* Pixels no path of L pixels passes through are dead from the start, taking the
+			first threshold swept as a multi-length pass does.  Left alive, they took
+			whatever threshold first shortened their chains */
+		PIX_TYPE first_threshold = input_image[sorted_indices[descending ? num_pixels - 1 : 0]];
+
+		for (y = 0; y < ny; ++y) {
+			for (x = 0, index = nx * y; x < nx; ++x, ++index) {
+				if (chain_image_up[GAP_INDEX(0, index)] + chain_image_down[GAP_INDEX(0, index)] + 1 < L) {
+					for (k = 0; k < nk; ++k) bin_output_image_array[GAP_INDEX(k, index)] = 0;
+					bin_output_image_count[index] = 0;
+					output_image[IMAGE_INDEX(x, y)] = first_threshold;
+				}
+			}
+		}
+	} else {
+		/* Multi-length pass: count the lengths alive at each pixel instead.  Those longer
+			than any path through the pixel are dead from the start, taking the first
+			threshold swept (the image minimum for an opening) */
+		PIX_TYPE first_threshold = input_image[sorted_indices[descending ? num_pixels - 1 : 0]];
+
+		for (y = 0; y < ny; ++y) {
+			for (x = 0, index = nx * y; x < nx; ++x, ++index) {
+				bin_output_image_count[index] = num_lengths;
+				stack_extinguish(lengths, bin_output_image_count[index],
+					chain_image_up[GAP_INDEX(0, index)] + chain_image_down[GAP_INDEX(0, index)] + 1,
+					first_threshold, output_image, IMAGE_INDEX(x, y), num_pixels);
+			}
+		}
+	}
 	/****************************************************************************************************/
 
-	/* For each threshold from smallest to largest */
+	/* For each threshold from smallest to largest, or largest to smallest if descending.
+		sort_index counts the pixels swept, sweep_indices[sweep_step * sort_index] is next */
+	int * sweep_indices = descending ? sorted_indices + num_pixels - 1 : sorted_indices;
+	int sweep_step = descending ? -1 : 1;
+
+#ifdef PATHOPEN_STATS
+	Path_Open_Pass_Stats & stats = workspace.stats;
+	long long num_merges = path_queue_up.num_merges + path_queue_down.num_merges;
+	long long num_merged = path_queue_up.num_merged + path_queue_down.num_merged;
+	chrono::steady_clock::time_point phase_start;
+
+	memset(&stats, 0, sizeof(stats));
+#endif
+
 	sort_index = 0;
 	while(sort_index < num_pixels) {
-		PATHOPEN_PIX_TYPE threshold;
+		PIX_TYPE threshold;
 
 		/*********************************** Process threshold pixels *****************************************/
-		threshold = input_image[sorted_indices[sort_index]];
+#ifdef PATHOPEN_STATS
+		++stats.num_levels;
+		phase_start = chrono::steady_clock::now();
+#endif
+		threshold = input_image[sweep_indices[sweep_step * sort_index]];
 #ifdef DEBUGGING
 		cout << "Threshold = " << (int)threshold << endl;
 #endif
-		while(input_image[sorted_indices[sort_index]] == threshold) {
-			/* Collect into rows for enqueueing */
-			vector< vector<PIXEL_INDEX_TYPE> > new_row_queue_down(nk);
-			vector< vector<PIXEL_INDEX_TYPE> > new_row_queue_up(nk);
-			int row_y = sorted_indices[sort_index] / nx;
+		while(same_level(input_image[sweep_indices[sweep_step * sort_index]], threshold)) {
+			int row_y = IMAGE_Y(sweep_indices[sweep_step * sort_index]);
 #ifdef DEBUGGING
 			cout << "y = " << row_y << endl;
 #endif
 
-			while(input_image[sorted_indices[sort_index]] == threshold && sorted_indices[sort_index] / nx == row_y) {
+			while(same_level(input_image[sweep_indices[sweep_step * sort_index]], threshold) && IMAGE_Y(sweep_indices[sweep_step * sort_index]) == row_y) {
 				/* Extract index and coordinates */
-				index = sorted_indices[sort_index];
-				y = index / nx;
-				x = index % nx;
+				image_index = sweep_indices[sweep_step * sort_index];
+				y = IMAGE_Y(image_index);
+				x = IMAGE_X(image_index);
+				index = TRANSPOSED ? x + nx * y : image_index;
 
 #ifdef DEBUGGING
 				cout << "\tx = " << x << endl;
@@ -271,6 +2488,20 @@ static int vert_pathopen(
 #endif
 					// Remove this pixel from the binary input image
 					bin_input_image[index] = 0;
+#ifdef PATHOPEN_STATS
+					++stats.num_seeds;
+#endif
+
+					// Multi-length pass: this ends every path through the pixel, leaving
+					// nothing alive for the code below (as with CENTRE_PIXEL_FIX)
+					if (lengths != NULL) {
+						stack_extinguish(lengths, bin_output_image_count[index], 0, threshold, output_image, IMAGE_INDEX(x, y), num_pixels);
+					}
+					// Transform pass: likewise the end of the pixel's curve
+					if (transform_log != NULL) {
+						transform_log->add_point(IMAGE_INDEX(x, y), transform_log->path_length[IMAGE_INDEX(x, y)], (GPOT_PIX_TYPE)threshold);
+						transform_log->path_length[IMAGE_INDEX(x, y)] = 0;
+					}
 
 #ifndef CENTRE_PIXEL_FIX
 					// Update the outputs
@@ -278,14 +2509,14 @@ static int vert_pathopen(
 						// Update the output flags for each gap index (and count)
 						bin_output_image_count[index] = 0;
 						for (k = 0; k < K; ++k) {
-							bin_output_image_array[k + nk * index] = 
-								(chain_image_up[k + nk * index] + chain_image_down[(K - 1 - k) + nk * index] + 1) >= L;
-							bin_output_image_count[index] += bin_output_image_array[k + nk * index];
+							bin_output_image_array[GAP_INDEX(k, index)] = 
+								(chain_image_up[GAP_INDEX(k, index)] + chain_image_down[GAP_INDEX(K - 1 - k, index)] + 1) >= L;
+							bin_output_image_count[index] += bin_output_image_array[GAP_INDEX(k, index)];
 						}
 
 						// If all paths have been extinguished, update output
 						if (bin_output_image_count[index] == 0) {
-							output_image[index] = threshold;
+							output_image[IMAGE_INDEX(x, y)] = threshold;
 						}
 					}
 #else
@@ -293,7 +2524,7 @@ static int vert_pathopen(
 					// If all paths have been extinguished, update output
 					if (bin_output_image_count[index] > 0) {
 						bin_output_image_count[index] = 0;
-						output_image[index] = threshold;
+						output_image[IMAGE_INDEX(x, y)] = threshold;
 					}
 #endif // CENTRE_PIXEL_FIX
 
@@ -301,33 +2532,19 @@ static int vert_pathopen(
 					/* Enqueue downward pixels for update */
 					if (y < ny - 1) {
 						if (x > 0) {
-							new_index = index + nx - 1;
-							
 							// Enqueue this pixel for all k
 							for (k = 0; k < nk; ++k) {
-								if (!in_queue_down[k + nk * new_index]) {
-									in_queue_down[k + nk * new_index] = 1;
-									new_row_queue_down[k].push_back(x - 1);
-								}
+								path_queue_down.insert(k, y + 1, x - 1);
 							}
 						}
-						new_index = index + nx;
 						// Enqueue this pixel for all k
 						for (k = 0; k < nk; ++k) {
-							if (!in_queue_down[k + nk * new_index]) {
-								in_queue_down[k + nk * new_index] = 1;
-								new_row_queue_down[k].push_back(x);
-							}
+							path_queue_down.insert(k, y + 1, x);
 						}
 						if (x < nx - 1) {
-							new_index = index + nx + 1;
-							
 							// Enqueue this pixel for all k
 							for (k = 0; k < nk; ++k) {
-								if (!in_queue_down[k + nk * new_index]) {
-									in_queue_down[k + nk * new_index] = 1;
-									new_row_queue_down[k].push_back(x + 1);
-								}
+								path_queue_down.insert(k, y + 1, x + 1);
 							}
 						}
 					}
@@ -335,33 +2552,19 @@ static int vert_pathopen(
 					/* Enqueue upward pixels for update */
 					if (y > 0) {
 						if (x > 0) {
-							new_index = index - nx - 1;
-							
 							// Enqueue this pixel for all k
 							for (k = 0; k < nk; ++k) {
-								if (!in_queue_up[k + nk * new_index]) {
-									in_queue_up[k + nk * new_index] = 1;
-									new_row_queue_up[k].push_back(x - 1);
-								}
+								path_queue_up.insert(k, y - 1, x - 1);
 							}
 						}
-						new_index = index - nx;
 						// Enqueue this pixel for all k
 						for (k = 0; k < nk; ++k) {
-							if (!in_queue_up[k + nk * new_index]) {
-								in_queue_up[k + nk * new_index] = 1;
-								new_row_queue_up[k].push_back(x);
-							}
+							path_queue_up.insert(k, y - 1, x);
 						}
 						if (x < nx - 1) {
-							new_index = index - nx + 1;
-							
 							// Enqueue this pixel for all k
 							for (k = 0; k < nk; ++k) {
-								if (!in_queue_up[k + nk * new_index]) {
-									in_queue_up[k + nk * new_index] = 1;
-									new_row_queue_up[k].push_back(x + 1);
-								}
+								path_queue_up.insert(k, y - 1, x + 1);
 							}
 						}
 					}
@@ -371,44 +2574,15 @@ static int vert_pathopen(
 				++sort_index;
 				if (sort_index >= num_pixels) break;
 			}
-#ifdef DEBUGGING
-			cout << "Merging row queues" << endl;
-#endif
-
-			// Merge row queues into path queues
+			// Commit the new entries of the neighbouring rows
 			if (row_y + 1 < ny) {
-#ifdef DEBUGGING
-				cout << "Down queues" << endl;
-#endif
 				for (k = 0; k < nk; ++k) {
-					if (new_row_queue_down[k].size() > 0) {
-#ifdef DEBUGGING
-						cout << "k = " << k << ":";
-						for (i = 0; i < new_row_queue_down[k].size(); ++i) {
-							cout << new_row_queue_down[k][i] << " ";
-						}
-						cout << endl;
-#endif
-						path_queue_down.merge_row(new_row_queue_down[k], k, row_y + 1);
-					}
+					path_queue_down.commit(k, row_y + 1);
 				}
 			}
-
 			if (row_y - 1 >= 0) {
-#ifdef DEBUGGING
-				cout << "Up queues" << endl;
-#endif
 				for (k = 0; k < nk; ++k) {
-					if (new_row_queue_up[k].size() > 0) {
-#ifdef DEBUGGING
-						cout << "k = " << k << ":";
-						for (i = 0; i < new_row_queue_up[k].size(); ++i) {
-							cout << new_row_queue_up[k][i] << " ";
-						}
-						cout << endl;
-#endif
-						path_queue_up.merge_row(new_row_queue_up[k], k, row_y - 1);
-					}
+					path_queue_up.commit(k, row_y - 1);
 				}
 			}
 
@@ -418,18 +2592,20 @@ static int vert_pathopen(
 			if (sort_index >= num_pixels) break;
 		}
 
+#ifdef PATHOPEN_STATS
+		stats_lap(stats.seed_time, phase_start);
+#endif
+
 		/*************************************** Downward sweep *********************************************/
 		/* Propagate changes at current threshold down the image */
 #ifdef DEBUGGING
 		cout << "DOWNWARD SWEEP - before" << endl;
-		dump_state(
+		dump_state<CHAIN_TYPE, PLANAR>(
 			nx,									// Image dimensions etc.
 			ny,
 			nk,
 			path_queue_up,						// Queueing structures
 			path_queue_down,
-			in_queue_up,
-			in_queue_down,
 			bin_input_image,					// Input/output binary images
 			bin_output_image_array,
 			bin_output_image_count,
@@ -443,19 +2619,14 @@ static int vert_pathopen(
 			cout << "k = " << k << endl;
 #endif
 			for (y = 1; y < ny; ++y) {
-				vector<PIXEL_INDEX_TYPE> & row_queue = path_queue_down.q[k][y];
-				if (row_queue.size() == 0) continue;
+				if (path_queue_down.empty(k, y)) continue;
 #ifdef DEBUGGING
 				cout << "\ty = " << y << endl;
 #endif
 
-				vector<PIXEL_INDEX_TYPE> new_row_queue_cur_k;
-				vector<PIXEL_INDEX_TYPE> new_row_queue_next_k;
-
-				/* Perform updates on points in row_queue, propagating changes to the new row queues */
-				for (unsigned int ui = 0; ui < row_queue.size(); ++ui) {
-					/* Extract x-coordinate and pixel index */
-					x = row_queue[ui];
+				/* Perform updates on points in the row queue, propagating changes to the next rows */
+				for (x = path_queue_down.first(k, y); x >= 0; x = path_queue_down.next(k, y, x + 1)) {
+					/* Extract pixel index */
 					index = x + nx * y;
 
 #ifdef DEBUGGING
@@ -463,7 +2634,10 @@ static int vert_pathopen(
 #endif
 
 					/* Unflag -> no longer in queue */
-					in_queue_down[k + nk * index] = 0;
+					path_queue_down.remove(k, y, x);
+#ifdef PATHOPEN_STATS
+					++stats.num_enqueued_down;
+#endif
 
 					/* Update chain length from upward neighbours */
 					// Note: Only y > 0 may be 'updated', so we are assured of the existence of previous neighbours!
@@ -472,75 +2646,92 @@ static int vert_pathopen(
 					if (k > 0) {
 						if (x > 0) {
 							new_index = index - nx - 1;
-							if (chain_image_up[k - 1 + nk * new_index] > max_prev) {
-								max_prev = chain_image_up[k - 1 + nk * new_index];
+							if (chain_image_up[GAP_INDEX(k - 1, new_index)] > max_prev) {
+								max_prev = chain_image_up[GAP_INDEX(k - 1, new_index)];
 							}
 						}
 						new_index = index - nx;
-						if (chain_image_up[k - 1 + nk * new_index] > max_prev) {
-							max_prev = chain_image_up[k - 1 + nk * new_index];
+						if (chain_image_up[GAP_INDEX(k - 1, new_index)] > max_prev) {
+							max_prev = chain_image_up[GAP_INDEX(k - 1, new_index)];
 						}
 						if (x < nx - 1) {
 							new_index = index - nx + 1;
-							if (chain_image_up[k - 1 + nk * new_index] > max_prev) {
-								max_prev = chain_image_up[k - 1 + nk * new_index];
+							if (chain_image_up[GAP_INDEX(k - 1, new_index)] > max_prev) {
+								max_prev = chain_image_up[GAP_INDEX(k - 1, new_index)];
 							}
 						}
 					}
 					// Current level - no gap allowed
 					if (x > 0) {
 						new_index = index - nx - 1;
-						if (bin_input_image[new_index] == 1 && chain_image_up[k + nk * new_index] > max_prev) {
-							max_prev = chain_image_up[k + nk * new_index];
+						if (bin_input_image[new_index] == 1 && chain_image_up[GAP_INDEX(k, new_index)] > max_prev) {
+							max_prev = chain_image_up[GAP_INDEX(k, new_index)];
 						}
 					}
 					new_index = index - nx;
-					if (bin_input_image[new_index] == 1 && chain_image_up[k + nk * new_index] > max_prev) {
-						max_prev = chain_image_up[k + nk * new_index];
+					if (bin_input_image[new_index] == 1 && chain_image_up[GAP_INDEX(k, new_index)] > max_prev) {
+						max_prev = chain_image_up[GAP_INDEX(k, new_index)];
 					}
 					if (x < nx - 1) {
 						new_index = index - nx + 1;
-						if (bin_input_image[new_index] == 1 && chain_image_up[k + nk * new_index] > max_prev) {
-							max_prev = chain_image_up[k + nk * new_index];
+						if (bin_input_image[new_index] == 1 && chain_image_up[GAP_INDEX(k, new_index)] > max_prev) {
+							max_prev = chain_image_up[GAP_INDEX(k, new_index)];
 						}
 					}
 
 					/* Update chain length? */
-					if (max_prev + 1 < chain_image_up[k + nk * index]) {
+					if (max_prev + 1 < chain_image_up[GAP_INDEX(k, index)]) {
+#ifdef PATHOPEN_STATS
+						++stats.num_chain_updates;
+#endif
 #ifdef DEBUGGING
-						cout << "New chain length is " << chain_image_up[k + nk * index] << endl;
+						cout << "New chain length is " << (int)chain_image_up[GAP_INDEX(k, index)] << endl;
 #endif
 						// Update chain length
-						chain_image_up[k + nk * index] = max_prev + 1;
+						chain_image_up[GAP_INDEX(k, index)] = max_prev + 1;
 
 						// Propagate changes to output
-						if (bin_input_image[index]) {
+						if (lengths != NULL) {
+							// Multi-length pass: removed pixels have nothing left alive
+							if (bin_input_image[index]) {
+								stack_shorten<PIX_TYPE, CHAIN_TYPE, PLANAR>(lengths, bin_output_image_count[index],
+									chain_image_up[GAP_INDEX(k, index)] + chain_image_down[GAP_INDEX(K - k, index)] + 1,
+									chain_image_up, chain_image_down, index, num_pixels, nk, threshold, output_image, IMAGE_INDEX(x, y));
+							}
+						} else if (transform_log != NULL) {
+							// Transform pass: likewise
+							if (bin_input_image[index]) {
+								transform_shorten<PIX_TYPE, CHAIN_TYPE, PLANAR>(*transform_log,
+									chain_image_up[GAP_INDEX(k, index)] + chain_image_down[GAP_INDEX(K - k, index)] + 1,
+									chain_image_up, chain_image_down, index, num_pixels, nk, threshold, IMAGE_INDEX(x, y));
+							}
+						} else if (bin_input_image[index]) {
 							char new_bin_output_flag = 
-								(chain_image_up[k + nk * index] + chain_image_down[(K - k) + nk * index] + 1 >= L);
+								(chain_image_up[GAP_INDEX(k, index)] + chain_image_down[GAP_INDEX(K - k, index)] + 1 >= L);
 							// Did we cross the threshold?
-							if (bin_output_image_array[k + nk * index] && !new_bin_output_flag) {
+							if (bin_output_image_array[GAP_INDEX(k, index)] && !new_bin_output_flag) {
 								// Clear the flag
-								bin_output_image_array[k + nk * index] = 0;
+								bin_output_image_array[GAP_INDEX(k, index)] = 0;
 								--bin_output_image_count[index];
 								// Did this extinguish the last path?
 								if (bin_output_image_count[index] == 0) {
 									// Write to output
-									output_image[index] = threshold;
+									output_image[IMAGE_INDEX(x, y)] = threshold;
 								}
 							}
 						} else {
 							if (K - 1 - k >= 0) {
 								char new_bin_output_flag = 
-									(chain_image_up[k + nk * index] + chain_image_down[(K - 1 - k) + nk * index] + 1 >= L);
+									(chain_image_up[GAP_INDEX(k, index)] + chain_image_down[GAP_INDEX(K - 1 - k, index)] + 1 >= L);
 								// Did we cross the threshold?
-								if (bin_output_image_array[k + nk * index] && !new_bin_output_flag) {
+								if (bin_output_image_array[GAP_INDEX(k, index)] && !new_bin_output_flag) {
 									// Clear the flag
-									bin_output_image_array[k + nk * index] = 0;
+									bin_output_image_array[GAP_INDEX(k, index)] = 0;
 									--bin_output_image_count[index];
 									// Did this extinguish the last path?
 									if (bin_output_image_count[index] == 0) {
 										// Write to output
-										output_image[index] = threshold;
+										output_image[IMAGE_INDEX(x, y)] = threshold;
 									}
 								}
 							}
@@ -551,73 +2742,43 @@ static int vert_pathopen(
 						if (y < ny - 1) {
 							// Same layer
 							if (x > 0) {
-								new_index = index + nx - 1;
-								if (!in_queue_down[k + nk * new_index]) {
-									new_row_queue_cur_k.push_back(x - 1);
-									in_queue_down[k + nk * new_index] = 1;
-								}
-							}
-							new_index = index + nx;
-							if (!in_queue_down[k + nk * new_index]) {
-								new_row_queue_cur_k.push_back(x);
-								in_queue_down[k + nk * new_index] = 1;
+								path_queue_down.insert(k, y + 1, x - 1);
 							}
+							path_queue_down.insert(k, y + 1, x);
 							if (x < nx - 1) {
-								new_index = index + nx + 1;
-								if (!in_queue_down[k + nk * new_index]) {
-									new_row_queue_cur_k.push_back(x + 1);
-									in_queue_down[k + nk * new_index] = 1;
-								}
+								path_queue_down.insert(k, y + 1, x + 1);
 							}
 							// Down one layer
 							if (k < K) {
 								if (x > 0) {
-									new_index = index + nx - 1;
-									if (!in_queue_down[k + 1 + nk * new_index]) {
-										new_row_queue_next_k.push_back(x - 1);
-										in_queue_down[k + 1 + nk * new_index] = 1;
-									}
-								}
-								new_index = index + nx;
-								if (!in_queue_down[k + 1 + nk * new_index]) {
-									new_row_queue_next_k.push_back(x);
-									in_queue_down[k + 1 + nk * new_index] = 1;
+									path_queue_down.insert(k + 1, y + 1, x - 1);
 								}
+								path_queue_down.insert(k + 1, y + 1, x);
 								if (x < nx - 1) {
-									new_index = index + nx + 1;
-									if (!in_queue_down[k + 1 + nk * new_index]) {
-										new_row_queue_next_k.push_back(x + 1);
-										in_queue_down[k + 1 + nk * new_index] = 1;
-									}
+									path_queue_down.insert(k + 1, y + 1, x + 1);
 								}
 							}
 						}
 					}
 				}
 				// Wipe old queue
-				row_queue.resize(0);
+				path_queue_down.clear_row(k, y);
 
-				/* Merge new row queues into existing queues */
+				/* Commit new entries into existing queues */
 				if (y + 1 < ny) {
-					if (new_row_queue_cur_k.size() > 0) {
-						path_queue_down.merge_row(new_row_queue_cur_k, k, y + 1);
-					}
-					if (new_row_queue_next_k.size() > 0) {
-						path_queue_down.merge_row(new_row_queue_next_k, k + 1, y + 1);
-					}
+					path_queue_down.commit(k, y + 1);
+					if (k < K) path_queue_down.commit(k + 1, y + 1);
 				}
 			}
 		}
 #ifdef DEBUGGING
 		cout << "DOWNWARD SWEEP - after" << endl;
-		dump_state(
+		dump_state<CHAIN_TYPE, PLANAR>(
 			nx,									// Image dimensions etc.
 			ny,
 			nk,
 			path_queue_up,						// Queueing structures
 			path_queue_down,
-			in_queue_up,
-			in_queue_down,
 			bin_input_image,					// Input/output binary images
 			bin_output_image_array,
 			bin_output_image_count,
@@ -626,17 +2787,19 @@ static int vert_pathopen(
 		);
 #endif
 
+#ifdef PATHOPEN_STATS
+		stats_lap(stats.down_time, phase_start);
+#endif
+
 		/*************************************** Upward sweep *********************************************/
 #ifdef DEBUGGING
 		cout << "UPWARD SWEEP - before" << endl;
-		dump_state(
+		dump_state<CHAIN_TYPE, PLANAR>(
 			nx,									// Image dimensions etc.
 			ny,
 			nk,
 			path_queue_up,						// Queueing structures
 			path_queue_down,
-			in_queue_up,
-			in_queue_down,
 			bin_input_image,					// Input/output binary images
 			bin_output_image_array,
 			bin_output_image_count,
@@ -651,20 +2814,15 @@ static int vert_pathopen(
 			cout << "k = " << k << endl;
 #endif
 			for (y = ny - 2; y >= 0; --y) {
-				vector<PIXEL_INDEX_TYPE> & row_queue = path_queue_up.q[k][y];
-				if (row_queue.size() == 0) continue;
+				if (path_queue_up.empty(k, y)) continue;
 
 #ifdef DEBUGGING
 				cout << "\ty = " << y << endl;
 #endif
 
-				vector<PIXEL_INDEX_TYPE> new_row_queue_cur_k;
-				vector<PIXEL_INDEX_TYPE> new_row_queue_next_k;
-
-				/* Perform updates on points in row_queue, propagating changes to the new row queues */
-				for (unsigned int ui = 0; ui < row_queue.size(); ++ui) {
-					/* Extract x-coordinate and pixel index */
-					x = row_queue[ui];
+				/* Perform updates on points in the row queue, propagating changes to the next rows */
+				for (x = path_queue_up.first(k, y); x >= 0; x = path_queue_up.next(k, y, x + 1)) {
+					/* Extract pixel index */
 					index = x + nx * y;
 
 #ifdef DEBUGGING
@@ -672,7 +2830,10 @@ static int vert_pathopen(
 #endif
 
 					/* Unflag -> no longer in queue */
-					in_queue_up[k + nk * index] = 0;
+					path_queue_up.remove(k, y, x);
+#ifdef PATHOPEN_STATS
+					++stats.num_enqueued_up;
+#endif
 
 					/* Update chain length from downward neighbours */
 					// Note: Only y < ny - 1 may be 'updated', so we are assured of the existence of previous neighbours!
@@ -681,72 +2842,89 @@ static int vert_pathopen(
 					if (k > 0) {
 						if (x > 0) {
 							new_index = index + nx - 1;
-							if (chain_image_down[k - 1 + nk * new_index] > max_prev) {
-								max_prev = chain_image_down[k - 1 + nk * new_index];
+							if (chain_image_down[GAP_INDEX(k - 1, new_index)] > max_prev) {
+								max_prev = chain_image_down[GAP_INDEX(k - 1, new_index)];
 							}
 						}
 						new_index = index + nx;
-						if (chain_image_down[k - 1 + nk * new_index] > max_prev) {
-							max_prev = chain_image_down[k - 1 + nk * new_index];
+						if (chain_image_down[GAP_INDEX(k - 1, new_index)] > max_prev) {
+							max_prev = chain_image_down[GAP_INDEX(k - 1, new_index)];
 						}
 						if (x < nx - 1) {
 							new_index = index + nx + 1;
-							if (chain_image_down[k - 1 + nk * new_index] > max_prev) {
-								max_prev = chain_image_down[k - 1 + nk * new_index];
+							if (chain_image_down[GAP_INDEX(k - 1, new_index)] > max_prev) {
+								max_prev = chain_image_down[GAP_INDEX(k - 1, new_index)];
 							}
 						}
 					}
 					// Current level - no gap allowed
 					if (x > 0) {
 						new_index = index + nx - 1;
-						if (bin_input_image[new_index] == 1 && chain_image_down[k + nk * new_index] > max_prev) {
-							max_prev = chain_image_down[k + nk * new_index];
+						if (bin_input_image[new_index] == 1 && chain_image_down[GAP_INDEX(k, new_index)] > max_prev) {
+							max_prev = chain_image_down[GAP_INDEX(k, new_index)];
 						}
 					}
 					new_index = index + nx;
-					if (bin_input_image[new_index] == 1 && chain_image_down[k + nk * new_index] > max_prev) {
-						max_prev = chain_image_down[k + nk * new_index];
+					if (bin_input_image[new_index] == 1 && chain_image_down[GAP_INDEX(k, new_index)] > max_prev) {
+						max_prev = chain_image_down[GAP_INDEX(k, new_index)];
 					}
 					if (x < nx - 1) {
 						new_index = index + nx + 1;
-						if (bin_input_image[new_index] == 1 && chain_image_down[k + nk * new_index] > max_prev) {
-							max_prev = chain_image_down[k + nk * new_index];
+						if (bin_input_image[new_index] == 1 && chain_image_down[GAP_INDEX(k, new_index)] > max_prev) {
+							max_prev = chain_image_down[GAP_INDEX(k, new_index)];
 						}
 					}
 
 					/* Update chain length? */
-					if (max_prev + 1 < chain_image_down[k + nk * index]) {
+					if (max_prev + 1 < chain_image_down[GAP_INDEX(k, index)]) {
+#ifdef PATHOPEN_STATS
+						++stats.num_chain_updates;
+#endif
 						// Update chain length
-						chain_image_down[k + nk * index] = max_prev + 1;
+						chain_image_down[GAP_INDEX(k, index)] = max_prev + 1;
 
 						// Propagate changes to output
-						if (bin_input_image[index]) {
+						if (lengths != NULL) {
+							// Multi-length pass: removed pixels have nothing left alive
+							if (bin_input_image[index]) {
+								stack_shorten<PIX_TYPE, CHAIN_TYPE, PLANAR>(lengths, bin_output_image_count[index],
+									chain_image_up[GAP_INDEX(K - k, index)] + chain_image_down[GAP_INDEX(k, index)] + 1,
+									chain_image_up, chain_image_down, index, num_pixels, nk, threshold, output_image, IMAGE_INDEX(x, y));
+							}
+						} else if (transform_log != NULL) {
+							// Transform pass: likewise
+							if (bin_input_image[index]) {
+								transform_shorten<PIX_TYPE, CHAIN_TYPE, PLANAR>(*transform_log,
+									chain_image_up[GAP_INDEX(K - k, index)] + chain_image_down[GAP_INDEX(k, index)] + 1,
+									chain_image_up, chain_image_down, index, num_pixels, nk, threshold, IMAGE_INDEX(x, y));
+							}
+						} else if (bin_input_image[index]) {
 							char new_bin_output_flag = 
-								(chain_image_up[(K - k) + nk * index] + chain_image_down[k + nk * index] + 1 >= L);
+								(chain_image_up[GAP_INDEX(K - k, index)] + chain_image_down[GAP_INDEX(k, index)] + 1 >= L);
 							// Did we cross the threshold?
-							if (bin_output_image_array[(K - k) + nk * index] && !new_bin_output_flag) {
+							if (bin_output_image_array[GAP_INDEX(K - k, index)] && !new_bin_output_flag) {
 								// Update flags
-								bin_output_image_array[(K - k) + nk * index] = 0;
+								bin_output_image_array[GAP_INDEX(K - k, index)] = 0;
 								--bin_output_image_count[index];
 								// Did this extinguish the last path?
 								if (bin_output_image_count[index] == 0) {
 									// Write to output
-									output_image[index] = threshold;
+									output_image[IMAGE_INDEX(x, y)] = threshold;
 								}
 							}
 						} else {
 							if (K - 1 - k >= 0) {
 								char new_bin_output_flag = 
-									(chain_image_up[(K - 1 - k) + nk * index] + chain_image_down[k + nk * index] + 1 >= L);
+									(chain_image_up[GAP_INDEX(K - 1 - k, index)] + chain_image_down[GAP_INDEX(k, index)] + 1 >= L);
 								// Did we cross the threshold?
-								if (bin_output_image_array[(K - 1 - k) + nk * index] && !new_bin_output_flag) {
+								if (bin_output_image_array[GAP_INDEX(K - 1 - k, index)] && !new_bin_output_flag) {
 									// Update flags
-									bin_output_image_array[(K - 1 - k) + nk * index] = 0;
+									bin_output_image_array[GAP_INDEX(K - 1 - k, index)] = 0;
 									--bin_output_image_count[index];
 									// Did this extinguish the last path?
 									if (bin_output_image_count[index] == 0) {
 										// Write to output
-										output_image[index] = threshold;
+										output_image[IMAGE_INDEX(x, y)] = threshold;
 									}
 								}
 							}
@@ -757,93 +2935,60 @@ static int vert_pathopen(
 						if (y > 0) {
 							// Same layer
 							if (x > 0) {
-								new_index = index - nx - 1;
-								if (!in_queue_up[k + nk * new_index]) {
-									new_row_queue_cur_k.push_back(x - 1);
-									in_queue_up[k + nk * new_index] = 1;
-								}
-							}
-							new_index = index - nx;
-							if (!in_queue_up[k + nk * new_index]) {
-								new_row_queue_cur_k.push_back(x);
-								in_queue_up[k + nk * new_index] = 1;
+								path_queue_up.insert(k, y - 1, x - 1);
 							}
+							path_queue_up.insert(k, y - 1, x);
 							if (x < nx - 1) {
-								new_index = index - nx + 1;
-								if (!in_queue_up[k + nk * new_index]) {
-									new_row_queue_cur_k.push_back(x + 1);
-									in_queue_up[k + nk * new_index] = 1;
-								}
+								path_queue_up.insert(k, y - 1, x + 1);
 							}
 							// Down one layer
 							if (k < K) {
 								if (x > 0) {
-									new_index = index - nx - 1;
-									if (!in_queue_up[k + 1 + nk * new_index]) {
-										new_row_queue_next_k.push_back(x - 1);
-										in_queue_up[k + 1 + nk * new_index] = 1;
-									}
-								}
-								new_index = index - nx;
-								if (!in_queue_up[k + 1 + nk * new_index]) {
-									new_row_queue_next_k.push_back(x);
-									in_queue_up[k + 1 + nk * new_index] = 1;
+									path_queue_up.insert(k + 1, y - 1, x - 1);
 								}
+								path_queue_up.insert(k + 1, y - 1, x);
 								if (x < nx - 1) {
-									new_index = index - nx + 1;
-									if (!in_queue_up[k + 1 + nk * new_index]) {
-										new_row_queue_next_k.push_back(x + 1);
-										in_queue_up[k + 1 + nk * new_index] = 1;
-									}
+									path_queue_up.insert(k + 1, y - 1, x + 1);
 								}
 							}
 						}
 					}
 				}
 				// Wipe old queue
-				row_queue.resize(0);
+				path_queue_up.clear_row(k, y);
 
-				/* Merge new row queues into existing queues */
+				/* Commit new entries into existing queues */
 				if (y - 1 >= 0) {
-					if (new_row_queue_cur_k.size() > 0) {
-						path_queue_up.merge_row(new_row_queue_cur_k, k, y - 1);
-					}
-					if (new_row_queue_next_k.size() > 0) {
-						path_queue_up.merge_row(new_row_queue_next_k, k + 1, y - 1);
-					}
+					path_queue_up.commit(k, y - 1);
+					if (k < K) path_queue_up.commit(k + 1, y - 1);
 				}
 			}
 		}
 #ifdef DEBUGGING
 		cout << "UPWARD SWEEP - after" << endl;
-		dump_state(
+		dump_state<CHAIN_TYPE, PLANAR>(
 			nx,									// Image dimensions etc.
 			ny,
 			nk,
 			path_queue_up,						// Queueing structures
 			path_queue_down,
-			in_queue_up,
-			in_queue_down,
 			bin_input_image,					// Input/output binary images
 			bin_output_image_array,
 			bin_output_image_count,
 			chain_image_up,						// Up/down chain lengths
 			chain_image_down
 		);
+#endif
+#ifdef PATHOPEN_STATS
+		stats_lap(stats.up_time, phase_start);
 #endif
 	}
 
-	/* Free allocated memory */
-	free((void *)in_queue_up);
-	free((void *)in_queue_down);
-
-	free((void *)bin_input_image);
-	
-	free((void *)chain_image_up);
-	free((void *)chain_image_down);
-
-	free((void *)bin_output_image_array);
-	free((void *)bin_output_image_count);
+#ifdef PATHOPEN_STATS
+	stats.num_early_outs = stats.num_enqueued_down + stats.num_enqueued_up - stats.num_chain_updates;
+	stats.num_merges = path_queue_up.num_merges + path_queue_down.num_merges - num_merges;
+	stats.num_merged = path_queue_up.num_merged + path_queue_down.num_merged - num_merged;
+#endif
 
 	return 0;
 }
@@ -851,52 +2996,54 @@ static int vert_pathopen(
 
 
 
-/* A path opening in the ++ diagonal direction.
+/* A path opening in the ++ diagonal direction, or with descending a path closing.
 	Conjugate with flip to perform +- diagonal path openings
 */
+template <class PIX_TYPE, class CHAIN_TYPE, bool PLANAR>
 static int diag_pathopen(
-	PATHOPEN_PIX_TYPE * input_image,					/* The input image */
+	Path_Open_Workspace & workspace,					/* Working memory */
+	PIX_TYPE * input_image,								/* The input image */
 	int * sorted_indices,								/* Monotonic transform to [0, 1, ...] of input image */
+	bool descending,									/* Sweep thresholds downwards, for a path closing */
 	int nx, int ny,										/* Image dimensions */
-	int L,												/* The threshold line length */
+	int L,												/* The threshold line length, the largest of lengths */
+	const int * lengths,								/* Increasing lengths of a multi-length pass, or NULL */
+	int num_lengths,									/* Number of lengths */
+	Path_Open_Transform_Log * transform_log,			/* Curves of a transform pass, or NULL */
 	int K,												/* The maximum gap number */
-	PATHOPEN_PIX_TYPE * output_image					/* Output image */
+	PIX_TYPE * output_image								/* Output image, or one per length */
 )
 {
 	int k, x, y, index, new_index, sort_index, num_pixels;
 
 	/************************************** Allocation **********************************************/
+	/* All working memory is owned by the workspace */
 	num_pixels = nx * ny;
 	int nk = K + 1;
 
-	/* Construct queueing system */
-	Path_Queue path_queue_up(nk, ny, nx);
-	Path_Queue path_queue_down(nk, ny, nx);
+	/* Queueing system and in_queue flags, empty between passes */
+	Path_Open_Queue & path_queue_up = workspace.path_queue_up;
+	Path_Open_Queue & path_queue_down = workspace.path_queue_down;
+	path_queue_up.reshape(ny, nx);
+	path_queue_down.reshape(ny, nx);
 
 	/* Dynamic binary input image */
-	char * bin_input_image = (char *)malloc(num_pixels * sizeof(char));
-
-	/* in_queue flags */
-	char * in_queue_up = (char *)malloc(num_pixels * nk * sizeof(char));
-	char * in_queue_down = (char *)malloc(num_pixels * nk * sizeof(char));
+	char * bin_input_image = workspace.bin_input_image;
 
-	/* Chain length images [k + nk * pixel_index].  These don't include the current pixel. */
-	int * chain_image_up = (int *)malloc(num_pixels * nk * sizeof(int));
-	int * chain_image_down = (int *)malloc(num_pixels * nk * sizeof(int));
+	/* Chain length images [GAP_INDEX(k, pixel_index)].  These don't include the current pixel. */
+	workspace.reserve_chain_images(sizeof(CHAIN_TYPE));
+	CHAIN_TYPE * chain_image_up = (CHAIN_TYPE *)workspace.chain_image_up;
+	CHAIN_TYPE * chain_image_down = (CHAIN_TYPE *)workspace.chain_image_down;
 
 	// At each pixel, we store the vector of binary outputs indexed by gap number of upward chain
-	char * bin_output_image_array = (char *)malloc(num_pixels * nk * sizeof(char));
+	char * bin_output_image_array = workspace.bin_output_image_array;
 	// Also count the vector of binary outputs, to note when they are all extinguished (boolean PQ!)
-	char * bin_output_image_count = (char *)malloc(num_pixels * sizeof(char));
+	char * bin_output_image_count = workspace.bin_output_image_count;
 
 	/************************************** Initialisation **********************************************/
 	/* Dynamic binary threshold image is initially all 1's */
 	memset(bin_input_image, 1, num_pixels * sizeof(char));
 
-	/* Queue initially empty */
-	memset(in_queue_up, 0, num_pixels * nk * sizeof(char));
-	memset(in_queue_down, 0, num_pixels * nk * sizeof(char));
-
 	/* Initialise the chain lengths */
 	for (y = 0; y < ny; ++y) {
 	for (x = 0; x < nx; ++x) {
@@ -911,48 +3058,102 @@ static int diag_pathopen(
 #endif
 
 		for (k = 0; k < nk; ++k)
-			chain_image_up[k + nk * index] = up_length;
+			chain_image_up[GAP_INDEX(k, index)] = up_length;
 		for (k = 0; k < nk; ++k)
-			chain_image_down[k + nk * index] = down_length;
+			chain_image_down[GAP_INDEX(k, index)] = down_length;
 	}
 	}
 
-	/* Binary output vector at each pixel */
-	memset(bin_output_image_array, 1, num_pixels * nk * sizeof(char));
-	memset(bin_output_image_count, nk, num_pixels * sizeof(char));
+	if (transform_log != NULL) {
+		/* Transform pass: no output image, just the longest path through each pixel.
+			Nothing is alive for the output code */
+		memset(bin_output_image_count, 0, num_pixels * sizeof(char));
+
+		for (y = 0; y < ny; ++y) {
+			for (x = 0, index = nx * y; x < nx; ++x, ++index) {
+				transform_log->path_length[index] =
+					chain_image_up[GAP_INDEX(0, index)] + chain_image_down[GAP_INDEX(0, index)] + 1;
+			}
+		}
+	} else if (lengths == NULL) {
+		/* Binary output vector at each pixel */
+		memset(bin_output_image_array, 1, num_pixels * nk * sizeof(char));
+		memset(bin_output_image_count, nk, num_pixels * sizeof(char));
+
+		/* Set output image to default value (0 here) */
+		memset(output_image, 0, num_pixels * sizeof(PIX_TYPE));
+
+		/* Pixels no path of L pixels passes through are dead from the start, taking the
+			first threshold swept as a multi-length pass does.  Left alive, they took
+			whatever threshold first shortened their chains */
+		PIX_TYPE first_threshold = input_image[sorted_indices[descending ? num_pixels - 1 : 0]];
+
+		for (y = 0; y < ny; ++y) {
+			for (x = 0, index = nx * y; x < nx; ++x, ++index) {
+				if (chain_image_up[GAP_INDEX(0, index)] + chain_image_down[GAP_INDEX(0, index)] + 1 < L) {
+					for (k = 0; k < nk; ++k) bin_output_image_array[GAP_INDEX(k, index)] = 0;
+					bin_output_image_count[index] = 0;
+					output_image[index] = first_threshold;
+				}
+			}
+		}
+	} else {
+		/* Multi-length pass: count the lengths alive at each pixel instead.  Those longer
+			than any path through the pixel are dead from the start, taking the first
+			threshold swept (the image minimum for an opening) */
+		PIX_TYPE first_threshold = input_image[sorted_indices[descending ? num_pixels - 1 : 0]];
 
-	/* Set output image to default value (0 here) */
-	memset(output_image, 0, num_pixels * sizeof(PATHOPEN_PIX_TYPE));
+		for (y = 0; y < ny; ++y) {
+			for (x = 0, index = nx * y; x < nx; ++x, ++index) {
+				bin_output_image_count[index] = num_lengths;
+				stack_extinguish(lengths, bin_output_image_count[index],
+					chain_image_up[GAP_INDEX(0, index)] + chain_image_down[GAP_INDEX(0, index)] + 1,
+					first_threshold, output_image, index, num_pixels);
+			}
+		}
+	}
 	/****************************************************************************************************/
 
-	/* For each threshold from smallest to largest */
+	/* For each threshold from smallest to largest, or largest to smallest if descending.
+		sort_index counts the pixels swept, sweep_indices[sweep_step * sort_index] is next */
+	int * sweep_indices = descending ? sorted_indices + num_pixels - 1 : sorted_indices;
+	int sweep_step = descending ? -1 : 1;
+
+#ifdef PATHOPEN_STATS
+	Path_Open_Pass_Stats & stats = workspace.stats;
+	long long num_merges = path_queue_up.num_merges + path_queue_down.num_merges;
+	long long num_merged = path_queue_up.num_merged + path_queue_down.num_merged;
+	chrono::steady_clock::time_point phase_start;
+
+	memset(&stats, 0, sizeof(stats));
+#endif
+
 	sort_index = 0;
 	while(sort_index < num_pixels) {
-		PATHOPEN_PIX_TYPE threshold;
+		PIX_TYPE threshold;
 
 		/*********************************** Process threshold pixels *****************************************/
-		threshold = input_image[sorted_indices[sort_index]];
+#ifdef PATHOPEN_STATS
+		++stats.num_levels;
+		phase_start = chrono::steady_clock::now();
+#endif
+		threshold = input_image[sweep_indices[sweep_step * sort_index]];
 #ifdef DEBUGGING
 		cout << "Threshold = " << (int)threshold << endl;
 #endif
-		while(input_image[sorted_indices[sort_index]] == threshold) {
-			/* Collect into rows for enqueueing */
-			vector< vector<PIXEL_INDEX_TYPE> > new_row_queue_down(nk);
-			vector< vector<PIXEL_INDEX_TYPE> > new_row_queue_right(nk);
-			vector< vector<PIXEL_INDEX_TYPE> > new_row_queue_up(nk);
-			vector< vector<PIXEL_INDEX_TYPE> > new_row_queue_left(nk);
-			int row_y = sorted_indices[sort_index] / nx;
+		while(same_level(input_image[sweep_indices[sweep_step * sort_index]], threshold)) {
+			int row_y = sweep_indices[sweep_step * sort_index] / nx;
 #ifdef DEBUGGING
 			cout << "y = " << row_y << endl;
 #endif
 
 			while(
-				input_image[sorted_indices[sort_index]] == threshold 
+				same_level(input_image[sweep_indices[sweep_step * sort_index]], threshold)
 				&& 
-				sorted_indices[sort_index] / nx == row_y
+				sweep_indices[sweep_step * sort_index] / nx == row_y
 			) {
 				/* Extract index and coordinates */
-				index = sorted_indices[sort_index];
+				index = sweep_indices[sweep_step * sort_index];
 				y = index / nx;
 				x = index % nx;
 
@@ -968,6 +3169,20 @@ static int diag_pathopen(
 #endif
 					// Remove this pixel from the binary input image
 					bin_input_image[index] = 0;
+#ifdef PATHOPEN_STATS
+					++stats.num_seeds;
+#endif
+
+					// Multi-length pass: this ends every path through the pixel, leaving
+					// nothing alive for the code below (as with CENTRE_PIXEL_FIX)
+					if (lengths != NULL) {
+						stack_extinguish(lengths, bin_output_image_count[index], 0, threshold, output_image, index, num_pixels);
+					}
+					// Transform pass: likewise the end of the pixel's curve
+					if (transform_log != NULL) {
+						transform_log->add_point(index, transform_log->path_length[index], (GPOT_PIX_TYPE)threshold);
+						transform_log->path_length[index] = 0;
+					}
 
 #ifndef CENTRE_PIXEL_FIX
 					// Update the outputs
@@ -975,9 +3190,9 @@ static int diag_pathopen(
 						// Update the output flags for each gap index (and count)
 						bin_output_image_count[index] = 0;
 						for (k = 0; k < K; ++k) {
-							bin_output_image_array[k + nk * index] = 
-								(chain_image_up[k + nk * index] + chain_image_down[(K - 1 - k) + nk * index] + 1) >= L;
-							bin_output_image_count[index] += bin_output_image_array[k + nk * index];
+							bin_output_image_array[GAP_INDEX(k, index)] = 
+								(chain_image_up[GAP_INDEX(k, index)] + chain_image_down[GAP_INDEX(K - 1 - k, index)] + 1) >= L;
+							bin_output_image_count[index] += bin_output_image_array[GAP_INDEX(k, index)];
 						}
 
 						// If all paths have been extinguished, update output
@@ -996,68 +3211,41 @@ static int diag_pathopen(
 
 					/* Enqueue downward pixels for update */
 					if (y < ny - 1) {
-						new_index = index + nx;
 						// Enqueue this pixel for all k
 						for (k = 0; k < nk; ++k) {
-							if (!in_queue_down[k + nk * new_index]) {
-								in_queue_down[k + nk * new_index] = 1;
-								new_row_queue_down[k].push_back(x);
-							}
+							path_queue_down.insert(k, y + 1, x);
 						}
 						if (x < nx - 1) {
-							new_index = index + nx + 1;
-							
 							// Enqueue this pixel for all k
 							for (k = 0; k < nk; ++k) {
-								if (!in_queue_down[k + nk * new_index]) {
-									in_queue_down[k + nk * new_index] = 1;
-									new_row_queue_down[k].push_back(x + 1);
-								}
+								path_queue_down.insert(k, y + 1, x + 1);
 							}
 						}
 					}
 					if (x < nx - 1) {
-						new_index = index + 1;
 						// Enqueue this pixel for all k
 						for (k = 0; k < nk; ++k) {
-							if (!in_queue_down[k + nk * new_index]) {
-								in_queue_down[k + nk * new_index] = 1;
-								new_row_queue_right[k].push_back(x + 1);
-							}
+							path_queue_down.insert(k, y, x + 1);
 						}
 					}
 
 					/* Enqueue upward pixels for update */
 					if (y > 0) {
 						if (x > 0) {
-							new_index = index - nx - 1;
-							
 							// Enqueue this pixel for all k
 							for (k = 0; k < nk; ++k) {
-								if (!in_queue_up[k + nk * new_index]) {
-									in_queue_up[k + nk * new_index] = 1;
-									new_row_queue_up[k].push_back(x - 1);
-								}
+								path_queue_up.insert(k, y - 1, x - 1);
 							}
 						}
-						new_index = index - nx;
 						// Enqueue this pixel for all k
 						for (k = 0; k < nk; ++k) {
-							if (!in_queue_up[k + nk * new_index]) {
-								in_queue_up[k + nk * new_index] = 1;
-								new_row_queue_up[k].push_back(x);
-							}
+							path_queue_up.insert(k, y - 1, x);
 						}
 					}
 					if (x > 0) {
-						new_index = index - 1;
-						
 						// Enqueue this pixel for all k
 						for (k = 0; k < nk; ++k) {
-							if (!in_queue_up[k + nk * new_index]) {
-								in_queue_up[k + nk * new_index] = 1;
-								new_row_queue_left[k].push_back(x - 1);
-							}
+							path_queue_up.insert(k, y, x - 1);
 						}
 					}
 				}
@@ -1066,74 +3254,22 @@ static int diag_pathopen(
 				++sort_index;
 				if (sort_index >= num_pixels) break;
 			}
-#ifdef DEBUGGING
-			cout << "Merging row queues" << endl;
-#endif
-
-			// Merge row queues into path queues
-#ifdef DEBUGGING
-			cout << "Down queues" << endl;
-#endif
-			// Down
+			// Commit the new entries of the neighbouring rows and of this row
 			if (row_y + 1 < ny) {
 				for (k = 0; k < nk; ++k) {
-					if (new_row_queue_down[k].size() > 0) {
-#ifdef DEBUGGING
-						cout << "k = " << k << ":";
-						for (i = 0; i < new_row_queue_down[k].size(); ++i) {
-							cout << new_row_queue_down[k][i] << " ";
-						}
-						cout << endl;
-#endif
-						path_queue_down.merge_row(new_row_queue_down[k], k, row_y + 1);
-					}
+					path_queue_down.commit(k, row_y + 1);
 				}
 			}
-			// Right
 			for (k = 0; k < nk; ++k) {
-				if (new_row_queue_right[k].size() > 0) {
-#ifdef DEBUGGING
-				cout << "k = " << k << ":";
-				for (i = 0; i < new_row_queue_right[k].size(); ++i) {
-					cout << new_row_queue_right[k][i] << " ";
-				}
-				cout << endl;
-#endif
-					path_queue_down.merge_row(new_row_queue_right[k], k, row_y);
-				}
+				path_queue_down.commit(k, row_y);
 			}
-
-
-#ifdef DEBUGGING
-			cout << "Up queues" << endl;
-#endif
-			// Up
 			if (row_y - 1 >= 0) {
 				for (k = 0; k < nk; ++k) {
-					if (new_row_queue_up[k].size() > 0) {
-#ifdef DEBUGGING
-						cout << "k = " << k << ":";
-						for (i = 0; i < new_row_queue_up[k].size(); ++i) {
-							cout << new_row_queue_up[k][i] << " ";
-						}
-						cout << endl;
-#endif
-						path_queue_up.merge_row(new_row_queue_up[k], k, row_y - 1);
-					}
+					path_queue_up.commit(k, row_y - 1);
 				}
 			}
-			// Left
 			for (k = 0; k < nk; ++k) {
-				if (new_row_queue_left[k].size() > 0) {
-#ifdef DEBUGGING
-					cout << "k = " << k << ":";
-					for (i = 0; i < new_row_queue_left[k].size(); ++i) {
-						cout << new_row_queue_left[k][i] << " ";
-					}
-					cout << endl;
-#endif
-					path_queue_up.merge_row(new_row_queue_left[k], k, row_y);
-				}
+				path_queue_up.commit(k, row_y);
 			}
 
 #ifdef DEBUGGING
@@ -1142,18 +3278,20 @@ static int diag_pathopen(
 			if (sort_index >= num_pixels) break;
 		}
 
+#ifdef PATHOPEN_STATS
+		stats_lap(stats.seed_time, phase_start);
+#endif
+
 		/*************************************** Downward sweep *********************************************/
 		/* Propagate changes at current threshold down the image */
 #ifdef DEBUGGING
 		cout << "DOWNWARD SWEEP - before" << endl;
-		dump_state(
+		dump_state<CHAIN_TYPE, PLANAR>(
 			nx,									// Image dimensions etc.
 			ny,
 			nk,
 			path_queue_up,						// Queueing structures
 			path_queue_down,
-			in_queue_up,
-			in_queue_down,
 			bin_input_image,					// Input/output binary images
 			bin_output_image_array,
 			bin_output_image_count,
@@ -1167,8 +3305,7 @@ static int diag_pathopen(
 			cout << "k = " << k << endl;
 #endif
 			for (y = 0; y < ny; ++y) {
-				vector<PIXEL_INDEX_TYPE> & row_queue = path_queue_down.q[k][y];
-				if (row_queue.size() == 0) continue;
+				if (path_queue_down.empty(k, y)) continue;
 
 
 #ifdef DEBUGGING
@@ -1176,13 +3313,8 @@ static int diag_pathopen(
 #endif
 
 				bool right_queue = false;
-				vector<PIXEL_INDEX_TYPE> cur_row_queue_next_k;
-				vector<PIXEL_INDEX_TYPE> new_row_queue_cur_k;
-				vector<PIXEL_INDEX_TYPE> new_row_queue_next_k;
-
-				/* Perform updates on points in row_queue, propagating changes to the new row queues */
-				unsigned int ui = 0;
-				x = row_queue[ui];
+				/* Perform updates on points in the row queue, propagating changes to the next rows */
+				x = path_queue_down.first(k, y);
 				while (true) {
 					/* Extract x-coordinate and pixel index */
 					index = x + nx * y;
@@ -1192,7 +3324,10 @@ static int diag_pathopen(
 #endif
 
 					/* Unflag -> no longer in queue */
-					in_queue_down[k + nk * index] = 0;
+					path_queue_down.remove(k, y, x);
+#ifdef PATHOPEN_STATS
+					++stats.num_enqueued_down;
+#endif
 
 					/* Update chain length from upward neighbours */
 					int max_prev = -1;
@@ -1201,19 +3336,19 @@ static int diag_pathopen(
 						if (y > 0) {
 							if (x > 0) {
 								new_index = index - nx - 1;
-								if (chain_image_up[k - 1 + nk * new_index] > max_prev) {
-									max_prev = chain_image_up[k - 1 + nk * new_index];
+								if (chain_image_up[GAP_INDEX(k - 1, new_index)] > max_prev) {
+									max_prev = chain_image_up[GAP_INDEX(k - 1, new_index)];
 								}
 							}
 							new_index = index - nx;
-							if (chain_image_up[k - 1 + nk * new_index] > max_prev) {
-								max_prev = chain_image_up[k - 1 + nk * new_index];
+							if (chain_image_up[GAP_INDEX(k - 1, new_index)] > max_prev) {
+								max_prev = chain_image_up[GAP_INDEX(k - 1, new_index)];
 							}
 						}
 						if (x > 0) {
 							new_index = index - 1;
-							if (chain_image_up[k - 1 + nk * new_index] > max_prev) {
-								max_prev = chain_image_up[k - 1 + nk * new_index];
+							if (chain_image_up[GAP_INDEX(k - 1, new_index)] > max_prev) {
+								max_prev = chain_image_up[GAP_INDEX(k - 1, new_index)];
 							}
 						}
 					}
@@ -1221,38 +3356,55 @@ static int diag_pathopen(
 					if (y > 0) {
 						if (x > 0) {
 							new_index = index - nx - 1;
-							if (bin_input_image[new_index] == 1 && chain_image_up[k + nk * new_index] > max_prev) {
-								max_prev = chain_image_up[k + nk * new_index];
+							if (bin_input_image[new_index] == 1 && chain_image_up[GAP_INDEX(k, new_index)] > max_prev) {
+								max_prev = chain_image_up[GAP_INDEX(k, new_index)];
 							}
 						}
 						new_index = index - nx;
-						if (bin_input_image[new_index] == 1 && chain_image_up[k + nk * new_index] > max_prev) {
-							max_prev = chain_image_up[k + nk * new_index];
+						if (bin_input_image[new_index] == 1 && chain_image_up[GAP_INDEX(k, new_index)] > max_prev) {
+							max_prev = chain_image_up[GAP_INDEX(k, new_index)];
 						}
 					}
 					if (x > 0) {
 						new_index = index - 1;
-						if (bin_input_image[new_index] == 1 && chain_image_up[k + nk * new_index] > max_prev) {
-							max_prev = chain_image_up[k + nk * new_index];
+						if (bin_input_image[new_index] == 1 && chain_image_up[GAP_INDEX(k, new_index)] > max_prev) {
+							max_prev = chain_image_up[GAP_INDEX(k, new_index)];
 						}
 					}
 
 					/* Update chain length? */
-					if (max_prev + 1 < chain_image_up[k + nk * index]) {
+					if (max_prev + 1 < chain_image_up[GAP_INDEX(k, index)]) {
+#ifdef PATHOPEN_STATS
+						++stats.num_chain_updates;
+#endif
 #ifdef DEBUGGING
-						cout << "New chain length is " << chain_image_up[k + nk * index] << endl;
+						cout << "New chain length is " << (int)chain_image_up[GAP_INDEX(k, index)] << endl;
 #endif
 						// Update chain length
-						chain_image_up[k + nk * index] = max_prev + 1;
+						chain_image_up[GAP_INDEX(k, index)] = max_prev + 1;
 
 						// Propagate changes to output
-						if (bin_input_image[index]) {
+						if (lengths != NULL) {
+							// Multi-length pass: removed pixels have nothing left alive
+							if (bin_input_image[index]) {
+								stack_shorten<PIX_TYPE, CHAIN_TYPE, PLANAR>(lengths, bin_output_image_count[index],
+									chain_image_up[GAP_INDEX(k, index)] + chain_image_down[GAP_INDEX(K - k, index)] + 1,
+									chain_image_up, chain_image_down, index, num_pixels, nk, threshold, output_image, index);
+							}
+						} else if (transform_log != NULL) {
+							// Transform pass: likewise
+							if (bin_input_image[index]) {
+								transform_shorten<PIX_TYPE, CHAIN_TYPE, PLANAR>(*transform_log,
+									chain_image_up[GAP_INDEX(k, index)] + chain_image_down[GAP_INDEX(K - k, index)] + 1,
+									chain_image_up, chain_image_down, index, num_pixels, nk, threshold, index);
+							}
+						} else if (bin_input_image[index]) {
 							char new_bin_output_flag = 
-								(chain_image_up[k + nk * index] + chain_image_down[(K - k) + nk * index] + 1 >= L);
+								(chain_image_up[GAP_INDEX(k, index)] + chain_image_down[GAP_INDEX(K - k, index)] + 1 >= L);
 							// Did we cross the threshold?
-							if (bin_output_image_array[k + nk * index] && !new_bin_output_flag) {
+							if (bin_output_image_array[GAP_INDEX(k, index)] && !new_bin_output_flag) {
 								// Clear the flag
-								bin_output_image_array[k + nk * index] = 0;
+								bin_output_image_array[GAP_INDEX(k, index)] = 0;
 								--bin_output_image_count[index];
 								// Did this extinguish the last path?
 								if (bin_output_image_count[index] == 0) {
@@ -1263,11 +3415,11 @@ static int diag_pathopen(
 						} else {
 							if (K - 1 - k >= 0) {
 								char new_bin_output_flag = 
-									(chain_image_up[k + nk * index] + chain_image_down[(K - 1 - k) + nk * index] + 1 >= L);
+									(chain_image_up[GAP_INDEX(k, index)] + chain_image_down[GAP_INDEX(K - 1 - k, index)] + 1 >= L);
 								// Did we cross the threshold?
-								if (bin_output_image_array[k + nk * index] && !new_bin_output_flag) {
+								if (bin_output_image_array[GAP_INDEX(k, index)] && !new_bin_output_flag) {
 									// Clear the flag
-									bin_output_image_array[k + nk * index] = 0;
+									bin_output_image_array[GAP_INDEX(k, index)] = 0;
 									--bin_output_image_count[index];
 									// Did this extinguish the last path?
 									if (bin_output_image_count[index] == 0) {
@@ -1282,49 +3434,28 @@ static int diag_pathopen(
 						/* Propagate changes by enqueueing downward neighbours */
 						if (y < ny - 1) {
 							// Same layer
-							new_index = index + nx;
-							if (!in_queue_down[k + nk * new_index]) {
-								new_row_queue_cur_k.push_back(x);
-								in_queue_down[k + nk * new_index] = 1;
-							}
+							path_queue_down.insert(k, y + 1, x);
 							if (x < nx - 1) {
-								new_index = index + nx + 1;
-								if (!in_queue_down[k + nk * new_index]) {
-									new_row_queue_cur_k.push_back(x + 1);
-									in_queue_down[k + nk * new_index] = 1;
-								}
+								path_queue_down.insert(k, y + 1, x + 1);
 							}
 						}
 						if (x < nx - 1) {
-							new_index = index + 1;
-							if (!in_queue_down[k + nk * new_index]) {
+							if (!path_queue_down.contains(k, y, x + 1)) {
 								right_queue = true;
-								in_queue_down[k + nk * new_index] = 1;
+								path_queue_down.mark(k, y, x + 1);
 							}
 						}
 
 						// Down one layer
 						if (k < K) {
 							if (y < ny - 1) {
-								new_index = index + nx;
-								if (!in_queue_down[k + 1 + nk * new_index]) {
-									new_row_queue_next_k.push_back(x);
-									in_queue_down[k + 1 + nk * new_index] = 1;
-								}
+								path_queue_down.insert(k + 1, y + 1, x);
 								if (x < nx - 1) {
-									new_index = index + nx + 1;
-									if (!in_queue_down[k + 1 + nk * new_index]) {
-										new_row_queue_next_k.push_back(x + 1);
-										in_queue_down[k + 1 + nk * new_index] = 1;
-									}
+									path_queue_down.insert(k + 1, y + 1, x + 1);
 								}
 							}
 							if (x < nx - 1) {
-								new_index = index + 1;
-								if (!in_queue_down[k + 1 + nk * new_index]) {
-									cur_row_queue_next_k.push_back(x + 1);
-									in_queue_down[k + 1 + nk * new_index] = 1;
-								}
+								path_queue_down.insert(k + 1, y, x + 1);
 							}
 						}
 					}
@@ -1336,49 +3467,31 @@ static int diag_pathopen(
 						++x;
 						// Test halting condition
 						if (x > nx - 1) break;
-
-						// Consume the row queue?
-						if (ui + 1 < row_queue.size()) {
-							if (row_queue[ui + 1] == x)
-								++ui;
-						}
 					} else {
 						// Halting condition
-						if (ui + 1 >= row_queue.size()) {
-							break;
-						} else {
-							++ui;
-							x = row_queue[ui];
-						}
+						x = path_queue_down.next(k, y, x + 1);
+						if (x < 0) break;
 					}
 				}
 				// Wipe old queue
-				row_queue.resize(0);
+				path_queue_down.clear_row(k, y);
 
-				/* Merge new row queues into existing queues */
+				/* Commit new entries into existing queues */
 				if (y + 1 < ny) {
-					if (new_row_queue_cur_k.size() > 0) {
-						path_queue_down.merge_row(new_row_queue_cur_k, k, y + 1);
-					}
-					if (new_row_queue_next_k.size() > 0) {
-						path_queue_down.merge_row(new_row_queue_next_k, k + 1, y + 1);
-					}
-				}
-				if (cur_row_queue_next_k.size() > 0) {
-					path_queue_down.merge_row(cur_row_queue_next_k, k + 1, y);
+					path_queue_down.commit(k, y + 1);
+					if (k < K) path_queue_down.commit(k + 1, y + 1);
 				}
+				if (k < K) path_queue_down.commit(k + 1, y);
 			}
 		}
 #ifdef DEBUGGING
 		cout << "DOWNWARD SWEEP - after" << endl;
-		dump_state(
+		dump_state<CHAIN_TYPE, PLANAR>(
 			nx,									// Image dimensions etc.
 			ny,
 			nk,
 			path_queue_up,						// Queueing structures
 			path_queue_down,
-			in_queue_up,
-			in_queue_down,
 			bin_input_image,					// Input/output binary images
 			bin_output_image_array,
 			bin_output_image_count,
@@ -1387,17 +3500,19 @@ static int diag_pathopen(
 		);
 #endif
 
+#ifdef PATHOPEN_STATS
+		stats_lap(stats.down_time, phase_start);
+#endif
+
 		/*************************************** Upward sweep *********************************************/
 #ifdef DEBUGGING
 		cout << "UPWARD SWEEP - before" << endl;
-		dump_state(
+		dump_state<CHAIN_TYPE, PLANAR>(
 			nx,									// Image dimensions etc.
 			ny,
 			nk,
 			path_queue_up,						// Queueing structures
 			path_queue_down,
-			in_queue_up,
-			in_queue_down,
 			bin_input_image,					// Input/output binary images
 			bin_output_image_array,
 			bin_output_image_count,
@@ -1412,21 +3527,15 @@ static int diag_pathopen(
 			cout << "k = " << k << endl;
 #endif
 			for (y = ny - 1; y >= 0; --y) {
-				vector<PIXEL_INDEX_TYPE> & row_queue = path_queue_up.q[k][y];
-				if (row_queue.size() == 0) continue;
+				if (path_queue_up.empty(k, y)) continue;
 
 #ifdef DEBUGGING
 				cout << "\ty = " << y << endl;
 #endif
 
 				bool left_queue = false;
-				vector<PIXEL_INDEX_TYPE> cur_row_queue_next_k;
-				vector<PIXEL_INDEX_TYPE> new_row_queue_cur_k;
-				vector<PIXEL_INDEX_TYPE> new_row_queue_next_k;
-
-				/* Perform updates on points in row_queue, propagating changes to the new row queues */
-                                int i = row_queue.size() - 1; // needs to be signed
-				x = row_queue[i];
+				/* Perform updates on points in the row queue, propagating changes to the next rows */
+				x = path_queue_up.last(k, y);
 				while(true) {
 					/* Extract x-coordinate and pixel index */
 					index = x + nx * y;
@@ -1436,7 +3545,10 @@ static int diag_pathopen(
 #endif
 
 					/* Unflag -> no longer in queue */
-					in_queue_up[k + nk * index] = 0;
+					path_queue_up.remove(k, y, x);
+#ifdef PATHOPEN_STATS
+					++stats.num_enqueued_up;
+#endif
 
 					/* Update chain length from downward neighbours */
 					// Note: Only y < ny - 1 may be 'updated', so we are assured of the existence of previous neighbours!
@@ -1445,56 +3557,73 @@ static int diag_pathopen(
 					if (k > 0) {
 						if (y < ny - 1) {
 							new_index = index + nx;
-							if (chain_image_down[k - 1 + nk * new_index] > max_prev) {
-								max_prev = chain_image_down[k - 1 + nk * new_index];
+							if (chain_image_down[GAP_INDEX(k - 1, new_index)] > max_prev) {
+								max_prev = chain_image_down[GAP_INDEX(k - 1, new_index)];
 							}
 							if (x < nx - 1) {
 								new_index = index + nx + 1;
-								if (chain_image_down[k - 1 + nk * new_index] > max_prev) {
-									max_prev = chain_image_down[k - 1 + nk * new_index];
+								if (chain_image_down[GAP_INDEX(k - 1, new_index)] > max_prev) {
+									max_prev = chain_image_down[GAP_INDEX(k - 1, new_index)];
 								}
 							}
 						}
 						if (x < nx - 1) {
 							new_index = index + 1;
-							if (chain_image_down[k - 1 + nk * new_index] > max_prev) {
-								max_prev = chain_image_down[k - 1 + nk * new_index];
+							if (chain_image_down[GAP_INDEX(k - 1, new_index)] > max_prev) {
+								max_prev = chain_image_down[GAP_INDEX(k - 1, new_index)];
 							}
 						}
 					}
 					// Current level - no gap allowed
 					if (y < ny - 1) {
 						new_index = index + nx;
-						if (bin_input_image[new_index] == 1 && chain_image_down[k + nk * new_index] > max_prev) {
-							max_prev = chain_image_down[k + nk * new_index];
+						if (bin_input_image[new_index] == 1 && chain_image_down[GAP_INDEX(k, new_index)] > max_prev) {
+							max_prev = chain_image_down[GAP_INDEX(k, new_index)];
 						}
 						if (x < nx - 1) {
 							new_index = index + nx + 1;
-							if (bin_input_image[new_index] == 1 && chain_image_down[k + nk * new_index] > max_prev) {
-								max_prev = chain_image_down[k + nk * new_index];
+							if (bin_input_image[new_index] == 1 && chain_image_down[GAP_INDEX(k, new_index)] > max_prev) {
+								max_prev = chain_image_down[GAP_INDEX(k, new_index)];
 							}
 						}
 					}
 					if (x < nx - 1) {
 						new_index = index + 1;
-						if (bin_input_image[new_index] == 1 && chain_image_down[k + nk * new_index] > max_prev) {
-							max_prev = chain_image_down[k + nk * new_index];
+						if (bin_input_image[new_index] == 1 && chain_image_down[GAP_INDEX(k, new_index)] > max_prev) {
+							max_prev = chain_image_down[GAP_INDEX(k, new_index)];
 						}
 					}
 
 					/* Update chain length? */
-					if (max_prev + 1 < chain_image_down[k + nk * index]) {
+					if (max_prev + 1 < chain_image_down[GAP_INDEX(k, index)]) {
+#ifdef PATHOPEN_STATS
+						++stats.num_chain_updates;
+#endif
 						// Update chain length
-						chain_image_down[k + nk * index] = max_prev + 1;
+						chain_image_down[GAP_INDEX(k, index)] = max_prev + 1;
 
 						// Propagate changes to output
-						if (bin_input_image[index]) {
+						if (lengths != NULL) {
+							// Multi-length pass: removed pixels have nothing left alive
+							if (bin_input_image[index]) {
+								stack_shorten<PIX_TYPE, CHAIN_TYPE, PLANAR>(lengths, bin_output_image_count[index],
+									chain_image_up[GAP_INDEX(K - k, index)] + chain_image_down[GAP_INDEX(k, index)] + 1,
+									chain_image_up, chain_image_down, index, num_pixels, nk, threshold, output_image, index);
+							}
+						} else if (transform_log != NULL) {
+							// Transform pass: likewise
+							if (bin_input_image[index]) {
+								transform_shorten<PIX_TYPE, CHAIN_TYPE, PLANAR>(*transform_log,
+									chain_image_up[GAP_INDEX(K - k, index)] + chain_image_down[GAP_INDEX(k, index)] + 1,
+									chain_image_up, chain_image_down, index, num_pixels, nk, threshold, index);
+							}
+						} else if (bin_input_image[index]) {
 							char new_bin_output_flag = 
-								(chain_image_up[(K - k) + nk * index] + chain_image_down[k + nk * index] + 1 >= L);
+								(chain_image_up[GAP_INDEX(K - k, index)] + chain_image_down[GAP_INDEX(k, index)] + 1 >= L);
 							// Did we cross the threshold?
-							if (bin_output_image_array[(K - k) + nk * index] && !new_bin_output_flag) {
+							if (bin_output_image_array[GAP_INDEX(K - k, index)] && !new_bin_output_flag) {
 								// Update flags
-								bin_output_image_array[(K - k) + nk * index] = 0;
+								bin_output_image_array[GAP_INDEX(K - k, index)] = 0;
 								--bin_output_image_count[index];
 								// Did this extinguish the last path?
 								if (bin_output_image_count[index] == 0) {
@@ -1505,11 +3634,11 @@ static int diag_pathopen(
 						} else {
 							if (K - 1 - k >= 0) {
 								char new_bin_output_flag = 
-									(chain_image_up[(K - 1 - k) + nk * index] + chain_image_down[k + nk * index] + 1 >= L);
+									(chain_image_up[GAP_INDEX(K - 1 - k, index)] + chain_image_down[GAP_INDEX(k, index)] + 1 >= L);
 								// Did we cross the threshold?
-								if (bin_output_image_array[(K - 1 - k) + nk * index] && !new_bin_output_flag) {
+								if (bin_output_image_array[GAP_INDEX(K - 1 - k, index)] && !new_bin_output_flag) {
 									// Update flags
-									bin_output_image_array[(K - 1 - k) + nk * index] = 0;
+									bin_output_image_array[GAP_INDEX(K - 1 - k, index)] = 0;
 									--bin_output_image_count[index];
 									// Did this extinguish the last path?
 									if (bin_output_image_count[index] == 0) {
@@ -1525,23 +3654,14 @@ static int diag_pathopen(
 						if (y > 0) {
 							// Same layer
 							if (x > 0) {
-								new_index = index - nx - 1;
-								if (!in_queue_up[k + nk * new_index]) {
-									new_row_queue_cur_k.push_back(x - 1);
-									in_queue_up[k + nk * new_index] = 1;
-								}
-							}
-							new_index = index - nx;
-							if (!in_queue_up[k + nk * new_index]) {
-								new_row_queue_cur_k.push_back(x);
-								in_queue_up[k + nk * new_index] = 1;
+								path_queue_up.insert(k, y - 1, x - 1);
 							}
+							path_queue_up.insert(k, y - 1, x);
 						}
 						if (x > 0) {
-							new_index = index - 1;
-							if (!in_queue_up[k + nk * new_index]) {
+							if (!path_queue_up.contains(k, y, x - 1)) {
 								left_queue = true;
-								in_queue_up[k + nk * new_index] = 1;
+								path_queue_up.mark(k, y, x - 1);
 							}
 						}
 
@@ -1549,24 +3669,12 @@ static int diag_pathopen(
 						if (k < K) {
 							if (y > 0) {
 								if (x > 0) {
-									new_index = index - nx - 1;
-									if (!in_queue_up[k + 1 + nk * new_index]) {
-										new_row_queue_next_k.push_back(x - 1);
-										in_queue_up[k + 1 + nk * new_index] = 1;
-									}
-								}
-								new_index = index - nx;
-								if (!in_queue_up[k + 1 + nk * new_index]) {
-									new_row_queue_next_k.push_back(x);
-									in_queue_up[k + 1 + nk * new_index] = 1;
+									path_queue_up.insert(k + 1, y - 1, x - 1);
 								}
+								path_queue_up.insert(k + 1, y - 1, x);
 							}
 							if (x > 0) {
-								new_index = index - 1;
-								if (!in_queue_up[k + 1 + nk * new_index]) {
-									cur_row_queue_next_k.push_back(x - 1);
-									in_queue_up[k + 1 + nk * new_index] = 1;
-								}
+								path_queue_up.insert(k + 1, y, x - 1);
 							}
 						}
 					}
@@ -1578,72 +3686,48 @@ static int diag_pathopen(
 						--x;
 						// Test halting condition
 						if (x < 0) break;
-
-						// Consume the row queue?
-						if (i - 1 >= 0) {
-							if (row_queue[i - 1] == x)
-								--i;
-						}
 					} else {
 						// Halting condition
-						if (i - 1 < 0) {
-							break;
-						} else {
-							--i;
-							x = row_queue[i];
-						}
+						x = path_queue_up.prev(k, y, x - 1);
+						if (x < 0) break;
 					}
 				}
 				// Wipe old queue
-				row_queue.resize(0);
+				path_queue_up.clear_row(k, y);
 
-				/* Merge new row queues into existing queues */
+				/* Commit new entries into existing queues, collected in descending order */
 				if (y - 1 >= 0) {
-					if (new_row_queue_cur_k.size() > 0) {
-						reverse(new_row_queue_cur_k.begin(), new_row_queue_cur_k.end());
-						path_queue_up.merge_row(new_row_queue_cur_k, k, y - 1);
-					}
-					if (new_row_queue_next_k.size() > 0) {
-						reverse(new_row_queue_next_k.begin(), new_row_queue_next_k.end());
-						path_queue_up.merge_row(new_row_queue_next_k, k + 1, y - 1);
-					}
-				}
-				if (cur_row_queue_next_k.size() > 0) {
-					reverse(cur_row_queue_next_k.begin(), cur_row_queue_next_k.end());
-					path_queue_up.merge_row(cur_row_queue_next_k, k + 1, y);
+					path_queue_up.commit(k, y - 1);
+					if (k < K) path_queue_up.commit(k + 1, y - 1);
 				}
+				if (k < K) path_queue_up.commit(k + 1, y);
 			}
 		}
 #ifdef DEBUGGING
 		cout << "UPWARD SWEEP - after" << endl;
-		dump_state(
+		dump_state<CHAIN_TYPE, PLANAR>(
 			nx,									// Image dimensions etc.
 			ny,
 			nk,
 			path_queue_up,						// Queueing structures
 			path_queue_down,
-			in_queue_up,
-			in_queue_down,
 			bin_input_image,					// Input/output binary images
 			bin_output_image_array,
 			bin_output_image_count,
 			chain_image_up,						// Up/down chain lengths
 			chain_image_down
 		);
+#endif
+#ifdef PATHOPEN_STATS
+		stats_lap(stats.up_time, phase_start);
 #endif
 	}
 
-	/* Free allocated memory */
-	free((void *)in_queue_up);
-	free((void *)in_queue_down);
-
-	free((void *)bin_input_image);
-	
-	free((void *)chain_image_up);
-	free((void *)chain_image_down);
-
-	free((void *)bin_output_image_array);
-	free((void *)bin_output_image_count);
+#ifdef PATHOPEN_STATS
+	stats.num_early_outs = stats.num_enqueued_down + stats.num_enqueued_up - stats.num_chain_updates;
+	stats.num_merges = path_queue_up.num_merges + path_queue_down.num_merges - num_merges;
+	stats.num_merged = path_queue_up.num_merged + path_queue_down.num_merged - num_merged;
+#endif
 
 	return 0;
 }
@@ -1653,22 +3737,22 @@ static int diag_pathopen(
 	Nifty debugging function 
 	- dump the state of the algorithm to the terminal for verification.
 */
+template <class CHAIN_TYPE, bool PLANAR>
 void dump_state(
 	int nx,									// Image dimensions etc.
 	int ny,
 	int nk,
-	Path_Queue & path_queue_up,				// Queueing structures
-	Path_Queue & path_queue_down,
-	char * in_queue_up,
-	char * in_queue_down,
+	Path_Open_Queue & path_queue_up,		// Queueing structures
+	Path_Open_Queue & path_queue_down,
 	char * bin_input_image,					// Input/output binary images
 	char * bin_output_image_array,
 	char * bin_output_image_count,
-	int * chain_image_up,					// Up/down chain lengths
-	int * chain_image_down
+	CHAIN_TYPE * chain_image_up,			// Up/down chain lengths
+	CHAIN_TYPE * chain_image_down
 )
 {
 	int x, y, k;
+	int num_pixels = nx * ny;
 
 	cout << endl << "STATE DUMP" << endl;
 
@@ -1688,7 +3772,7 @@ void dump_state(
 		for (y = 0; y < ny; ++y) {
 			cout << "\t" << y << ":";
 			for (x = 0; x < nx; ++x) {
-				cout << (int)bin_output_image_array[k + nk * (x + nx * y)] << " ";
+				cout << (int)bin_output_image_array[GAP_INDEX(k, x + nx * y)] << " ";
 			}
 			cout << endl;
 		}
@@ -1711,7 +3795,7 @@ void dump_state(
 		for (y = 0; y < ny; ++y) {
 			cout << "\t" << y << ":";
 			for (x = 0; x < nx; ++x) {
-				cout << chain_image_down[k + nk * (x + nx * y)] << " ";
+				cout << (int)chain_image_down[GAP_INDEX(k, x + nx * y)] << " ";
 			}
 			cout << endl;
 		}
@@ -1723,7 +3807,7 @@ void dump_state(
 		for (y = 0; y < ny; ++y) {
 			cout << "\t" << y << ":";
 			for (x = 0; x < nx; ++x) {
-				cout << chain_image_up[k + nk * (x + nx * y)] << " ";
+				cout << (int)chain_image_up[GAP_INDEX(k, x + nx * y)] << " ";
 			}
 			cout << endl;
 		}
@@ -1735,11 +3819,11 @@ void dump_state(
 	for (k = 0; k < nk; ++k) {
 		cout << "k = " << k << endl;
 		for (y = 0; y < ny; ++y) {
-			vector<PIXEL_INDEX_TYPE> & q = path_queue_down.q[k][y];
-			if (q.size() == 0) continue;
+			PIXEL_INDEX_TYPE * q = path_queue_down.row(k, y);
+			if (path_queue_down.row_length(k, y) == 0) continue;
 
 			cout << "\t" << y << ":";
-			for (i = 0; i < q.size(); ++i) {
+			for (i = 0; i < path_queue_down.row_length(k, y); ++i) {
 				cout <<	q[i] << " ";
 			}
 			cout << endl;
@@ -1752,7 +3836,7 @@ void dump_state(
 		for (y = 0; y < ny; ++y) {
 			cout << "\t" << y << ":";
 			for (x = 0; x < nx; ++x) {
-				cout << (int)in_queue_down[k + nk * (x + nx * y)] << " ";
+				cout << (int)path_queue_down.contains(k, y, x) << " ";
 			}
 			cout << endl;
 		}
@@ -1762,11 +3846,11 @@ void dump_state(
 	for (k = 0; k < nk; ++k) {
 		cout << "k = " << k << endl;
 		for (y = 0; y < ny; ++y) {
-			vector<PIXEL_INDEX_TYPE> & q = path_queue_up.q[k][y];
-			if (q.size() == 0) continue;
+			PIXEL_INDEX_TYPE * q = path_queue_up.row(k, y);
+			if (path_queue_up.row_length(k, y) == 0) continue;
 
 			cout << "\t" << y << ":";
-			for (i = 0; i < q.size(); ++i) {
+			for (i = 0; i < path_queue_up.row_length(k, y); ++i) {
 				cout <<	q[i] << " ";
 			}
 			cout << endl;
@@ -1779,7 +3863,7 @@ void dump_state(
 		for (y = 0; y < ny; ++y) {
 			cout << "\t" << y << ":";
 			for (x = 0; x < nx; ++x) {
-				cout << (int)in_queue_up[k + nk * (x + nx * y)] << " ";
+				cout << (int)path_queue_up.contains(k, y, x) << " ";
 			}
 			cout << endl;
 		}
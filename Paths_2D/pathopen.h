@@ -63,6 +63,7 @@ knowledge of the CeCILL-B license and that you accept its terms.
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
 
 #include "pathopenclose.h"
 #include "path_queue.h"
@@ -73,42 +74,220 @@ extern "C" {
 
 #define PATHOPEN_LENGTH_HEURISTIC
 
+/* Queue pixels for update in per-row bitsets rather than sorted arrays (see path_queue.h),
+   unless compiled with PATHOPEN_QUEUE_ARRAY defined */
+#ifndef PATHOPEN_QUEUE_ARRAY
+#define PATHOPEN_QUEUE_BITSET
+#endif
+
+#ifdef PATHOPEN_QUEUE_BITSET
+typedef Path_Queue_Bitset Path_Open_Queue;
+#else
+typedef Path_Queue Path_Open_Queue;
+#endif
+
+/* Store the per-gap images planar (gap-major) rather than interleaved from this K on */
+#define PATHOPEN_PLANAR_MIN_K 2
+
+/* Compile with PATHOPEN_STATS defined (-DPATHOPEN_STATS, for this file and path_queue.cxx
+   alike) to count the work of each pass into Path_Open_Pass_Stats.  Without it the
+   counting is compiled out */
+
+/************************************* WORKING MEMORY **************************************/
+/* Path_Open_Workspace:
+	Working memory of one orientation pass, sized for either orientation of an nx * ny image.
+	A pass leaves its path queues empty, with their in_queue flags cleared, so only the binary
+	images and chain lengths need reinitialising on the next pass.
+*/
+class Path_Open_Workspace {
+public:
+	int num_pixels;
+	int nk;
+
+	/* Queueing system, holding the in_queue flags */
+	Path_Open_Queue path_queue_up;
+	Path_Open_Queue path_queue_down;
+
+	/* Dynamic binary input image */
+	char * bin_input_image;
+
+	/* Chain length images [GAP_INDEX(k, pixel_index)].  These don't include the current pixel.
+		Their type depends on L, see chain_length_size() */
+	void * chain_image_up;
+	void * chain_image_down;
+	size_t chain_length_size;						/* Allocated bytes per chain length */
+
+	/* Binary outputs indexed by gap number of upward chain, and their count.  A multi-length
+		pass counts the lengths still alive at each pixel instead */
+	char * bin_output_image_array;
+	char * bin_output_image_count;
+
+	/* What the last pass did, counted if PATHOPEN_STATS is defined */
+	Path_Open_Pass_Stats stats;
+
+	Path_Open_Workspace(
+		int nx, int ny,								/* Image dimensions */
+		int K										/* The maximum gap number */
+	);
+
+	~Path_Open_Workspace();
+
+	/* reserve_chain_images:
+		Make room for chain lengths of the given size, reallocating only if they grow.
+	*/
+	void reserve_chain_images(
+		size_t chain_length_size						/* Bytes per chain length */
+	);
+};
+
+/* A point of a granulometric curve in the pool of a Path_Open_Transform_Log */
+typedef struct {
+	int path_length;
+	int previous;									/* The point before at the same pixel, or -1 */
+	GPOT_PIX_TYPE threshold;
+} Path_Open_Transform_Point;
+
+/* Path_Open_Transform_Log:
+	The granulometric curves recorded by one orientation pass of pathopen_transform().  The
+	pass keeps the longest path through each pixel, adding a point as the sweep shortens it;
+	the points of all pixels share one growing pool, each linked to the one before it.
+	Pixels are indexed as in the pass's output image.
+*/
+class Path_Open_Transform_Log {
+public:
+	int num_pixels;
+	int max_length;									/* Longer paths are recorded as this long */
+
+	int * path_length;								/* Longest path through each pixel */
+	int * last_point;								/* Last point of each pixel, or -1 */
+	int * num_points;								/* Number of points of each pixel */
+
+	Path_Open_Transform_Point * points;				/* The pool */
+	size_t size;									/* Points in the pool */
+	size_t allocated_size;
+	bool failed;									/* Out of memory: the curves are incomplete */
+
+	Path_Open_Transform_Log(
+		int num_pixels,
+		int max_length								/* Longer paths are recorded as this long */
+	);
+
+	~Path_Open_Transform_Log();
+
+	/* add_point:
+		As add_point() in path_support.c, on the curve of one pixel.
+	*/
+	inline void add_point(
+		int pixel_index,
+		int path_length,							/* The path_length of the new point */
+		GPOT_PIX_TYPE threshold						/* The grayscale threshold of the new point */
+	);
+};
+
 /************************************* FUNCTION PROTOTYPES **************************************/
-/* A path opening along the vertical direction.
-Conjugate with transpose to perform horizontal path openings */
+/* Sort an image of any supported pixel type by its pixel values, as image_sort() in
+	path_support.c does for PATHOPEN_PIX_TYPE.  Equal pixels stay in raster order */
+template <class PIX_TYPE>
+static void image_sort(
+	PIX_TYPE * input_image,
+	int num_pixels,
+	int * sorted_indices,
+	void * buffer,									/* Scratch, see image_sort_buffer_size() */
+	int num_threads									/* Maximum number of threads */
+);
+
+/* Bytes of scratch needed by image_sort() */
+static size_t image_sort_buffer_size(
+	int num_pixels,
+	size_t pixel_size								/* Bytes per pixel */
+);
+
+/* Multi-length passes: record the threshold in the output of each length that no longer
+	fits the longest path through a pixel */
+template <class PIX_TYPE>
+static inline void stack_extinguish(
+	const int * lengths,							/* The increasing lengths */
+	char & alive_count,								/* Number of lengths still alive at the pixel */
+	int path_length,								/* Longest path through the pixel */
+	PIX_TYPE threshold,								/* Current threshold */
+	PIX_TYPE * output_stack,						/* One output image per length */
+	int output_index,								/* Index of the pixel in an output image */
+	int num_pixels									/* Pixels per output image */
+);
+
+template <class PIX_TYPE, class CHAIN_TYPE, bool PLANAR>
+static inline void stack_shorten(
+	const int * lengths,							/* The increasing lengths */
+	char & alive_count,								/* Number of lengths still alive at the pixel */
+	int pair_length,								/* The new length of the shortened path */
+	CHAIN_TYPE * chain_image_up,					/* Up/down chain lengths */
+	CHAIN_TYPE * chain_image_down,
+	int index,										/* Index of the pixel in the chain images */
+	int num_pixels, int nk,							/* Chain image dimensions */
+	PIX_TYPE threshold,								/* Current threshold */
+	PIX_TYPE * output_stack,						/* One output image per length */
+	int output_index								/* Index of the pixel in an output image */
+);
+
+/* Transform passes: a path through a pixel still in the binary image has shortened */
+template <class PIX_TYPE, class CHAIN_TYPE, bool PLANAR>
+static inline void transform_shorten(
+	Path_Open_Transform_Log & log,					/* The pass's curves */
+	int pair_length,								/* The new length of the shortened path */
+	CHAIN_TYPE * chain_image_up,					/* Up/down chain lengths */
+	CHAIN_TYPE * chain_image_down,
+	int index,										/* Index of the pixel in the chain images */
+	int num_pixels, int nk,							/* Chain image dimensions */
+	PIX_TYPE threshold,								/* Current threshold */
+	int output_index								/* Index of the pixel in the output image */
+);
+
+/* A path opening (or with descending, closing) along the vertical direction.
+With TRANSPOSED, the horizontal path opening of the ny * nx image viewed transposed */
+template <class PIX_TYPE, class CHAIN_TYPE, bool PLANAR, bool TRANSPOSED>
 static int vert_pathopen(
-	PATHOPEN_PIX_TYPE * input_image,					/* The input image */
+	Path_Open_Workspace & workspace,					/* Working memory */
+	PIX_TYPE * input_image,								/* The input image */
 	int * sorted_indices,								/* Monotonic transform to [0, 1, ...] of input image */
+	bool descending,									/* Sweep thresholds downwards, for a path closing */
 	int nx, int ny,										/* Image dimensions */
-	int L,												/* The threshold line length */
+	int L,												/* The threshold line length, the largest of lengths */
+	const int * lengths,								/* Increasing lengths of a multi-length pass, or NULL */
+	int num_lengths,									/* Number of lengths */
+	Path_Open_Transform_Log * transform_log,			/* Curves of a transform pass, or NULL */
 	int K,												/* The maximum gap number */
-	PATHOPEN_PIX_TYPE * output_image					/* Output image */
+	PIX_TYPE * output_image								/* Output image, or one per length */
 );
 
-/* A path opening in the ++ diagonal direction.
+/* A path opening (or with descending, closing) in the ++ diagonal direction.
 	Conjugate with flip to perform +- diagonal path openings
 */
+template <class PIX_TYPE, class CHAIN_TYPE, bool PLANAR>
 static int diag_pathopen(
-	PATHOPEN_PIX_TYPE * input_image,					/* The input image */
+	Path_Open_Workspace & workspace,					/* Working memory */
+	PIX_TYPE * input_image,								/* The input image */
 	int * sorted_indices,								/* Monotonic transform to [0, 1, ...] of input image */
+	bool descending,									/* Sweep thresholds downwards, for a path closing */
 	int nx, int ny,										/* Image dimensions */
-	int L,												/* The threshold line length */
+	int L,												/* The threshold line length, the largest of lengths */
+	const int * lengths,								/* Increasing lengths of a multi-length pass, or NULL */
+	int num_lengths,									/* Number of lengths */
+	Path_Open_Transform_Log * transform_log,			/* Curves of a transform pass, or NULL */
 	int K,												/* The maximum gap number */
-	PATHOPEN_PIX_TYPE * output_image					/* Output image */
+	PIX_TYPE * output_image								/* Output image, or one per length */
 );
 
 /* Debugging */
+template <class CHAIN_TYPE, bool PLANAR>
 void dump_state(
 	int nx,									// Image dimensions etc.
 	int ny,
 	int nk,
-	Path_Queue & path_queue_up,				// Queueing structures
-	Path_Queue & path_queue_down,
-	char * in_queue_up,
-	char * in_queue_down,
+	Path_Open_Queue & path_queue_up,		// Queueing structures
+	Path_Open_Queue & path_queue_down,
 	char * bin_input_image,					// Input/output binary images
 	char * bin_output_image_array,
 	char * bin_output_image_count,
-	int * chain_image_up,					// Up/down chain lengths
-	int * chain_image_down
+	CHAIN_TYPE * chain_image_up,			// Up/down chain lengths
+	CHAIN_TYPE * chain_image_down
 );
@@ -0,0 +1,462 @@
+/*
+ *		File:		pathopen_client.cxx
+ *
+ *		Purpose:	Load generator for pathopen_server: several connections send
+ *					requests back to back, inline or through a shared memory ring, and
+ *					the latency percentiles, throughput and server overhead are reported
+ *
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "pathopenclose.h"
+#include "pathopen_protocol.h"
+#include "test_images.h"
+
+using namespace std;
+using namespace std::chrono;
+
+/* Client_Options:
+	What to send, and how much.
+*/
+struct Client_Options {
+	const char * socket_path;
+	int num_connections;
+	int num_requests;								/* Per connection */
+	int nx, ny;
+	int L, K;
+	int op;
+	int depth;
+	int num_slots;									/* Of a shared ring, or 0 to send pixels inline */
+	bool mutate;									/* Rewrite ring pixels while their requests are in flight */
+	bool check;										/* Compare the first result with a local filter */
+	bool unsealed;									/* Only offer a ring in a plain file */
+};
+
+/* Client_Result:
+	What one connection saw, per request.
+*/
+struct Client_Result {
+	vector<double> latencies;						/* Round trip (s) */
+	vector<double> overheads;						/* Round trip less filtering (s) */
+	int num_failures;
+};
+
+/* check_output:
+	Filter the input here and compare.  Returns 0 if the server agrees.
+*/
+template <class PIX_TYPE>
+static int check_output(const Client_Options & options, void * input, void * output)
+{
+	size_t size = (size_t)options.nx * options.ny * sizeof(PIX_TYPE);
+	PIX_TYPE * reference = (PIX_TYPE *)malloc(size);
+	int differs;
+
+	if (options.op == PATHOPEN_OP_CLOSE) {
+		pathclose((PIX_TYPE *)input, options.nx, options.ny, options.L, options.K, reference);
+	} else {
+		pathopen((PIX_TYPE *)input, options.nx, options.ny, options.L, options.K, reference);
+	}
+	differs = memcmp(reference, output, size) != 0;
+
+	free((void *)reference);
+	return differs;
+}
+
+/* check_first:
+	check_output() for the connection's pixel type, reporting a difference.  Returns
+	the number of failures.
+*/
+static int check_first(const Client_Options * options, int c, void * input, void * output)
+{
+	int differs;
+
+	switch (options->depth) {
+		case 1: differs = check_output<unsigned char>(*options, input, output); break;
+		case 2: differs = check_output<unsigned short>(*options, input, output); break;
+		default: differs = check_output<float>(*options, input, output); break;
+	}
+	if (differs) {
+		fprintf(stderr, "Connection %d: the server's result differs from a local filter\n", c);
+	}
+	return differs;
+}
+
+/* mutate_slots:
+	Scribble over the input of every slot of a ring until told to stop, as a client
+	that ignores the protocol would.  The server must not crash, but its results are
+	then anyone's guess.
+*/
+static void mutate_slots(Path_Open_Ring * ring, int num_slots, size_t size, const atomic<bool> * stop,
+	unsigned int seed)
+{
+	int s;
+
+	while (!stop->load()) {
+		for (s = 0; s < num_slots; ++s) {
+			unsigned char * input = (unsigned char *)pathopen_ring_input(ring->map, ring->slot_size, s);
+			size_t i;
+			for (i = 0; i < 64; ++i) {
+				seed = seed * 1103515245 + 12345;
+				input[(seed >> 8) % size] = (unsigned char)(seed >> 24);
+			}
+		}
+		this_thread::yield();
+	}
+}
+
+/* run_shared:
+	Send the requests of one connection through a ring, keeping every slot busy: each
+	response frees its slot for the next request.  Request ids are slot numbers.
+*/
+static void run_shared(const Client_Options * options, int c, int fd, Path_Open_Request request,
+	void * input, Client_Result * result)
+{
+	size_t size = (size_t)options->nx * options->ny * options->depth;
+	Path_Open_Ring * ring = pathopen_ring_create(options->num_slots, size);
+	vector<steady_clock::time_point> sent(options->num_slots);
+	Path_Open_Response response;
+	atomic<bool> stop(false);
+	thread mutator;
+	int s, num_sent = 0, num_received = 0;
+
+	if (ring == NULL || pathopen_attach_ring(fd, ring) != PATHOPEN_STATUS_OK) {
+		fprintf(stderr, "Connection %d: could not attach a shared ring\n", c);
+		result->num_failures = options->num_requests;
+		if (ring != NULL) pathopen_ring_destroy(ring);
+		return;
+	}
+
+	/* The pixels are written into the ring once, as a camera would write each frame */
+	for (s = 0; s < options->num_slots; ++s) {
+		memcpy(pathopen_ring_input(ring->map, ring->slot_size, s), input, size);
+	}
+
+	if (options->mutate) {
+		mutator = thread(mutate_slots, ring, options->num_slots, size, &stop, (unsigned int)c + 1);
+	}
+
+	request.payload = PATHOPEN_PAYLOAD_SHARED;
+	for (s = 0; s < options->num_slots && num_sent < options->num_requests; ++s, ++num_sent) {
+		request.id = request.slot = s;
+		sent[s] = steady_clock::now();
+		if (pathopen_send_all(fd, &request, sizeof(request)) != 0) break;
+	}
+
+	while (num_received < num_sent) {
+		if (pathopen_recv_all(fd, &response, sizeof(response)) != 0 ||
+			response.status != PATHOPEN_STATUS_OK || response.id >= (unsigned int)options->num_slots) {
+			break;
+		}
+		s = (int)response.id;
+		double latency = duration<double>(steady_clock::now() - sent[s]).count();
+		result->latencies.push_back(latency);
+		result->overheads.push_back(latency - response.filter_time);
+
+		if (options->check && num_received == 0) {
+			result->num_failures += check_first(options, c, input, pathopen_ring_output(ring->map, ring->slot_size, s));
+		}
+		++num_received;
+
+		if (num_sent < options->num_requests) {
+			request.id = request.slot = s;
+			sent[s] = steady_clock::now();
+			if (pathopen_send_all(fd, &request, sizeof(request)) != 0) break;
+			++num_sent;
+		}
+	}
+	result->num_failures += options->num_requests - num_received;
+
+	if (options->mutate) {
+		stop.store(true);
+		mutator.join();
+	}
+	pathopen_ring_destroy(ring);
+}
+
+/* check_unsealed_ring:
+	Offer the server a ring in a plain file, which cannot be sealed, and cut the file
+	short: the server must refuse the ring, and still answer the next connection.
+	Returns 0 if it did, else 1.
+*/
+static int check_unsealed_ring(const Client_Options * options)
+{
+	char name[] = "/tmp/pathopen_ringXXXXXX";
+	Path_Open_Ring ring;
+	Path_Open_Ring_Header header;
+	Path_Open_Request request;
+	Path_Open_Response response;
+	unsigned char pixels[4 * 4] = {0};
+	int fd, status, failed = 1;
+
+	memset(&ring, 0, sizeof(ring));
+	ring.num_slots = 1;
+	ring.slot_size = ((size_t)options->nx * options->ny * options->depth + 63) & ~(size_t)63;
+	ring.map_size = pathopen_ring_size(ring.num_slots, ring.slot_size);
+	header.magic = PATHOPEN_PROTOCOL_MAGIC;
+	header.num_slots = ring.num_slots;
+	header.slot_size = ring.slot_size;
+
+	if ((fd = pathopen_connect(options->socket_path)) < 0) {
+		fprintf(stderr, "Could not connect to %s\n", options->socket_path);
+		return 1;
+	}
+	if ((ring.fd = mkstemp(name)) < 0) {
+		fprintf(stderr, "Could not make a file for the ring\n");
+		close(fd);
+		return 1;
+	}
+	unlink(name);
+
+	if (ftruncate(ring.fd, (off_t)ring.map_size) != 0 ||
+		pwrite(ring.fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+		fprintf(stderr, "Could not write the ring's header\n");
+	} else if ((status = pathopen_attach_ring(fd, &ring)) != PATHOPEN_STATUS_BAD_REQUEST) {
+		fprintf(stderr, "The server answered %d to an unsealed ring\n", status);
+	} else if (ftruncate(ring.fd, 0) != 0) {
+		fprintf(stderr, "Could not cut the ring short\n");
+	} else {
+		/* The refusal ends the connection; a fresh one shows the server is still up */
+		close(fd);
+		memset(&request, 0, sizeof(request));
+		request.magic = PATHOPEN_PROTOCOL_MAGIC;
+		request.nx = request.ny = 4;
+		request.L = 2;
+		request.op = PATHOPEN_OP_OPEN;
+		request.depth = 1;
+		request.payload = PATHOPEN_PAYLOAD_INLINE;
+		if ((fd = pathopen_connect(options->socket_path)) < 0 ||
+			pathopen_call(fd, &request, pixels, &response, pixels) != PATHOPEN_STATUS_OK) {
+			fprintf(stderr, "The server no longer answers\n");
+		} else {
+			printf("Unsealed ring refused\n");
+			failed = 0;
+		}
+	}
+
+	close(ring.fd);
+	if (fd >= 0) close(fd);
+	return failed;
+}
+
+/* run_connection:
+	Send the requests of one connection back to back, timing each.
+*/
+static void run_connection(const Client_Options * options, int c, Client_Result * result)
+{
+	Path_Open_Request request;
+	Path_Open_Response response;
+	size_t size = (size_t)options->nx * options->ny * options->depth;
+	void * input = malloc(size);
+	void * output = malloc(size);
+	int fd, r;
+
+	result->num_failures = 0;
+	switch (options->depth) {
+		case 1: make_ridges(options->nx, options->ny, c + 1, (unsigned char *)input, NULL, NULL); break;
+		case 2: make_ridges(options->nx, options->ny, c + 1, NULL, (unsigned short *)input, NULL); break;
+		default: make_ridges(options->nx, options->ny, c + 1, NULL, NULL, (float *)input); break;
+	}
+
+	if ((fd = pathopen_connect(options->socket_path)) < 0) {
+		fprintf(stderr, "Could not connect to %s\n", options->socket_path);
+		result->num_failures = options->num_requests;
+		free(input);
+		free(output);
+		return;
+	}
+
+	memset(&request, 0, sizeof(request));
+	request.magic = PATHOPEN_PROTOCOL_MAGIC;
+	request.nx = options->nx;
+	request.ny = options->ny;
+	request.L = options->L;
+	request.K = options->K;
+	request.op = options->op;
+	request.depth = options->depth;
+	request.payload = PATHOPEN_PAYLOAD_INLINE;
+
+	if (options->num_slots > 0) {
+		run_shared(options, c, fd, request, input, result);
+	} else {
+		for (r = 0; r < options->num_requests; ++r) {
+			steady_clock::time_point start = steady_clock::now();
+
+			request.id = r;
+			if (pathopen_call(fd, &request, input, &response, output) != PATHOPEN_STATUS_OK || response.id != (unsigned int)r) {
+				result->num_failures += options->num_requests - r;
+				break;
+			}
+			double latency = duration<double>(steady_clock::now() - start).count();
+			result->latencies.push_back(latency);
+			result->overheads.push_back(latency - response.filter_time);
+
+			if (options->check && r == 0) {
+				result->num_failures += check_first(options, c, input, output);
+			}
+		}
+	}
+
+	close(fd);
+	free(input);
+	free(output);
+}
+
+/* percentile:
+	The p-th percentile of sorted values, nearest rank.
+*/
+static double percentile(const vector<double> & sorted, double p)
+{
+	size_t rank = (size_t)ceil(p / 100 * sorted.size());
+
+	return sorted[MAX(rank, (size_t)1) - 1];
+}
+
+int usage(const char *name)
+{
+	fprintf(stderr, "Usage : %s <socket path> [-c connections] [-n requests] [-s NXxNY] [-L L] [-K K]\n", name);
+	fprintf(stderr, "        [-d depth] [-shm slots] [-mutate] [-close] [-check] [-unsealed]\n");
+	fprintf(stderr, "Where : connections is the number of clients sending at once (default: 1)\n");
+	fprintf(stderr, "        requests is the number each sends (default: 100)\n");
+	fprintf(stderr, "        NXxNY is the image size (default: 512x512)\n");
+	fprintf(stderr, "        L and K are the path length and gaps (default: 20 and 0)\n");
+	fprintf(stderr, "        depth is 1 or 2 bytes per pixel, or 4 for float (default: 1)\n");
+	fprintf(stderr, "        slots is the size of a shared memory ring to pass pixels through, with a\n");
+	fprintf(stderr, "              request in flight per slot (default: 0, pixels sent on the socket)\n");
+	fprintf(stderr, "        -mutate keeps rewriting the ring's pixels while the server reads them, to\n");
+	fprintf(stderr, "              test that it survives; only the statuses of the results count\n");
+	fprintf(stderr, "        -close asks for path closings rather than openings\n");
+	fprintf(stderr, "        -check compares each connection's first result with a local filter\n");
+	fprintf(stderr, "        -unsealed only checks that the server refuses a ring it cannot seal\n");
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	Client_Options options;
+	vector<Client_Result> results;
+	vector<thread> connections;
+	vector<double> latencies, overheads;
+	int a, c, num_failures = 0;
+
+	if (argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+	options.socket_path = argv[1];
+	options.num_connections = 1;
+	options.num_requests = 100;
+	options.nx = options.ny = 512;
+	options.L = 20;
+	options.K = 0;
+	options.op = PATHOPEN_OP_OPEN;
+	options.depth = 1;
+	options.num_slots = 0;
+	options.mutate = false;
+	options.check = false;
+	options.unsealed = false;
+	for (a = 2; a < argc; ++a) {
+		if (strcmp(argv[a], "-close") == 0) options.op = PATHOPEN_OP_CLOSE;
+		else if (strcmp(argv[a], "-check") == 0) options.check = true;
+		else if (strcmp(argv[a], "-mutate") == 0) options.mutate = true;
+		else if (strcmp(argv[a], "-unsealed") == 0) options.unsealed = true;
+		else if (a + 1 == argc) break;
+		else if (strcmp(argv[a], "-c") == 0) options.num_connections = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-n") == 0) options.num_requests = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-s") == 0) sscanf(argv[++a], "%dx%d", &options.nx, &options.ny);
+		else if (strcmp(argv[a], "-L") == 0) options.L = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-K") == 0) options.K = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-d") == 0) options.depth = atoi(argv[++a]);
+		else if (strcmp(argv[a], "-shm") == 0) options.num_slots = atoi(argv[++a]);
+		else break;
+	}
+	if (a < argc || options.num_connections < 1 || options.num_requests < 1 || options.num_slots < 0 ||
+		(options.mutate && (options.num_slots == 0 || options.check)) ||
+		options.nx < 1 || options.ny < 1 || (options.depth != 1 && options.depth != 2 && options.depth != 4)) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (options.unsealed) return check_unsealed_ring(&options);
+
+	results.resize(options.num_connections);
+	steady_clock::time_point start = steady_clock::now();
+	for (c = 0; c < options.num_connections; ++c) {
+		connections.push_back(thread(run_connection, &options, c, &results[c]));
+	}
+	for (c = 0; c < options.num_connections; ++c) {
+		connections[c].join();
+	}
+	double elapsed_time = duration<double>(steady_clock::now() - start).count();
+
+	for (c = 0; c < options.num_connections; ++c) {
+		latencies.insert(latencies.end(), results[c].latencies.begin(), results[c].latencies.end());
+		overheads.insert(overheads.end(), results[c].overheads.begin(), results[c].overheads.end());
+		num_failures += results[c].num_failures;
+	}
+	if (latencies.empty()) {
+		fprintf(stderr, "No request succeeded\n");
+		return 1;
+	}
+	sort(latencies.begin(), latencies.end());
+	sort(overheads.begin(), overheads.end());
+
+	printf("%d requests (%d failed) of %d x %d, L = %d, K = %d on %d connections, ",
+		(int)latencies.size() + num_failures, num_failures, options.nx, options.ny, options.L, options.K,
+		options.num_connections);
+	if (options.num_slots > 0) printf("rings of %d slots, ", options.num_slots);
+	else printf("inline, ");
+	printf("in %.3f s: %.1f requests/s\n", elapsed_time, latencies.size() / elapsed_time);
+	printf("latency  p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+		1e3 * percentile(latencies, 50), 1e3 * percentile(latencies, 90),
+		1e3 * percentile(latencies, 99), 1e3 * latencies.back());
+	printf("overhead p50 %.3f ms, p99 %.3f ms (latency less filtering, including queueing)\n",
+		1e3 * percentile(overheads, 50), 1e3 * percentile(overheads, 99));
+
+	return num_failures != 0;
+}
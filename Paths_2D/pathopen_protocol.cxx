@@ -0,0 +1,322 @@
+/*
+ *		File:		pathopen_protocol.cxx
+ *
+ *		Purpose:	Socket and shared memory calls shared by pathopen_server and its
+ *					clients
+ *
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "pathopen_protocol.h"
+
+/* Linux flags, done without elsewhere */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+int pathopen_send_all(
+	int fd,
+	const void * buffer,
+	size_t size
+)
+{
+	const char * p = (const char *)buffer;
+	ssize_t sent;
+
+	while (size > 0) {
+		/* A peer gone away is an error here, not a SIGPIPE */
+		sent = send(fd, p, size, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR) continue;
+		if (sent <= 0) return -1;
+		p += sent;
+		size -= (size_t)sent;
+	}
+	return 0;
+}
+
+int pathopen_recv_all(
+	int fd,
+	void * buffer,
+	size_t size
+)
+{
+	char * p = (char *)buffer;
+	ssize_t received;
+
+	while (size > 0) {
+		received = recv(fd, p, size, 0);
+		if (received < 0 && errno == EINTR) continue;
+		if (received <= 0) return -1;
+		p += received;
+		size -= (size_t)received;
+	}
+	return 0;
+}
+
+int pathopen_recv_request(
+	int fd,
+	Path_Open_Request * request,
+	int * passed_fd
+)
+{
+	union {
+		struct cmsghdr header;
+		char buffer[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct msghdr message;
+	struct iovec vector;
+	struct cmsghdr * cmsg;
+	ssize_t received;
+
+	/* A descriptor arrives with the first byte of its request, so that is read with
+	   recvmsg() and the rest as usual */
+	*passed_fd = -1;
+	memset(&message, 0, sizeof(message));
+	vector.iov_base = request;
+	vector.iov_len = sizeof(Path_Open_Request);
+	message.msg_iov = &vector;
+	message.msg_iovlen = 1;
+	message.msg_control = control.buffer;
+	message.msg_controllen = sizeof(control.buffer);
+
+	do {
+		received = recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+	} while (received < 0 && errno == EINTR);
+	if (received <= 0) return -1;
+
+	for (cmsg = CMSG_FIRSTHDR(&message); cmsg != NULL; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+			cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+			memcpy(passed_fd, CMSG_DATA(cmsg), sizeof(int));
+		}
+	}
+
+	if (pathopen_recv_all(fd, (char *)request + received, sizeof(Path_Open_Request) - received) != 0) {
+		if (*passed_fd >= 0) close(*passed_fd);
+		*passed_fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+int pathopen_connect(
+	const char * socket_path
+)
+{
+	struct sockaddr_un address;
+	int fd;
+
+	if (strlen(socket_path) >= sizeof(address.sun_path)) return -1;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socket_path);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) return -1;
+	if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int pathopen_call(
+	int fd,
+	const Path_Open_Request * request,
+	const void * input,
+	Path_Open_Response * response,
+	void * output
+)
+{
+	size_t size = (size_t)request->nx * request->ny * request->depth;
+
+	if (pathopen_send_all(fd, request, sizeof(Path_Open_Request)) != 0 ||
+		(request->payload == PATHOPEN_PAYLOAD_INLINE && pathopen_send_all(fd, input, size) != 0) ||
+		pathopen_recv_all(fd, response, sizeof(Path_Open_Response)) != 0 ||
+		response->magic != PATHOPEN_PROTOCOL_MAGIC) {
+		return -1;
+	}
+	if (response->status == PATHOPEN_STATUS_OK && request->payload == PATHOPEN_PAYLOAD_INLINE &&
+		pathopen_recv_all(fd, output, size) != 0) {
+		return -1;
+	}
+	return response->status;
+}
+
+
+/****************************** Shared memory ring ************************************/
+size_t pathopen_ring_size(
+	int num_slots,
+	size_t slot_size
+)
+{
+	return PATHOPEN_RING_HEADER_SIZE + 2 * slot_size * num_slots;
+}
+
+void * pathopen_ring_input(
+	void * map,
+	size_t slot_size,
+	int slot
+)
+{
+	return (char *)map + PATHOPEN_RING_HEADER_SIZE + 2 * slot_size * slot;
+}
+
+void * pathopen_ring_output(
+	void * map,
+	size_t slot_size,
+	int slot
+)
+{
+	return (char *)map + PATHOPEN_RING_HEADER_SIZE + 2 * slot_size * slot + slot_size;
+}
+
+Path_Open_Ring * pathopen_ring_create(
+	int num_slots,
+	size_t slot_size
+)
+{
+	Path_Open_Ring * ring;
+	Path_Open_Ring_Header * header;
+	size_t map_size;
+	void * map;
+	int fd;
+
+	if (num_slots <= 0 || slot_size == 0) return NULL;
+
+	/* Slots start on 64-byte boundaries, whatever the pixel type */
+	slot_size = (slot_size + 63) & ~(size_t)63;
+	map_size = pathopen_ring_size(num_slots, slot_size);
+
+#ifdef MFD_ALLOW_SEALING
+	fd = memfd_create("pathopen_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd >= 0 && (ftruncate(fd, (off_t)map_size) != 0 ||
+		fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) != 0)) {
+		close(fd);
+		return NULL;
+	}
+#else
+	fd = -1;
+#endif
+	if (fd < 0) return NULL;
+
+	map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	header = (Path_Open_Ring_Header *)map;
+	header->magic = PATHOPEN_PROTOCOL_MAGIC;
+	header->num_slots = num_slots;
+	header->slot_size = slot_size;
+
+	ring = (Path_Open_Ring *)malloc(sizeof(Path_Open_Ring));
+	ring->fd = fd;
+	ring->map = map;
+	ring->map_size = map_size;
+	ring->num_slots = num_slots;
+	ring->slot_size = slot_size;
+
+	return ring;
+}
+
+void pathopen_ring_destroy(
+	Path_Open_Ring * ring
+)
+{
+	munmap(ring->map, ring->map_size);
+	close(ring->fd);
+	free((void *)ring);
+}
+
+int pathopen_attach_ring(
+	int fd,
+	const Path_Open_Ring * ring
+)
+{
+	union {
+		struct cmsghdr header;
+		char buffer[CMSG_SPACE(sizeof(int))];
+	} control;
+	Path_Open_Request request;
+	Path_Open_Response response;
+	struct msghdr message;
+	struct iovec vector;
+	struct cmsghdr * cmsg;
+	ssize_t sent;
+
+	memset(&request, 0, sizeof(request));
+	request.magic = PATHOPEN_PROTOCOL_MAGIC;
+	request.op = PATHOPEN_OP_ATTACH;
+
+	/* The request, with the ring's descriptor alongside */
+	memset(&message, 0, sizeof(message));
+	memset(&control, 0, sizeof(control));
+	vector.iov_base = &request;
+	vector.iov_len = sizeof(request);
+	message.msg_iov = &vector;
+	message.msg_iovlen = 1;
+	message.msg_control = control.buffer;
+	message.msg_controllen = sizeof(control.buffer);
+	cmsg = CMSG_FIRSTHDR(&message);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &ring->fd, sizeof(int));
+
+	do {
+		sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+	} while (sent < 0 && errno == EINTR);
+	if (sent <= 0 || pathopen_send_all(fd, (char *)&request + sent, sizeof(request) - sent) != 0 ||
+		pathopen_recv_all(fd, &response, sizeof(response)) != 0 ||
+		response.magic != PATHOPEN_PROTOCOL_MAGIC) {
+		return -1;
+	}
+	return response.status;
+}
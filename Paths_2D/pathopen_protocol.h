@@ -0,0 +1,241 @@
+/*
+ *		File:		pathopen_protocol.h
+ *
+ *		Purpose:	The local socket protocol of pathopen_server, inline or through
+ *					shared memory, and the calls a client needs to speak it
+ *
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+#ifndef PATHOPEN_PROTOCOL_H
+#define PATHOPEN_PROTOCOL_H
+
+#include <stddef.h>
+
+/*
+ * A client connects to the server's Unix domain socket and sends requests one at a
+ * time, each a Path_Open_Request followed by its nx * ny * depth bytes of pixels; the
+ * server answers each with a Path_Open_Response followed, if the status is
+ * PATHOPEN_STATUS_OK, by the filtered pixels.  Client and server share a machine, so
+ * everything is in its byte order.  Many clients may be connected at once; their
+ * requests are filtered concurrently, up to the server's number of workers.
+ *
+ * Alternatively the pixels stay in a ring of slots in memory shared with the server, so
+ * that only the headers cross the socket.  The server reads a slot's input once, into
+ * memory of its own, since the client could rewrite it meanwhile, and pathopen() writes
+ * the output straight into the slot.  The client makes the ring with
+ * pathopen_ring_create() and hands it over once with pathopen_attach_ring().  The server
+ * refuses a ring that is not sealed against shrinking, since one cut short under its
+ * mapping would kill it, so rings need memfd sealing.  Each request then names a
+ * slot, with payload PATHOPEN_PAYLOAD_SHARED, and its output is in that slot once the
+ * response arrives.  Such requests need not wait for one another: the client may have
+ * one in flight per slot, and their responses come back in the order they finish.
+ *
+ */
+
+#define PATHOPEN_PROTOCOL_MAGIC 0x50415448				/* "PATH" */
+
+/* Largest image accepted, in pixels */
+#define PATHOPEN_MAX_REQUEST_PIXELS (1 << 26)
+
+/* Largest (K + 1) * nx * ny accepted: the per-gap images a worker needs grow as this */
+#define PATHOPEN_MAX_REQUEST_GAP_PIXELS (1 << 28)
+
+/* The filter to apply, or PATHOPEN_OP_ATTACH to take over the ring whose descriptor
+   comes with the request */
+enum {
+	PATHOPEN_OP_OPEN = 0,
+	PATHOPEN_OP_CLOSE = 1,
+	PATHOPEN_OP_ATTACH = 2
+};
+
+/* Where the pixels travel: after the request and response on the socket, or in a
+   slot of the attached ring */
+enum {
+	PATHOPEN_PAYLOAD_INLINE = 0,
+	PATHOPEN_PAYLOAD_SHARED = 1
+};
+
+/* Outcome of a request */
+enum {
+	PATHOPEN_STATUS_OK = 0,
+	PATHOPEN_STATUS_BAD_REQUEST = 1,				/* Malformed, or an unknown op, depth or payload */
+	PATHOPEN_STATUS_TOO_LARGE = 2					/* More than PATHOPEN_MAX_REQUEST_PIXELS or
+													   PATHOPEN_MAX_REQUEST_GAP_PIXELS, or K >= L */
+};
+
+typedef struct {
+	unsigned int magic;								/* PATHOPEN_PROTOCOL_MAGIC */
+	unsigned int id;								/* Returned in the response */
+	int nx, ny;										/* Image dimensions */
+	int L;											/* The threshold line length */
+	int K;											/* The maximum number of gaps in the path */
+	int op;											/* PATHOPEN_OP_... */
+	int depth;										/* Bytes per pixel: 1, 2, or 4 for float */
+	int payload;									/* PATHOPEN_PAYLOAD_... */
+	int slot;										/* The ring slot, for PATHOPEN_PAYLOAD_SHARED */
+} Path_Open_Request;
+
+typedef struct {
+	unsigned int magic;								/* PATHOPEN_PROTOCOL_MAGIC */
+	unsigned int id;								/* That of the request */
+	int status;										/* PATHOPEN_STATUS_... */
+	int reserved;
+	double queue_time;								/* Waiting for a worker (s) */
+	double filter_time;								/* Filtering (s) */
+} Path_Open_Response;
+
+/* pathopen_send_all, pathopen_recv_all:
+	Send or receive exactly size bytes.  Return 0, or -1 if the connection failed or
+	was closed.
+*/
+int pathopen_send_all(
+	int fd,
+	const void * buffer,
+	size_t size
+);
+
+int pathopen_recv_all(
+	int fd,
+	void * buffer,
+	size_t size
+);
+
+/* pathopen_recv_request:
+	Receive a request, and the descriptor sent with it if any into *passed_fd (else
+	-1).  Returns 0, or -1 if the connection failed or was closed.
+*/
+int pathopen_recv_request(
+	int fd,
+	Path_Open_Request * request,
+	int * passed_fd
+);
+
+/* pathopen_connect:
+	Connect to a server's socket.  Returns the connected descriptor, or -1.
+*/
+int pathopen_connect(
+	const char * socket_path
+);
+
+/* pathopen_call:
+	Send a request with its input pixels and wait for the response, receiving the
+	output pixels into output if the status is PATHOPEN_STATUS_OK.  Returns the status,
+	or -1 if the connection failed.
+*/
+int pathopen_call(
+	int fd,
+	const Path_Open_Request * request,
+	const void * input,
+	Path_Open_Response * response,
+	void * output
+);
+
+/****************************** Shared memory ring ************************************/
+/*
+ * The ring is one shared memory object: a page holding a Path_Open_Ring_Header, then
+ * num_slots slots of slot_size bytes of input followed by slot_size bytes of output.
+ *
+ */
+
+#define PATHOPEN_RING_HEADER_SIZE 4096
+
+typedef struct {
+	unsigned int magic;								/* PATHOPEN_PROTOCOL_MAGIC */
+	int num_slots;
+	size_t slot_size;								/* Bytes of input, and of output, per slot */
+} Path_Open_Ring_Header;
+
+/* The client's end of a ring */
+typedef struct {
+	int fd;											/* The shared memory object */
+	void * map;										/* Its mapping */
+	size_t map_size;
+	int num_slots;
+	size_t slot_size;
+} Path_Open_Ring;
+
+/* pathopen_ring_size:
+	Bytes of shared memory for a ring.
+*/
+size_t pathopen_ring_size(
+	int num_slots,
+	size_t slot_size
+);
+
+/* pathopen_ring_input, pathopen_ring_output:
+	Where a slot's input and output pixels are, in a ring mapped at map.
+*/
+void * pathopen_ring_input(
+	void * map,
+	size_t slot_size,
+	int slot
+);
+
+void * pathopen_ring_output(
+	void * map,
+	size_t slot_size,
+	int slot
+);
+
+/* pathopen_ring_create:
+	Make and map a ring of anonymous shared memory: a memfd, sealed against shrinking so
+	that the server's mapping stays valid.  Returns NULL on failure, or where there is
+	no sealable memfd, since the server would refuse the ring.
+*/
+Path_Open_Ring * pathopen_ring_create(
+	int num_slots,
+	size_t slot_size								/* At least the largest image, in bytes */
+);
+
+/* pathopen_ring_destroy:
+	Unmap and close the client's end; the server keeps its own until the connection closes.
+*/
+void pathopen_ring_destroy(
+	Path_Open_Ring * ring
+);
+
+/* pathopen_attach_ring:
+	Hand a ring to the server for the rest of this connection.  Returns the status of
+	the PATHOPEN_OP_ATTACH request, or -1 if the connection failed.
+*/
+int pathopen_attach_ring(
+	int fd,
+	const Path_Open_Ring * ring
+);
+
+#endif // PATHOPEN_PROTOCOL_H
@@ -0,0 +1,255 @@
+/*
+ *		File:		pathopen_reference.cxx
+ *
+ *		Purpose:	Path openings and closings by threshold decomposition, one binary
+ *					opening per gray level by dynamic programming
+ *
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include "pathopen_reference.h"
+
+using namespace std;
+
+/* Reference_Orientation:
+	The three predecessors of a pixel along paths of one orientation, as offsets, and a
+	key a * x + b * y that is smaller at every predecessor, putting pixels in path order.
+*/
+struct Reference_Orientation {
+	int dx[3], dy[3];
+	int a, b;
+};
+
+static const Reference_Orientation reference_orientations[4] = {
+	{ {-1, 0, 1}, {-1, -1, -1}, 0, 1 },				/* Vertical, downwards */
+	{ {-1, -1, -1}, {-1, 0, 1}, 1, 0 },				/* Horizontal, rightwards */
+	{ {-1, -1, 0}, {0, -1, -1}, 1, 1 },				/* ++diagonal, right and down */
+	{ {-1, -1, 0}, {0, 1, 1}, 1, -1 }				/* +-diagonal, right and up */
+};
+
+/* - longest_paths:
+	For every pixel p and k <= K, the most pixels on a path of one orientation ending
+	at p (forwards) or starting at p (backwards), p included, with at most k of them
+	outside the binary image; -1 if p alone is already too many.  order lists the
+	pixels in path order.
+*/
+static void longest_paths(
+	const Reference_Orientation & orientation,
+	const char * binary_image,						/* 1 inside the set */
+	int nx, int ny, int K,
+	const vector<int> & order,						/* Pixels in path order */
+	bool backwards,									/* Paths starting at each pixel instead */
+	vector<int> & lengths							/* [k * nx * ny + p] */
+)
+{
+	int num_pixels = nx * ny;
+	int i, j, k, p, x, y, qx, qy, gap, best, sign = backwards ? -1 : 1;
+
+	for (i = 0; i < num_pixels; ++i) {
+		p = order[backwards ? num_pixels - 1 - i : i];
+		x = p % nx;
+		y = p / nx;
+		gap = !binary_image[p];
+		for (k = 0; k <= K; ++k) {
+			if (gap > k) {
+				lengths[(size_t)k * num_pixels + p] = -1;
+				continue;
+			}
+			best = 0;
+			for (j = 0; j < 3; ++j) {
+				qx = x + sign * orientation.dx[j];
+				qy = y + sign * orientation.dy[j];
+				if (qx < 0 || qx >= nx || qy < 0 || qy >= ny) continue;
+				best = max(best, lengths[(size_t)(k - gap) * num_pixels + qx + nx * qy]);
+			}
+			lengths[(size_t)k * num_pixels + p] = best + 1;
+		}
+	}
+}
+
+/* - reference_passes:
+	The opening, or with closing the closing, one threshold at a time: each pixel's
+	output is the last threshold at which some orientation still keeps it.  The
+	longest paths serve every length at once, an output image per length.
+*/
+template <class PIX_TYPE>
+static int reference_passes(
+	const PIX_TYPE * input_image,
+	int nx, int ny,
+	const int * lengths, int num_lengths,
+	int K,
+	bool closing,
+	PIX_TYPE * output_image
+)
+{
+	int num_pixels = nx * ny;
+	int o, j, k, p, t, longest;
+
+	if (num_lengths < 1 || K < 0) return -1;
+	for (j = 0; j < num_lengths; ++j) {
+		if (lengths[j] < 0) return -1;
+	}
+	if (num_pixels <= 0) return 0;
+
+	/* The thresholds, in sweep order */
+	vector<PIX_TYPE> levels(input_image, input_image + num_pixels);
+	sort(levels.begin(), levels.end());
+	levels.erase(unique(levels.begin(), levels.end()), levels.end());
+	if (closing) reverse(levels.begin(), levels.end());
+
+	/* Where no path fits, the first threshold swept */
+	for (p = 0; p < num_pixels * num_lengths; ++p) output_image[p] = levels[0];
+
+	/* Path order of each orientation */
+	vector<int> orders[4];
+	for (o = 0; o < 4; ++o) {
+		const Reference_Orientation & orientation = reference_orientations[o];
+		vector<pair<int, int> > keys(num_pixels);
+
+		for (p = 0; p < num_pixels; ++p) {
+			keys[p] = make_pair(orientation.a * (p % nx) + orientation.b * (p / nx), p);
+		}
+		sort(keys.begin(), keys.end());
+		orders[o].resize(num_pixels);
+		for (p = 0; p < num_pixels; ++p) orders[o][p] = keys[p].second;
+	}
+
+	vector<char> binary_image(num_pixels);
+	vector<int> forwards((size_t)(K + 1) * num_pixels), backwards((size_t)(K + 1) * num_pixels);
+
+	for (t = 0; t < (int)levels.size(); ++t) {
+		for (p = 0; p < num_pixels; ++p) {
+			binary_image[p] = closing ? (input_image[p] <= levels[t]) : (input_image[p] >= levels[t]);
+		}
+
+		for (o = 0; o < 4; ++o) {
+			longest_paths(reference_orientations[o], &binary_image[0], nx, ny, K, orders[o], false, forwards);
+			longest_paths(reference_orientations[o], &binary_image[0], nx, ny, K, orders[o], true, backwards);
+
+			for (p = 0; p < num_pixels; ++p) {
+				if (!binary_image[p]) continue;
+
+				/* p is counted in both halves, and is no gap */
+				longest = 0;
+				for (k = 0; k <= K; ++k) {
+					longest = max(longest, forwards[(size_t)k * num_pixels + p] + backwards[(size_t)(K - k) * num_pixels + p] - 1);
+				}
+				for (j = 0; j < num_lengths; ++j) {
+					if (longest >= lengths[j]) output_image[(size_t)num_pixels * j + p] = levels[t];
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* - pathopen_reference:
+	The path opening by threshold decomposition.
+*/
+template <class PIX_TYPE>
+int pathopen_reference(
+	const PIX_TYPE * input_image,					/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_image							/* Output image */
+)
+{
+	return reference_passes(input_image, nx, ny, &L, 1, K, false, output_image);
+}
+
+/* - pathclose_reference:
+	The path closing by threshold decomposition.
+*/
+template <class PIX_TYPE>
+int pathclose_reference(
+	const PIX_TYPE * input_image,					/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_image							/* Output image */
+)
+{
+	return reference_passes(input_image, nx, ny, &L, 1, K, true, output_image);
+}
+
+/* - pathopen_reference_stack:
+	The path opening at each of several lengths by threshold decomposition.
+*/
+template <class PIX_TYPE>
+int pathopen_reference_stack(
+	const PIX_TYPE * input_image,					/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	const int * lengths,							/* Threshold line lengths, in any order */
+	int num_lengths,								/* Number of lengths */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_stack							/* Output image per length, end to end */
+)
+{
+	return reference_passes(input_image, nx, ny, lengths, num_lengths, K, false, output_stack);
+}
+
+/* - pathclose_reference_stack:
+	The path closing at each of several lengths by threshold decomposition.
+*/
+template <class PIX_TYPE>
+int pathclose_reference_stack(
+	const PIX_TYPE * input_image,					/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	const int * lengths,							/* Threshold line lengths, in any order */
+	int num_lengths,								/* Number of lengths */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_stack							/* Output image per length, end to end */
+)
+{
+	return reference_passes(input_image, nx, ny, lengths, num_lengths, K, true, output_stack);
+}
+
+#define PATHOPEN_REFERENCE_INSTANTIATE(PIX_TYPE) \
+	template int pathopen_reference<PIX_TYPE>(const PIX_TYPE *, int, int, int, int, PIX_TYPE *); \
+	template int pathclose_reference<PIX_TYPE>(const PIX_TYPE *, int, int, int, int, PIX_TYPE *); \
+	template int pathopen_reference_stack<PIX_TYPE>(const PIX_TYPE *, int, int, const int *, int, int, PIX_TYPE *); \
+	template int pathclose_reference_stack<PIX_TYPE>(const PIX_TYPE *, int, int, const int *, int, int, PIX_TYPE *);
+
+PATHOPEN_REFERENCE_INSTANTIATE(unsigned char)
+PATHOPEN_REFERENCE_INSTANTIATE(unsigned short)
+PATHOPEN_REFERENCE_INSTANTIATE(float)
@@ -0,0 +1,102 @@
+/*
+ *		File:		pathopen_reference.h
+ *
+ *		Purpose:	Slow, plain path openings and closings by threshold decomposition,
+ *					the oracle the fast kernels are tested against
+ *
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+#ifndef PATHOPEN_REFERENCE_H
+#define PATHOPEN_REFERENCE_H
+
+/*
+ * The definition pathopen() implements, computed the obvious way.  For each threshold t
+ * among the image's values, take the binary image X of the pixels at or above t.  A
+ * pixel of X is kept if some path through it of at least L pixels has at most K pixels
+ * outside X, anywhere along it: a path moves row by row (vertical), column by column
+ * (horizontal), or by one step right, down or both (each diagonal, the +- one upwards).
+ * The longest such paths are found by dynamic programming over the pixels in path
+ * order, once per orientation, number of gaps and direction.  The output at a pixel is
+ * the largest t at which it is kept, or the image minimum if no path of L pixels can
+ * pass through it at all.  A closing is the same on the pixels at or below t, from the
+ * top down, the image maximum standing in where no path fits.
+ *
+ * Time is O(levels * nx * ny * K), so only small images are practical.  Instantiated for
+ * unsigned char, unsigned short and float.  Returns -1 for a negative length or K.
+ */
+template <class PIX_TYPE>
+int pathopen_reference(
+	const PIX_TYPE * input_image,					/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_image							/* Output image */
+);
+
+template <class PIX_TYPE>
+int pathclose_reference(
+	const PIX_TYPE * input_image,					/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_image							/* Output image */
+);
+
+/* The same at each of several lengths, for pathopen_stack() and pathclose_stack(): one
+   sweep of the thresholds serves them all */
+template <class PIX_TYPE>
+int pathopen_reference_stack(
+	const PIX_TYPE * input_image,					/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	const int * lengths,							/* Threshold line lengths, in any order */
+	int num_lengths,								/* Number of lengths */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_stack							/* Output image per length, end to end */
+);
+
+template <class PIX_TYPE>
+int pathclose_reference_stack(
+	const PIX_TYPE * input_image,					/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	const int * lengths,							/* Threshold line lengths, in any order */
+	int num_lengths,								/* Number of lengths */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_stack							/* Output image per length, end to end */
+);
+
+#endif // PATHOPEN_REFERENCE_H
@@ -0,0 +1,466 @@
+/*
+ *		File:		pathopen_server.cxx
+ *
+ *		Purpose:	A long-running path opening service on a Unix domain socket.  Each
+ *					connection is read by its own thread; requests are filtered by a
+ *					fixed pool of workers, each keeping contexts for the image sizes it
+ *					has seen, writing straight into the client's shared memory where it
+ *					has attached a ring.  See pathopen_protocol.h
+ *
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "pathopenclose.h"
+#include "pathopen_protocol.h"
+
+using namespace std;
+using namespace std::chrono;
+
+/* Contexts each worker keeps, one per image size and K */
+#define SERVER_MAX_CONTEXTS 4
+
+struct Server_Connection;
+
+/* Server_Job:
+	A request on its way through a worker.  An inline request's connection thread waits
+	for it and sends the response; a shared one is answered by the worker.
+*/
+struct Server_Job {
+	Path_Open_Request request;
+	Path_Open_Response response;
+	void * input;
+	void * output;
+	Server_Connection * connection;
+	steady_clock::time_point queued;
+	bool done;
+	mutex lock;
+	condition_variable finished;
+};
+
+/* Server_Connection:
+	A client, and the ring it has attached if any, with a job per slot.
+*/
+struct Server_Connection {
+	int fd;
+	mutex send_lock;								/* Responses come from several threads */
+
+	void * ring;									/* The client's ring, mapped */
+	size_t ring_size;
+	int num_slots;
+	size_t slot_size;
+	Server_Job * slot_jobs;
+
+	mutex lock;										/* Guards the slot jobs' done flags */
+	condition_variable idle;
+	int num_in_flight;								/* Shared requests not yet answered */
+};
+
+/* Server_Queue:
+	Jobs waiting for a worker, first come first served.
+*/
+class Server_Queue {
+public:
+	void push(Server_Job * job)
+	{
+		lock_guard<mutex> guard(lock);
+		jobs.push_back(job);
+		ready.notify_one();
+	}
+
+	Server_Job * pop()
+	{
+		unique_lock<mutex> guard(lock);
+		Server_Job * job;
+
+		ready.wait(guard, [this]() { return !jobs.empty(); });
+		job = jobs.front();
+		jobs.pop_front();
+		return job;
+	}
+
+private:
+	mutex lock;
+	condition_variable ready;
+	deque<Server_Job *> jobs;
+};
+
+/* filter:
+	Open or close a job's input pixels as PIX_TYPE, into its output.
+*/
+template <class PIX_TYPE>
+static void filter(Path_Open_Context & context, Server_Job * job, void * input)
+{
+	if (job->request.op == PATHOPEN_OP_CLOSE) {
+		pathclose(context, (PIX_TYPE *)input, (PIX_TYPE *)job->output);
+	} else {
+		pathopen(context, (PIX_TYPE *)input, (PIX_TYPE *)job->output);
+	}
+}
+
+/* serve_jobs:
+	A worker: filter jobs from the queue for ever.
+*/
+static void serve_jobs(Server_Queue * queue)
+{
+	Path_Open_Context_Cache contexts(SERVER_MAX_CONTEXTS, 1);
+	vector<char> snapshot;
+
+	for (;;) {
+		Server_Job * job = queue->pop();
+		const Path_Open_Request & request = job->request;
+		steady_clock::time_point start = steady_clock::now();
+		void * input = job->input;
+
+		job->response.queue_time = duration<double>(start - job->queued).count();
+
+		/* The client may write to its slot at any time, and the filters read their
+		   input more than once, trusting it not to change: a slot is read just once,
+		   into memory of the worker's own.  The output is still written in place. */
+		if (request.payload == PATHOPEN_PAYLOAD_SHARED) {
+			size_t size = (size_t)request.nx * request.ny * request.depth;
+			if (snapshot.size() < size) {
+				snapshot.resize(size);
+			}
+			memcpy(&snapshot[0], job->input, size);
+			input = &snapshot[0];
+		}
+
+		Path_Open_Context & context = contexts.context(request.nx, request.ny, request.L, request.K);
+		switch (request.depth) {
+			case 1:
+				filter<unsigned char>(context, job, input);
+				break;
+			case 2:
+				filter<unsigned short>(context, job, input);
+				break;
+			default:
+				filter<float>(context, job, input);
+				break;
+		}
+		job->response.filter_time = duration<double>(steady_clock::now() - start).count();
+
+		if (request.payload == PATHOPEN_PAYLOAD_SHARED) {
+			/* The slot is free before the client can hear so, and the response is sent
+			   from a copy since the slot's job may then be reused at once.  The
+			   connection lasts until the last of its jobs is counted out. */
+			Server_Connection * connection = job->connection;
+			Path_Open_Response response = job->response;
+			{
+				lock_guard<mutex> send_guard(connection->send_lock);
+				{
+					lock_guard<mutex> guard(connection->lock);
+					job->done = true;
+				}
+				pathopen_send_all(connection->fd, &response, sizeof(Path_Open_Response));
+			}
+			lock_guard<mutex> guard(connection->lock);
+			--connection->num_in_flight;
+			connection->idle.notify_all();
+		} else {
+			lock_guard<mutex> guard(job->lock);
+			job->done = true;
+			job->finished.notify_one();
+		}
+	}
+}
+
+/* check_request:
+	The status a filter request will get, PATHOPEN_STATUS_OK if it can be filtered.
+*/
+static int check_request(const Path_Open_Request & request, const Server_Connection & connection)
+{
+	if (request.magic != PATHOPEN_PROTOCOL_MAGIC || request.nx <= 0 || request.ny <= 0 ||
+		request.L < 1 || request.K < 0 ||
+		(request.op != PATHOPEN_OP_OPEN && request.op != PATHOPEN_OP_CLOSE) ||
+		(request.depth != 1 && request.depth != 2 && request.depth != 4) ||
+		(request.payload != PATHOPEN_PAYLOAD_INLINE && request.payload != PATHOPEN_PAYLOAD_SHARED)) {
+		return PATHOPEN_STATUS_BAD_REQUEST;
+	}
+	/* Gaps are paid for in memory per pixel, and a path needs fewer than L of them */
+	if ((double)request.nx * request.ny > PATHOPEN_MAX_REQUEST_PIXELS || request.K >= request.L ||
+		((double)request.K + 1) * request.nx * request.ny > PATHOPEN_MAX_REQUEST_GAP_PIXELS) {
+		return PATHOPEN_STATUS_TOO_LARGE;
+	}
+	if (request.payload == PATHOPEN_PAYLOAD_SHARED) {
+		if (connection.ring == NULL || request.slot < 0 || request.slot >= connection.num_slots) {
+			return PATHOPEN_STATUS_BAD_REQUEST;
+		}
+		if ((size_t)request.nx * request.ny * request.depth > connection.slot_size) {
+			return PATHOPEN_STATUS_TOO_LARGE;
+		}
+	}
+	return PATHOPEN_STATUS_OK;
+}
+
+/* attach_ring:
+	Map the ring whose descriptor came with a PATHOPEN_OP_ATTACH request.  Returns the
+	status of the request.
+*/
+static int attach_ring(Server_Connection & connection, int ring_fd)
+{
+	Path_Open_Ring_Header header;
+	struct stat ring_status;
+	int s;
+
+	if (connection.ring != NULL || ring_fd < 0) return PATHOPEN_STATUS_BAD_REQUEST;
+
+	/* A client could otherwise shrink the ring under the workers' feet.  A descriptor that
+		cannot carry seals, such as a plain file, fails F_GET_SEALS; without seals at all
+		no ring can be trusted. */
+#ifdef F_GET_SEALS
+	{
+		int seals = fcntl(ring_fd, F_GET_SEALS);
+		if (seals < 0 || (seals & F_SEAL_SHRINK) == 0) return PATHOPEN_STATUS_BAD_REQUEST;
+	}
+#else
+	return PATHOPEN_STATUS_BAD_REQUEST;
+#endif
+	if (fstat(ring_fd, &ring_status) != 0 || (size_t)ring_status.st_size < PATHOPEN_RING_HEADER_SIZE ||
+		pread(ring_fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+		header.magic != PATHOPEN_PROTOCOL_MAGIC || header.num_slots <= 0 || header.slot_size == 0 ||
+		(size_t)(ring_status.st_size - PATHOPEN_RING_HEADER_SIZE) / 2 / header.num_slots < header.slot_size) {
+		return PATHOPEN_STATUS_BAD_REQUEST;
+	}
+
+	connection.ring_size = pathopen_ring_size(header.num_slots, header.slot_size);
+	connection.ring = mmap(NULL, connection.ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0);
+	if (connection.ring == MAP_FAILED) {
+		connection.ring = NULL;
+		return PATHOPEN_STATUS_BAD_REQUEST;
+	}
+	connection.num_slots = header.num_slots;
+	connection.slot_size = header.slot_size;
+	connection.slot_jobs = new Server_Job[header.num_slots];
+	for (s = 0; s < header.num_slots; ++s) {
+		connection.slot_jobs[s].connection = &connection;
+		connection.slot_jobs[s].done = true;
+	}
+
+	return PATHOPEN_STATUS_OK;
+}
+
+/* serve_connection:
+	Read a client's requests and hand each to the workers.  Inline requests are taken
+	one at a time, and answered here with their pixels; shared ones are answered by the
+	worker, so the client may have one in flight per slot.  A request that cannot be
+	served is answered and the connection closed, since whatever follows it cannot be
+	trusted.
+*/
+static void serve_connection(int fd, Server_Queue * queue)
+{
+	Server_Connection connection;
+	Server_Job job;
+	Path_Open_Request request;
+	Path_Open_Response response;
+	vector<char> buffer;
+	size_t size;
+	int ring_fd;
+
+	connection.fd = fd;
+	connection.ring = NULL;
+	connection.slot_jobs = NULL;
+	connection.num_in_flight = 0;
+	job.connection = &connection;
+
+	while (pathopen_recv_request(fd, &request, &ring_fd) == 0) {
+		memset(&response, 0, sizeof(Path_Open_Response));
+		response.magic = PATHOPEN_PROTOCOL_MAGIC;
+		response.id = request.id;
+
+		if (request.magic == PATHOPEN_PROTOCOL_MAGIC && request.op == PATHOPEN_OP_ATTACH) {
+			response.status = attach_ring(connection, ring_fd);
+		} else {
+			response.status = check_request(request, connection);
+		}
+		if (ring_fd >= 0) {
+			close(ring_fd);
+		}
+
+		if (response.status == PATHOPEN_STATUS_OK && request.op != PATHOPEN_OP_ATTACH &&
+			request.payload == PATHOPEN_PAYLOAD_SHARED) {
+			/* Filtered into the ring and answered by the worker */
+			Server_Job & slot_job = connection.slot_jobs[request.slot];
+			{
+				lock_guard<mutex> guard(connection.lock);
+				if (!slot_job.done) {
+					response.status = PATHOPEN_STATUS_BAD_REQUEST;
+				} else {
+					slot_job.done = false;
+					++connection.num_in_flight;
+				}
+			}
+			if (response.status == PATHOPEN_STATUS_OK) {
+				slot_job.request = request;
+				slot_job.response = response;
+				slot_job.input = pathopen_ring_input(connection.ring, connection.slot_size, request.slot);
+				slot_job.output = pathopen_ring_output(connection.ring, connection.slot_size, request.slot);
+				slot_job.queued = steady_clock::now();
+				queue->push(&slot_job);
+				continue;
+			}
+		}
+
+		if (response.status != PATHOPEN_STATUS_OK || request.op == PATHOPEN_OP_ATTACH) {
+			lock_guard<mutex> guard(connection.send_lock);
+			if (pathopen_send_all(fd, &response, sizeof(Path_Open_Response)) != 0 ||
+				response.status != PATHOPEN_STATUS_OK) {
+				break;
+			}
+			continue;
+		}
+
+		/* Inline: input and output share one buffer, kept for the next request */
+		size = (size_t)request.nx * request.ny * request.depth;
+		if (buffer.size() < 2 * size) {
+			buffer.resize(2 * size);
+		}
+		job.request = request;
+		job.response = response;
+		job.input = &buffer[0];
+		job.output = &buffer[size];
+		if (pathopen_recv_all(fd, job.input, size) != 0) break;
+
+		job.done = false;
+		job.queued = steady_clock::now();
+		queue->push(&job);
+		{
+			unique_lock<mutex> guard(job.lock);
+			job.finished.wait(guard, [&job]() { return job.done; });
+		}
+
+		lock_guard<mutex> guard(connection.send_lock);
+		if (pathopen_send_all(fd, &job.response, sizeof(Path_Open_Response)) != 0 ||
+			pathopen_send_all(fd, job.output, size) != 0) {
+			break;
+		}
+	}
+
+	/* The workers may still be filtering in the ring */
+	{
+		unique_lock<mutex> guard(connection.lock);
+		connection.idle.wait(guard, [&connection]() { return connection.num_in_flight == 0; });
+	}
+	if (connection.ring != NULL) {
+		munmap(connection.ring, connection.ring_size);
+		delete [] connection.slot_jobs;
+	}
+	close(fd);
+}
+
+/* The socket, removed on SIGINT or SIGTERM */
+static const char * socket_path;
+
+static void stop(int)
+{
+	unlink(socket_path);
+	_exit(0);
+}
+
+int usage(const char *name)
+{
+	fprintf(stderr, "Usage : %s <socket path> [num_workers]\n", name);
+	fprintf(stderr, "Where : <socket path> is the Unix domain socket to listen on, replaced if it exists\n");
+	fprintf(stderr, "        num_workers is the number of requests filtered at once (default: all cores)\n");
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_un address;
+	struct sigaction action;
+	int listen_fd, fd, num_workers, w;
+	Server_Queue queue;
+
+	if (argc < 2 || strlen(argv[1]) >= sizeof(address.sun_path)) {
+		usage(argv[0]);
+		return 1;
+	}
+	socket_path = argv[1];
+	num_workers = (argc > 2) ? atoi(argv[2]) : 0;
+	if (num_workers <= 0) {
+		num_workers = MAX((int)thread::hardware_concurrency(), 1);
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socket_path);
+	unlink(socket_path);
+	if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+		bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+		listen(listen_fd, SOMAXCONN) != 0) {
+		perror(socket_path);
+		return 1;
+	}
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = stop;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	for (w = 0; w < num_workers; ++w) {
+		thread(serve_jobs, &queue).detach();
+	}
+	printf("%s: listening on %s with %d workers\n", argv[0], socket_path, num_workers);
+	fflush(stdout);
+
+	for (;;) {
+		if ((fd = accept(listen_fd, NULL, NULL)) < 0) continue;
+		thread(serve_connection, fd, &queue).detach();
+	}
+
+	return 0;
+}
@@ -59,20 +59,575 @@ knowledge of the CeCILL-B license and that you accept its terms.
 #ifndef PATHOPENCLOSE_H
 #define PATHOPENCLOSE_H
 
+#include <stddef.h>
+#include <limits.h>
+
 extern "C" {
 	#include "path_support.h"
 }
 
+/* Most lengths one call to pathopen_stack() can take */
+#define PATHOPEN_MAX_LENGTHS CHAR_MAX
+
 /* Define DEBUG to enable printfs for debugging */
 /* #define PATHOPEN_DEBUG */
 /* #define PATHOPEN_DIAG_DEBUG */
 
+/* pathopen and pathopen_threaded are instantiated for the pixel types unsigned char
+   (PATHOPEN_PIX_TYPE), unsigned short and float.  Float images must not contain NaNs.
+   A pixel that no path of L pixels can pass through, as when L is longer than the image
+   allows, takes the image minimum. */
+template <class PIX_TYPE>
+int pathopen(
+	PIX_TYPE * input_image,							/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_image							/* Output image */
+);
+
+/* Same as pathopen(), but runs the four orientation passes concurrently.
+   num_threads <= 0 selects the hardware concurrency.  Output is identical to pathopen(). */
+template <class PIX_TYPE>
+int pathopen_threaded(
+	PIX_TYPE * input_image,							/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_image,						/* Output image */
+	int num_threads									/* Number of worker threads */
+);
+
+/* Working memory of one orientation pass, see pathopen.h */
+class Path_Open_Workspace;
+
+/* Path_Open_Pass_Stats:
+	The work of one orientation pass, counted only when the library is compiled with
+	PATHOPEN_STATS defined (see pathopen_stats_enabled()); all zeros otherwise.  Every
+	queue entry is visited once by its sweep, and either shortens a chain length or
+	stops the propagation there.  Times are in seconds.
+*/
+struct Path_Open_Pass_Stats {
+	long long num_levels;							/* Threshold levels swept */
+	long long num_seeds;							/* Pixels removed at their threshold */
+	long long num_enqueued_down;					/* Queue entries of the downward sweeps */
+	long long num_enqueued_up;						/* Queue entries of the upward sweeps */
+	long long num_merges;							/* merge_row() calls, by the PATHOPEN_QUEUE_ARRAY queue only */
+	long long num_merged;							/* Entries they merged in */
+	long long num_chain_updates;					/* Chain lengths shortened */
+	long long num_early_outs;						/* Entries whose chain length held */
+	double seed_time;								/* Removing pixels and queueing their neighbours */
+	double down_time;								/* Downward sweeps */
+	double up_time;									/* Upward sweeps */
+};
+
+/* Path_Open_Context:
+	All the working memory needed to path-open images of a given size, allocated once
+	and recycled by every call to pathopen(context, ...).  Between calls, L may be
+	changed freely; the image size and K are fixed at construction.
+*/
+class Path_Open_Context {
+public:
+	/* Parameters */
+	int nx, ny;										/* Image dimensions */
+	int L;											/* The threshold line length */
+	int K;											/* The maximum number of gaps in the path */
+	int num_threads;								/* Number of worker threads */
+
+	/* Sorted and flipped copies of the input.  The pixel images are
+		of the type last passed to pathopen(context, ...), see reserve_pixel_images() */
+	int * sorted_indices;
+	int * flipped_sorted_indices;
+	void * flipped_input_image;
+
+	/* Per-orientation outputs, max-reduced (min- for a closing) into the output image */
+	void * diag_image;								/* ++diagonal */
+	void * horiz_image;								/* Horizontal */
+	void * flipped_antidiag_image;					/* +-diagonal, flipped */
+	void * sort_buffer;								/* Radix sort scratch for wide pixels */
+	size_t pixel_size;								/* Allocated bytes per pixel */
+
+	/* Per-orientation outputs of pathopen_stack(), the three stacks end to end */
+	void * stack_images;
+	size_t stack_images_size;						/* Allocated bytes */
+
+	/* Seconds of each orientation pass of the last whole-image call: vertical,
+		++diagonal, horizontal and +-diagonal */
+	double pass_times[4];
+
+	/* What each of those passes did, when counted: see Path_Open_Pass_Stats */
+	Path_Open_Pass_Stats pass_stats[4];
+
+	/* One kernel workspace per thread */
+	Path_Open_Workspace * * workspaces;
+
+	/* Methods */
+	Path_Open_Context(
+		int nx, int ny,								/* Image dimensions */
+		int L,										/* The threshold line length */
+		int K,										/* The maximum number of gaps in the path */
+		int num_threads = 1							/* Number of worker threads, <= 0 for all cores */
+	);
+
+	~Path_Open_Context();
+
+	/* reserve_pixel_images:
+		Make room for pixels of the given size, reallocating only if they grow.
+		The constructor reserves for PATHOPEN_PIX_TYPE.
+	*/
+	void reserve_pixel_images(
+		size_t pixel_size							/* Bytes per pixel */
+	);
+
+	/* reserve_stack_images:
+		Make room for num_lengths images of pixel_size per orientation, reallocating only
+		if they grow.  Nothing is reserved until the first pathopen_stack().
+	*/
+	void reserve_stack_images(
+		int num_lengths								/* Images per orientation */
+	);
+
+private:
+	/* Not copyable: owns its buffers */
+	Path_Open_Context(const Path_Open_Context &);
+	Path_Open_Context & operator=(const Path_Open_Context &);
+};
+
+/* Path_Open_Context_Cache:
+	Contexts for a run of images of varying sizes, made on first use and reused for
+	every later image of the same size and K, up to max_contexts of them with the least
+	recently used dropped first.  One per thread: the cache is not locked.
+*/
+class Path_Open_Context_Cache {
+public:
+	Path_Open_Context_Cache(
+		int max_contexts = 4,						/* Contexts kept */
+		int num_threads = 1							/* Worker threads of each context */
+	);
+
+	~Path_Open_Context_Cache();
+
+	/* context:
+		A context for nx * ny images and K gaps, with its L set.
+	*/
+	Path_Open_Context & context(
+		int nx, int ny,								/* Image dimensions */
+		int L,										/* The threshold line length */
+		int K										/* The maximum number of gaps in the path */
+	);
+
+private:
+	int max_contexts;
+	int num_threads;
+	int num_contexts;
+	Path_Open_Context * * contexts;					/* Most recently used last */
+
+	/* Not copyable: owns its contexts */
+	Path_Open_Context_Cache(const Path_Open_Context_Cache &);
+	Path_Open_Context_Cache & operator=(const Path_Open_Context_Cache &);
+};
+
+/* Path opening using the working memory of a context made for this image size */
+template <class PIX_TYPE>
 int pathopen(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The input image */
+	PIX_TYPE * output_image							/* Output image */
+);
+
+/* pathopen(context, ...) split in two, so that several openings of one image sort it
+   only once: pathopen_presort() sorts the image into context.sorted_indices and builds
+   its flipped copies, then pathopen_presorted() (or pathclose_presorted(), below) may be
+   called any number of times on that same image, changing context.L in between.  A
+   permutation already sorted by another context (of a different K, say) may be passed
+   in to skip the sort. */
+template <class PIX_TYPE>
+void pathopen_presort(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The input image */
+	const int * sorted_indices = NULL				/* Its sorted pixel indices, or NULL to sort */
+);
+
+template <class PIX_TYPE>
+int pathopen_presorted(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The image given to pathopen_presort() */
+	PIX_TYPE * output_image							/* Output image */
+);
+
+/* Path closings, the duals of the above: pathclose(f) = M - pathopen(M - f) for any M,
+   but computed without the inverted copies, by sweeping the thresholds downwards.
+   pathopen_presort() serves both, so an image may be opened and closed on one sort
+   and one set of working buffers.  A pixel that no path of L pixels can pass through
+   takes the image maximum. */
+template <class PIX_TYPE>
+int pathclose(
+	PIX_TYPE * input_image,							/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_image							/* Output image */
+);
+
+template <class PIX_TYPE>
+int pathclose_threaded(
+	PIX_TYPE * input_image,							/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_image,						/* Output image */
+	int num_threads									/* Number of worker threads */
+);
+
+template <class PIX_TYPE>
+int pathclose(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The input image */
+	PIX_TYPE * output_image							/* Output image */
+);
+
+template <class PIX_TYPE>
+int pathclose_presorted(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The image given to pathopen_presort() */
+	PIX_TYPE * output_image							/* Output image */
+);
+
+/* Path openings or closings at several lengths from one sort and a single pass per
+   orientation, rather than a call per length.  lengths must be strictly increasing,
+   from 1, and at most PATHOPEN_MAX_LENGTHS of them; a repeated length, like any other
+   bad list, makes these return -1.  The output for lengths[i] is the image at
+   output_stack + nx * ny * i, and matches that of pathopen() or pathclose() at
+   L = lengths[i].  The _presorted forms follow pathopen_presort() as above. */
+template <class PIX_TYPE>
+int pathopen_stack(
+	PIX_TYPE * input_image,							/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	const int * lengths,							/* Increasing threshold line lengths */
+	int num_lengths,								/* Number of lengths */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_stack							/* One output image per length */
+);
+
+template <class PIX_TYPE>
+int pathopen_stack(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The input image */
+	const int * lengths,							/* Increasing threshold line lengths */
+	int num_lengths,								/* Number of lengths */
+	PIX_TYPE * output_stack							/* One output image per length */
+);
+
+template <class PIX_TYPE>
+int pathopen_stack_presorted(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The image given to pathopen_presort() */
+	const int * lengths,							/* Increasing threshold line lengths */
+	int num_lengths,								/* Number of lengths */
+	PIX_TYPE * output_stack							/* One output image per length */
+);
+
+template <class PIX_TYPE>
+int pathclose_stack(
+	PIX_TYPE * input_image,							/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	const int * lengths,							/* Increasing threshold line lengths */
+	int num_lengths,								/* Number of lengths */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_stack							/* One output image per length */
+);
+
+template <class PIX_TYPE>
+int pathclose_stack(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The input image */
+	const int * lengths,							/* Increasing threshold line lengths */
+	int num_lengths,								/* Number of lengths */
+	PIX_TYPE * output_stack							/* One output image per length */
+);
+
+template <class PIX_TYPE>
+int pathclose_stack_presorted(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PIX_TYPE * input_image,							/* The image given to pathopen_presort() */
+	const int * lengths,							/* Increasing threshold line lengths */
+	int num_lengths,								/* Number of lengths */
+	PIX_TYPE * output_stack							/* One output image per length */
+);
+
+/* The path opening transform of a PATHOPEN_PIX_TYPE image: the granulometric curve of
+   every pixel, from which its path opening for any length L follows by
+   pixel_path_length_to_threshold() (see path_support.h) without recomputing, lengths
+   no path reaches giving the image minimum as in pathopen().  The curves are exact for
+   lengths up to max_length, or all lengths if max_length <= 0; a smaller max_length
+   bounds the chain lengths as pathopen() does, for speed.  The result is freed with
+   PATH_GRANULOMETRY_IMAGE_destructor(), and is NULL if memory ran out. */
+PATH_GRANULOMETRY_IMAGE * pathopen_transform(
+	PATHOPEN_PIX_TYPE * input_image,				/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int K,											/* The maximum number of gaps in the path */
+	int max_length,									/* Longest length to resolve, <= 0 for all */
+	int num_threads									/* Number of worker threads, <= 0 for all cores */
+);
+
+PATH_GRANULOMETRY_IMAGE * pathopen_transform(
+	Path_Open_Context & context,					/* Working memory and parameters */
 	PATHOPEN_PIX_TYPE * input_image,				/* The input image */
+	int max_length									/* Longest length to resolve, <= 0 for all */
+);
+
+PATH_GRANULOMETRY_IMAGE * pathopen_transform_presorted(
+	Path_Open_Context & context,					/* Working memory and parameters */
+	PATHOPEN_PIX_TYPE * input_image,				/* The image given to pathopen_presort() */
+	int max_length									/* Longest length to resolve, <= 0 for all */
+);
+
+/* The path opening at one length, rendered from a path opening transform in parallel */
+void pathopen_transform_render(
+	PATH_GRANULOMETRY_IMAGE * transform,			/* The transform */
+	int path_length,								/* The threshold line length */
+	PATHOPEN_PIX_TYPE * output_image,				/* Output image */
+	int num_threads									/* Number of worker threads, <= 0 for all cores */
+);
+
+/* Tiled path openings, for images too large to path-open in one piece.  Every pixel's
+   opening depends only on the pixels within L - 1 of it, so the image is processed in
+   tiles overlapping by a halo of L pixels and the tile interiors are stitched together,
+   the result being identical to that of pathopen() or pathclose() on the whole image.
+   The tiles' orientation passes are shared out among num_threads threads, each working
+   through the passes of the tiles it read and stealing others' when it runs out.  A
+   tile is only read once the working memory of those in progress leaves room for it
+   within memory_budget bytes (see pathopen_memory_size()), and the tiles are made
+   small enough for several to be in progress at once.  These return -1 if the budget
+   cannot hold even a one-pixel interior, or if the tile I/O fails. */
+
+/* Path_Open_Tile_IO:
+	Where a tiled opening reads its input and writes its output, so that neither need be
+	held in memory.  Tiles are rectangles of columns [x, x + w) and rows [y, y + h), and
+	row j of a tile starts at tile + stride * j.  Return 0 on success, -1 on failure.
+	Calls are made one at a time, though not always from the same thread.
+*/
+template <class PIX_TYPE>
+class Path_Open_Tile_IO {
+public:
+	virtual ~Path_Open_Tile_IO() {}
+
+	virtual int read_tile(
+		int x, int y, int w, int h,					/* Tile rectangle */
+		PIX_TYPE * tile, int stride					/* Destination */
+	) = 0;
+
+	virtual int write_tile(
+		int x, int y, int w, int h,					/* Tile rectangle */
+		const PIX_TYPE * tile, int stride			/* Source */
+	) = 0;
+};
+
+/* Path_Open_Tile_Stats:
+	What became of one tile of a tiled opening.  Instants are in seconds since the start
+	of the call, durations in seconds.
+*/
+struct Path_Open_Tile_Stats {
+	int x, y, w, h;									/* Interior rectangle */
+	int region_nx, region_ny;						/* Dimensions with the halo */
+	int admit_thread;								/* Thread that read and sorted it */
+	int pass_threads[4];							/* Thread that ran each orientation pass */
+	double admit_time;								/* Instant it was admitted */
+	double finish_time;								/* Instant its interior was written */
+	double read_time;								/* Reading the tile */
+	double sort_time;								/* Sorting it and its flipped copies */
+	double pass_times[4];							/* Each orientation pass */
+	double write_time;								/* Reducing the passes and writing */
+};
+
+/* Path_Open_Engine_Stats:
+	Scheduling statistics of a tiled opening, and a record per tile in the order
+	admitted.  May be reused from call to call.
+*/
+class Path_Open_Engine_Stats {
+public:
+	int num_threads;								/* Worker threads */
+	int tile_nx, tile_ny;							/* Largest interior */
+	int halo;										/* Overlap on each side */
+	size_t memory_budget;							/* Bytes allowed */
+	size_t peak_memory;								/* Most bytes admitted at once */
+	int max_tiles_in_flight;						/* Most tiles admitted at once */
+	int num_steals;									/* Passes run by a thread that did not admit the tile */
+	double elapsed_time;							/* Seconds for the whole call */
+	double busy_time;								/* Seconds of work summed over threads */
+	Path_Open_Pass_Stats pass_stats[4];				/* Work of each orientation, summed over tiles */
+
+	int num_tiles;
+	Path_Open_Tile_Stats * tiles;
+
+	Path_Open_Engine_Stats();
+	~Path_Open_Engine_Stats();
+
+	/* print:
+		Report the statistics on standard output, with a line per tile if asked, and the
+		pass statistics if counted
+	*/
+	void print(
+		bool per_tile								/* Also list every tile */
+	) const;
+
+private:
+	/* Not copyable: owns the tile records */
+	Path_Open_Engine_Stats(const Path_Open_Engine_Stats &);
+	Path_Open_Engine_Stats & operator=(const Path_Open_Engine_Stats &);
+};
+
+/* Whether the library counts into Path_Open_Pass_Stats, having been compiled with
+   PATHOPEN_STATS defined */
+bool pathopen_stats_enabled();
+
+/* Report the pass statistics of the context's last whole-image call on standard output,
+   an orientation per line and their total.  Whole-image calls are pathopen(),
+   pathclose(), their _stack and _presorted forms and pathopen_transform(); the tiled
+   calls sum theirs into Path_Open_Engine_Stats and a Path_Open_Stream into its own
+   pass_stats, which the second form reports */
+void pathopen_print_stats(
+	const Path_Open_Context & context				/* Context of the call */
+);
+
+void pathopen_print_stats(
+	const Path_Open_Pass_Stats * pass_stats			/* Statistics of the four orientations */
+);
+
+/* Bytes of working memory pathopen() needs for an nx * ny image of the given pixel size */
+size_t pathopen_memory_size(
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	size_t pixel_size,								/* Bytes per pixel */
+	int num_threads									/* Number of worker threads, <= 0 for all cores */
+);
+
+template <class PIX_TYPE>
+int pathopen_tiled(
+	Path_Open_Tile_IO<PIX_TYPE> & io,				/* Input and output image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	size_t memory_budget,							/* Bytes of working memory */
+	int num_threads,								/* Number of worker threads, <= 0 for all cores */
+	Path_Open_Engine_Stats * stats = NULL			/* Statistics, or NULL */
+);
+
+template <class PIX_TYPE>
+int pathopen_tiled(
+	PIX_TYPE * input_image,							/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_image,						/* Output image */
+	size_t memory_budget,							/* Bytes of working memory */
+	int num_threads,								/* Number of worker threads, <= 0 for all cores */
+	Path_Open_Engine_Stats * stats = NULL			/* Statistics, or NULL */
+);
+
+template <class PIX_TYPE>
+int pathclose_tiled(
+	Path_Open_Tile_IO<PIX_TYPE> & io,				/* Input and output image */
 	int nx, int ny,									/* Image dimensions */
 	int L,											/* The threshold line length */
 	int K,											/* The maximum number of gaps in the path */
-	PATHOPEN_PIX_TYPE * output_image				/* Output image */
+	size_t memory_budget,							/* Bytes of working memory */
+	int num_threads,								/* Number of worker threads, <= 0 for all cores */
+	Path_Open_Engine_Stats * stats = NULL			/* Statistics, or NULL */
 );
 
+template <class PIX_TYPE>
+int pathclose_tiled(
+	PIX_TYPE * input_image,							/* The input image */
+	int nx, int ny,									/* Image dimensions */
+	int L,											/* The threshold line length */
+	int K,											/* The maximum number of gaps in the path */
+	PIX_TYPE * output_image,						/* Output image */
+	size_t memory_budget,							/* Bytes of working memory */
+	int num_threads,								/* Number of worker threads, <= 0 for all cores */
+	Path_Open_Engine_Stats * stats = NULL			/* Statistics, or NULL */
+);
+
+/* Path_Open_Stream:
+	Path openings or closings of an image arriving a row at a time, such as from a
+	line-scan camera, of any height.  As for the tiled openings, output row y depends only
+	on input rows y - L + 1 to y + L - 1, so the rows are opened in bands of band_rows,
+	each with L rows of the input above and below it, in a rolling window of at most
+	band_rows + 2 * L rows.  A band's output is emitted as soon as the L rows below it have
+	arrived, at most delay() rows after its first input row.  The output is identical to
+	pathopen() or pathclose() on the whole image once finish() has marked its bottom.
+	Wider bands cost less work per row, at the price of more delay and memory.
+*/
+template <class PIX_TYPE>
+class Path_Open_Stream {
+public:
+	/* Parameters */
+	int nx;											/* Image width */
+	int L;											/* The threshold line length */
+	int K;											/* The maximum number of gaps in the path */
+	bool closing;									/* Path closing rather than opening */
+	int band_rows;									/* Output rows per band */
+	int halo;										/* Input rows beyond each side of a band */
+	int num_threads;								/* Number of worker threads */
+
+	/* State */
+	PIX_TYPE * window;								/* Input rows window_y .. window_y + window_rows - 1 */
+	int window_y;
+	int window_rows;
+	int next_y;										/* First row not yet emitted */
+	PIX_TYPE * band_output;							/* Output of the window */
+	Path_Open_Context * context;					/* Working memory, for the window's height */
+	Path_Open_Pass_Stats pass_stats[4];				/* Work of each orientation, summed over bands */
+
+	/* Methods */
+	Path_Open_Stream(
+		int nx,										/* Image width */
+		int L,										/* The threshold line length */
+		int K,										/* The maximum number of gaps in the path */
+		bool closing = false,						/* Path closing rather than opening */
+		int band_rows = 0,							/* Output rows per band, <= 0 for 2 * L */
+		int num_threads = 1							/* Number of worker threads, <= 0 for all cores */
+	);
+
+	~Path_Open_Stream();
+
+	/* push_row:
+		Append the next row of the input.  Whenever this completes a band, its rows are
+		written to output_rows, which must have room for max_output_rows() rows.
+		Returns the number of rows written.
+	*/
+	int push_row(
+		const PIX_TYPE * input_row,					/* nx pixels */
+		PIX_TYPE * output_rows						/* Finished rows, if any */
+	);
+
+	/* finish:
+		Mark the end of the image, writing all the rows not yet emitted to output_rows,
+		and start afresh for a new image.  Returns the number of rows written.
+	*/
+	int finish(
+		PIX_TYPE * output_rows						/* The remaining rows */
+	);
+
+	/* Rows push_row() or finish() may write at once */
+	int max_output_rows() const { return band_rows + halo; }
+
+	/* Most rows pushed after a row before its output is written */
+	int delay() const { return band_rows + halo - 1; }
+
+private:
+	/* emit:
+		Open the window and write its rows from next_y up to y_end, then slide it down.
+	*/
+	int emit(
+		int y_end,									/* Row after the last to write */
+		PIX_TYPE * output_rows						/* Written rows */
+	);
+
+	/* Not copyable: owns its buffers */
+	Path_Open_Stream(const Path_Open_Stream &);
+	Path_Open_Stream & operator=(const Path_Open_Stream &);
+};
+
 #endif // PATHOPENCLOSE_H
@@ -0,0 +1,315 @@
+/*
+ *		File:		test_gray_image_io.c
+ *
+ *		Purpose:	Check that the native PGM, TIFF and raw readers get back what the
+ *					writers and mappings put out, and read big-endian and plain files
+ *					written elsewhere
+ *
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "GrayImageIO.h"
+
+#define TEST_FILE_PREFIX "test_gray_image_io"
+
+/* - check_image:
+ * Compare an image read back with the expected dimensions, depth and pixels.
+ * Returns 1 on a mismatch, counting a NULL image as one, and frees the image.
+ */
+static int check_image(
+	GRAY_IMAGE * image,
+	const char * what,
+	int nx, int ny,
+	int depth,
+	const void * pixels
+)
+{
+	int failed = image == NULL || image->nx != nx || image->ny != ny || image->depth != depth ||
+		memcmp(image->buf, pixels, (size_t)nx * ny * depth) != 0;
+
+	if (failed) printf("%s: MISMATCH\n", what);
+	if (image != NULL) GRAY_IMAGE_destructor(image);
+
+	return failed;
+}
+
+/* - test_round_trips:
+ * Write an image in each format and depth and read it back
+ */
+static int test_round_trips(void)
+{
+	static const char * extensions[] = {".pgm", ".PNM", ".tif", ".tiff", ".raw", ".gray"};
+	char filename[64];
+	int e, depth, i, nx = 37, ny = 11, num_failures = 0;
+	GRAY_IMAGE * image;
+
+	for (depth = 1; depth <= 2; ++depth) {
+		image = GRAY_IMAGE_constructor(nx, ny, depth);
+		for (i = 0; i < nx * ny * depth; ++i) {
+			((unsigned char *)image->buf)[i] = (unsigned char)(rand() >> 4);
+		}
+
+		for (e = 0; e < (int)(sizeof(extensions) / sizeof(extensions[0])); ++e) {
+			sprintf(filename, TEST_FILE_PREFIX "%d%s", depth, extensions[e]);
+			if (write_gray_image(image, filename) != 0) {
+				printf("%s: could not write\n", filename);
+				++num_failures;
+				continue;
+			}
+			if (gray_image_format(filename) == GRAY_FORMAT_RAW) {
+				num_failures += check_image(read_raw_image(filename, nx, ny, depth), filename, nx, ny, depth, image->buf);
+			} else {
+				num_failures += check_image(read_gray_image(filename), filename, nx, ny, depth, image->buf);
+			}
+			remove(filename);
+		}
+
+		GRAY_IMAGE_destructor(image);
+	}
+
+	return num_failures;
+}
+
+/* - test_mappings:
+ * Fill mapped output files and read them back, then map files written in full.  The
+ * formats that cannot be mapped at some depth on this machine are skipped.
+ */
+static int test_mappings(void)
+{
+	static const char * extensions[] = {".pgm", ".tif", ".raw"};
+	char filename[64];
+	int e, depth, i, nx = 29, ny = 13, num_failures = 0;
+	GRAY_IMAGE * image;
+	GRAY_MAPPED_IMAGE * mapped;
+
+	for (depth = 1; depth <= 2; ++depth) {
+		image = GRAY_IMAGE_constructor(nx, ny, depth);
+		for (i = 0; i < nx * ny * depth; ++i) {
+			((unsigned char *)image->buf)[i] = (unsigned char)(rand() >> 4);
+		}
+
+		for (e = 0; e < (int)(sizeof(extensions) / sizeof(extensions[0])); ++e) {
+			sprintf(filename, TEST_FILE_PREFIX "_mapped%d%s", depth, extensions[e]);
+
+			/* Through a writable mapping, as pathopen() would write its output */
+			if ((mapped = create_mapped_gray_image(filename, nx, ny, depth)) != NULL) {
+				memcpy(mapped->image.buf, image->buf, (size_t)nx * ny * depth);
+				if (GRAY_MAPPED_IMAGE_destructor(mapped) != 0) {
+					printf("%s: could not unmap\n", filename);
+					++num_failures;
+				}
+				if (gray_image_format(filename) == GRAY_FORMAT_RAW) {
+					num_failures += check_image(read_raw_image(filename, nx, ny, depth), filename, nx, ny, depth, image->buf);
+				} else {
+					num_failures += check_image(read_gray_image(filename), filename, nx, ny, depth, image->buf);
+				}
+			} else if (e != 0 || depth == 1) {
+				printf("%s: could not create a mapping\n", filename);
+				++num_failures;
+			}
+
+			/* Read-only mappings of input */
+			write_gray_image(image, filename);
+			if (gray_image_format(filename) == GRAY_FORMAT_RAW) {
+				mapped = map_raw_image(filename, nx, ny, depth);
+			} else {
+				mapped = map_gray_image(filename);
+			}
+			if (mapped != NULL) {
+				if (mapped->image.nx != nx || mapped->image.ny != ny || mapped->image.depth != depth ||
+					memcmp(mapped->image.buf, image->buf, (size_t)nx * ny * depth) != 0) {
+					printf("%s: mapped MISMATCH\n", filename);
+					++num_failures;
+				}
+				GRAY_MAPPED_IMAGE_destructor(mapped);
+			} else if (e == 2 || (e == 0 && depth == 1)) {
+				printf("%s: could not map\n", filename);
+				++num_failures;
+			}
+			remove(filename);
+		}
+
+		GRAY_IMAGE_destructor(image);
+	}
+
+	return num_failures;
+}
+
+/* - test_in_place:
+ * Write a filter's output over its own mapped input, as test_pathopen does when given
+ * one file for both: same_gray_image_file() must see through the spelling, and the
+ * output, written in full after filtering, must come from the original pixels.
+ */
+static int test_in_place(void)
+{
+	const char * filename = TEST_FILE_PREFIX "_in_place.pgm";
+	const char * respelt = "./" TEST_FILE_PREFIX "_in_place.pgm";
+	int i, nx = 64, ny = 48, num_failures = 0;
+	GRAY_IMAGE * image = GRAY_IMAGE_constructor(nx, ny, 1);
+	GRAY_IMAGE * expected = GRAY_IMAGE_constructor(nx, ny, 1);
+	GRAY_IMAGE * output = GRAY_IMAGE_constructor(nx, ny, 1);
+	GRAY_MAPPED_IMAGE * input;
+
+	for (i = 0; i < nx * ny; ++i) {
+		((unsigned char *)image->buf)[i] = (unsigned char)(rand() >> 4);
+		((unsigned char *)expected->buf)[i] = (unsigned char)(255 - ((unsigned char *)image->buf)[i]);
+	}
+	write_gray_image(image, filename);
+	write_gray_image(image, TEST_FILE_PREFIX "_other.pgm");
+
+	if (!same_gray_image_file(filename, respelt) || same_gray_image_file(filename, TEST_FILE_PREFIX "_other.pgm") ||
+		same_gray_image_file(filename, TEST_FILE_PREFIX "_missing.pgm")) {
+		printf("same_gray_image_file: MISMATCH\n");
+		++num_failures;
+	}
+
+	if ((input = map_gray_image(filename)) == NULL) {
+		printf("%s: could not map\n", filename);
+		++num_failures;
+	} else {
+		if (same_gray_image_file(filename, respelt)) {
+			for (i = 0; i < nx * ny; ++i) {
+				((unsigned char *)output->buf)[i] = (unsigned char)(255 - ((unsigned char *)input->image.buf)[i]);
+			}
+			write_gray_image(output, respelt);
+		}
+		GRAY_MAPPED_IMAGE_destructor(input);
+		num_failures += check_image(read_gray_image(filename), "in place", nx, ny, 1, expected->buf);
+	}
+
+	remove(filename);
+	remove(TEST_FILE_PREFIX "_other.pgm");
+	GRAY_IMAGE_destructor(image);
+	GRAY_IMAGE_destructor(expected);
+	GRAY_IMAGE_destructor(output);
+
+	return num_failures;
+}
+
+/* - write_file:
+ * Write size bytes to a file
+ */
+static void write_file(
+	const char * filename,
+	const void * data,
+	size_t size
+)
+{
+	FILE * file = fopen(filename, "wb");
+
+	fwrite(data, 1, size, file);
+	fclose(file);
+}
+
+/* - test_foreign_files:
+ * Files the writers never produce: plain PGM with comments, a big-endian 16-bit
+ * WhiteIsZero TIFF in two strips, then files to be left to ImageMagick
+ */
+static int test_foreign_files(void)
+{
+	static const char plain[] = "P2\n# comment\n3 2 # more\n1000\n0 1 2\n999\n1000 500\n";
+	static const unsigned short plain_pixels[] = {0, 1, 2, 999, 1000, 500};
+	/* 2 x 3 pixels; rows 0-1 in a strip at 118, row 2 in a strip at 126 */
+	static const unsigned char big_endian[] = {
+		'M', 'M', 0, 42, 0, 0, 0, 8,
+		0, 8,
+		1, 0, 0, 3, 0, 0, 0, 1, 0, 2, 0, 0,				/* ImageWidth 2 */
+		1, 1, 0, 4, 0, 0, 0, 1, 0, 0, 0, 3,				/* ImageLength 3 */
+		1, 2, 0, 3, 0, 0, 0, 1, 0, 16, 0, 0,			/* BitsPerSample 16 */
+		1, 3, 0, 3, 0, 0, 0, 1, 0, 1, 0, 0,				/* Compression none */
+		1, 6, 0, 3, 0, 0, 0, 1, 0, 0, 0, 0,				/* WhiteIsZero */
+		1, 17, 0, 4, 0, 0, 0, 2, 0, 0, 0, 110,			/* StripOffsets, at 110 */
+		1, 21, 0, 3, 0, 0, 0, 1, 0, 1, 0, 0,			/* SamplesPerPixel 1 */
+		1, 22, 0, 3, 0, 0, 0, 1, 0, 2, 0, 0,			/* RowsPerStrip 2 */
+		0, 0, 0, 0,
+		0, 0, 0, 118, 0, 0, 0, 126,
+		0, 0, 0, 1, 0, 2, 0, 3,
+		255, 240, 0, 5
+	};
+	static const unsigned short big_endian_pixels[] = {65535, 65534, 65533, 65532, 15, 65530};
+	unsigned char compressed[sizeof(big_endian)];
+	int num_failures = 0;
+	GRAY_IMAGE * image;
+
+	write_file(TEST_FILE_PREFIX ".pgm", plain, sizeof(plain) - 1);
+	num_failures += check_image(read_gray_image(TEST_FILE_PREFIX ".pgm"), "plain PGM", 3, 2, 2, plain_pixels);
+
+	write_file(TEST_FILE_PREFIX ".tif", big_endian, sizeof(big_endian));
+	num_failures += check_image(read_gray_image(TEST_FILE_PREFIX ".tif"), "big-endian TIFF", 2, 3, 2, big_endian_pixels);
+
+	/* PackBits compression */
+	memcpy(compressed, big_endian, sizeof(big_endian));
+	compressed[10 + 12 * 3 + 8] = 0x80;
+	compressed[10 + 12 * 3 + 9] = 0x05;
+	write_file(TEST_FILE_PREFIX ".tif", compressed, sizeof(compressed));
+	if ((image = read_gray_image(TEST_FILE_PREFIX ".tif")) != NULL) {
+		printf("compressed TIFF: read natively\n");
+		GRAY_IMAGE_destructor(image);
+		++num_failures;
+	}
+
+	/* Short of its last row */
+	write_file(TEST_FILE_PREFIX ".tif", big_endian, sizeof(big_endian) - 4);
+	if ((image = read_gray_image(TEST_FILE_PREFIX ".tif")) != NULL) {
+		printf("truncated TIFF: read\n");
+		GRAY_IMAGE_destructor(image);
+		++num_failures;
+	}
+	if ((image = read_raw_image(TEST_FILE_PREFIX ".tif", 100, 100, 1)) != NULL) {
+		printf("short raw file: read\n");
+		GRAY_IMAGE_destructor(image);
+		++num_failures;
+	}
+
+	remove(TEST_FILE_PREFIX ".pgm");
+	remove(TEST_FILE_PREFIX ".tif");
+
+	return num_failures;
+}
+
+int main(int argc, char ** argv)
+{
+	int num_failures = test_round_trips() + test_mappings() + test_in_place() + test_foreign_files();
+
+	printf("%d failures\n", num_failures);
+
+	return num_failures != 0;
+}
@@ -0,0 +1,78 @@
+/*
+ *		File:		test_images.h
+ *
+ *		Purpose:	Synthetic images shared by the tests and the server's load generator
+ *
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+#ifndef TEST_IMAGES_H
+#define TEST_IMAGES_H
+
+#include <math.h>
+#include <stdlib.h>
+
+/* - make_ridges:
+	Two sine gratings across each other, oriented ridges under noise, so that paths of
+	every orientation and of many lengths survive.  The 8-bit pixels are quantised to
+	steps of 8 for plateaus and ties.  Any of the three images may be NULL; those given
+	hold the same picture, the same for the same seed.
+*/
+static void make_ridges(
+	int nx, int ny,									/* Image dimensions */
+	unsigned int seed,								/* For srand() */
+	unsigned char * image8,							/* 0 to 255, or NULL */
+	unsigned short * image16,						/* Around 2000, or NULL */
+	float * image32									/* Around 0, or NULL */
+)
+{
+	int x, y;
+
+	srand(seed);
+	for (y = 0; y < ny; ++y) {
+		for (x = 0; x < nx; ++x) {
+			double ridges = sin(0.2 * x + 0.1 * y) + sin(0.07 * x - 0.3 * y);
+			int noise = rand() % 64 - 32;
+
+			if (image8 != NULL) image8[x + nx * y] = (unsigned char)((int)(128 + 50 * ridges + noise) & ~7);
+			if (image16 != NULL) image16[x + nx * y] = (unsigned short)(1000 * (2 + ridges) + 17 * noise);
+			if (image32 != NULL) image32[x + nx * y] = (float)(ridges + 0.01 * noise);
+		}
+	}
+}
+
+#endif // TEST_IMAGES_H
@@ -46,6 +46,42 @@ knowledge of the CeCILL-B license and that you accept its terms.
 #include <iostream>
 using namespace std;
 
+/* test_queue:
+	Insert out of order and with repeats, then visit row (1, 2) both ways, removing as we go
+*/
+template <class QUEUE>
+void test_queue(QUEUE & q) {
+	int x;
+
+	q.insert(1, 2, 8);
+	q.insert(1, 2, 3);
+	q.insert(1, 2, 8);
+	q.commit(1, 2);
+	q.insert(1, 2, 5);
+	q.insert(1, 2, 0);
+	q.insert(1, 2, 9);
+	q.commit(1, 2);
+
+	// Row (1, 2) is 0, 3, 5, 8, 9
+	cout << "contains(1, 2, 5) = " << q.contains(1, 2, 5) << ", contains(1, 2, 6) = " << q.contains(1, 2, 6) << endl;
+	q.print_state();
+
+	cout << "descending:";
+	for (x = q.last(1, 2); x >= 0; x = q.prev(1, 2, x - 1)) {
+		cout << " " << x;
+	}
+	cout << endl;
+
+	cout << "ascending, removing:";
+	for (x = q.first(1, 2); x >= 0; x = q.next(1, 2, x + 1)) {
+		cout << " " << x;
+		q.remove(1, 2, x);
+	}
+	cout << endl;
+	q.clear_row(1, 2);
+	cout << "empty(1, 2) = " << q.empty(1, 2) << endl;
+}
+
 int main(int argc, char * * argv) {
 	cout << "Hello world!" << endl;
 
@@ -73,7 +109,17 @@ int main(int argc, char * * argv) {
 	pq.merge_row(row, 0, 0);
 	pq.merge_row(row, 2, 0);
 
+	// Merging duplicates keeps a single copy: (0, 0) becomes 0, 1, 2, 3, 5, 6, 7, 8, 9
+	PIXEL_INDEX_TYPE overlap[] = {0, 3, 7, 8};
+	pq.merge_row(overlap, 4, 0, 0);
+
 	pq.print_state();
+
+	// Both queue types through the interface used by the kernels
+	Path_Queue aq(num_gaps, num_rows, row_length);
+	Path_Queue_Bitset bq(num_gaps, num_rows, row_length);
+	test_queue(aq);
+	test_queue(bq);
 	
 	return 0;
 }
@@ -45,6 +45,7 @@ knowledge of the CeCILL-B license and that you accept its terms.
 
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 
 using namespace std;
@@ -54,25 +55,41 @@ extern "C" {
 	#include "pde_toolbox_defs.h"
 //	#include "pde_toolbox_LSTB.h"
 	#include "ImageMagickIO.h"
+	#include "GrayImageIO.h"
 }
 
 #include "pathopenclose.h"
 
 int usage(const char *name)
 {
-    cerr << "Usage : "<< name <<" <input image> L K <output image>" << endl;
-    cerr << "Where : <input image> is an 8-bit grey-level image in any format readable by ImageMagick" << endl;
+    cerr << "Usage : "<< name <<" [--stats] <input image> L K <output image> [num_threads]" << endl;
+    cerr << "Where : <input image> is a grey-level image in any format readable by ImageMagick" << endl;
+    cerr << "        8- and 16-bit PGM and uncompressed TIFF are read directly, without ImageMagick," << endl;
+    cerr << "        and 8-bit PGM is memory-mapped rather than read" << endl;
     cerr << "        L is the length of the path " << endl;
     cerr << "        K is the number of admissible missing pixels " << endl;
-    cerr << "        <output image> is an 8-bit image. The extention determines the format" << endl;
+    cerr << "        <output image> has the depth of the input. The extention determines the format;" << endl;
+    cerr << "        .pgm, .pnm, .tif, .tiff, .raw and .gray are written directly, through a" << endl;
+    cerr << "        memory mapping of the output file where the pixels need no conversion" << endl;
+    cerr << "        num_threads is the number of threads to use (default: all cores)" << endl;
+    cerr << "        --stats reports the work of each orientation pass, if the library was" << endl;
+    cerr << "                compiled with PATHOPEN_STATS defined" << endl;
 
     return 0;
 }
 
-int readargs(int argc, char *argv[], char **input, int *L, int *K, char **output)
+int readargs(int argc, char *argv[], char **input, int *L, int *K, char **output, int *num_threads, bool *print_stats)
 {
     int notOKarg = 0;
     
+    /* Options first */
+    *print_stats = false;
+    if (argc > 1 && strcmp(argv[1], "--stats") == 0) {
+        *print_stats = true;
+        --argc;
+        ++argv;
+    }
+
     if (argc < 5) {
         notOKarg = 1;
     } else {
@@ -80,6 +97,7 @@ int readargs(int argc, char *argv[], char **input, int *L, int *K, char **output
         *L = atoi(argv[2]);
         *K = atoi(argv[3]);
         *output = argv[4];
+        *num_threads = (argc > 5) ? atoi(argv[5]) : 0;
     }
     
     
@@ -88,46 +106,108 @@ int readargs(int argc, char *argv[], char **input, int *L, int *K, char **output
 
 int main(int argc, char **argv)
 {
-    int   i, L, K;
+    int   L, K, num_threads;
+    bool  print_stats;
     char *input, *output;
     clock_t start, stop;
     
-    if (readargs(argc, argv, &input, &L, &K, &output) != 0) {
+    if (readargs(argc, argv, &input, &L, &K, &output, &num_threads, &print_stats) != 0) {
         usage(argv[0]);
     } else {
 	
-	/* Open an image from file */
+	/* Open an image from file: mapped if its pixels can be used in place, otherwise
+	   read natively if it is PGM or TIFF */
+	GRAY_MAPPED_IMAGE * input_map = map_gray_image(input);
+	GRAY_IMAGE * input_gray = (input_map != NULL) ? &input_map->image : read_gray_image(input);
+	if (input_gray != NULL) {
+	    int nx = input_gray->nx;
+	    int ny = input_gray->ny;
+
+	    // Filter straight into the output file's pages when its format allows, unless
+	    // the output is the mapped input, which creating it would truncate
+	    GRAY_MAPPED_IMAGE * output_map = (input_map != NULL && same_gray_image_file(input, output)) ?
+	        NULL : create_mapped_gray_image(output, nx, ny, input_gray->depth);
+	    GRAY_IMAGE * output_gray = (output_map != NULL) ?
+	        &output_map->image : GRAY_IMAGE_constructor(nx, ny, input_gray->depth);
+
+	    // Filter the 8- or 16-bit pixels as they were read, in a context (as
+	    // pathopen_threaded() would) whose pass statistics can be read back
+	    Path_Open_Context context(nx, ny, L, K, num_threads);
+	    cout << "Calling pathopen()" << endl;
+	    start = clock();
+	    if (input_gray->depth == 1) {
+	        pathopen(context, (unsigned char *)input_gray->buf, (unsigned char *)output_gray->buf);
+	    } else {
+	        pathopen(context, (unsigned short *)input_gray->buf, (unsigned short *)output_gray->buf);
+	    }
+	    stop = clock();
+	    cout << "pathopen() returned! CPU time elapsed:" << ((double)stop-start)/CLOCKS_PER_SEC << endl;
+	    if (print_stats) {
+	        pathopen_print_stats(context);
+	    }
+
+	    /* Save output to file, with ImageMagick for formats not handled here */
+	    if (output_map != NULL) {
+	        if (GRAY_MAPPED_IMAGE_destructor(output_map) != 0) {
+	            cerr << "Could not write " << output << endl;
+	        }
+	    } else if (gray_image_format(output) != GRAY_FORMAT_UNKNOWN) {
+	        if (write_gray_image(output_gray, output) != 0) {
+	            cerr << "Could not write " << output << endl;
+	        }
+	    } else {
+	        BVECT * dim = BVECT_constructor(2);
+	        dim->buf[0] = nx;
+	        dim->buf[1] = ny;
+	        BIMAGE * output_bimage = BIMAGE_constructor(dim);
+	        for (int i = 0; i < nx * ny; ++i) {
+	            output_bimage->buf[i] = (input_gray->depth == 1) ?
+	                ((unsigned char *)output_gray->buf)[i] : ((unsigned short *)output_gray->buf)[i];
+	        }
+	        write_grayscale_image(output_bimage, output);
+	        BIMAGE_destructor(output_bimage);
+	        BVECT_destructor(dim);
+	    }
+
+	    if (output_map == NULL) {
+	        GRAY_IMAGE_destructor(output_gray);
+	    }
+	    if (input_map != NULL) {
+	        GRAY_MAPPED_IMAGE_destructor(input_map);
+	    } else {
+	        GRAY_IMAGE_destructor(input_gray);
+	    }
+	    return 0;
+	}
+
+	/* Otherwise open it with ImageMagick */
 	BIMAGE * input_bimage = read_grayscale_image(argv[0], input);
+	if (input_bimage == NULL) {
+	    cerr << "Could not read " << input << endl;
+	    return 1;
+	}
 	// Allocate remaining images
 	BIMAGE * output_bimage = BIMAGE_constructor(input_bimage->dim);
 	int nx = input_bimage->dim->buf[0];
 	int ny = input_bimage->dim->buf[1];
-        int num_pixels = nx*ny;
-	PATHOPEN_PIX_TYPE * input_image = new PATHOPEN_PIX_TYPE[nx * ny];
-	PATHOPEN_PIX_TYPE * output_image = new PATHOPEN_PIX_TYPE[nx * ny];
-
-	// Convert intermediate float to PATHOPEN_PIX_TYPE (unsigned char)
-	for (i = 0; i < num_pixels; ++i) {
-            input_image[i] = static_cast<PATHOPEN_PIX_TYPE>(input_bimage->buf[i]);
-	}
 
-	cout << "Calling pathopen()" << endl;
-        start = clock();
-	pathopen(
-            input_image, /* The input image */
+	// Filter the float pixels directly, keeping the full precision of 12/16-bit inputs
+	Path_Open_Context context(
             nx, ny,	 /* Image dimensions */
             L,		 /* The threshold line length */
             K,		 /* The maximum number of gaps in the path */
-            output_image /* Output image */
+            num_threads	 /* Number of threads, 0 for all cores */
             );
+	cout << "Calling pathopen()" << endl;
+        start = clock();
+	pathopen(context, input_bimage->buf, output_bimage->buf);
         stop = clock();
 	cout << "pathopen() returned! CPU time elapsed:" << ((double)stop-start)/CLOCKS_PER_SEC << endl;
+	if (print_stats) {
+	    pathopen_print_stats(context);
+	}
 
 	/* Save output to file */
-	// Convert 0-65535 float to PATHOPEN_PIX_TYPE (unsigned char)
-	for (i = 0; i < num_pixels; ++i) {
-            output_bimage->buf[i] = static_cast<PATHOPEN_PIX_TYPE>(output_image[i]);
-	}
 	// Write file
 	write_grayscale_image(
 		output_bimage,
@@ -135,8 +215,6 @@ int main(int argc, char **argv)
 	);
 
 	// Deallocate
-	delete input_image;
-	delete output_image;
 	BIMAGE_destructor(input_bimage);
 	BIMAGE_destructor(output_bimage);
         
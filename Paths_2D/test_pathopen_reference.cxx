@@ -0,0 +1,255 @@
+/*
+ *		File:		test_pathopen_reference.cxx
+ *
+ *		Purpose:	Compare pathopen(), pathclose() and their stacks against the
+ *					threshold decomposition reference on random small images
+ *
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pathopenclose.h"
+#include "pathopen_reference.h"
+
+/* Mismatches reported in full before the rest are only counted */
+#define MAX_REPORTS 10
+
+static int num_reports = 0;
+
+/* - report_mismatch:
+	Describe the first differing pixel, and the image if it is small enough to read.
+*/
+template <class PIX_TYPE>
+static void report_mismatch(const char * name, const PIX_TYPE * input_image, int nx, int ny, int L, int K,
+	const PIX_TYPE * output_image, const PIX_TYPE * expected_image)
+{
+	int x, y, p;
+
+	if (++num_reports > MAX_REPORTS) return;
+	for (p = 0; output_image[p] == expected_image[p]; ++p) ;
+	printf("%s %d x %d, L = %d, K = %d: MISMATCH at (%d, %d), %g for %g\n",
+		name, nx, ny, L, K, p % nx, p / nx, (double)output_image[p], (double)expected_image[p]);
+	if (nx <= 16 && ny <= 16) {
+		for (y = 0; y < ny; ++y) {
+			printf("\t");
+			for (x = 0; x < nx; ++x) printf(" %5g", (double)input_image[x + nx * y]);
+			printf("\n");
+		}
+	}
+}
+
+/* - test_image:
+	Open and close one image at every length from 1 to beyond the longest path the
+	image holds, one call per length and as a stack, with K gaps.  Returns the number
+	of mismatches.
+*/
+template <class PIX_TYPE>
+static int test_image(const char * name, PIX_TYPE * input_image, int nx, int ny, int K, int * num_runs)
+{
+	int num_pixels = nx * ny;
+	int lengths[PATHOPEN_MAX_LENGTHS];
+	int j, closing, num_lengths, num_failures = 0;
+	PIX_TYPE * expected_stack, * output_stack, * output_image;
+	char label[64];
+
+	num_lengths = MIN(nx + ny + 1, PATHOPEN_MAX_LENGTHS);
+	for (j = 0; j < PATHOPEN_MAX_LENGTHS; ++j) lengths[j] = j + 1;
+
+	expected_stack = (PIX_TYPE *)malloc((size_t)num_pixels * num_lengths * sizeof(PIX_TYPE));
+	output_stack = (PIX_TYPE *)malloc((size_t)num_pixels * num_lengths * sizeof(PIX_TYPE));
+	output_image = (PIX_TYPE *)malloc(num_pixels * sizeof(PIX_TYPE));
+
+	for (closing = 0; closing <= 1; ++closing) {
+		if (closing) pathclose_reference_stack(input_image, nx, ny, lengths, num_lengths, K, expected_stack);
+		else pathopen_reference_stack(input_image, nx, ny, lengths, num_lengths, K, expected_stack);
+
+		for (j = 0; j < num_lengths; ++j) {
+			PIX_TYPE * expected_image = expected_stack + (size_t)num_pixels * j;
+
+			if (closing) pathclose(input_image, nx, ny, lengths[j], K, output_image);
+			else pathopen(input_image, nx, ny, lengths[j], K, output_image);
+			if (memcmp(output_image, expected_image, num_pixels * sizeof(PIX_TYPE))) {
+				sprintf(label, "%s %s", name, closing ? "pathclose" : "pathopen");
+				report_mismatch(label, input_image, nx, ny, lengths[j], K, output_image, expected_image);
+				++num_failures;
+			}
+			++*num_runs;
+		}
+
+		if (closing) pathclose_stack(input_image, nx, ny, lengths, num_lengths, K, output_stack);
+		else pathopen_stack(input_image, nx, ny, lengths, num_lengths, K, output_stack);
+		for (j = 0; j < num_lengths; ++j) {
+			size_t offset = (size_t)num_pixels * j;
+
+			if (memcmp(output_stack + offset, expected_stack + offset, num_pixels * sizeof(PIX_TYPE))) {
+				sprintf(label, "%s %s", name, closing ? "pathclose_stack" : "pathopen_stack");
+				report_mismatch(label, input_image, nx, ny, lengths[j], K, output_stack + offset, expected_stack + offset);
+				++num_failures;
+			}
+			++*num_runs;
+		}
+	}
+
+	free((void *)expected_stack);
+	free((void *)output_stack);
+	free((void *)output_image);
+
+	return num_failures;
+}
+
+/* - make_image:
+	Random pixels of one kind: 0 constant, 1 binary, 2 four levels, 3 any byte.
+	Few levels make plateaus and ties, which the sweeps must handle.
+*/
+static void make_image(unsigned char * image, int nx, int ny, int kind)
+{
+	int p, constant = rand() % 256;
+
+	for (p = 0; p < nx * ny; ++p) {
+		switch (kind) {
+			case 0: image[p] = (unsigned char)constant; break;
+			case 1: image[p] = (unsigned char)(255 * (rand() % 2)); break;
+			case 2: image[p] = (unsigned char)(60 * (rand() % 4)); break;
+			default: image[p] = (unsigned char)(rand() % 256); break;
+		}
+	}
+}
+
+/* - test_all_types:
+	test_image() for every K from 0 to 3, on the image in bytes and, if asked, also in
+	unsigned shorts and floats.
+*/
+static int test_all_types(unsigned char * image8, int nx, int ny, bool wide_types, int * num_runs)
+{
+	int p, K, num_failures = 0;
+	int num_pixels = nx * ny;
+	unsigned short * image16 = (unsigned short *)malloc(num_pixels * sizeof(unsigned short));
+	float * image32 = (float *)malloc(num_pixels * sizeof(float));
+
+	for (p = 0; p < num_pixels; ++p) {
+		image16[p] = (unsigned short)(257 * image8[p]);
+		image32[p] = image8[p] / 7.0f - 10.0f;
+	}
+	for (K = 0; K <= 3; ++K) {
+		num_failures += test_image("8 bit", image8, nx, ny, K, num_runs);
+		if (wide_types) {
+			num_failures += test_image("16 bit", image16, nx, ny, K, num_runs);
+			num_failures += test_image("float", image32, nx, ny, K, num_runs);
+		}
+	}
+
+	free((void *)image16);
+	free((void *)image32);
+
+	return num_failures;
+}
+
+/* - test_bad_lengths:
+	The stack calls must refuse lengths that repeat, fall, or start below 1, rather
+	than return a stack.  Returns the number that were accepted.
+*/
+static int test_bad_lengths(int * num_runs)
+{
+	static const int bad_lengths[][3] = {{1, 2, 2}, {3, 3, 4}, {2, 1, 3}, {0, 1, 2}};
+	unsigned char image[4 * 3] = {0};
+	unsigned char stack[3 * 4 * 3];
+	int i, num_failures = 0;
+
+	for (i = 0; i < (int)(sizeof(bad_lengths) / sizeof(bad_lengths[0])); ++i) {
+		if (pathopen_stack(image, 4, 3, bad_lengths[i], 3, 0, stack) != -1 ||
+			pathclose_stack(image, 4, 3, bad_lengths[i], 3, 0, stack) != -1) {
+			fprintf(stderr, "lengths %d %d %d: accepted\n", bad_lengths[i][0], bad_lengths[i][1], bad_lengths[i][2]);
+			++num_failures;
+		}
+		++*num_runs;
+	}
+
+	return num_failures;
+}
+
+int main(int argc, char ** argv)
+{
+	/* One pixel, one-pixel-wide strips either way, and two-pixel ones */
+	static const int edge_sizes[][2] = {{1, 1}, {1, 7}, {7, 1}, {1, 12}, {12, 1}, {2, 9}, {9, 2}};
+	int num_images, seed, i, s, kind, nx, ny, num_runs = 0, num_failures = 0;
+	unsigned char * image8;
+
+	num_images = (argc > 1) ? atoi(argv[1]) : 200;
+	seed = (argc > 2) ? atoi(argv[2]) : 1;
+	if (num_images < 0) {
+		fprintf(stderr, "Usage : %s [num_images [seed]]\n", argv[0]);
+		return 1;
+	}
+	srand(seed);
+
+	image8 = (unsigned char *)malloc(16 * 16 * sizeof(unsigned char));
+
+	/* Every kind of image on the edge sizes, in every pixel type */
+	for (s = 0; s < (int)(sizeof(edge_sizes) / sizeof(edge_sizes[0])); ++s) {
+		for (kind = 0; kind < 4; ++kind) {
+			nx = edge_sizes[s][0];
+			ny = edge_sizes[s][1];
+			make_image(image8, nx, ny, kind);
+			num_failures += test_all_types(image8, nx, ny, true, &num_runs);
+		}
+	}
+
+	/* Random sizes up to 12 x 12, a fifth of them one pixel wide or high; the wider
+		pixel types on every fourth */
+	for (i = 0; i < num_images; ++i) {
+		nx = 1 + rand() % 12;
+		ny = 1 + rand() % 12;
+		if (rand() % 5 == 0) {
+			if (rand() % 2) nx = 1;
+			else ny = 1;
+		}
+		kind = rand() % 4;
+		make_image(image8, nx, ny, kind);
+		num_failures += test_all_types(image8, nx, ny, i % 4 == 0, &num_runs);
+	}
+
+	free((void *)image8);
+
+	num_failures += test_bad_lengths(&num_runs);
+
+	printf("%d comparisons, %d mismatches\n", num_runs, num_failures);
+
+	return num_failures == 0 ? 0 : 1;
+}
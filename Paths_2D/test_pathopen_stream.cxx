@@ -0,0 +1,131 @@
+/*
+ *		File:		test_pathopen_stream.cxx
+ *
+ *		Purpose:	Check that Path_Open_Stream agrees bit for bit with pathopen() and
+ *					pathclose() on the whole image, within its promised delay
+ *
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pathopenclose.h"
+#include "test_images.h"
+
+/* test_stream:
+	Stream one image through a stream twice, the second time after finish(), and compare
+	with the whole-image result.  Returns the number of failures.
+*/
+template <class PIX_TYPE>
+int test_stream(PIX_TYPE * input_image, int nx, int ny, int L, int K, bool closing, int band_rows)
+{
+	Path_Open_Stream<PIX_TYPE> stream(nx, L, K, closing, band_rows, 1);
+	int num_pixels = nx * ny;
+	int y, n, num_written, repeat, num_failures = 0;
+	PIX_TYPE * reference_image, * output_image;
+
+	reference_image = (PIX_TYPE *)malloc(num_pixels * sizeof(PIX_TYPE));
+	output_image = (PIX_TYPE *)malloc((num_pixels + nx * stream.max_output_rows()) * sizeof(PIX_TYPE));
+	if (closing) pathclose(input_image, nx, ny, L, K, reference_image);
+	else pathopen(input_image, nx, ny, L, K, reference_image);
+
+	for (repeat = 0; repeat < 2; ++repeat) {
+		memset(output_image, 0, num_pixels * sizeof(PIX_TYPE));
+		num_written = 0;
+		for (y = 0; y < ny; ++y) {
+			n = stream.push_row(input_image + nx * y, output_image + nx * num_written);
+			num_written += n;
+			if (n > stream.max_output_rows() || (y + 1 - num_written > stream.delay() + 1)) {
+				printf("%d x %d, L = %d, K = %d, band %d: row %d pushed, %d written\n",
+					nx, ny, L, K, band_rows, y, num_written);
+				++num_failures;
+			}
+		}
+		num_written += stream.finish(output_image + nx * num_written);
+
+		if (num_written != ny || memcmp(output_image, reference_image, num_pixels * sizeof(PIX_TYPE))) {
+			printf("%d x %d, L = %d, K = %d, %s, band %d: MISMATCH\n",
+				nx, ny, L, K, closing ? "closing" : "opening", band_rows);
+			++num_failures;
+		}
+	}
+
+	free((void *)reference_image);
+	free((void *)output_image);
+
+	return num_failures;
+}
+
+int main(int argc, char ** argv)
+{
+	static const int sizes[][2] = {{1, 1}, {7, 1}, {1, 30}, {23, 9}, {40, 57}, {64, 150}};
+	static const int path_lengths[] = {1, 3, 8, 20};
+	static const int bands[] = {0, 1, 7};
+	int s, l, b, K, closing, nx, ny, num_runs = 0, num_failures = 0;
+	unsigned char * image8;
+	float * image32;
+
+	for (s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); ++s) {
+		nx = sizes[s][0];
+		ny = sizes[s][1];
+		image8 = (unsigned char *)malloc(nx * ny * sizeof(unsigned char));
+		image32 = (float *)malloc(nx * ny * sizeof(float));
+
+		make_ridges(nx, ny, s + 1, image8, (unsigned short *)NULL, image32);
+
+		for (l = 0; l < (int)(sizeof(path_lengths) / sizeof(path_lengths[0])); ++l) {
+			for (K = 0; K <= 2; K += 2) {
+				for (b = 0; b < (int)(sizeof(bands) / sizeof(bands[0])); ++b) {
+					for (closing = 0; closing <= 1; ++closing) {
+						num_failures += test_stream(image8, nx, ny, path_lengths[l], K, closing != 0, bands[b]);
+						num_failures += test_stream(image32, nx, ny, path_lengths[l], K, closing != 0, bands[b]);
+						num_runs += 2;
+					}
+				}
+			}
+		}
+
+		free((void *)image8);
+		free((void *)image32);
+	}
+
+	printf("%d streams, %d failures\n", num_runs, num_failures);
+
+	return num_failures == 0 ? 0 : 1;
+}
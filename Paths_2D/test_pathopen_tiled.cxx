@@ -0,0 +1,185 @@
+/*
+ *		File:		test_pathopen_tiled.cxx
+ *
+ *		Purpose:	Check that pathopen_tiled() and pathclose_tiled() agree bit for bit
+ *					with pathopen() and pathclose() on the whole image, on one thread
+ *					and on several, and keep within their memory budget
+ *
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use, 
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info". 
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability. 
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or 
+data to be ensured and,  more generally, to use and operate it in the 
+same conditions as regards security. 
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pathopenclose.h"
+#include "test_images.h"
+
+/* Counting_Tile_IO:
+	In-memory tile I/O counting the tiles
+*/
+template <class PIX_TYPE>
+class Counting_Tile_IO : public Path_Open_Tile_IO<PIX_TYPE> {
+public:
+	PIX_TYPE * input_image;
+	PIX_TYPE * output_image;
+	int nx;
+	int num_tiles;
+
+	Counting_Tile_IO(PIX_TYPE * input_image, PIX_TYPE * output_image, int nx) :
+		input_image(input_image), output_image(output_image), nx(nx), num_tiles(0) {}
+
+	int read_tile(int x, int y, int w, int h, PIX_TYPE * tile, int stride) {
+		int j;
+		++num_tiles;
+		for (j = 0; j < h; ++j) {
+			memcpy(tile + stride * j, input_image + x + nx * (y + j), w * sizeof(PIX_TYPE));
+		}
+		return 0;
+	}
+
+	int write_tile(int x, int y, int w, int h, const PIX_TYPE * tile, int stride) {
+		int j;
+		for (j = 0; j < h; ++j) {
+			memcpy(output_image + x + nx * (y + j), tile + stride * j, w * sizeof(PIX_TYPE));
+		}
+		return 0;
+	}
+};
+
+/* test_image:
+	Open and close one image whole and tiled, with tiles of a small interior (as small
+	as one pixel) and of a large one, on one thread and on three.  Returns the number
+	of mismatches.
+*/
+template <class PIX_TYPE>
+int test_image(PIX_TYPE * input_image, int nx, int ny, int L, int K, int * num_tiled)
+{
+	int interiors[2] = {L / 2 + 1, 2 * L + 3};
+	int num_pixels = nx * ny;
+	int i, closing, num_threads, tile_n, num_failures = 0;
+	size_t budget;
+	PIX_TYPE * reference_image, * output_image;
+
+	reference_image = (PIX_TYPE *)malloc(num_pixels * sizeof(PIX_TYPE));
+	output_image = (PIX_TYPE *)malloc(num_pixels * sizeof(PIX_TYPE));
+
+	for (closing = 0; closing <= 1; ++closing) {
+		if (closing) pathclose(input_image, nx, ny, L, K, reference_image);
+		else pathopen(input_image, nx, ny, L, K, reference_image);
+
+		for (i = 0; i < 4; ++i) {
+			Counting_Tile_IO<PIX_TYPE> io(input_image, output_image, nx);
+			Path_Open_Engine_Stats stats;
+
+			/* Enough for square tiles of the given interior, with their halos, one
+				workspace each and as many at once as the threads need */
+			num_threads = (i < 2) ? 1 : 3;
+			tile_n = interiors[i % 2] + 2 * L;
+			budget = (pathopen_memory_size(tile_n, tile_n, L, K, sizeof(PIX_TYPE), num_threads)
+				+ 2 * (size_t)tile_n * tile_n * sizeof(PIX_TYPE)) * (num_threads == 1 ? 1 : 2);
+
+			memset(output_image, 0, num_pixels * sizeof(PIX_TYPE));
+			if ((closing ? pathclose_tiled(io, nx, ny, L, K, budget, num_threads, &stats)
+					: pathopen_tiled(io, nx, ny, L, K, budget, num_threads, &stats)) != 0) {
+				printf("%d x %d, L = %d, K = %d, %s, interior %d, %d threads: FAILED\n",
+					nx, ny, L, K, closing ? "closing" : "opening", interiors[i % 2], num_threads);
+				++num_failures;
+			} else if (memcmp(output_image, reference_image, num_pixels * sizeof(PIX_TYPE))) {
+				printf("%d x %d, L = %d, K = %d, %s, interior %d, %d threads, %d tiles: MISMATCH\n",
+					nx, ny, L, K, closing ? "closing" : "opening", interiors[i % 2], num_threads, io.num_tiles);
+				++num_failures;
+			} else if (stats.peak_memory > budget || stats.num_tiles != io.num_tiles) {
+				printf("%d x %d, L = %d, K = %d: %lu bytes admitted of %lu, %d of %d tiles counted\n",
+					nx, ny, L, K, (unsigned long)stats.peak_memory, (unsigned long)budget,
+					stats.num_tiles, io.num_tiles);
+				++num_failures;
+			}
+			if (io.num_tiles > 1) ++*num_tiled;
+		}
+	}
+
+	free((void *)reference_image);
+	free((void *)output_image);
+
+	return num_failures;
+}
+
+int main(int argc, char ** argv)
+{
+	static const int sizes[][2] = {{1, 1}, {9, 1}, {1, 9}, {17, 13}, {64, 40}, {40, 64}, {96, 64}};
+	static const int path_lengths[] = {1, 2, 5, 12, 30};
+	int s, l, K, nx, ny, num_runs = 0, num_tiled = 0, num_failures = 0;
+	unsigned char * image8;
+	unsigned short * image16;
+	float * image32;
+
+	for (s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); ++s) {
+		nx = sizes[s][0];
+		ny = sizes[s][1];
+		image8 = (unsigned char *)malloc(nx * ny * sizeof(unsigned char));
+		image16 = (unsigned short *)malloc(nx * ny * sizeof(unsigned short));
+		image32 = (float *)malloc(nx * ny * sizeof(float));
+
+		make_ridges(nx, ny, s + 1, image8, image16, image32);
+
+		for (l = 0; l < (int)(sizeof(path_lengths) / sizeof(path_lengths[0])); ++l) {
+			for (K = 0; K <= 2; ++K) {
+				num_failures += test_image(image8, nx, ny, path_lengths[l], K, &num_tiled);
+				num_failures += test_image(image16, nx, ny, path_lengths[l], K, &num_tiled);
+				num_failures += test_image(image32, nx, ny, path_lengths[l], K, &num_tiled);
+				num_runs += 3;
+			}
+		}
+
+		free((void *)image8);
+		free((void *)image16);
+		free((void *)image32);
+	}
+
+	/* A budget too small for any tile is refused */
+	image8 = (unsigned char *)calloc(100 * 100, sizeof(unsigned char));
+	if (pathopen_tiled(image8, 100, 100, 10, 1, image8, 1000, 1) != -1) {
+		printf("Undersized budget accepted\n");
+		++num_failures;
+	}
+	free((void *)image8);
+
+	printf("%d images, %d tiled runs, %d failures\n", num_runs, num_tiled, num_failures);
+
+	return num_failures == 0 ? 0 : 1;
+}
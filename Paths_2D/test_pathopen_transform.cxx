@@ -0,0 +1,301 @@
+/*
+ *		File:		test_pathopen_transform.cxx
+ *
+ *		Purpose:	Compare the path opening transform, rendered at every length, with
+ *					pathopen(), and check the curve pool and its lookups and merges
+ *
+
+  Copyright Benjamin Appleton and Hugues Talbot, Nov 2009
+
+  ben.appleton@gmail.com
+  hugues.talbot@gmail.com / hugues.talbot@univ-paris-est.fr
+
+This software is a computer program whose purpose is to perform
+  connected morphological operators with path structuring elements.
+
+This software is governed by the CeCILL-B  license under French law and
+abiding by the rules of distribution of free software.  You can  use,
+modify and/ or redistribute the software under the terms of the CeCILL-B
+license as circulated by CEA, CNRS and INRIA at the following URL
+"http://www.cecill.info".
+
+As a counterpart to the access to the source code and  rights to copy,
+modify and redistribute granted by the license, users are provided only
+with a limited warranty  and the software's author,  the holder of the
+economic rights,  and the successive licensors  have only  limited
+liability.
+
+In this respect, the user's attention is drawn to the risks associated
+with loading,  using,  modifying and/or developing or reproducing the
+software by the user in light of its specific status of free software,
+that may mean  that it is complicated to manipulate,  and  that  also
+therefore means  that it is reserved for developers  and  experienced
+professionals having in-depth computer knowledge. Users are therefore
+encouraged to load and test the software's suitability as regards their
+requirements in conditions enabling the security of their systems and/or
+data to be ensured and,  more generally, to use and operate it in the
+same conditions as regards security.
+
+The fact that you are presently reading this means that you have had
+knowledge of the CeCILL-B license and that you accept its terms.
+
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pathopenclose.h"
+
+/* Failures reported in full before the rest are only counted */
+#define MAX_REPORTS 10
+
+static int num_reports = 0;
+
+/* - report:
+	Describe a failure, and the image if it is small enough to read.
+*/
+static void report(const char * what, const PATHOPEN_PIX_TYPE * input_image, int nx, int ny, int L, int K)
+{
+	int x, y;
+
+	if (++num_reports > MAX_REPORTS) return;
+	printf("%d x %d, L = %d, K = %d: %s\n", nx, ny, L, K, what);
+	if (nx <= 16 && ny <= 16) {
+		for (y = 0; y < ny; ++y) {
+			printf("\t");
+			for (x = 0; x < nx; ++x) printf(" %3d", (int)input_image[x + nx * y]);
+			printf("\n");
+		}
+	}
+}
+
+/* - scan_path_length_to_threshold, scan_threshold_to_path_length:
+	The lookups by a scan along the curve, as they were before they bisected.
+*/
+static GPOT_PIX_TYPE scan_path_length_to_threshold(int path_length, const PATH_GRANULOMETRY * curve)
+{
+	GPOT_PIX_TYPE value = 0;
+	int i;
+
+	for (i = 0; i < curve->length && curve->path_length[i] >= path_length; ++i) {
+		value = curve->threshold[i];
+	}
+	return value;
+}
+
+static int scan_threshold_to_path_length(GPOT_PIX_TYPE threshold, const PATH_GRANULOMETRY * curve)
+{
+	int path_length = 0;
+	int i;
+
+	for (i = 0; i < curve->length; ++i) {
+		path_length = curve->path_length[i];
+		if (curve->threshold[i] > threshold) break;
+	}
+	return path_length;
+}
+
+/* - copy_curve:
+	A curve of its own, grown point by point, with the points of a view into the pool.
+*/
+static PATH_GRANULOMETRY * copy_curve(const PATH_GRANULOMETRY * view)
+{
+	PATH_GRANULOMETRY * curve = PATH_GRANULOMETRY_constructor(0);
+	int i;
+
+	for (i = 0; i < view->length; ++i) {
+		add_point(view->path_length[i], view->threshold[i], curve);
+	}
+	return curve;
+}
+
+/* - same_curve:
+	Whether two curves have the same points.
+*/
+static bool same_curve(const PATH_GRANULOMETRY * a, const PATH_GRANULOMETRY * b)
+{
+	return a->length == b->length &&
+		memcmp(a->path_length, b->path_length, a->length * sizeof(int)) == 0 &&
+		memcmp(a->threshold, b->threshold, a->length * sizeof(GPOT_PIX_TYPE)) == 0;
+}
+
+/* - test_curves:
+	Check the curves of a transform: points of decreasing length and increasing
+	threshold, that survive being copied point by point and packed again; lookups that
+	agree with scans, at every length and threshold; and merges of neighbouring curves
+	that take the better of the two at every length.  Returns the number of failures.
+*/
+static int test_curves(PATH_GRANULOMETRY_IMAGE * transform, const PATHOPEN_PIX_TYPE * input_image,
+	int nx, int ny, int K, int * num_runs)
+{
+	int num_pixels = nx * ny;
+	int max_length = nx + ny + 1;
+	int i, j, L, t, num_failures = 0;
+	PATH_GRANULOMETRY * * curves = (PATH_GRANULOMETRY * *)malloc(num_pixels * sizeof(PATH_GRANULOMETRY *));
+	PATH_GRANULOMETRY * merged = PATH_GRANULOMETRY_constructor(0);
+	PATH_GRANULOMETRY_IMAGE * packed;
+	PATH_GRANULOMETRY view;
+
+	for (i = 0; i < num_pixels; ++i) {
+		PATH_GRANULOMETRY_IMAGE_curve(i, transform, &view);
+		curves[i] = copy_curve(&view);
+		if (!same_curve(curves[i], &view)) {
+			report("curve not in canonical order", input_image, nx, ny, 0, K);
+			++num_failures;
+		}
+		for (L = 0; L <= max_length; ++L) {
+			if (path_length_to_threshold(L, &view) != scan_path_length_to_threshold(L, &view)) {
+				report("path_length_to_threshold() differs from a scan", input_image, nx, ny, L, K);
+				++num_failures;
+			}
+		}
+		for (t = 0; t < PATHOPEN_PIX_TYPE_NUM; ++t) {
+			if (threshold_to_path_length((GPOT_PIX_TYPE)t, &view) != scan_threshold_to_path_length((GPOT_PIX_TYPE)t, &view) ||
+				pixel_threshold_to_path_length(i, (GPOT_PIX_TYPE)t, transform) != threshold_to_path_length((GPOT_PIX_TYPE)t, &view)) {
+				report("threshold_to_path_length() differs from a scan", input_image, nx, ny, t, K);
+				++num_failures;
+			}
+		}
+		++*num_runs;
+	}
+
+	/* Packed again, the pool is the same */
+	packed = PATH_GRANULOMETRY_IMAGE_pack(curves, num_pixels);
+	if (packed == NULL || packed->num_points != transform->num_points ||
+		memcmp(packed->offsets, transform->offsets, (num_pixels + 1) * sizeof(size_t)) != 0 ||
+		memcmp(packed->path_length, transform->path_length, transform->num_points * sizeof(int)) != 0 ||
+		memcmp(packed->threshold, transform->threshold, transform->num_points * sizeof(GPOT_PIX_TYPE)) != 0) {
+		report("PATH_GRANULOMETRY_IMAGE_pack() differs", input_image, nx, ny, 0, K);
+		++num_failures;
+	}
+	if (packed != NULL) PATH_GRANULOMETRY_IMAGE_destructor(packed);
+	++*num_runs;
+
+	/* Each curve merged with the next */
+	for (i = 0; i + 1 < num_pixels; ++i) {
+		j = i + 1;
+		merged->length = 0;
+		merge_into(curves[i], curves[j], merged);
+		for (L = 0; L <= max_length; ++L) {
+			if (path_length_to_threshold(L, merged) !=
+				MAX(path_length_to_threshold(L, curves[i]), path_length_to_threshold(L, curves[j]))) {
+				report("merge_into() is not the better of its curves", input_image, nx, ny, L, K);
+				++num_failures;
+			}
+		}
+		++*num_runs;
+	}
+
+	for (i = 0; i < num_pixels; ++i) {
+		PATH_GRANULOMETRY_destructor(curves[i]);
+	}
+	free((void *)curves);
+	PATH_GRANULOMETRY_destructor(merged);
+
+	return num_failures;
+}
+
+/* - test_image:
+	Render the transform of one image, with K gaps, at every length from 1 to beyond the
+	longest path the image holds, and compare with pathopen(); then the same for a
+	transform resolving lengths up to 3 only, at those lengths.  Returns the number of
+	failures.
+*/
+static int test_image(PATHOPEN_PIX_TYPE * input_image, int nx, int ny, int K, int * num_runs)
+{
+	int num_pixels = nx * ny;
+	int L, max_length, num_failures = 0;
+	PATHOPEN_PIX_TYPE * expected_image = (PATHOPEN_PIX_TYPE *)malloc(num_pixels * sizeof(PATHOPEN_PIX_TYPE));
+	PATHOPEN_PIX_TYPE * output_image = (PATHOPEN_PIX_TYPE *)malloc(num_pixels * sizeof(PATHOPEN_PIX_TYPE));
+	PATH_GRANULOMETRY_IMAGE * transform;
+
+	for (max_length = 0; max_length <= 3; max_length += 3) {
+		transform = pathopen_transform(input_image, nx, ny, K, max_length, 2);
+		if (transform == NULL) {
+			report("pathopen_transform() failed", input_image, nx, ny, max_length, K);
+			++num_failures;
+			continue;
+		}
+
+		for (L = 1; L <= (max_length > 0 ? max_length : nx + ny + 1); ++L) {
+			pathopen(input_image, nx, ny, L, K, expected_image);
+			pathopen_transform_render(transform, L, output_image, 2);
+			if (memcmp(output_image, expected_image, num_pixels * sizeof(PATHOPEN_PIX_TYPE))) {
+				report(max_length > 0 ? "render of a bounded transform differs" : "render differs",
+					input_image, nx, ny, L, K);
+				++num_failures;
+			}
+			++*num_runs;
+		}
+		if (max_length == 0) {
+			num_failures += test_curves(transform, input_image, nx, ny, K, num_runs);
+		}
+
+		PATH_GRANULOMETRY_IMAGE_destructor(transform);
+	}
+
+	free((void *)expected_image);
+	free((void *)output_image);
+
+	return num_failures;
+}
+
+/* - make_image:
+	Random pixels of between 2 and 201 evenly spaced levels, lifted off 0 so that the
+	image minimum is not the value an empty curve gives.  The more levels, the more
+	points each curve holds.
+*/
+static void make_image(PATHOPEN_PIX_TYPE * image, int nx, int ny)
+{
+	int p, num_levels = 2 + rand() % 200;
+	int step = 200 / (num_levels - 1);
+	int base = 1 + rand() % 40;
+
+	for (p = 0; p < nx * ny; ++p) {
+		image[p] = (PATHOPEN_PIX_TYPE)(base + step * (rand() % num_levels));
+	}
+}
+
+int main(int argc, char ** argv)
+{
+	/* One pixel, one-pixel-wide strips either way, and two-pixel ones */
+	static const int edge_sizes[][2] = {{1, 1}, {2, 1}, {1, 7}, {7, 1}, {2, 9}, {9, 2}};
+	int num_images, seed, i, s, K, nx, ny, num_runs = 0, num_failures = 0;
+	PATHOPEN_PIX_TYPE * image;
+
+	num_images = (argc > 1) ? atoi(argv[1]) : 100;
+	seed = (argc > 2) ? atoi(argv[2]) : 1;
+	if (num_images < 0) {
+		fprintf(stderr, "Usage : %s [num_images [seed]]\n", argv[0]);
+		return 1;
+	}
+	srand(seed);
+
+	image = (PATHOPEN_PIX_TYPE *)malloc(16 * 16 * sizeof(PATHOPEN_PIX_TYPE));
+
+	for (s = 0; s < (int)(sizeof(edge_sizes) / sizeof(edge_sizes[0])); ++s) {
+		nx = edge_sizes[s][0];
+		ny = edge_sizes[s][1];
+		make_image(image, nx, ny);
+		for (K = 0; K <= 2; ++K) {
+			num_failures += test_image(image, nx, ny, K, &num_runs);
+		}
+	}
+
+	/* Random sizes up to 14 x 14 */
+	for (i = 0; i < num_images; ++i) {
+		nx = 1 + rand() % 14;
+		ny = 1 + rand() % 14;
+		make_image(image, nx, ny);
+		for (K = 0; K <= 2; ++K) {
+			num_failures += test_image(image, nx, ny, K, &num_runs);
+		}
+	}
+
+	free((void *)image);
+
+	printf("%d comparisons, %d failures\n", num_runs, num_failures);
+
+	return num_failures == 0 ? 0 : 1;
+}